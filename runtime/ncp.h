@@ -139,13 +139,16 @@ __ncp_ncprt_repl((void*)address, ncp_rtrepl_##name##_start, ncp_rtrepl_##name##_
 #define __ncp_main_jump(address) __ncp_main_label(jump, address)
 #define __ncp_main_call(address) __ncp_main_label(call, address)
 #define __ncp_main_hook(address) __ncp_main_label(hook, address)
+#define __ncp_main_lhook(address) __ncp_main_label(lhook, address)
 #define __ncp_ovxx_jump(address, overlay) __ncp_ovxx_label(jump, address, overlay)
 #define __ncp_ovxx_call(address, overlay) __ncp_ovxx_label(call, address, overlay)
 #define __ncp_ovxx_hook(address, overlay) __ncp_ovxx_label(hook, address, overlay)
+#define __ncp_ovxx_lhook(address, overlay) __ncp_ovxx_label(lhook, address, overlay)
 
 #define ncp_jump(...) __ncp_get_macro(__VA_ARGS__, , __ncp_ovxx_jump, __ncp_main_jump)(__VA_ARGS__)
 #define ncp_call(...) __ncp_get_macro(__VA_ARGS__, , __ncp_ovxx_call, __ncp_main_call)(__VA_ARGS__)
 #define ncp_hook(...) __ncp_get_macro(__VA_ARGS__, , __ncp_ovxx_hook, __ncp_main_hook)(__VA_ARGS__)
+#define ncp_lhook(...) __ncp_get_macro(__VA_ARGS__, , __ncp_ovxx_lhook, __ncp_main_lhook)(__VA_ARGS__)
 
 // THUMB
 
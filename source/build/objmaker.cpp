@@ -15,6 +15,7 @@
 #include "../log.hpp"
 #include "../process.hpp"
 #include "buildlogger.hpp"
+#include "timingrecorder.hpp"
 
 #include <functional>
 
@@ -116,6 +117,7 @@ void ObjMaker::getSourceFiles()
 					fs::path objPath = buildPath + ".o";
 					fs::path depPath = buildPath + ".d";
 					fs::path asmPath = buildPath + ".s";
+					fs::path metaPath = buildPath + ".ncpmeta";
 
 					bool buildSrc;
 					fs::file_time_type objTime;
@@ -134,6 +136,7 @@ void ObjMaker::getSourceFiles()
 					srcFile->objFilePath = objPath;
 					srcFile->depFilePath = depPath;
 					srcFile->asmFilePath = asmPath;
+					srcFile->metaFilePath = metaPath;
 					srcFile->objFileWriteTime = objTime;
 					srcFile->fileType = fileType;
 					srcFile->region = &region;
@@ -320,13 +323,28 @@ void ObjMaker::compileSources()
 				return ccmd;
 			};
 
+			auto runStep = [&](TimingRecorder::StepKind kind, const std::string& ccmd, const std::string& outputFile, bool outputDeps){
+				auto stepStart = std::chrono::steady_clock::now();
+				int retcode = Process::start(ccmd.c_str(), &out);
+				if (retcode == 0 && TimingRecorder::isEnabled())
+				{
+					auto stepTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - stepStart);
+					TimingRecorder::recordStep(
+						kind, outputFile, stepTime.count(), outputFile,
+						outputDeps ? srcFile->depFilePath : fs::path(),
+						kind == TimingRecorder::StepKind::Assemble
+					);
+				}
+				return retcode;
+			};
+
 			if (srcFile->fileType != SourceFileType::ASM)
 			{
 				std::string asmS = srcFile->asmFilePath.string();
 
 				std::string ccmd = makeBuildCmd(true, srcFile->fileType, srcS, asmS);
 
-				int retcode = Process::start(ccmd.c_str(), &out);
+				int retcode = runStep(TimingRecorder::StepKind::Compile, ccmd, asmS, true);
 				if (retcode != 0)
 				{
 					srcFile->failed = true;
@@ -339,9 +357,10 @@ void ObjMaker::compileSources()
 				srcS = asmS;
 			}
 
-			std::string ccmd = makeBuildCmd(srcFile->fileType == SourceFileType::ASM, SourceFileType::ASM, srcS, objS);
+			bool isAsmSource = srcFile->fileType == SourceFileType::ASM;
+			std::string ccmd = makeBuildCmd(isAsmSource, SourceFileType::ASM, srcS, objS);
 
-			int retcode = Process::start(ccmd.c_str(), &out);
+			int retcode = runStep(TimingRecorder::StepKind::Assemble, ccmd, objS, isAsmSource);
 			if (retcode != 0)
 			{
 				srcFile->failed = true;
@@ -13,6 +13,7 @@ public:
 	std::filesystem::path objFilePath;
 	std::filesystem::path depFilePath;
 	std::filesystem::path asmFilePath;
+	std::filesystem::path metaFilePath;
 
 	std::filesystem::file_time_type objFileWriteTime;
 	std::size_t fileType;
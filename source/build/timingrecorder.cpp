@@ -0,0 +1,122 @@
+#include "timingrecorder.hpp"
+
+#include <vector>
+#include <mutex>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+#include "../log.hpp"
+#include "../except.hpp"
+#include "../util.hpp"
+
+namespace fs = std::filesystem;
+
+namespace TimingRecorder {
+
+static const char* s_stepKindNames[] = { "cc", "as", "ld", "ar" };
+
+struct StepEntry
+{
+	StepKind kind;
+	std::uint64_t durationUs;
+	std::uintmax_t outputSize;
+	std::string outputBlob;
+	std::string depBlob;
+	std::string outputKey;
+};
+
+static bool s_enabled = false;
+static fs::path s_outDir;
+static std::mutex s_mutex;
+static std::vector<StepEntry> s_entries;
+static std::size_t s_failedBlobs = 0;
+
+static std::string storeBlob(const fs::path& file, const std::string& key, const char* ext)
+{
+	std::ostringstream oss;
+	oss << std::hex << std::setw(16) << std::setfill('0') << Util::fnv1a64(key.data(), key.size()) << ext;
+	std::string blobName = oss.str();
+
+	fs::path blobPath = s_outDir / "blobs" / blobName;
+	// Called from the build threads, so failures are only counted and reported on save.
+	std::error_code ec;
+	fs::copy_file(file, blobPath, fs::copy_options::overwrite_existing, ec);
+	if (ec)
+	{
+		std::lock_guard<std::mutex> lock(s_mutex);
+		s_failedBlobs++;
+		return "-";
+	}
+	return blobName;
+}
+
+void start(const fs::path& outDir)
+{
+	s_outDir = fs::absolute(outDir);
+	fs::path blobDir = s_outDir / "blobs";
+	if (!fs::exists(blobDir) && !fs::create_directories(blobDir))
+		throw ncp::dir_error(blobDir, ncp::dir_error::create);
+	s_enabled = true;
+}
+
+bool isEnabled()
+{
+	return s_enabled;
+}
+
+void recordStep(
+	StepKind kind, const std::string& outputKey, std::uint64_t durationUs,
+	const fs::path& outputFile, const fs::path& depFile, bool keepOutput
+)
+{
+	if (!s_enabled)
+		return;
+
+	StepEntry entry;
+	entry.kind = kind;
+	entry.durationUs = durationUs;
+	entry.outputKey = outputKey;
+	entry.outputSize = fs::exists(outputFile) ? fs::file_size(outputFile) : 0;
+	entry.outputBlob = (keepOutput && fs::exists(outputFile)) ? storeBlob(outputFile, outputKey, ".bin") : "-";
+	entry.depBlob = (!depFile.empty() && fs::exists(depFile)) ? storeBlob(depFile, outputKey, ".d") : "-";
+
+	std::lock_guard<std::mutex> lock(s_mutex);
+	s_entries.push_back(std::move(entry));
+}
+
+void save()
+{
+	if (!s_enabled)
+		return;
+
+	fs::path manifestPath = s_outDir / "manifest.txt";
+
+	if (s_failedBlobs != 0)
+		Log::out << OWARN << s_failedBlobs << " toolchain outputs could not be stored, their steps will replay as zero-filled files." << std::endl;
+
+	// One step per line, the output key goes last because it may contain spaces:
+	// <kind> <duration_us> <output_size> <output_blob> <dep_blob> <output_key>
+	std::ostringstream o;
+	o << "# NCPatcher timing manifest\n";
+	for (const StepEntry& entry : s_entries)
+	{
+		o << s_stepKindNames[int(entry.kind)] << ' '
+			<< entry.durationUs << ' '
+			<< entry.outputSize << ' '
+			<< entry.outputBlob << ' '
+			<< entry.depBlob << ' '
+			<< entry.outputKey << '\n';
+	}
+
+	std::string str = o.str();
+	std::ofstream outputFile(manifestPath);
+	if (!outputFile.is_open())
+		throw ncp::file_error(manifestPath, ncp::file_error::write);
+	outputFile.write(str.data(), std::streamsize(str.length()));
+	outputFile.close();
+
+	Log::out << OINFO << "Recorded " << s_entries.size() << " toolchain steps to: " << OSTR(manifestPath.string()) << std::endl;
+}
+
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <filesystem>
+
+/*
+ * Records how long every toolchain invocation took and what it produced,
+ * so that the build can later be replayed by the fake toolchain (tools/fakechain)
+ * for reproducible benchmarks without the real compiler.
+ * */
+namespace TimingRecorder {
+
+enum class StepKind
+{
+	Compile = 0, // source -> assembly (or object for assembly sources)
+	Assemble,    // assembly -> object
+	Link,        // objects -> elf
+	Archive      // objects -> link archive
+};
+
+void start(const std::filesystem::path& outDir);
+bool isEnabled();
+
+/**
+ * @brief Records a finished toolchain step. Thread-safe.
+ *
+ * @param kind The kind of step.
+ * @param outputKey The output path exactly as it was passed to the tool.
+ * @param durationUs How long the step took, in microseconds.
+ * @param outputFile The produced file, stored as a blob if keepOutput is set.
+ * @param depFile The produced dependency file, or empty if none.
+ * @param keepOutput If the output file contents must be replayed, otherwise only its size is.
+ */
+void recordStep(
+	StepKind kind, const std::string& outputKey, std::uint64_t durationUs,
+	const std::filesystem::path& outputFile, const std::filesystem::path& depFile, bool keepOutput
+);
+
+void save();
+
+}
@@ -37,6 +37,10 @@ static TargetConfig arm9Config;
 static std::vector<std::string> preBuildCmds;
 static std::vector<std::string> postBuildCmds;
 static int threadCount;
+static bool linkArchives;
+static Linker linker;
+static int linkerThreads;
+static bool linkerVerify;
 static std::time_t lastWriteTime;
 
 static void expandTemplates(std::string& val)
@@ -107,6 +111,29 @@ static void readTargetFromJson(JsonReader& json, bool arm9, TargetConfig& out)
 	}
 }
 
+static Linker readLinker(JsonReader& json)
+{
+	if (!json.hasMember("linker"))
+		return Linker::Gcc;
+
+	std::string name = getString(json["linker"]);
+	if (name == "gcc")
+		return Linker::Gcc;
+	if (name == "bfd")
+		return Linker::Bfd;
+	if (name == "gold")
+		return Linker::Gold;
+	if (name == "lld")
+		return Linker::Lld;
+	if (name == "internal")
+		return Linker::Internal;
+
+	std::ostringstream oss;
+	oss << "Invalid linker " << OSTR(name) << " in " << OSTR(s_jsonFileName) << OREASONNL;
+	oss << "Expected one of " << OSTR("gcc") << ", " << OSTR("bfd") << ", " << OSTR("gold") << ", " << OSTR("lld") << " or " << OSTR("internal") << ".";
+	throw ncp::exception(oss.str());
+}
+
 static void readBuildCommands(const JsonMember& member, std::vector<std::string>& cmdsOut)
 {
 	size_t size = member.size();
@@ -148,6 +175,10 @@ void load()
 	readBuildCommands(json["post-build"], postBuildCmds);
 
 	threadCount = json["thread-count"].getInt();
+	linkArchives = json.hasMember("link-archives") && json["link-archives"].getBool();
+	linker = readLinker(json);
+	linkerThreads = json.hasMember("linker-threads") ? json["linker-threads"].getInt() : 0;
+	linkerVerify = json.hasMember("linker-verify") && json["linker-verify"].getBool();
 
 	lastWriteTime = Util::toTimeT(fs::last_write_time(jsonPath));
 
@@ -181,6 +212,10 @@ const std::vector<std::string>& getPreBuildCmds() { return preBuildCmds; }
 const std::vector<std::string>& getPostBuildCmds() { return postBuildCmds; }
 
 int getThreadCount() { return threadCount; }
+bool getLinkArchives() { return linkArchives; }
+Linker getLinker() { return linker; }
+int getLinkerThreads() { return linkerThreads; }
+bool getLinkerVerify() { return linkerVerify; }
 std::time_t getLastWriteTime() { return lastWriteTime; }
 
 }
@@ -6,6 +6,15 @@
 
 namespace BuildConfig {
 
+enum class Linker
+{
+	Gcc, // through the gcc driver
+	Bfd,
+	Gold,
+	Lld,
+	Internal // the in-process linker
+};
+
 void load();
 
 const std::string& getVariable(const std::string& value);
@@ -26,6 +35,10 @@ const std::vector<std::string>& getPreBuildCmds();
 const std::vector<std::string>& getPostBuildCmds();
 
 int getThreadCount();
+bool getLinkArchives();
+Linker getLinker();
+int getLinkerThreads();
+bool getLinkerVerify();
 std::time_t getLastWriteTime();
 
 }
@@ -43,6 +43,8 @@ void BuildTarget::load(const fs::path& targetFilePath, bool isArm9)
 	}
 
 	arenaLo = json.hasMember("arenaLo") ? json["arenaLo"].getInt() : 0;
+	orderSections = json.hasMember("order_sections") && json["order_sections"].getBool();
+	alignHotChains = json.hasMember("align_hot_chains") && json["align_hot_chains"].getBool();
 	
 	if (json.hasMember("symbols"))
 	{
@@ -50,6 +52,12 @@ void BuildTarget::load(const fs::path& targetFilePath, bool isArm9)
 		symbols.make_preferred();
 	}
 
+	if (json.hasMember("profile"))
+	{
+		profile = getString(json["profile"]);
+		profile.make_preferred();
+	}
+
 	getDirectoryArray(json["includes"], includes);
 
 	cFlags = getString(json["c_flags"]);
@@ -74,7 +82,19 @@ void BuildTarget::load(const fs::path& targetFilePath, bool isArm9)
 		else
 			region.address = (region.mode == Mode::Create) ? regionObj["address"].getInt() : 0;
 		region.length = regionObj.hasMember("length") ? regionObj["length"].getInt() : 0x100000;
+		if (region.destination == DestItcm || region.destination == DestDtcm)
+		{
+			if (!isArm9)
+				throw ncp::exception("The ARM7 has no TCM, the \"itcm\" and \"dtcm\" destinations are only for the ARM9.");
+			if (region.mode != Mode::Append)
+				throw ncp::exception("The \"itcm\" and \"dtcm\" destinations only support the append mode.");
+			// The end of the DTCM holds the stacks and the IRQ handler, only the user knows how much of it they take
+			if (region.destination == DestDtcm && !regionObj.hasMember("length"))
+				throw ncp::exception("A \"dtcm\" region must set its \"length\", leaving room for the stacks at the end of the DTCM.");
+		}
 		readOverwrites(region, regionObj);
+		readDeadFunctions(region, regionObj);
+		region.reclaimJumped = regionObj.hasMember("reclaim_jumped") && regionObj["reclaim_jumped"].getBool();
 		regions.push_back(region);
 	}
 
@@ -202,10 +222,20 @@ void BuildTarget::readDestination(BuildTarget::Region& region, const JsonMember&
 	}
 	if (destStrV == "main")
 	{
-		region.destination = -1;
+		region.destination = DestMain;
+		return;
+	}
+	if (destStrV == "itcm")
+	{
+		region.destination = DestItcm;
+		return;
+	}
+	if (destStrV == "dtcm")
+	{
+		region.destination = DestDtcm;
 		return;
 	}
-	throw ncp::exception(R"(Invalid destination, use either "main" or "ovXX".)");
+	throw ncp::exception(R"(Invalid destination, use either "main", "itcm", "dtcm" or "ovXX".)");
 }
 
 void BuildTarget::readRegionMode(BuildTarget::Region& region, const JsonMember& member)
@@ -258,3 +288,28 @@ void BuildTarget::readOverwrites(BuildTarget::Region& region, const JsonMember&
 		}
 	}
 }
+
+void BuildTarget::readDeadFunctions(BuildTarget::Region& region, const JsonMember& member)
+{
+	if (member.hasMember("dead_functions"))
+	{
+		JsonMember functionsArray = member["dead_functions"];
+		functionsArray.assertArray();
+		size_t functionCount = functionsArray.size();
+		for (size_t i = 0; i < functionCount; i++)
+		{
+			JsonMember function = functionsArray[i];
+			if (function.isArray())
+			{
+				if (function.size() != 2)
+					throw ncp::exception("A dead function with a size must be given as [string name, int size].");
+				region.deadFunctions.push_back(DeadFunction{ getString(function[size_t(0)]), u32(function[size_t(1)].getInt()) });
+			}
+			else
+			{
+				region.deadFunctions.push_back(DeadFunction{ getString(function), 0 });
+			}
+		}
+	}
+	region.reclaimUnsized = member.hasMember("reclaim_unsized") && member["reclaim_unsized"].getBool();
+}
@@ -18,12 +18,23 @@ public:
 		Create
 	};
 
+	// The destinations of the regions placed in the tightly coupled memories of the ARM9, overlays are 0 and up
+	static constexpr int DestMain = -1;
+	static constexpr int DestItcm = -2;
+	static constexpr int DestDtcm = -3;
+
 	struct Overwrites
 	{
 		u32 startAddress;
 		u32 endAddress;
 	};
 
+	struct DeadFunction
+	{
+		std::string name;
+		u32 size; // 0 if not given, the function then ends where the next symbol starts
+	};
+
 	struct Region
 	{
 		std::vector<std::filesystem::path> sources;
@@ -37,20 +48,26 @@ public:
 		std::string asmFlags;
 		//std::string ldFlags;
 		std::vector<Overwrites> overwrites;
+		std::vector<DeadFunction> deadFunctions; // functions of the symbols file that are never called, reclaimed as overwrites
+		bool reclaimUnsized; // reclaim the dead functions without a size up to the next symbol
+		bool reclaimJumped; // reclaim the bodies of the functions replaced by an ncp_jump
 	};
 
 	std::unordered_map<std::string, std::string> varmap;
 	int arenaLo{};
+	bool orderSections{}; // order the code sections of every unit by their call graph
+	bool alignHotChains{}; // start the ordered call chains at a line of the instruction cache
 	std::vector<std::filesystem::path> includes;
 	std::vector<Region> regions;
 	std::filesystem::path symbols;
+	std::filesystem::path profile; // the PC samples of the new code, to place its hot and cold sections
 	std::string cFlags;
 	std::string cppFlags;
 	std::string asmFlags;
 	std::string ldFlags;
 
 	[[nodiscard]] constexpr bool getArm9() const { return m_isArm9; }
-	[[nodiscard]] constexpr std::time_t getLastWriteTime() { return m_lastWriteTime; }
+	[[nodiscard]] constexpr std::time_t getLastWriteTime() const { return m_lastWriteTime; }
 	[[nodiscard]] constexpr bool getForceRebuild() const { return m_forceRebuild; }
 
 	constexpr void setForceRebuild(bool forceRebuild) { m_forceRebuild = forceRebuild; }
@@ -67,6 +84,7 @@ private:
 	static void readDestination(BuildTarget::Region& region, const JsonMember& member);
 	static void readRegionMode(BuildTarget::Region& region, const JsonMember& member);
 	void readOverwrites(BuildTarget::Region& region, const JsonMember& member);
+	void readDeadFunctions(BuildTarget::Region& region, const JsonMember& member);
 
 	bool m_isArm9{};
 	std::time_t m_lastWriteTime;
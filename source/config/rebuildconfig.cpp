@@ -7,6 +7,7 @@
 #include "../main.hpp"
 #include "../except.hpp"
 #include "../util.hpp"
+#include "../mappedfile.hpp"
 
 namespace fs = std::filesystem;
 
@@ -18,6 +19,15 @@ static std::time_t arm9TargetWriteTime;
 static std::vector<u32> arm7PatchedOvs;
 static std::vector<u32> arm9PatchedOvs;
 static std::vector<std::string> defines;
+static u64 arm7InputFingerprint;
+static u64 arm9InputFingerprint;
+static u64 arm7OutputFingerprint;
+static u64 arm9OutputFingerprint;
+
+// The fingerprints are appended after the defines, so older files still load
+static constexpr u32 FingerprintMagic = 0x4650434E; // "NCPF"
+static constexpr u32 FingerprintVersion = 1;
+static constexpr std::size_t FingerprintSize = 8 + (4 * sizeof(u64));
 
 void load()
 {
@@ -25,6 +35,11 @@ void load()
 	fs::current_path(Main::getWorkPath());
 	const fs::path& rebFile = BuildConfig::getBackupDir() / "rebuild.bin";
 
+	arm7InputFingerprint = 0;
+	arm9InputFingerprint = 0;
+	arm7OutputFingerprint = 0;
+	arm9OutputFingerprint = 0;
+
 	if (!fs::exists(rebFile))
 	{
 		buildConfigWriteTime = std::numeric_limits<std::time_t>::max();
@@ -34,20 +49,16 @@ void load()
 		return;
 	}
 
-	std::vector<u8> data;
-	std::ifstream inputFile(rebFile, std::ios::binary);
-	if (!inputFile.is_open())
+	MappedFile inputFile;
+	if (!inputFile.open(rebFile))
 		throw ncp::file_error(rebFile, ncp::file_error::read);
-	std::uintmax_t inputFileSize = fs::file_size(rebFile);
-	data.resize(inputFileSize);
-	u8* pData = data.data();
-	inputFile.read(reinterpret_cast<char*>(pData), inputFileSize);
-	inputFile.close();
+	std::size_t inputFileSize = inputFile.size();
+	const u8* pData = inputFile.data();
 
 	if (inputFileSize < 29)
 		throw ncp::exception("rebuild.bin file is invalid, expected the file to have at least 29 bytes.");
 
-	u8* curDataPtr = pData;
+	const u8* curDataPtr = pData;
 	auto read = [&curDataPtr]<typename T>(){
 		T value = Util::read<T>(curDataPtr);
 		curDataPtr += sizeof(T);
@@ -81,6 +92,9 @@ void load()
 	defines.clear();
 	defines.reserve(definesCount);
 	for (u32 i = 0; i < definesCount; ++i) {
+		if (curDataPtr + 4 > pData + inputFileSize)
+			throw ncp::exception("rebuild.bin file is invalid, define count is more than it holds.");
+
 		u32 defineLength = read.template operator()<u32>();
 		
 		// Check if we have enough remaining data for this string
@@ -92,6 +106,19 @@ void load()
 		defines.push_back(std::move(define));
 	}
 
+	if (curDataPtr + FingerprintSize <= pData + inputFileSize)
+	{
+		u32 magic = read.template operator()<u32>();
+		u32 version = read.template operator()<u32>();
+		if (magic == FingerprintMagic && version == FingerprintVersion)
+		{
+			arm7InputFingerprint = read.template operator()<u64>();
+			arm9InputFingerprint = read.template operator()<u64>();
+			arm7OutputFingerprint = read.template operator()<u64>();
+			arm9OutputFingerprint = read.template operator()<u64>();
+		}
+	}
+
 	fs::current_path(curPath);
 }
 
@@ -112,7 +139,7 @@ void save()
 	}
 
 	std::vector<u8> data;
-	std::size_t dataSize = (3 * sizeof(std::time_t)) + 12 + (arm7PatchedOvCount * 4) + (arm9PatchedOvCount * 4) + definesSize;
+	std::size_t dataSize = (3 * sizeof(std::time_t)) + 12 + (arm7PatchedOvCount * 4) + (arm9PatchedOvCount * 4) + definesSize + FingerprintSize;
 	data.resize(dataSize);
 	u8* pData = data.data();
 
@@ -142,6 +169,13 @@ void save()
 		curDataPtr += define.length();
 	}
 
+	write.template operator()<u32>(FingerprintMagic);
+	write.template operator()<u32>(FingerprintVersion);
+	write.template operator()<u64>(arm7InputFingerprint);
+	write.template operator()<u64>(arm9InputFingerprint);
+	write.template operator()<u64>(arm7OutputFingerprint);
+	write.template operator()<u64>(arm9OutputFingerprint);
+
 	std::ofstream outputFile(rebFile, std::ios::binary);
 	if (!outputFile.is_open())
 		throw ncp::file_error(rebFile, ncp::file_error::write);
@@ -157,10 +191,18 @@ std::time_t getArm9TargetWriteTime() { return arm9TargetWriteTime; }
 std::vector<u32>& getArm7PatchedOvs() { return arm7PatchedOvs; }
 std::vector<u32>& getArm9PatchedOvs() { return arm9PatchedOvs; }
 const std::vector<std::string>& getDefines() { return defines; }
+u64 getArm7InputFingerprint() { return arm7InputFingerprint; }
+u64 getArm9InputFingerprint() { return arm9InputFingerprint; }
+u64 getArm7OutputFingerprint() { return arm7OutputFingerprint; }
+u64 getArm9OutputFingerprint() { return arm9OutputFingerprint; }
 
 void setBuildConfigWriteTime(std::time_t value) { buildConfigWriteTime = value; }
 void setArm7TargetWriteTime(std::time_t value) { arm7TargetWriteTime = value; }
 void setArm9TargetWriteTime(std::time_t value) { arm9TargetWriteTime = value; }
 void setDefines(const std::vector<std::string>& value) { defines = value; }
+void setArm7InputFingerprint(u64 value) { arm7InputFingerprint = value; }
+void setArm9InputFingerprint(u64 value) { arm9InputFingerprint = value; }
+void setArm7OutputFingerprint(u64 value) { arm7OutputFingerprint = value; }
+void setArm9OutputFingerprint(u64 value) { arm9OutputFingerprint = value; }
 
 }
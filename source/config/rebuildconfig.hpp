@@ -17,10 +17,18 @@ std::time_t getArm9TargetWriteTime();
 std::vector<u32>& getArm7PatchedOvs();
 std::vector<u32>& getArm9PatchedOvs();
 const std::vector<std::string>& getDefines();
+u64 getArm7InputFingerprint();
+u64 getArm9InputFingerprint();
+u64 getArm7OutputFingerprint();
+u64 getArm9OutputFingerprint();
 
 void setBuildConfigWriteTime(std::time_t value);
 void setArm7TargetWriteTime(std::time_t value);
 void setArm9TargetWriteTime(std::time_t value);
 void setDefines(const std::vector<std::string>& defines);
+void setArm7InputFingerprint(u64 value);
+void setArm9InputFingerprint(u64 value);
+void setArm7OutputFingerprint(u64 value);
+void setArm9OutputFingerprint(u64 value);
 
 }
@@ -1,24 +1,184 @@
 #include "elf.hpp"
 
-#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+#include "log.hpp"
+#include "except.hpp"
 
 Elf32::Elf32() :
-	dataptr(nullptr)
+	dataptr(nullptr), m_shStrTbl(nullptr), m_symTbl(nullptr), m_symStrTbl(nullptr), m_symbolIndexBuilt(false)
 {}
 
-Elf32::~Elf32()
-{
-	delete[] dataptr;
-}
+Elf32::~Elf32() = default;
 
 bool Elf32::load(const std::filesystem::path& elf)
 {
-	std::uintmax_t fs = std::filesystem::file_size(elf);
-	std::ifstream ef(elf, std::ios::binary);
-	if (!ef.is_open())
+	if (!m_file.open(elf))
 		return false;
-	dataptr = new char[fs];
-	ef.read(dataptr, std::streamsize(fs));
-	ef.close();
+	parse(m_file.data(), m_file.size(), elf.string());
 	return true;
 }
+
+void Elf32::loadFromMemory(std::vector<u8> image, const std::string& name)
+{
+	m_image = std::move(image);
+	parse(m_image.data(), m_image.size(), name);
+}
+
+void Elf32::parse(const u8* data, std::size_t fileSize, const std::string& name)
+{
+	dataptr = reinterpret_cast<const char*>(data);
+
+	auto fail = [&](const char* reason){
+		std::ostringstream oss;
+		oss << "Invalid ELF file: " << OSTR(name) << OREASONNL << reason;
+		throw ncp::exception(oss.str());
+	};
+
+	// Offsets come from the file, compare in 64 bits so that they can not wrap around
+	auto inBounds = [&](std::uint64_t offset, std::uint64_t size){
+		return offset + size <= fileSize;
+	};
+
+	if (!inBounds(0, sizeof(Elf32_Ehdr)))
+		fail("The file is too small to contain an ELF header.");
+
+	const Elf32_Ehdr& eh = getHeader();
+	if (eh.e_ident[EI_MAG0] != ELFMAG0 || eh.e_ident[EI_MAG1] != ELFMAG1 ||
+		eh.e_ident[EI_MAG2] != ELFMAG2 || eh.e_ident[EI_MAG3] != ELFMAG3)
+		fail("The ELF magic is missing.");
+	if (eh.e_ident[EI_CLASS] != ELFCLASS32)
+		fail("Only 32-bit ELF files are supported.");
+
+	if (eh.e_phnum != 0)
+	{
+		if (eh.e_phentsize != sizeof(Elf32_Phdr))
+			fail("Unexpected program header entry size.");
+		if (!inBounds(eh.e_phoff, std::uint64_t(eh.e_phnum) * sizeof(Elf32_Phdr)))
+			fail("The program header table exceeds the file.");
+	}
+
+	if (eh.e_shnum != 0)
+	{
+		if (eh.e_shentsize != sizeof(Elf32_Shdr))
+			fail("Unexpected section header entry size.");
+		if (!inBounds(eh.e_shoff, std::uint64_t(eh.e_shnum) * sizeof(Elf32_Shdr)))
+			fail("The section header table exceeds the file.");
+		if (eh.e_shstrndx >= eh.e_shnum)
+			fail("The section name string table index is out of range.");
+
+		const Elf32_Shdr* sh_tbl = getSectionHeaderTable();
+		for (std::size_t i = 0; i < eh.e_shnum; i++)
+		{
+			const Elf32_Shdr& sh = sh_tbl[i];
+			if (sh.sh_type != SHT_NOBITS && sh.sh_type != SHT_NULL && !inBounds(sh.sh_offset, sh.sh_size))
+				fail("A section exceeds the file.");
+			if ((sh.sh_type == SHT_SYMTAB || sh.sh_type == SHT_REL || sh.sh_type == SHT_RELA) && sh.sh_link >= eh.e_shnum)
+				fail("A section links to a section that does not exist.");
+		}
+
+		// Names are read as C strings, they must be terminated inside of the table
+		const Elf32_Shdr& shstr = sh_tbl[eh.e_shstrndx];
+		auto isTerminated = [&](const Elf32_Shdr& strSh){
+			return strSh.sh_type != SHT_NOBITS && strSh.sh_size != 0 && dataptr[strSh.sh_offset + strSh.sh_size - 1] == '\0';
+		};
+		if (!isTerminated(shstr))
+			fail("The section name string table is not terminated.");
+		m_shStrTbl = getSection<char>(shstr);
+
+		m_sectionIndex.reserve(eh.e_shnum);
+		for (std::size_t i = 0; i < eh.e_shnum; i++)
+		{
+			const Elf32_Shdr& sh = sh_tbl[i];
+			if (sh.sh_name >= shstr.sh_size)
+				fail("A section name is out of the string table.");
+			m_sectionIndex.try_emplace(getSectionName(sh), int(i));
+
+			if (m_symTbl == nullptr && sh.sh_type == SHT_SYMTAB)
+				m_symTbl = &sh;
+		}
+		if (m_symTbl == nullptr)
+		{
+			for (std::size_t i = 0; i < eh.e_shnum; i++)
+			{
+				if (sh_tbl[i].sh_type == SHT_DYNSYM)
+				{
+					m_symTbl = &sh_tbl[i];
+					break;
+				}
+			}
+		}
+
+		if (m_symTbl != nullptr)
+		{
+			if (m_symTbl->sh_link >= eh.e_shnum)
+				fail("The symbol table links to a section that does not exist.");
+			const Elf32_Shdr& symStr = sh_tbl[m_symTbl->sh_link];
+			if (!isTerminated(symStr))
+				fail("The symbol name string table is not terminated.");
+			m_symStrTbl = getSection<char>(symStr);
+
+			for (const Elf32_Sym& sym : getSymbols())
+			{
+				if (sym.st_name >= symStr.sh_size)
+					fail("A symbol name is out of the string table.");
+			}
+		}
+	}
+}
+
+int Elf32::findSection(std::string_view name) const
+{
+	auto it = m_sectionIndex.find(name);
+	return it != m_sectionIndex.end() ? it->second : -1;
+}
+
+const Elf32_Sym* Elf32::findSymbol(std::string_view name) const
+{
+	if (!m_symbolIndexBuilt)
+	{
+		ElfRange<Elf32_Sym> symbols = getSymbols();
+		m_symbolIndex.reserve(symbols.size());
+		for (const Elf32_Sym& sym : symbols)
+			m_symbolIndex.try_emplace(getSymbolName(sym), &sym);
+		m_symbolIndexBuilt = true;
+	}
+
+	auto it = m_symbolIndex.find(name);
+	return it != m_symbolIndex.end() ? it->second : nullptr;
+}
+
+void ElfRelocationIndex::build(const Elf32& elf, const Elf32_Shdr& relSection)
+{
+	m_entries.clear();
+	if (relSection.sh_type == SHT_RELA)
+	{
+		ElfRange<Elf32_Rela> relas = elf.getSectionEntries<Elf32_Rela>(relSection);
+		m_entries.reserve(relas.size());
+		for (std::size_t i = 0; i < relas.size(); i++)
+			m_entries.push_back(Entry{ relas[i].r_offset, relas[i].r_info, relas[i].r_addend, true, i });
+	}
+	else
+	{
+		ElfRange<Elf32_Rel> rels = elf.getSectionEntries<Elf32_Rel>(relSection);
+		m_entries.reserve(rels.size());
+		for (std::size_t i = 0; i < rels.size(); i++)
+			m_entries.push_back(Entry{ rels[i].r_offset, rels[i].r_info, 0, false, i });
+	}
+
+	// Stable, so that the first relocation at an offset stays the first one
+	std::stable_sort(m_entries.begin(), m_entries.end(), [](const Entry& a, const Entry& b){
+		return a.offset < b.offset;
+	});
+}
+
+const ElfRelocationIndex::Entry* ElfRelocationIndex::find(Elf32_Addr offset) const
+{
+	auto it = std::lower_bound(m_entries.begin(), m_entries.end(), offset, [](const Entry& e, Elf32_Addr off){
+		return e.offset < off;
+	});
+	if (it == m_entries.end() || it->offset != offset)
+		return nullptr;
+	return &*it;
+}
@@ -2,7 +2,13 @@
 
 #include <cstdint>
 
+#include <string>
 #include <filesystem>
+#include <vector>
+#include <string_view>
+#include <unordered_map>
+
+#include "mappedfile.hpp"
 
 typedef uint32_t Elf32_Addr;
 typedef uint16_t Elf32_Half;
@@ -19,6 +25,29 @@ typedef uint32_t Elf32_Word;
 #define ELF32_R_TYPE(i)   ((unsigned char)(i))
 #define ELF32_R_INFO(s,t) (((s)<<8)+(unsigned char)(t))
 
+#define EI_MAG0  0
+#define EI_MAG1  1
+#define EI_MAG2  2
+#define EI_MAG3  3
+#define EI_CLASS 4
+#define EI_DATA  5
+#define EI_VERSION 6
+
+#define ELFMAG0    0x7f
+#define ELFMAG1    'E'
+#define ELFMAG2    'L'
+#define ELFMAG3    'F'
+#define ELFCLASS32 1
+#define ELFDATA2LSB 1
+#define EV_CURRENT 1
+
+#define ET_REL  1
+#define ET_EXEC 2
+
+#define EM_ARM 40
+
+#define EF_ARM_EABI_VER5 0x05000000
+
 #define SHT_NULL     0
 #define SHT_PROGBITS 1
 #define SHT_SYMTAB   2
@@ -32,11 +61,28 @@ typedef uint32_t Elf32_Word;
 #define SHT_SHLIB    10
 #define SHT_DYNSYM   11
 #define SHT_NUM      12
+#define SHT_INIT_ARRAY    14
+#define SHT_FINI_ARRAY    15
+#define SHT_PREINIT_ARRAY 16
+#define SHT_GROUP         17
 #define SHT_LOPROC   0x70000000
 #define SHT_HIPROC   0x7fffffff
 #define SHT_LOUSER   0x80000000
 #define SHT_HIUSER   0xffffffff
 
+#define SHF_WRITE     0x1
+#define SHF_ALLOC     0x2
+#define SHF_EXECINSTR 0x4
+#define SHF_MERGE     0x10
+#define SHF_STRINGS   0x20
+
+#define SHN_UNDEF     0
+#define SHN_LORESERVE 0xff00
+#define SHN_ABS       0xfff1
+#define SHN_COMMON    0xfff2
+
+#define GRP_COMDAT 0x1
+
 #define STB_LOCAL  0
 #define STB_GLOBAL 1
 #define STB_WEAK   2
@@ -49,6 +95,8 @@ typedef uint32_t Elf32_Word;
 #define STT_COMMON  5
 #define STT_TLS     6
 
+#define ELF32_ST_INFO(b,t) (((b)<<4)+((t)&0xf))
+
 #define PF_R 0x4
 #define PF_W 0x2
 #define PF_X 0x1
@@ -120,14 +168,47 @@ struct Elf32_Shdr
 	Elf32_Word sh_entsize;   // 0x24 | Entry size if section holds table
 };
 
+/*
+ * A view over a contiguous array of ELF table entries.
+ * */
+template<typename T>
+class ElfRange
+{
+public:
+	constexpr ElfRange() : m_data(nullptr), m_count(0) {}
+	constexpr ElfRange(const T* data, std::size_t count) : m_data(data), m_count(count) {}
+
+	[[nodiscard]] constexpr const T* begin() const { return m_data; }
+	[[nodiscard]] constexpr const T* end() const { return m_data + m_count; }
+	[[nodiscard]] constexpr std::size_t size() const { return m_count; }
+	[[nodiscard]] constexpr bool empty() const { return m_count == 0; }
+	[[nodiscard]] constexpr const T& operator[](std::size_t i) const { return m_data[i]; }
+
+private:
+	const T* m_data;
+	std::size_t m_count;
+};
+
 class Elf32
 {
 public:
 	Elf32();
 	~Elf32();
 
+	/**
+	 * @brief Maps the ELF file into memory, validates its layout and indexes the sections by name.
+	 *
+	 * @return false if the file could not be opened, throws if the file is malformed.
+	 */
 	bool load(const std::filesystem::path& elf);
 
+	/**
+	 * @brief Takes an ELF image that is already in memory, validates and indexes it like load.
+	 *
+	 * @param name The name to show in the errors.
+	 */
+	void loadFromMemory(std::vector<u8> image, const std::string& name);
+
 	[[nodiscard]] inline const Elf32_Ehdr& getHeader() const {
 		return *reinterpret_cast<const Elf32_Ehdr*>(dataptr);
 	};
@@ -145,6 +226,110 @@ public:
 		return reinterpret_cast<const T*>(dataptr + sh.sh_offset);
 	}
 
+	[[nodiscard]] inline ElfRange<Elf32_Shdr> getSections() const {
+		return { getSectionHeaderTable(), getHeader().e_shnum };
+	}
+
+	// The section contents as an array of sh_size / sizeof(T) entries.
+	template<typename T>
+	[[nodiscard]] inline ElfRange<T> getSectionEntries(const Elf32_Shdr& sh) const {
+		return { getSection<T>(sh), sh.sh_size / sizeof(T) };
+	}
+
+	[[nodiscard]] inline std::string_view getSectionName(const Elf32_Shdr& sh) const {
+		return &m_shStrTbl[sh.sh_name];
+	}
+
+	// The symbol table section, or nullptr if the file has none.
+	[[nodiscard]] constexpr const Elf32_Shdr* getSymbolTable() const { return m_symTbl; }
+
+	[[nodiscard]] inline ElfRange<Elf32_Sym> getSymbols() const {
+		return m_symTbl != nullptr ? getSectionEntries<Elf32_Sym>(*m_symTbl) : ElfRange<Elf32_Sym>();
+	}
+
+	[[nodiscard]] inline std::string_view getSymbolName(const Elf32_Sym& sym) const {
+		return &m_symStrTbl[sym.st_name];
+	}
+
+	/**
+	 * @brief Finds a section by name in constant time.
+	 *
+	 * @return The index of the first section with that name, or -1 if it does not exist.
+	 */
+	[[nodiscard]] int findSection(std::string_view name) const;
+
+	/**
+	 * @brief Finds a symbol by name in constant time, the index is built on the first call.
+	 *
+	 * @return The first symbol with that name, or nullptr if it does not exist.
+	 */
+	[[nodiscard]] const Elf32_Sym* findSymbol(std::string_view name) const;
+
+	/**
+	 * @brief Calls cb(sectionIdx, section, sectionName) for every section, until it returns true.
+	 */
+	template<typename F>
+	void forEachSection(F&& cb) const
+	{
+		ElfRange<Elf32_Shdr> sections = getSections();
+		for (std::size_t i = 0; i < sections.size(); i++)
+		{
+			const Elf32_Shdr& sh = sections[i];
+			if (cb(i, sh, getSectionName(sh)))
+				break;
+		}
+	}
+
+	/**
+	 * @brief Calls cb(symbol, symbolName) for every symbol, until it returns true.
+	 */
+	template<typename F>
+	void forEachSymbol(F&& cb) const
+	{
+		for (const Elf32_Sym& sym : getSymbols())
+		{
+			if (cb(sym, getSymbolName(sym)))
+				break;
+		}
+	}
+
+private:
+	MappedFile m_file;
+	std::vector<u8> m_image;
+	const char* dataptr;
+	const char* m_shStrTbl;
+	const Elf32_Shdr* m_symTbl;
+	const char* m_symStrTbl;
+	std::unordered_map<std::string_view, int> m_sectionIndex;
+	mutable std::unordered_map<std::string_view, const Elf32_Sym*> m_symbolIndex;
+	mutable bool m_symbolIndexBuilt;
+
+	void parse(const u8* data, std::size_t size, const std::string& name);
+};
+
+/*
+ * The relocations of a REL or RELA section sorted by offset,
+ * so that the relocation at an offset is found with a binary search.
+ * */
+class ElfRelocationIndex
+{
+public:
+	struct Entry
+	{
+		Elf32_Addr offset;
+		Elf32_Word info;
+		Elf32_Sword addend; // only valid if hasAddend, REL addends are stored in the relocated data
+		bool hasAddend;
+		std::size_t index; // the index in the relocation table
+	};
+
+	void build(const Elf32& elf, const Elf32_Shdr& relSection);
+
+	// The first relocation of the table at that offset, or nullptr if there is none.
+	[[nodiscard]] const Entry* find(Elf32_Addr offset) const;
+
+	[[nodiscard]] constexpr const std::vector<Entry>& getEntries() const { return m_entries; }
+
 private:
-	char* dataptr;
+	std::vector<Entry> m_entries;
 };
@@ -15,6 +15,7 @@
 #include "ndsbin/armbin.hpp"
 #include "build/sourcefilejob.hpp"
 #include "build/objmaker.hpp"
+#include "build/timingrecorder.hpp"
 #include "patch/patchmaker.hpp"
 
 #ifdef _WIN32
@@ -41,6 +42,7 @@ static std::filesystem::path s_romPath;
 static const char* s_errorContext = nullptr;
 static bool s_verbose = false;
 static std::vector<std::string> s_defines;
+static std::filesystem::path s_recordTimingsDir;
 
 const std::filesystem::path& getAppPath() { return s_appPath; }
 const std::filesystem::path& getWorkPath() { return s_workPath; }
@@ -63,6 +65,9 @@ static void printHelp()
 	Log::out << "  -h, --help       Show this help message and exit" << std::endl;
 	Log::out << "  -v, --verbose    Enable verbose logging output" << std::endl;
 	Log::out << "  --define VALUE   Define a preprocessor macro for compilation" << std::endl;
+	Log::out << "  --record-timings DIR" << std::endl;
+	Log::out << "                   Record toolchain step timings and outputs to DIR" << std::endl;
+	Log::out << "                   for replaying with the fake toolchain" << std::endl;
 	Log::out << std::endl;
 	Log::out << "Description:" << std::endl;
 	Log::out << "  NCPatcher is a tool for patching Nintendo DS ROMs by compiling" << std::endl;
@@ -79,6 +84,9 @@ static void ncpMain()
 	BuildConfig::load();
 	RebuildConfig::load();
 
+	if (!Main::s_recordTimingsDir.empty())
+		TimingRecorder::start(Main::s_recordTimingsDir);
+
 	const std::string& toolchain = BuildConfig::getToolchain();
 	std::string gccPath = toolchain + "gcc";
 	if (!Process::exists(gccPath.c_str()))
@@ -157,6 +165,7 @@ static void ncpMain()
 	RebuildConfig::setBuildConfigWriteTime(BuildConfig::getLastWriteTime());
 	RebuildConfig::setDefines(Main::getDefines());
 	RebuildConfig::save();
+	TimingRecorder::save();
 
 	runCommandList(BuildConfig::getPostBuildCmds(), "Running post-build commands...", "Not all post-build commands succeeded.");
 
@@ -321,6 +330,14 @@ int main(int argc, char* argv[])
 				Log::error("--define option requires a value");
 				return 1;
 			}
+		} else if (strcmp(argv[i], "--record-timings") == 0) {
+			if (i + 1 < argc) {
+				Main::s_recordTimingsDir = argv[i + 1];
+				i++;
+			} else {
+				Log::error("--record-timings option requires a directory");
+				return 1;
+			}
 		} else {
 			std::ostringstream oss;
 			oss << "Unknown argument: " << argv[i];
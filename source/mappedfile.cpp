@@ -0,0 +1,176 @@
+#include "mappedfile.hpp"
+
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX 1
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile() :
+	m_data(nullptr), m_size(0), m_isOpen(false), m_fileHandle(nullptr), m_mapHandle(nullptr)
+{}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept :
+	m_data(std::exchange(other.m_data, nullptr)),
+	m_size(std::exchange(other.m_size, 0)),
+	m_isOpen(std::exchange(other.m_isOpen, false)),
+	m_fileHandle(std::exchange(other.m_fileHandle, nullptr)),
+	m_mapHandle(std::exchange(other.m_mapHandle, nullptr))
+{}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+	if (this != &other)
+	{
+		close();
+		m_data = std::exchange(other.m_data, nullptr);
+		m_size = std::exchange(other.m_size, 0);
+		m_isOpen = std::exchange(other.m_isOpen, false);
+		m_fileHandle = std::exchange(other.m_fileHandle, nullptr);
+		m_mapHandle = std::exchange(other.m_mapHandle, nullptr);
+	}
+	return *this;
+}
+
+bool MappedFile::open(const std::filesystem::path& path)
+{
+	close();
+
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize))
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	m_fileHandle = file;
+	m_size = std::size_t(fileSize.QuadPart);
+	m_isOpen = true;
+
+	// Empty files can not be mapped
+	if (m_size == 0)
+		return true;
+
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr)
+	{
+		close();
+		return false;
+	}
+	m_mapHandle = mapping;
+
+	m_data = static_cast<const u8*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (m_data == nullptr)
+	{
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (m_data != nullptr)
+		UnmapViewOfFile(m_data);
+	if (m_mapHandle != nullptr)
+		CloseHandle(m_mapHandle);
+	if (m_fileHandle != nullptr)
+		CloseHandle(m_fileHandle);
+	m_data = nullptr;
+	m_mapHandle = nullptr;
+	m_fileHandle = nullptr;
+	m_size = 0;
+	m_isOpen = false;
+}
+
+#else
+
+MappedFile::MappedFile() :
+	m_data(nullptr), m_size(0), m_isOpen(false)
+{}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept :
+	m_data(std::exchange(other.m_data, nullptr)),
+	m_size(std::exchange(other.m_size, 0)),
+	m_isOpen(std::exchange(other.m_isOpen, false))
+{}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+	if (this != &other)
+	{
+		close();
+		m_data = std::exchange(other.m_data, nullptr);
+		m_size = std::exchange(other.m_size, 0);
+		m_isOpen = std::exchange(other.m_isOpen, false);
+	}
+	return *this;
+}
+
+bool MappedFile::open(const std::filesystem::path& path)
+{
+	close();
+
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	m_size = std::size_t(st.st_size);
+	m_isOpen = true;
+
+	// Empty files can not be mapped
+	if (m_size != 0)
+	{
+		void* addr = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (addr == MAP_FAILED)
+		{
+			::close(fd);
+			m_size = 0;
+			m_isOpen = false;
+			return false;
+		}
+		m_data = static_cast<const u8*>(addr);
+	}
+
+	// The mapping stays valid after the descriptor is closed
+	::close(fd);
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (m_data != nullptr)
+		munmap(const_cast<u8*>(m_data), m_size);
+	m_data = nullptr;
+	m_size = 0;
+	m_isOpen = false;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+	close();
+}
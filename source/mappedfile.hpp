@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+
+#include "types.hpp"
+
+/*
+ * Read-only memory mapping of a whole file.
+ * The contents are paged in on demand by the OS instead of
+ * being copied through a stream buffer.
+ * */
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+
+	bool open(const std::filesystem::path& path);
+	void close();
+
+	[[nodiscard]] constexpr const u8* data() const { return m_data; }
+	[[nodiscard]] constexpr std::size_t size() const { return m_size; }
+	[[nodiscard]] constexpr bool isOpen() const { return m_isOpen; }
+
+private:
+	const u8* m_data;
+	std::size_t m_size;
+	bool m_isOpen;
+#ifdef _WIN32
+	void* m_fileHandle;
+	void* m_mapHandle;
+#endif
+};
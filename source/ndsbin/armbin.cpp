@@ -1,7 +1,6 @@
 #include "armbin.hpp"
 
 #include <iostream>
-#include <fstream>
 #include <string>
 #include <algorithm>
 #include <sstream>
@@ -11,6 +10,7 @@
 #include "../except.hpp"
 #include "../blz.hpp"
 #include "../util.hpp"
+#include "../mappedfile.hpp"
 
 namespace fs = std::filesystem;
 
@@ -37,23 +37,29 @@ void ArmBin::load(const fs::path& path, u32 entryAddr, u32 ramAddr, u32 autoLoad
 	if (!fs::exists(path))
 		throw ncp::file_error(path, ncp::file_error::find);
 
-	uintmax_t fileSize = fs::file_size(path);
+	MappedFile file;
+	if (!file.open(path))
+		throw ncp::file_error(path, ncp::file_error::read);
+
+	std::size_t fileSize = file.size();
 	if (fileSize < 4)
 		throw ncp::exception(getString(InvResn));
 
-	std::ifstream file(path, std::ios::binary);
-	if (!file.is_open())
-		throw ncp::file_error(path, ncp::file_error::read);
-
-	m_bytes.resize(fileSize);
-	file.read(reinterpret_cast<char*>(m_bytes.data()), std::streamsize(fileSize));
+	// The binary gets decompressed and patched in place, so it is copied out of the mapping once
+	m_bytes.assign(file.data(), file.data() + fileSize);
 	file.close();
 
 	u8* bytesData = m_bytes.data();
 
 	// FIND MODULE PARAMS ================================
 
-	m_moduleParamsOff = *reinterpret_cast<u32*>(&bytesData[autoLoadHookOff - m_ramAddr - 4]) - m_ramAddr;
+	u32 moduleParamsPtrOff = autoLoadHookOff - m_ramAddr - 4;
+	if (autoLoadHookOff < m_ramAddr + 4 || std::size_t(moduleParamsPtrOff) + 4 > fileSize)
+		throw ncp::exception(getString(InvResn));
+
+	m_moduleParamsOff = *reinterpret_cast<u32*>(&bytesData[moduleParamsPtrOff]) - m_ramAddr;
+	if (std::size_t(m_moduleParamsOff) + sizeof(ModuleParams) > fileSize)
+		throw ncp::exception(getString(InvResn));
 
 	Log::out << OINFO << "Found ModuleParams at: 0x" << std::uppercase << std::hex << m_moduleParamsOff << std::endl;
 
@@ -65,7 +71,11 @@ void ArmBin::load(const fs::path& path, u32 entryAddr, u32 ramAddr, u32 autoLoad
 	{
 		Log::out << OINFO << "Decompressing..." << std::endl;
 
-		u32 decompSize = fileSize + *reinterpret_cast<u32*>(&bytesData[moduleParams->compStaticEnd - m_ramAddr - 4]);
+		u32 compStaticEndOff = moduleParams->compStaticEnd - m_ramAddr;
+		if (moduleParams->compStaticEnd < m_ramAddr + 8 || compStaticEndOff > fileSize)
+			throw ncp::exception(getString(InvResn));
+
+		u32 decompSize = fileSize + *reinterpret_cast<u32*>(&bytesData[compStaticEndOff - 4]);
 
 		m_bytes.resize(decompSize);
 		bytesData = m_bytes.data();
@@ -1,13 +1,13 @@
 #include "headerbin.hpp"
 
 #include <iostream>
-#include <fstream>
 #include <cstring>
 #include <sstream>
 
 #include "../main.hpp"
 #include "../log.hpp"
 #include "../except.hpp"
+#include "../mappedfile.hpp"
 
 namespace fs = std::filesystem;
 
@@ -24,15 +24,13 @@ void HeaderBin::load(const fs::path& path)
 	if (!fs::exists(path))
 		throw ncp::file_error(path, ncp::file_error::find);
 
-	std::ifstream headerFile(path, std::ios::binary);
-	if (!headerFile.is_open())
+	MappedFile headerFile;
+	if (!headerFile.open(path))
 		throw ncp::file_error(path, ncp::file_error::read);
 
-	uintmax_t headerSize = fs::file_size(path);
+	std::size_t headerSize = headerFile.size();
 	if (headerSize < 512)
 	{
-		headerFile.close();
-
 		std::ostringstream oss;
 		oss << "Invalid ROM header file: " << OSTR(path.string()) << OREASONNL;
 		oss << "Expected a minimum of 512 bytes, got " << headerSize << " bytes.";
@@ -40,6 +38,5 @@ void HeaderBin::load(const fs::path& path)
 	}
 
 	// TODO: More safety on HeaderBin loading
-	headerFile.read(reinterpret_cast<char*>(this), sizeof(HeaderBin));
-	headerFile.close();
+	std::memcpy(static_cast<void*>(this), headerFile.data(), sizeof(HeaderBin));
 }
@@ -1,11 +1,11 @@
 #include "overlaybin.hpp"
 
 #include <cstring>
-#include <fstream>
 #include <sstream>
 
 #include "../blz.hpp"
 #include "../except.hpp"
+#include "../mappedfile.hpp"
 
 namespace fs = std::filesystem;
 
@@ -20,17 +20,15 @@ void OverlayBin::load(const fs::path& path, u32 ramAddress, bool compressed, int
 	if (!fs::exists(path))
 		throw ncp::file_error(path, ncp::file_error::find);
 
-	uintmax_t fileSize = fs::file_size(path);
-
-	std::ifstream file(path, std::ios::binary);
-	if (!file.is_open())
+	MappedFile file;
+	if (!file.open(path))
 		throw ncp::file_error(path, ncp::file_error::read);
 
-	if (fileSize == 0)
+	if (file.size() == 0)
 		return;
 
-	m_bytes.resize(fileSize);
-	file.read(reinterpret_cast<char*>(m_bytes.data()), std::streamsize(fileSize));
+	// Overlays can be decompressed, appended to and patched, so they are copied out of the mapping once
+	m_bytes.assign(file.data(), file.data() + file.size());
 	file.close();
 
 	if (compressed)
@@ -0,0 +1,1683 @@
+#include "internallinker.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <sstream>
+#include <unordered_set>
+
+#include "linklayout.hpp"
+
+#include "../elf.hpp"
+#include "../mappedfile.hpp"
+#include "../log.hpp"
+#include "../except.hpp"
+#include "../util.hpp"
+
+namespace fs = std::filesystem;
+
+#define R_ARM_NONE        0
+#define R_ARM_PC24        1
+#define R_ARM_ABS32       2
+#define R_ARM_REL32       3
+#define R_ARM_ABS16       5
+#define R_ARM_ABS8        8
+#define R_ARM_THM_CALL    10
+#define R_ARM_CALL        28
+#define R_ARM_JUMP24      29
+#define R_ARM_TARGET1     38
+#define R_ARM_V4BX        40
+#define R_ARM_TARGET2     41
+#define R_ARM_PREL31      42
+#define R_ARM_THM_JUMP11  102
+#define R_ARM_THM_JUMP8   103
+
+struct InternalLinker::InputFile
+{
+	std::string name; // the object path, or the member name for archive members
+	const Archive* archive; // the archive the member was taken from, nullptr for objects
+	u32 memberOffset;
+	std::unique_ptr<Elf32> elf;
+	std::vector<std::unique_ptr<InputSection>> sections; // by section index, nullptr if it is not linked
+	std::vector<Symbol*> globals; // by symbol index, nullptr for the local symbols
+	u32 firstGlobal;
+};
+
+struct InternalLinker::InputSection
+{
+	InputFile* file;
+	u32 index;
+	const Elf32_Shdr* header;
+	std::string_view name;
+	const Elf32_Shdr* relocations = nullptr;
+	int output = -1; // the layout output section, -1 if it is discarded
+	bool keep = false;
+	bool live = false;
+	MergeGroup* merge = nullptr;
+	u32 size;
+	u32 address = 0;
+};
+
+struct InternalLinker::Archive
+{
+	std::string path; // as given to the linker, matched by "archive:" patterns
+	MappedFile file;
+	bool whole;
+	std::vector<std::pair<std::string_view, u32>> symbolIndex; // the symbol and the offset of its member, in armap order
+	std::string_view longNames;
+	std::unordered_set<u32> loadedMembers;
+};
+
+struct InternalLinker::Symbol
+{
+	enum class Kind
+	{
+		Undefined,
+		Object,   // defined by an input object, in a section or absolute
+		Absolute, // assigned by the symbols file
+		Script    // defined by the layout at a location of an output section
+	};
+
+	std::string_view name;
+	Kind kind = Kind::Undefined;
+	bool weak = false; // a weak definition, a strong one replaces it
+	bool provide = false; // a PROVIDE of the symbols file, objects replace it
+	bool strongRef = false; // referenced by a non weak undefined symbol, pulls archive members
+	bool referenced = false; // referenced by any undefined symbol, a PROVIDE is only output then
+	InputFile* file = nullptr;
+	u32 symIdx = 0;
+	u32 value = 0;
+	int output = -1;
+};
+
+// One output section worth of mergeable constants or strings with the same entry size and alignment
+struct InternalLinker::MergeGroup
+{
+	struct Entry
+	{
+		u32 inputOffset;
+		u32 length;
+		u32 unique;
+	};
+
+	struct Unique
+	{
+		std::string_view data;
+		u32 outputOffset = 0;
+		u32 suffixOf = u32(-1); // for strings that end another string
+	};
+
+	int output;
+	u32 entsize;
+	u32 alignment;
+	bool strings;
+	InputSection* first = nullptr; // the merged contents take its place, the others are left empty
+	std::vector<u8> data;
+	std::vector<Unique> uniques;
+	std::unordered_map<const InputSection*, std::vector<Entry>> entries;
+};
+
+static u32 alignUp(u32 value, u32 alignment)
+{
+	return alignment > 1 ? (value + alignment - 1) & ~(alignment - 1) : value;
+}
+
+static s32 signExtend(u32 value, int bits)
+{
+	u32 m = 1u << (bits - 1);
+	return s32((value ^ m) - m);
+}
+
+static u32 readBE32(const u8* data)
+{
+	return (u32(data[0]) << 24) | (u32(data[1]) << 16) | (u32(data[2]) << 8) | u32(data[3]);
+}
+
+InternalLinker::InternalLinker() :
+	m_layout(nullptr), m_options(nullptr)
+{}
+
+InternalLinker::~InternalLinker() = default;
+
+InternalLinker::Symbol& InternalLinker::getSymbol(std::string_view name)
+{
+	auto it = m_symbols.find(name);
+	if (it != m_symbols.end())
+		return *it->second;
+	Symbol& symbol = m_symbolStorage.emplace_back();
+	symbol.name = name;
+	m_symbols.emplace(name, &symbol);
+	return symbol;
+}
+
+std::vector<u8> InternalLinker::link(const LinkLayout& layout, const Options& options)
+{
+	m_layout = &layout;
+	m_options = &options;
+
+	// Symbols assigned by the script override the ones of the objects
+	for (std::size_t i = 0; i < layout.sections.size(); i++)
+	{
+		for (const LinkLayout::Command& cmd : layout.sections[i].commands)
+		{
+			if (cmd.type == LinkLayout::CommandType::Symbol || cmd.type == LinkLayout::CommandType::Reserve)
+			{
+				Symbol& symbol = getSymbol(cmd.symbol);
+				symbol.kind = Symbol::Kind::Script;
+				symbol.output = int(i);
+			}
+		}
+	}
+
+	if (!layout.symbolsFile.empty())
+		loadSymbolsFile(layout.symbolsFile);
+	if (!layout.importsFile.empty())
+		loadSymbolsFile(layout.importsFile);
+
+	// EXTERN symbols are kept and pull archive members, like undefined references
+	for (const std::string& name : layout.externs)
+	{
+		Symbol& symbol = getSymbol(name);
+		symbol.strongRef = true;
+		symbol.referenced = true;
+	}
+
+	for (const std::string& input : layout.inputs)
+	{
+		auto elf = std::make_unique<Elf32>();
+		if (!elf->load(input))
+			throw ncp::file_error(input, ncp::file_error::read);
+		addObject(std::move(elf), input, nullptr, 0);
+	}
+
+	for (const std::string& archive : options.wholeArchives)
+		addArchive(archive, true);
+
+	for (const std::string& library : options.libraries)
+	{
+		addArchive(findLibrary(library).string(), false);
+		loadArchiveMembers(*m_archives.back());
+	}
+
+	std::size_t groupStart = m_archives.size();
+	for (const std::string& library : options.groupLibraries)
+		addArchive(findLibrary(library).string(), false);
+	for (bool changed = true; changed;)
+	{
+		changed = false;
+		for (std::size_t i = groupStart; i < m_archives.size(); i++)
+			changed |= loadArchiveMembers(*m_archives[i]);
+	}
+
+	assignSections();
+	collectGarbage();
+	mergeSections();
+	placeSections();
+	applyRelocations();
+	return writeImage();
+}
+
+void InternalLinker::loadSymbolsFile(const fs::path& path)
+{
+	MappedFile file;
+	if (!file.open(path))
+		throw ncp::file_error(path, ncp::file_error::read);
+
+	std::string text(reinterpret_cast<const char*>(file.data()), file.size());
+
+	// Comments can appear anywhere, remove them first
+	for (std::size_t pos; (pos = text.find("/*")) != std::string::npos;)
+	{
+		std::size_t end = text.find("*/", pos + 2);
+		text.erase(pos, end == std::string::npos ? std::string::npos : end + 2 - pos);
+	}
+
+	auto trim = [](std::string_view str){
+		while (!str.empty() && std::isspace(static_cast<unsigned char>(str.front())))
+			str.remove_prefix(1);
+		while (!str.empty() && std::isspace(static_cast<unsigned char>(str.back())))
+			str.remove_suffix(1);
+		return str;
+	};
+
+	auto fail = [&](std::string_view statement){
+		std::ostringstream oss;
+		oss << "The internal linker does not support the statement " << OSTR(statement) << " in " << OSTR(path.string()) << OREASONNL;
+		oss << "Only symbol assignments of numbers and other symbols are supported, use an external linker for the rest.";
+		throw ncp::exception(oss.str());
+	};
+
+	std::size_t start = 0;
+	while (start < text.length())
+	{
+		std::size_t end = text.find(';', start);
+		if (end == std::string::npos)
+			end = text.length();
+		std::string_view statement = trim(std::string_view(text).substr(start, end - start));
+		start = end + 1;
+		if (statement.empty())
+			continue;
+
+		bool provide = false;
+		std::string_view assignment = statement;
+		if (assignment.starts_with("PROVIDE"))
+		{
+			std::size_t open = assignment.find('(');
+			std::size_t close = assignment.rfind(')');
+			if (open == std::string_view::npos || close == std::string_view::npos || close < open)
+				fail(statement);
+			assignment = assignment.substr(open + 1, close - open - 1);
+			provide = true;
+		}
+
+		std::size_t eq = assignment.find('=');
+		if (eq == std::string_view::npos)
+			fail(statement);
+		std::string_view name = trim(assignment.substr(0, eq));
+		std::string_view expr = trim(assignment.substr(eq + 1));
+		if (name.empty() || expr.empty())
+			fail(statement);
+
+		u32 value;
+		if (std::isdigit(static_cast<unsigned char>(expr[0])))
+		{
+			std::string number(expr);
+			u32 multiplier = 1;
+			if (number.back() == 'K' || number.back() == 'k')
+				multiplier = 1024;
+			else if (number.back() == 'M' || number.back() == 'm')
+				multiplier = 1024 * 1024;
+			if (multiplier != 1)
+				number.pop_back();
+			std::size_t parsed = 0;
+			try {
+				value = u32(std::stoul(number, &parsed, 0)) * multiplier;
+			} catch (std::exception&) {
+				fail(statement);
+			}
+			if (parsed != number.length())
+				fail(statement);
+		}
+		else
+		{
+			auto it = m_symbols.find(expr);
+			if (it == m_symbols.end() || it->second->kind != Symbol::Kind::Absolute)
+				fail(statement);
+			value = it->second->value;
+		}
+
+		// A PROVIDE does not replace a symbol that is already defined
+		auto it = m_symbols.find(name);
+		if (provide && it != m_symbols.end() && it->second->kind != Symbol::Kind::Undefined)
+			continue;
+
+		Symbol& symbol = it != m_symbols.end() ? *it->second : getSymbol(m_nameStorage.emplace_back(name));
+		symbol.kind = Symbol::Kind::Absolute;
+		symbol.value = value;
+		symbol.provide = provide;
+	}
+}
+
+void InternalLinker::addObject(std::unique_ptr<Elf32> elf, std::string name, const Archive* archive, u32 memberOffset)
+{
+	const Elf32_Ehdr& eh = elf->getHeader();
+	if (eh.e_type != ET_REL || eh.e_machine != EM_ARM)
+	{
+		std::ostringstream oss;
+		oss << OSTR(name) << " is not an ARM relocatable object.";
+		throw ncp::exception(oss.str());
+	}
+
+	auto file = std::make_unique<InputFile>();
+	InputFile* f = file.get();
+	f->name = std::move(name);
+	f->archive = archive;
+	f->memberOffset = memberOffset;
+
+	ElfRange<Elf32_Shdr> sections = elf->getSections();
+	const Elf32_Shdr* symtab = elf->getSymbolTable();
+	ElfRange<Elf32_Sym> symbols = elf->getSymbols();
+
+	// COMDAT groups are only linked once, the copies of the later objects are dropped
+	std::vector<bool> inDiscardedGroup(sections.size());
+	for (const Elf32_Shdr& sh : sections)
+	{
+		if (sh.sh_type != SHT_GROUP || sh.sh_size < 4 || symtab == nullptr || sh.sh_info >= symbols.size())
+			continue;
+		ElfRange<u32> group = elf->getSectionEntries<u32>(sh);
+		if ((group[0] & GRP_COMDAT) == 0)
+			continue;
+		std::string_view signature = elf->getSymbolName(symbols[sh.sh_info]);
+		if (m_comdatGroups.insert(signature).second)
+			continue;
+		for (std::size_t i = 1; i < group.size(); i++)
+		{
+			if (group[i] < inDiscardedGroup.size())
+				inDiscardedGroup[group[i]] = true;
+		}
+	}
+
+	f->sections.resize(sections.size());
+	for (std::size_t i = 1; i < sections.size(); i++)
+	{
+		const Elf32_Shdr& sh = sections[i];
+		if ((sh.sh_flags & SHF_ALLOC) == 0 || inDiscardedGroup[i])
+			continue;
+		if (sh.sh_type == SHT_REL || sh.sh_type == SHT_RELA || sh.sh_type == SHT_GROUP ||
+			sh.sh_type == SHT_SYMTAB || sh.sh_type == SHT_STRTAB)
+			continue;
+
+		auto section = std::make_unique<InputSection>();
+		section->file = f;
+		section->index = u32(i);
+		section->header = &sh;
+		section->name = elf->getSectionName(sh);
+		section->size = sh.sh_size;
+		f->sections[i] = std::move(section);
+	}
+
+	for (const Elf32_Shdr& sh : sections)
+	{
+		if ((sh.sh_type == SHT_REL || sh.sh_type == SHT_RELA) && sh.sh_info < sections.size() &&
+			f->sections[sh.sh_info] != nullptr && &sections[sh.sh_link] == symtab)
+			f->sections[sh.sh_info]->relocations = &sh;
+	}
+
+	f->firstGlobal = symtab != nullptr ? std::min<u32>(symtab->sh_info, u32(symbols.size())) : 0;
+	f->globals.resize(symbols.size());
+	for (u32 i = f->firstGlobal; i < symbols.size(); i++)
+	{
+		const Elf32_Sym& sym = symbols[i];
+		std::string_view symName = elf->getSymbolName(sym);
+		if (symName.empty())
+			continue;
+
+		Symbol& symbol = getSymbol(symName);
+		f->globals[i] = &symbol;
+
+		bool isWeak = ELF32_ST_BIND(sym.st_info) == STB_WEAK;
+
+		if (sym.st_shndx == SHN_UNDEF)
+		{
+			if (!isWeak)
+				symbol.strongRef = true;
+			symbol.referenced = true;
+			continue;
+		}
+		if (sym.st_shndx == SHN_COMMON)
+		{
+			std::ostringstream oss;
+			oss << "The internal linker does not support the common symbol " << OSTR(symName) << " of " << OSTR(f->name) << OREASONNL;
+			oss << "Compile with -fno-common or use an external linker.";
+			throw ncp::exception(oss.str());
+		}
+		if (sym.st_shndx < SHN_LORESERVE && (sym.st_shndx >= f->sections.size() || f->sections[sym.st_shndx] == nullptr))
+			continue; // defined in a dropped group or in a section that is not linked
+
+		switch (symbol.kind)
+		{
+		case Symbol::Kind::Script:
+			continue;
+		case Symbol::Kind::Absolute:
+			if (!symbol.provide)
+				continue;
+			break;
+		case Symbol::Kind::Object:
+			if (!symbol.weak && !isWeak)
+			{
+				std::ostringstream oss;
+				oss << "Multiple definition of " << OSTR(symName) << " in " << OSTR(f->name)
+					<< ", first defined in " << OSTR(symbol.file->name) << ".";
+				throw ncp::exception(oss.str());
+			}
+			if (!symbol.weak || isWeak)
+				continue; // the first weak definition or a strong one is kept
+			break;
+		default:
+			break;
+		}
+
+		symbol.kind = Symbol::Kind::Object;
+		symbol.weak = isWeak;
+		symbol.provide = false;
+		symbol.file = f;
+		symbol.symIdx = i;
+	}
+
+	f->elf = std::move(elf);
+	m_files.emplace_back(std::move(file));
+}
+
+void InternalLinker::addArchive(const std::string& path, bool whole)
+{
+	auto archive = std::make_unique<Archive>();
+	archive->path = path;
+	archive->whole = whole;
+
+	if (!archive->file.open(path))
+		throw ncp::file_error(path, ncp::file_error::read);
+
+	const u8* data = archive->file.data();
+	std::size_t size = archive->file.size();
+
+	auto fail = [&](const char* reason){
+		std::ostringstream oss;
+		oss << "Invalid archive: " << OSTR(path) << OREASONNL << reason;
+		throw ncp::exception(oss.str());
+	};
+
+	if (size < 8 || std::memcmp(data, "!<arch>\n", 8) != 0)
+	{
+		if (size >= 8 && std::memcmp(data, "!<thin>\n", 8) == 0)
+			fail("Thin archives are not supported by the internal linker.");
+		fail("The archive magic is missing.");
+	}
+
+	std::vector<u32> members;
+	for (std::size_t pos = 8; pos + 60 <= size;)
+	{
+		const char* header = reinterpret_cast<const char*>(data + pos);
+		std::string_view name(header, 16);
+		std::size_t memberSize = std::strtoul(std::string(header + 48, 10).c_str(), nullptr, 10);
+		std::size_t dataPos = pos + 60;
+		if (dataPos + memberSize > size)
+			fail("A member exceeds the file.");
+
+		if (name.starts_with("/ "))
+		{
+			// The symbol table, big endian: count, member offsets, then the names
+			if (memberSize < 4)
+				fail("The symbol table is truncated.");
+			u32 count = readBE32(data + dataPos);
+			if (4 + std::size_t(count) * 4 > memberSize)
+				fail("The symbol table is truncated.");
+			const char* names = reinterpret_cast<const char*>(data + dataPos + 4 + count * 4);
+			const char* namesEnd = reinterpret_cast<const char*>(data + dataPos + memberSize);
+			for (u32 i = 0; i < count && names < namesEnd; i++)
+			{
+				std::size_t len = strnlen(names, namesEnd - names);
+				archive->symbolIndex.emplace_back(std::string_view(names, len), readBE32(data + dataPos + 4 + i * 4));
+				names += len + 1;
+			}
+		}
+		else if (name.starts_with("// "))
+		{
+			archive->longNames = std::string_view(reinterpret_cast<const char*>(data + dataPos), memberSize);
+		}
+		else
+		{
+			members.push_back(u32(pos));
+		}
+
+		pos = dataPos + memberSize + (memberSize & 1);
+	}
+
+	Archive* a = archive.get();
+	m_archives.emplace_back(std::move(archive));
+
+	if (whole)
+	{
+		for (u32 member : members)
+		{
+			a->loadedMembers.insert(member);
+			addArchiveMember(*a, member);
+		}
+	}
+}
+
+void InternalLinker::addArchiveMember(Archive& archive, u32 offset)
+{
+	const u8* data = archive.file.data();
+	const char* header = reinterpret_cast<const char*>(data + offset);
+	std::size_t memberSize = std::strtoul(std::string(header + 48, 10).c_str(), nullptr, 10);
+
+	std::string name;
+	if (header[0] == '/' && std::isdigit(static_cast<unsigned char>(header[1])))
+	{
+		// A long name, stored in the long names table and terminated by "/\n"
+		std::size_t nameOffset = std::strtoul(std::string(header + 1, 15).c_str(), nullptr, 10);
+		if (nameOffset < archive.longNames.size())
+		{
+			std::string_view longName = archive.longNames.substr(nameOffset);
+			name = std::string(longName.substr(0, longName.find('\n')));
+		}
+	}
+	else
+	{
+		name = std::string(header, 16);
+	}
+	while (!name.empty() && (name.back() == ' ' || name.back() == '/'))
+		name.pop_back();
+
+	// Members are only 2 byte aligned inside of the archive, copy them out
+	std::vector<u8> image(data + offset + 60, data + offset + 60 + memberSize);
+	auto elf = std::make_unique<Elf32>();
+	elf->loadFromMemory(std::move(image), archive.path + '(' + name + ')');
+	addObject(std::move(elf), std::move(name), &archive, offset);
+}
+
+bool InternalLinker::loadArchiveMembers(Archive& archive)
+{
+	// Like ld, the symbol table is searched again until no member is added
+	bool loadedAny = false;
+	for (bool changed = true; changed;)
+	{
+		changed = false;
+		for (const auto& [name, offset] : archive.symbolIndex)
+		{
+			if (archive.loadedMembers.contains(offset))
+				continue;
+			auto it = m_symbols.find(name);
+			if (it == m_symbols.end() || it->second->kind != Symbol::Kind::Undefined || !it->second->strongRef)
+				continue;
+			archive.loadedMembers.insert(offset);
+			addArchiveMember(archive, offset);
+			changed = true;
+			loadedAny = true;
+		}
+	}
+	return loadedAny;
+}
+
+fs::path InternalLinker::findLibrary(const std::string& name) const
+{
+	// -l:file searches for the file name as it is
+	std::string fileName = name.starts_with(':') ? name.substr(1) : "lib" + name + ".a";
+	std::error_code ec;
+	for (const fs::path& dir : m_options->searchDirs)
+	{
+		fs::path path = dir / fileName;
+		if (fs::is_regular_file(path, ec))
+			return path;
+	}
+	std::ostringstream oss;
+	oss << "The internal linker could not find the library " << OSTR("-l" + name) << ".";
+	throw ncp::exception(oss.str());
+}
+
+/*
+ * Input sections go to the first command of the layout that matches them,
+ * the files are walked like ld does: the objects in input order,
+ * then the loaded members of every archive in archive order.
+ * */
+void InternalLinker::assignSections()
+{
+	for (const auto& file : m_files)
+	{
+		if (file->archive == nullptr)
+			m_walkOrder.push_back(file.get());
+	}
+	for (const auto& archive : m_archives)
+	{
+		std::size_t first = m_walkOrder.size();
+		for (const auto& file : m_files)
+		{
+			if (file->archive == archive.get())
+				m_walkOrder.push_back(file.get());
+		}
+		std::sort(m_walkOrder.begin() + first, m_walkOrder.end(), [](const InputFile* a, const InputFile* b){
+			return a->memberOffset < b->memberOffset;
+		});
+	}
+
+	std::unordered_map<std::string_view, std::vector<InputFile*>> filesByName;
+	for (InputFile* file : m_walkOrder)
+		filesByName[file->name].push_back(file);
+
+	std::vector<InputFile*> candidates;
+	auto getCandidates = [&](std::string_view pattern) -> const std::vector<InputFile*>& {
+		candidates.clear();
+		if (pattern == "*")
+			return m_walkOrder;
+		if (pattern.ends_with(':'))
+		{
+			// "archive:" matches every member of that archive
+			std::string_view archivePath = pattern.substr(0, pattern.length() - 1);
+			for (InputFile* file : m_walkOrder)
+			{
+				if (file->archive != nullptr && LinkLayout::matchPattern(archivePath, file->archive->path))
+					candidates.push_back(file);
+			}
+			return candidates;
+		}
+		std::size_t memberStart = pattern.rfind(':');
+		if (memberStart != std::string_view::npos && pattern.find_first_of("/\\", memberStart) == std::string_view::npos)
+		{
+			// "archive:member" matches a member of that archive, a drive letter is followed by a path
+			std::string_view archivePath = pattern.substr(0, memberStart);
+			std::string_view memberName = pattern.substr(memberStart + 1);
+			for (InputFile* file : m_walkOrder)
+			{
+				if (file->archive != nullptr && LinkLayout::matchPattern(archivePath, file->archive->path) &&
+					LinkLayout::matchPattern(memberName, file->name))
+					candidates.push_back(file);
+			}
+			return candidates;
+		}
+		if (pattern.find_first_of("*?") == std::string_view::npos)
+		{
+			auto it = filesByName.find(pattern);
+			if (it != filesByName.end())
+				return it->second;
+			return candidates;
+		}
+		for (InputFile* file : m_walkOrder)
+		{
+			if (LinkLayout::matchPattern(pattern, file->name))
+				candidates.push_back(file);
+		}
+		return candidates;
+	};
+
+	m_placed.resize(m_layout->sections.size());
+	for (std::size_t outIdx = 0; outIdx < m_layout->sections.size(); outIdx++)
+	{
+		const LinkLayout::OutputSection& out = m_layout->sections[outIdx];
+		m_placed[outIdx].resize(out.commands.size());
+		for (std::size_t cmdIdx = 0; cmdIdx < out.commands.size(); cmdIdx++)
+		{
+			const LinkLayout::Command& cmd = out.commands[cmdIdx];
+			if (cmd.type != LinkLayout::CommandType::Input)
+				continue;
+			for (InputFile* file : getCandidates(cmd.file))
+			{
+				for (auto& section : file->sections)
+				{
+					if (section == nullptr || section->output != -1 || !LinkLayout::matchPattern(cmd.section, section->name))
+						continue;
+					section->output = int(outIdx);
+					section->keep = cmd.keep;
+					m_placed[outIdx][cmdIdx].push_back(section.get());
+				}
+			}
+		}
+	}
+}
+
+/*
+ * Like --gc-sections, only the sections reachable from the roots are linked:
+ * the kept sections, the initializer arrays and the sections of the EXTERN symbols.
+ * */
+void InternalLinker::collectGarbage()
+{
+	std::vector<InputSection*> pending;
+	auto markLive = [&](InputSection* section){
+		if (section != nullptr && !section->live)
+		{
+			section->live = true;
+			pending.push_back(section);
+		}
+	};
+
+	auto markSymbol = [&](const Symbol& symbol){
+		if (symbol.kind != Symbol::Kind::Object)
+			return;
+		const Elf32_Sym& sym = symbol.file->elf->getSymbols()[symbol.symIdx];
+		if (sym.st_shndx < SHN_LORESERVE)
+			markLive(symbol.file->sections[sym.st_shndx].get());
+	};
+
+	for (const auto& file : m_files)
+	{
+		for (auto& section : file->sections)
+		{
+			if (section == nullptr)
+				continue;
+			u32 type = section->header->sh_type;
+			if (section->keep || type == SHT_INIT_ARRAY || type == SHT_FINI_ARRAY || type == SHT_PREINIT_ARRAY)
+				markLive(section.get());
+		}
+	}
+
+	for (const std::string& name : m_layout->externs)
+		markSymbol(getSymbol(name));
+	if (auto it = m_symbols.find("_start"); it != m_symbols.end())
+		markSymbol(*it->second);
+
+	while (!pending.empty())
+	{
+		InputSection* section = pending.back();
+		pending.pop_back();
+
+		if (section->relocations == nullptr)
+			continue;
+
+		InputFile& file = *section->file;
+		ElfRange<Elf32_Sym> symbols = file.elf->getSymbols();
+		ElfRelocationIndex relocations;
+		relocations.build(*file.elf, *section->relocations);
+		for (const auto& rel : relocations.getEntries())
+		{
+			u32 symIdx = ELF32_R_SYM(rel.info);
+			if (symIdx == 0 || symIdx >= symbols.size())
+				continue;
+			if (symIdx >= file.firstGlobal && file.globals[symIdx] != nullptr)
+			{
+				markSymbol(*file.globals[symIdx]);
+				continue;
+			}
+			u16 shndx = symbols[symIdx].st_shndx;
+			if (shndx != SHN_UNDEF && shndx < file.sections.size())
+				markLive(file.sections[shndx].get());
+		}
+	}
+}
+
+/*
+ * Sections of mergeable constants or strings that end up in the same output section
+ * are merged like ld does it: duplicated entries are only emitted once, in the order
+ * they were first seen, and strings that end another string point inside of it.
+ * */
+void InternalLinker::mergeSections()
+{
+	for (std::size_t outIdx = 0; outIdx < m_placed.size(); outIdx++)
+	{
+		for (const auto& placed : m_placed[outIdx])
+		{
+			for (InputSection* section : placed)
+			{
+				const Elf32_Shdr& sh = *section->header;
+				if (!section->live || (sh.sh_flags & SHF_MERGE) == 0 || sh.sh_entsize == 0 ||
+					sh.sh_type != SHT_PROGBITS || section->relocations != nullptr)
+					continue;
+
+				bool strings = (sh.sh_flags & SHF_STRINGS) != 0;
+				u32 alignment = std::max<u32>(sh.sh_addralign, 1);
+
+				MergeGroup* group = nullptr;
+				for (const auto& g : m_mergeGroups)
+				{
+					if (g->output == int(outIdx) && g->strings == strings && g->entsize == sh.sh_entsize && g->alignment == alignment)
+					{
+						group = g.get();
+						break;
+					}
+				}
+				if (group == nullptr)
+				{
+					group = m_mergeGroups.emplace_back(std::make_unique<MergeGroup>()).get();
+					group->output = int(outIdx);
+					group->entsize = sh.sh_entsize;
+					group->alignment = alignment;
+					group->strings = strings;
+					group->first = section;
+				}
+				section->merge = group;
+			}
+		}
+	}
+
+	for (const auto& group : m_mergeGroups)
+	{
+		std::unordered_map<std::string_view, u32> uniqueIndex;
+		u32 entsize = group->entsize;
+
+		for (const auto& placed : m_placed[group->output])
+		{
+			for (InputSection* section : placed)
+			{
+				if (section->merge != group.get())
+					continue;
+
+				const char* data = section->file->elf->getSection<char>(*section->header);
+				u32 size = section->header->sh_size;
+				std::vector<MergeGroup::Entry>& entries = group->entries[section];
+
+				for (u32 pos = 0; pos < size;)
+				{
+					u32 length;
+					if (group->strings)
+					{
+						// Up to and including the terminator of entsize zero bytes
+						length = size - pos;
+						for (u32 i = pos; i + entsize <= size; i += entsize)
+						{
+							bool isZero = true;
+							for (u32 j = 0; j < entsize; j++)
+								isZero &= data[i + j] == 0;
+							if (isZero)
+							{
+								length = i + entsize - pos;
+								break;
+							}
+						}
+					}
+					else
+					{
+						length = std::min(entsize, size - pos);
+					}
+
+					std::string_view bytes(data + pos, length);
+					auto [it, inserted] = uniqueIndex.try_emplace(bytes, u32(group->uniques.size()));
+					if (inserted)
+						group->uniques.push_back(MergeGroup::Unique{ bytes });
+					entries.push_back(MergeGroup::Entry{ pos, length, it->second });
+					pos += length;
+				}
+			}
+		}
+
+		std::vector<MergeGroup::Unique>& uniques = group->uniques;
+
+		if (group->strings && !uniques.empty())
+		{
+			// Sorted by the reversed contents, a string that ends another one comes right before it
+			std::vector<u32> order(uniques.size());
+			for (u32 i = 0; i < order.size(); i++)
+				order[i] = i;
+			std::sort(order.begin(), order.end(), [&](u32 a, u32 b){
+				std::string_view sa = uniques[a].data, sb = uniques[b].data;
+				std::size_t len = std::min(sa.length(), sb.length());
+				for (std::size_t i = 1; i <= len; i++)
+				{
+					unsigned char ca = sa[sa.length() - i], cb = sb[sb.length() - i];
+					if (ca != cb)
+						return ca < cb;
+				}
+				return sa.length() < sb.length();
+			});
+
+			u32 container = order.back();
+			for (std::size_t i = order.size() - 1; i-- > 0;)
+			{
+				u32 candidate = order[i];
+				std::string_view outer = uniques[container].data, inner = uniques[candidate].data;
+				u32 extra = u32(outer.length() - inner.length());
+				if (outer.length() >= inner.length() && (extra & (group->alignment - 1)) == 0 && outer.ends_with(inner))
+					uniques[candidate].suffixOf = container;
+				else
+					container = candidate;
+			}
+		}
+
+		u32 size = 0;
+		for (MergeGroup::Unique& unique : uniques)
+		{
+			if (unique.suffixOf != u32(-1))
+				continue;
+			size = alignUp(size, group->alignment);
+			unique.outputOffset = size;
+			size += u32(unique.data.length());
+		}
+		for (MergeGroup::Unique& unique : uniques)
+		{
+			if (unique.suffixOf != u32(-1))
+			{
+				const MergeGroup::Unique& outer = uniques[unique.suffixOf];
+				unique.outputOffset = outer.outputOffset + u32(outer.data.length() - unique.data.length());
+			}
+		}
+
+		group->data.resize(size);
+		for (const MergeGroup::Unique& unique : uniques)
+		{
+			if (unique.suffixOf == u32(-1))
+				std::memcpy(&group->data[unique.outputOffset], unique.data.data(), unique.data.length());
+		}
+
+		for (auto& [section, entries] : group->entries)
+			const_cast<InputSection*>(section)->size = (section == group->first) ? size : 0;
+	}
+}
+
+/*
+ * Output sections are placed one after the other in their memory, or at their
+ * address when pinned, an output section without contents or symbols is dropped like ld does.
+ * */
+void InternalLinker::placeSections()
+{
+	std::unordered_map<std::string_view, std::size_t> memoryIndex;
+	std::vector<u32> memoryDot(m_layout->memories.size());
+	for (std::size_t i = 0; i < m_layout->memories.size(); i++)
+	{
+		memoryIndex.emplace(m_layout->memories[i].name, i);
+		memoryDot[i] = m_layout->memories[i].origin;
+	}
+
+	auto isPlaced = [](const InputSection* section){
+		return section->live && (section->merge == nullptr || section->merge->first == section);
+	};
+
+	std::size_t count = m_layout->sections.size();
+	m_outputAddresses.assign(count, 0);
+	m_outputSizes.assign(count, 0);
+	m_outputAlignments.assign(count, 1);
+	m_outputFlags.assign(count, 0);
+	m_outputKept.assign(count, false);
+	m_outputIsBss.assign(count, true);
+
+	for (std::size_t outIdx = 0; outIdx < count; outIdx++)
+	{
+		const LinkLayout::OutputSection& out = m_layout->sections[outIdx];
+
+		auto memIt = memoryIndex.find(out.memory);
+		if (memIt == memoryIndex.end())
+		{
+			std::ostringstream oss;
+			oss << "The output section " << OSTR(out.name) << " is placed in the memory " << OSTR(out.memory) << " that does not exist.";
+			throw ncp::exception(oss.str());
+		}
+		const LinkLayout::Memory& memory = m_layout->memories[memIt->second];
+
+		bool hasContents = false;
+		u32 alignment = out.align4 ? 4 : 1;
+		u32 flags = 0;
+		for (std::size_t cmdIdx = 0; cmdIdx < out.commands.size(); cmdIdx++)
+		{
+			const LinkLayout::Command& cmd = out.commands[cmdIdx];
+			if (cmd.type == LinkLayout::CommandType::Symbol || cmd.type == LinkLayout::CommandType::Reserve)
+			{
+				hasContents = true;
+				if (cmd.type == LinkLayout::CommandType::Reserve)
+					m_outputIsBss[outIdx] = false;
+			}
+			for (const InputSection* section : m_placed[outIdx][cmdIdx])
+			{
+				if (!isPlaced(section))
+					continue;
+				hasContents = true;
+				alignment = std::max<u32>(alignment, section->header->sh_addralign);
+				flags |= section->header->sh_flags & (SHF_WRITE | SHF_ALLOC | SHF_EXECINSTR);
+				if (section->header->sh_type != SHT_NOBITS)
+					m_outputIsBss[outIdx] = false;
+			}
+		}
+		if (!hasContents)
+			continue;
+
+		u32 start = alignUp(memoryDot[memIt->second], alignment);
+		if (out.isPinned)
+		{
+			// Pinned sections share their memory in address order, ld rejects the ones that overlap
+			if (out.address < memoryDot[memIt->second])
+			{
+				std::ostringstream oss;
+				oss << "The output section " << OSTR(out.name) << " at " << Util::intToAddr(int(out.address), 8)
+					<< " overlaps the previous contents of the region " << OSTR(memory.name) << ".";
+				throw ncp::exception(oss.str());
+			}
+			start = out.address;
+		}
+		u32 dot = start;
+		for (std::size_t cmdIdx = 0; cmdIdx < out.commands.size(); cmdIdx++)
+		{
+			const LinkLayout::Command& cmd = out.commands[cmdIdx];
+			switch (cmd.type)
+			{
+			case LinkLayout::CommandType::Align:
+				dot = alignUp(dot, cmd.value);
+				break;
+			case LinkLayout::CommandType::Symbol:
+				getSymbol(cmd.symbol).value = dot;
+				break;
+			case LinkLayout::CommandType::Reserve:
+				getSymbol(cmd.symbol).value = dot;
+				dot += cmd.value;
+				break;
+			case LinkLayout::CommandType::Input:
+				for (InputSection* section : m_placed[outIdx][cmdIdx])
+				{
+					if (!isPlaced(section))
+						continue;
+					dot = alignUp(dot, section->header->sh_addralign);
+					section->address = dot;
+					dot += section->size;
+				}
+				break;
+			}
+		}
+
+		u64 memoryEnd = u64(memory.origin) + memory.length;
+		if (dot > memoryEnd)
+		{
+			std::ostringstream oss;
+			oss << "The output section " << OSTR(out.name) << " does not fit, region "
+				<< OSTR(memory.name) << " overflowed by " << (dot - memoryEnd) << " bytes.";
+			throw ncp::exception(oss.str());
+		}
+
+		memoryDot[memIt->second] = dot;
+		m_outputAddresses[outIdx] = start;
+		m_outputSizes[outIdx] = dot - start;
+		m_outputAlignments[outIdx] = alignment;
+		m_outputFlags[outIdx] = flags | SHF_ALLOC;
+		m_outputKept[outIdx] = true;
+	}
+}
+
+u32 InternalLinker::getSectionAddress(const InputSection& section, u32 offset) const
+{
+	const MergeGroup* group = section.merge;
+	if (group == nullptr)
+		return section.address + offset;
+
+	// The entry holding the offset moved, the offset inside of it did not
+	auto entriesIt = group->entries.find(&section);
+	if (entriesIt == group->entries.end())
+		return group->first->address + offset;
+	const std::vector<MergeGroup::Entry>& entries = entriesIt->second;
+	auto it = std::upper_bound(entries.begin(), entries.end(), offset, [](u32 off, const MergeGroup::Entry& e){
+		return off < e.inputOffset;
+	});
+	if (it == entries.begin())
+		return group->first->address + offset;
+	--it;
+	return group->first->address + group->uniques[it->unique].outputOffset + (offset - it->inputOffset);
+}
+
+bool InternalLinker::resolveSymbol(const InputSection& from, u32 symIdx, s32 addend, u32& value, bool& isThumb, bool& isUndefWeak) const
+{
+	const InputFile& file = *from.file;
+	ElfRange<Elf32_Sym> symbols = file.elf->getSymbols();
+
+	value = 0;
+	isThumb = false;
+	isUndefWeak = false;
+
+	if (symIdx == 0)
+	{
+		value = u32(addend);
+		return true;
+	}
+	if (symIdx >= symbols.size())
+		return false;
+
+	auto discarded = [&](std::string_view symName, const InputSection* target){
+		std::ostringstream oss;
+		oss << OSTR(symName) << " referenced in section " << OSTR(from.name) << " of " << OSTR(file.name)
+			<< " is defined in the discarded section " << OSTR(target != nullptr ? target->name : "?") << ".";
+		throw ncp::exception(oss.str());
+	};
+
+	auto fromSection = [&](const InputFile& defFile, const Elf32_Sym& sym, std::string_view symName){
+		if (sym.st_shndx == SHN_ABS)
+		{
+			isThumb = ELF32_ST_TYPE(sym.st_info) == STT_FUNC && (sym.st_value & 1) != 0;
+			value = (sym.st_value & ~u32(isThumb)) + u32(addend);
+			return;
+		}
+		const InputSection* target = sym.st_shndx < defFile.sections.size() ? defFile.sections[sym.st_shndx].get() : nullptr;
+		if (target == nullptr || !target->live || target->output == -1)
+			discarded(symName, target);
+
+		if (ELF32_ST_TYPE(sym.st_info) == STT_SECTION)
+		{
+			// The addend is an offset into the section, it can point into merged contents
+			value = getSectionAddress(*target, sym.st_value + u32(addend));
+			return;
+		}
+		isThumb = ELF32_ST_TYPE(sym.st_info) == STT_FUNC && (sym.st_value & 1) != 0;
+		value = getSectionAddress(*target, sym.st_value & ~u32(isThumb)) + u32(addend);
+	};
+
+	if (symIdx < file.firstGlobal || file.globals[symIdx] == nullptr)
+	{
+		const Elf32_Sym& sym = symbols[symIdx];
+		fromSection(file, sym, file.elf->getSymbolName(sym));
+		return true;
+	}
+
+	const Symbol& symbol = *file.globals[symIdx];
+	switch (symbol.kind)
+	{
+	case Symbol::Kind::Object:
+	{
+		const Elf32_Sym& sym = symbol.file->elf->getSymbols()[symbol.symIdx];
+		fromSection(*symbol.file, sym, symbol.name);
+		return true;
+	}
+	case Symbol::Kind::Absolute:
+		// Odd addresses of the symbols file are Thumb functions
+		isThumb = (symbol.value & 1) != 0;
+		value = (symbol.value & ~u32(1)) + u32(addend);
+		return true;
+	case Symbol::Kind::Script:
+		value = symbol.value + u32(addend);
+		return true;
+	default:
+		break;
+	}
+
+	if (ELF32_ST_BIND(symbols[symIdx].st_info) == STB_WEAK)
+	{
+		isUndefWeak = true;
+		value = u32(addend);
+		return true;
+	}
+	return false;
+}
+
+void InternalLinker::applyRelocations()
+{
+	std::size_t count = m_layout->sections.size();
+	m_outputData.resize(count);
+	for (std::size_t outIdx = 0; outIdx < count; outIdx++)
+	{
+		if (m_outputKept[outIdx] && !m_outputIsBss[outIdx])
+			m_outputData[outIdx].resize(m_outputSizes[outIdx]);
+	}
+
+	// Copy the contents first, so that everything is in place for the relocations
+	for (std::size_t outIdx = 0; outIdx < count; outIdx++)
+	{
+		if (m_outputData[outIdx].empty())
+			continue;
+		u8* out = m_outputData[outIdx].data();
+		for (const auto& placed : m_placed[outIdx])
+		{
+			for (const InputSection* section : placed)
+			{
+				if (!section->live || section->header->sh_type == SHT_NOBITS)
+					continue;
+				u32 offset = section->address - m_outputAddresses[outIdx];
+				if (section->merge != nullptr)
+				{
+					if (section->merge->first == section && !section->merge->data.empty())
+						std::memcpy(out + offset, section->merge->data.data(), section->merge->data.size());
+					continue;
+				}
+				if (section->size != 0)
+					std::memcpy(out + offset, section->file->elf->getSection<u8>(*section->header), section->size);
+			}
+		}
+	}
+
+	bool allowBlx = m_options->allowBlx;
+	std::ostringstream undefined;
+	std::size_t undefinedCount = 0;
+
+	for (std::size_t outIdx = 0; outIdx < count; outIdx++)
+	{
+		for (const auto& placed : m_placed[outIdx])
+		{
+			for (const InputSection* section : placed)
+			{
+				if (!section->live || section->relocations == nullptr || section->header->sh_type == SHT_NOBITS)
+					continue;
+
+				InputFile& file = *section->file;
+				u8* out = m_outputData[outIdx].data() + (section->address - m_outputAddresses[outIdx]);
+				ElfRelocationIndex relocations;
+				relocations.build(*file.elf, *section->relocations);
+
+				for (const auto& rel : relocations.getEntries())
+				{
+					u32 type = ELF32_R_TYPE(rel.info);
+					u32 symIdx = ELF32_R_SYM(rel.info);
+					if (type == R_ARM_NONE || type == R_ARM_V4BX)
+						continue;
+
+					auto fail = [&](const std::string& reason){
+						std::ostringstream oss;
+						oss << "Could not relocate " << OSTR(section->name) << "+0x" << std::hex << rel.offset
+							<< " of " << OSTR(file.name) << ": " << reason;
+						throw ncp::exception(oss.str());
+					};
+
+					u32 size = (type == R_ARM_ABS16) ? 2 : (type == R_ARM_ABS8) ? 1 :
+						(type == R_ARM_THM_JUMP11 || type == R_ARM_THM_JUMP8) ? 2 : 4;
+					if (u64(rel.offset) + size > section->size)
+						fail("the relocation is out of the section.");
+
+					u8* loc = out + rel.offset;
+					u32 P = section->address + rel.offset;
+					u32 insn = (size == 4) ? Util::read<u32>(loc) : (size == 2) ? Util::read<u16>(loc) : *loc;
+
+					// REL relocations keep their addend in the relocated data
+					s32 A;
+					if (rel.hasAddend)
+					{
+						A = rel.addend;
+					}
+					else
+					{
+						switch (type)
+						{
+						case R_ARM_PC24:
+						case R_ARM_CALL:
+						case R_ARM_JUMP24:
+							A = signExtend(insn & 0xFFFFFF, 24) << 2;
+							if ((insn & 0xFE000000) == 0xFA000000) // BLX keeps bit 1 in H
+								A |= (insn >> 23) & 2;
+							break;
+						case R_ARM_THM_CALL:
+						{
+							u16 lo = Util::read<u16>(loc + 2);
+							A = signExtend(((insn & 0x7FF) << 12) | ((lo & 0x7FF) << 1), 23);
+							break;
+						}
+						case R_ARM_THM_JUMP11:
+							A = signExtend((insn & 0x7FF) << 1, 12);
+							break;
+						case R_ARM_THM_JUMP8:
+							A = signExtend((insn & 0xFF) << 1, 9);
+							break;
+						case R_ARM_ABS16:
+							A = s16(insn);
+							break;
+						case R_ARM_ABS8:
+							A = s8(insn);
+							break;
+						case R_ARM_PREL31:
+							A = signExtend(insn & 0x7FFFFFFF, 31);
+							break;
+						default:
+							A = s32(insn);
+							break;
+						}
+					}
+
+					u32 S;
+					bool isThumb, isUndefWeak;
+					if (!resolveSymbol(*section, symIdx, A, S, isThumb, isUndefWeak))
+					{
+						undefinedCount++;
+						undefined << OERROR << "Undefined reference to " << OSTR(file.globals[symIdx]->name)
+							<< " in " << OSTR(section->name) << " of " << OSTR(file.name) << '\n';
+						continue;
+					}
+					u32 T = isThumb ? 1 : 0;
+
+					auto checkRange = [&](s64 offset, s64 min, s64 max){
+						if (offset < min || offset > max)
+						{
+							std::ostringstream oss;
+							oss << "the branch to 0x" << std::hex << std::uppercase << S << " from 0x" << P
+								<< " is out of range and would need a veneer.";
+							fail(oss.str());
+						}
+					};
+
+					switch (type)
+					{
+					case R_ARM_ABS32:
+					case R_ARM_TARGET1:
+						Util::write<u32>(loc, S | T);
+						break;
+					case R_ARM_REL32:
+					case R_ARM_TARGET2:
+						Util::write<u32>(loc, (S | T) - P);
+						break;
+					case R_ARM_PREL31:
+					{
+						s64 offset = s64(s32((S | T) - P));
+						checkRange(offset, -0x40000000, 0x3FFFFFFF);
+						Util::write<u32>(loc, (insn & 0x80000000) | (u32(offset) & 0x7FFFFFFF));
+						break;
+					}
+					case R_ARM_ABS16:
+					{
+						s64 v = s64(s32(S | T));
+						if (v < -0x8000 || v > 0xFFFF)
+							fail("the value does not fit in 16 bits.");
+						Util::write<u16>(loc, u16(v));
+						break;
+					}
+					case R_ARM_ABS8:
+					{
+						s64 v = s64(s32(S | T));
+						if (v < -0x80 || v > 0xFF)
+							fail("the value does not fit in 8 bits.");
+						*loc = u8(v);
+						break;
+					}
+					case R_ARM_PC24:
+					case R_ARM_CALL:
+					case R_ARM_JUMP24:
+					{
+						bool isBlx = (insn & 0xFE000000) == 0xFA000000;
+						bool isCall = type == R_ARM_CALL || isBlx || (type == R_ARM_PC24 && (insn & 0xFF000000) == 0xEB000000);
+
+						if (isUndefWeak)
+						{
+							// Like ld, a branch to an undefined weak symbol does nothing
+							Util::write<u32>(loc, (isBlx ? 0xE0000000 : (insn & 0xF0000000)) | 0x01A00000);
+							break;
+						}
+
+						s64 offset = s64(s32(S - P));
+						if (isThumb)
+						{
+							if (!isCall || !allowBlx)
+								fail("switching to Thumb from this branch would need a veneer.");
+							checkRange(offset, -0x2000000, 0x1FFFFFE);
+							Util::write<u32>(loc, 0xFA000000 | ((u32(offset) & 2) << 23) | ((u32(offset) >> 2) & 0xFFFFFF));
+						}
+						else
+						{
+							if ((offset & 3) != 0)
+								fail("the branch target is not word aligned.");
+							checkRange(offset, -0x2000000, 0x1FFFFFC);
+							u32 opcode = isBlx ? 0xEB000000 : (insn & 0xFF000000);
+							Util::write<u32>(loc, opcode | ((u32(offset) >> 2) & 0xFFFFFF));
+						}
+						break;
+					}
+					case R_ARM_THM_CALL:
+					{
+						if (isUndefWeak)
+						{
+							// Branch over the second half, to the next instruction
+							Util::write<u16>(loc, 0xE000);
+							Util::write<u16>(loc + 2, 0xBF00);
+							break;
+						}
+
+						s64 offset = s64(s32(S - P));
+						u16 lo;
+						if (isThumb)
+						{
+							checkRange(offset, -0x400000, 0x3FFFFE);
+							lo = 0xF800;
+						}
+						else
+						{
+							if (!allowBlx)
+								fail("switching to ARM from this branch would need a veneer.");
+							// BLX is relative to the word aligned PC
+							offset = (offset + 2) & ~s64(3);
+							checkRange(offset, -0x400000, 0x3FFFFC);
+							lo = 0xE800;
+						}
+						Util::write<u16>(loc, u16(0xF000 | ((u32(offset) >> 12) & 0x7FF)));
+						Util::write<u16>(loc + 2, u16(lo | ((u32(offset) >> 1) & 0x7FF)));
+						break;
+					}
+					case R_ARM_THM_JUMP11:
+					{
+						s64 offset = s64(s32(S - P));
+						checkRange(offset, -0x800, 0x7FE);
+						Util::write<u16>(loc, u16((insn & 0xF800) | ((u32(offset) >> 1) & 0x7FF)));
+						break;
+					}
+					case R_ARM_THM_JUMP8:
+					{
+						s64 offset = s64(s32(S - P));
+						checkRange(offset, -0x100, 0xFE);
+						Util::write<u16>(loc, u16((insn & 0xFF00) | ((u32(offset) >> 1) & 0xFF)));
+						break;
+					}
+					default:
+						fail("the relocation type " + std::to_string(type) + " is not supported by the internal linker.");
+					}
+				}
+			}
+		}
+	}
+
+	if (undefinedCount != 0)
+	{
+		(m_options->log != nullptr ? *m_options->log : Log::out) << undefined.str();
+		throw ncp::exception("Undefined references were found.");
+	}
+}
+
+/*
+ * The image holds the output sections followed by the symbol table,
+ * no program headers are written since nothing loads it.
+ * */
+std::vector<u8> InternalLinker::writeImage() const
+{
+	std::string shstrtab(1, '\0');
+	std::string strtab(1, '\0');
+	auto addString = [](std::string& table, std::string_view str){
+		u32 offset = u32(table.size());
+		table += str;
+		table += '\0';
+		return offset;
+	};
+
+	std::size_t count = m_layout->sections.size();
+	std::vector<u16> elfIndex(count, 0);
+	std::vector<Elf32_Shdr> headers(1, Elf32_Shdr{});
+	for (std::size_t outIdx = 0; outIdx < count; outIdx++)
+	{
+		if (!m_outputKept[outIdx])
+			continue;
+		Elf32_Shdr sh{};
+		sh.sh_name = addString(shstrtab, m_layout->sections[outIdx].name);
+		sh.sh_type = m_outputIsBss[outIdx] ? SHT_NOBITS : SHT_PROGBITS;
+		sh.sh_flags = m_outputFlags[outIdx];
+		sh.sh_addr = m_outputAddresses[outIdx];
+		sh.sh_size = m_outputSizes[outIdx];
+		sh.sh_addralign = m_outputAlignments[outIdx];
+		elfIndex[outIdx] = u16(headers.size());
+		headers.push_back(sh);
+	}
+
+	std::vector<Elf32_Sym> symbols(1, Elf32_Sym{});
+
+	auto outputOf = [&](const InputSection* section) -> u16 {
+		if (section == nullptr || !section->live || section->output == -1)
+			return 0;
+		return elfIndex[section->output];
+	};
+
+	// Locals first, as the ELF format requires
+	for (InputFile* file : m_walkOrder)
+	{
+		ElfRange<Elf32_Sym> fileSymbols = file->elf->getSymbols();
+		for (u32 i = 1; i < file->firstGlobal; i++)
+		{
+			const Elf32_Sym& sym = fileSymbols[i];
+			u32 type = ELF32_ST_TYPE(sym.st_info);
+			std::string_view name = file->elf->getSymbolName(sym);
+			if (name.empty() || type == STT_SECTION || type == STT_FILE || sym.st_shndx >= file->sections.size())
+				continue;
+			const InputSection* section = file->sections[sym.st_shndx].get();
+			u16 shndx = outputOf(section);
+			if (shndx == 0)
+				continue;
+			u32 thumbBit = (type == STT_FUNC) ? (sym.st_value & 1) : 0;
+			Elf32_Sym out{};
+			out.st_name = addString(strtab, name);
+			out.st_value = getSectionAddress(*section, sym.st_value & ~thumbBit) | thumbBit;
+			out.st_size = sym.st_size;
+			out.st_info = sym.st_info;
+			out.st_shndx = shndx;
+			symbols.push_back(out);
+		}
+	}
+
+	u32 firstGlobal = u32(symbols.size());
+
+	for (const Symbol& symbol : m_symbolStorage)
+	{
+		Elf32_Sym out{};
+		switch (symbol.kind)
+		{
+		case Symbol::Kind::Object:
+		{
+			const Elf32_Sym& sym = symbol.file->elf->getSymbols()[symbol.symIdx];
+			if (sym.st_shndx == SHN_ABS)
+			{
+				out.st_value = sym.st_value;
+				out.st_shndx = SHN_ABS;
+			}
+			else
+			{
+				const InputSection* section = symbol.file->sections[sym.st_shndx].get();
+				out.st_shndx = outputOf(section);
+				if (out.st_shndx == 0)
+					continue;
+				u32 thumbBit = (ELF32_ST_TYPE(sym.st_info) == STT_FUNC) ? (sym.st_value & 1) : 0;
+				out.st_value = getSectionAddress(*section, sym.st_value & ~thumbBit) | thumbBit;
+			}
+			out.st_size = sym.st_size;
+			out.st_info = sym.st_info;
+			break;
+		}
+		case Symbol::Kind::Absolute:
+			if (symbol.provide && !symbol.referenced)
+				continue;
+			out.st_value = symbol.value;
+			out.st_shndx = SHN_ABS;
+			out.st_info = ELF32_ST_INFO(STB_GLOBAL, STT_NOTYPE);
+			break;
+		case Symbol::Kind::Script:
+			if (!m_outputKept[symbol.output])
+				continue;
+			out.st_value = symbol.value;
+			out.st_shndx = elfIndex[symbol.output];
+			out.st_info = ELF32_ST_INFO(STB_GLOBAL, STT_NOTYPE);
+			break;
+		default:
+			continue;
+		}
+		out.st_name = addString(strtab, symbol.name);
+		symbols.push_back(out);
+	}
+
+	u16 symtabIdx = u16(headers.size());
+	u16 strtabIdx = u16(symtabIdx + 1);
+	u16 shstrtabIdx = u16(symtabIdx + 2);
+
+	Elf32_Shdr symtabSh{};
+	symtabSh.sh_name = addString(shstrtab, ".symtab");
+	symtabSh.sh_type = SHT_SYMTAB;
+	symtabSh.sh_size = u32(symbols.size() * sizeof(Elf32_Sym));
+	symtabSh.sh_link = strtabIdx;
+	symtabSh.sh_info = firstGlobal;
+	symtabSh.sh_addralign = 4;
+	symtabSh.sh_entsize = sizeof(Elf32_Sym);
+	headers.push_back(symtabSh);
+
+	Elf32_Shdr strtabSh{};
+	strtabSh.sh_name = addString(shstrtab, ".strtab");
+	strtabSh.sh_type = SHT_STRTAB;
+	strtabSh.sh_size = u32(strtab.size());
+	strtabSh.sh_addralign = 1;
+	headers.push_back(strtabSh);
+
+	Elf32_Shdr shstrtabSh{};
+	shstrtabSh.sh_name = addString(shstrtab, ".shstrtab");
+	shstrtabSh.sh_type = SHT_STRTAB;
+	shstrtabSh.sh_addralign = 1;
+	headers.push_back(shstrtabSh);
+	headers.back().sh_size = u32(shstrtab.size());
+
+	// Lay out the file: header, section contents, tables, section headers
+	std::vector<u8> image(sizeof(Elf32_Ehdr));
+	auto append = [&](const void* data, std::size_t size){
+		std::size_t offset = alignUp(u32(image.size()), 4);
+		image.resize(offset + size);
+		if (size != 0)
+			std::memcpy(&image[offset], data, size);
+		return u32(offset);
+	};
+
+	for (std::size_t outIdx = 0; outIdx < count; outIdx++)
+	{
+		if (elfIndex[outIdx] == 0)
+			continue;
+		Elf32_Shdr& sh = headers[elfIndex[outIdx]];
+		sh.sh_offset = m_outputIsBss[outIdx] ?
+			alignUp(u32(image.size()), 4) :
+			append(m_outputData[outIdx].data(), m_outputData[outIdx].size());
+	}
+	headers[symtabIdx].sh_offset = append(symbols.data(), symbols.size() * sizeof(Elf32_Sym));
+	headers[strtabIdx].sh_offset = append(strtab.data(), strtab.size());
+	headers[shstrtabIdx].sh_offset = append(shstrtab.data(), shstrtab.size());
+	u32 shoff = append(headers.data(), headers.size() * sizeof(Elf32_Shdr));
+
+	Elf32_Ehdr eh{};
+	eh.e_ident[EI_MAG0] = ELFMAG0;
+	eh.e_ident[EI_MAG1] = ELFMAG1;
+	eh.e_ident[EI_MAG2] = ELFMAG2;
+	eh.e_ident[EI_MAG3] = ELFMAG3;
+	eh.e_ident[EI_CLASS] = ELFCLASS32;
+	eh.e_ident[EI_DATA] = ELFDATA2LSB;
+	eh.e_ident[EI_VERSION] = EV_CURRENT;
+	eh.e_type = ET_EXEC;
+	eh.e_machine = EM_ARM;
+	eh.e_version = EV_CURRENT;
+	eh.e_flags = EF_ARM_EABI_VER5;
+	eh.e_ehsize = sizeof(Elf32_Ehdr);
+	eh.e_shoff = shoff;
+	eh.e_shentsize = sizeof(Elf32_Shdr);
+	eh.e_shnum = u16(headers.size());
+	eh.e_shstrndx = shstrtabIdx;
+	if (auto it = m_symbols.find("_start"); it != m_symbols.end() && it->second->kind == Symbol::Kind::Object)
+	{
+		for (const Elf32_Sym& sym : symbols)
+		{
+			if (std::string_view(&strtab[sym.st_name]) == "_start")
+				eh.e_entry = sym.st_value;
+		}
+	}
+	std::memcpy(image.data(), &eh, sizeof(Elf32_Ehdr));
+
+	return image;
+}
+
+std::size_t InternalLinker::compare(const Elf32& internal, const Elf32& reference, std::size_t maxReported, std::ostream& log)
+{
+	std::size_t differences = 0;
+	auto report = [&](const std::string& msg){
+		if (differences++ < maxReported)
+			log << OWARN << msg << std::endl;
+	};
+
+	auto isLinked = [](const Elf32_Shdr& sh){
+		return (sh.sh_flags & SHF_ALLOC) != 0 && sh.sh_size != 0;
+	};
+
+	auto hex = [](u32 value){
+		std::ostringstream oss;
+		oss << "0x" << std::hex << std::uppercase << value;
+		return oss.str();
+	};
+
+	ElfRange<Elf32_Shdr> refSections = reference.getSections();
+
+	internal.forEachSection([&](std::size_t, const Elf32_Shdr& sh, std::string_view name){
+		if (!isLinked(sh))
+			return false;
+		int refIdx = reference.findSection(name);
+		if (refIdx == -1 || !isLinked(refSections[refIdx]))
+		{
+			report("Section " + std::string(name) + " is missing from the reference.");
+			return false;
+		}
+		const Elf32_Shdr& ref = refSections[refIdx];
+		if (sh.sh_addr != ref.sh_addr || sh.sh_size != ref.sh_size)
+		{
+			report("Section " + std::string(name) + " is at " + hex(sh.sh_addr) + " with size " + hex(sh.sh_size) +
+				", the reference is at " + hex(ref.sh_addr) + " with size " + hex(ref.sh_size) + ".");
+			return false;
+		}
+		if (sh.sh_type != SHT_NOBITS && ref.sh_type != SHT_NOBITS)
+		{
+			const u8* a = internal.getSection<u8>(sh);
+			const u8* b = reference.getSection<u8>(ref);
+			for (u32 i = 0; i < sh.sh_size; i++)
+			{
+				if (a[i] != b[i])
+				{
+					report("Section " + std::string(name) + " differs from the reference at " + hex(sh.sh_addr + i) + ".");
+					break;
+				}
+			}
+		}
+		return false;
+	});
+
+	reference.forEachSection([&](std::size_t, const Elf32_Shdr& sh, std::string_view name){
+		if (isLinked(sh) && internal.findSection(name) == -1)
+			report("Section " + std::string(name) + " is missing from the internal linker output.");
+		return false;
+	});
+
+	internal.forEachSymbol([&](const Elf32_Sym& sym, std::string_view name){
+		if (ELF32_ST_BIND(sym.st_info) == STB_LOCAL || sym.st_shndx == SHN_UNDEF || name.empty())
+			return false;
+		const Elf32_Sym* ref = reference.findSymbol(name);
+		if (ref == nullptr)
+			report("Symbol " + std::string(name) + " is missing from the reference.");
+		else if (ref->st_value != sym.st_value)
+			report("Symbol " + std::string(name) + " is " + hex(sym.st_value) + ", the reference has " + hex(ref->st_value) + ".");
+		return false;
+	});
+
+	return differences;
+}
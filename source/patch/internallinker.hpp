@@ -0,0 +1,105 @@
+#pragma once
+
+#include <deque>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <filesystem>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "../types.hpp"
+
+class Elf32;
+struct LinkLayout;
+
+/*
+ * In-process linker for the subset of ARM ELF that NCPatcher links.
+ *
+ * It reads the same LinkLayout that is rendered into the GNU ld script:
+ * resolves the symbols, pulls the needed members out of the libraries,
+ * removes the unreferenced sections like --gc-sections, merges the
+ * mergeable constants, places the sections and applies the ARM and Thumb
+ * relocations, producing an ELF image with the output sections and symbols.
+ *
+ * Branches that would need a veneer (interworking without BLX or out of range)
+ * are not generated, they are reported as errors instead.
+ * */
+class InternalLinker
+{
+public:
+	struct Options
+	{
+		bool allowBlx = false; // BL and BLX may be swapped to switch the instruction set (ARMv5T and later)
+		std::vector<std::string> wholeArchives; // every member is linked, like --whole-archive
+		std::vector<std::string> libraries; // linked in order, like -l
+		std::vector<std::string> groupLibraries; // searched until nothing changes, like --start-group
+		std::vector<std::filesystem::path> searchDirs;
+		std::ostream* log = nullptr; // where the undefined references are reported, Log::out if not set
+	};
+
+	InternalLinker();
+	~InternalLinker();
+
+	/**
+	 * @brief Links the inputs of the layout in memory.
+	 *
+	 * @return The linked ELF image, throws if the link failed.
+	 */
+	std::vector<u8> link(const LinkLayout& layout, const Options& options);
+
+	/**
+	 * @brief Compares the output of the internal linker with the one of another linker,
+	 * the addresses, sizes and contents of the output sections and the values of the global symbols.
+	 *
+	 * @return The amount of differences found, up to maxReported of them are logged.
+	 */
+	static std::size_t compare(const Elf32& internal, const Elf32& reference, std::size_t maxReported, std::ostream& log);
+
+private:
+	struct InputFile;
+	struct InputSection;
+	struct Archive;
+	struct Symbol;
+	struct MergeGroup;
+
+	const LinkLayout* m_layout;
+	const Options* m_options;
+	std::vector<std::unique_ptr<InputFile>> m_files;
+	std::vector<InputFile*> m_walkOrder; // the objects, then the members of every archive in archive order
+	std::vector<std::unique_ptr<Archive>> m_archives;
+	std::deque<std::string> m_nameStorage;
+	std::deque<Symbol> m_symbolStorage;
+	std::unordered_map<std::string_view, Symbol*> m_symbols;
+	std::unordered_set<std::string_view> m_comdatGroups;
+	std::vector<std::unique_ptr<MergeGroup>> m_mergeGroups;
+	std::vector<std::vector<std::vector<InputSection*>>> m_placed; // the input sections of every command of every output section
+	std::vector<u32> m_outputAddresses;
+	std::vector<u32> m_outputSizes;
+	std::vector<u32> m_outputAlignments;
+	std::vector<u32> m_outputFlags;
+	std::vector<bool> m_outputKept; // false for the output sections that were dropped for being empty
+	std::vector<bool> m_outputIsBss;
+	std::vector<std::vector<u8>> m_outputData;
+
+	Symbol& getSymbol(std::string_view name);
+
+	void loadSymbolsFile(const std::filesystem::path& path);
+	void addObject(std::unique_ptr<Elf32> elf, std::string name, const Archive* archive, u32 memberOffset);
+	void addArchive(const std::string& path, bool whole);
+	void addArchiveMember(Archive& archive, u32 offset);
+	bool loadArchiveMembers(Archive& archive);
+	std::filesystem::path findLibrary(const std::string& name) const;
+
+	void assignSections();
+	void collectGarbage();
+	void mergeSections();
+	void placeSections();
+	void applyRelocations();
+	std::vector<u8> writeImage() const;
+
+	u32 getSectionAddress(const InputSection& section, u32 offset) const;
+	bool resolveSymbol(const InputSection& from, u32 symIdx, s32 addend, u32& value, bool& isThumb, bool& isUndefWeak) const;
+};
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <map>
+#include <vector>
+#include <algorithm>
+
+#include "../types.hpp"
+
+/*
+ * Static interval tree over half-open address ranges [start, end),
+ * with a separate tree for every destination (-1 arm, >= 0 overlay).
+ *
+ * Intervals are inserted first and build() sorts them, queries are only
+ * valid after that. Empty intervals are ignored, they can not overlap anything.
+ * */
+template<typename T>
+class IntervalTree
+{
+public:
+	struct Interval
+	{
+		u32 start;
+		u32 end;
+		T value;
+	};
+
+	void insert(int dest, u32 start, u32 end, const T& value)
+	{
+		if (end <= start)
+			return;
+		m_trees[dest].intervals.push_back(Interval{ start, end, value });
+		m_isBuilt = false;
+	}
+
+	void build()
+	{
+		for (auto& [dest, tree] : m_trees)
+		{
+			std::vector<Interval>& iv = tree.intervals;
+			// Stable, so that intervals with the same start keep their insertion order
+			std::stable_sort(iv.begin(), iv.end(), [](const Interval& a, const Interval& b){
+				return a.start < b.start;
+			});
+			tree.maxEnd.resize(iv.size());
+			buildMaxEnd(tree, 0, iv.size());
+		}
+		m_isBuilt = true;
+	}
+
+	/**
+	 * @brief Calls cb(a, b) once for every pair of overlapping intervals of the same destination.
+	 * Runs in O(n + k) after build(), k being the amount of reported pairs.
+	 */
+	template<typename F>
+	void forEachOverlap(F&& cb) const
+	{
+		for (const auto& [dest, tree] : m_trees)
+		{
+			const std::vector<Interval>& iv = tree.intervals;
+			// Sorted by start, so every following interval starting before this one ends overlaps it
+			for (std::size_t i = 0; i < iv.size(); i++)
+			{
+				for (std::size_t j = i + 1; j < iv.size() && iv[j].start < iv[i].end; j++)
+					cb(iv[i], iv[j]);
+			}
+		}
+	}
+
+	/**
+	 * @brief Calls cb(interval) for every interval of dest overlapping [start, end).
+	 * Runs in O(log n + k) after build(), k being the amount of reported intervals.
+	 */
+	template<typename F>
+	void forEachOverlapping(int dest, u32 start, u32 end, F&& cb) const
+	{
+		if (end <= start)
+			return;
+		auto it = m_trees.find(dest);
+		if (it == m_trees.end())
+			return;
+		query(it->second, 0, it->second.intervals.size(), start, end, cb);
+	}
+
+	[[nodiscard]] constexpr bool isBuilt() const { return m_isBuilt; }
+
+private:
+	struct Tree
+	{
+		std::vector<Interval> intervals;
+		std::vector<u32> maxEnd; // the max end in the subtree rooted at each middle index
+	};
+
+	std::map<int, Tree> m_trees;
+	bool m_isBuilt = true;
+
+	static u32 buildMaxEnd(Tree& tree, std::size_t lo, std::size_t hi)
+	{
+		if (lo >= hi)
+			return 0;
+		std::size_t mid = lo + (hi - lo) / 2;
+		u32 maxEnd = tree.intervals[mid].end;
+		maxEnd = std::max(maxEnd, buildMaxEnd(tree, lo, mid));
+		maxEnd = std::max(maxEnd, buildMaxEnd(tree, mid + 1, hi));
+		tree.maxEnd[mid] = maxEnd;
+		return maxEnd;
+	}
+
+	template<typename F>
+	static void query(const Tree& tree, std::size_t lo, std::size_t hi, u32 start, u32 end, F& cb)
+	{
+		if (lo >= hi)
+			return;
+		std::size_t mid = lo + (hi - lo) / 2;
+		if (tree.maxEnd[mid] <= start)
+			return;
+
+		query(tree, lo, mid, start, end, cb);
+
+		const Interval& interval = tree.intervals[mid];
+		if (interval.start >= end)
+			return; // everything to the right starts even later
+		if (interval.end > start)
+			cb(interval);
+
+		query(tree, mid + 1, hi, start, end, cb);
+	}
+};
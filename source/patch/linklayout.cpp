@@ -0,0 +1,206 @@
+#include "linklayout.hpp"
+
+#include "../util.hpp"
+
+LinkLayout::Command LinkLayout::Command::align(u32 alignment)
+{
+	Command cmd;
+	cmd.type = CommandType::Align;
+	cmd.value = alignment;
+	return cmd;
+}
+
+LinkLayout::Command LinkLayout::Command::symbolHere(std::string symbol)
+{
+	Command cmd;
+	cmd.type = CommandType::Symbol;
+	cmd.symbol = std::move(symbol);
+	return cmd;
+}
+
+LinkLayout::Command LinkLayout::Command::input(std::string file, std::string section, bool keep)
+{
+	Command cmd;
+	cmd.type = CommandType::Input;
+	cmd.file = std::move(file);
+	cmd.section = std::move(section);
+	cmd.keep = keep;
+	return cmd;
+}
+
+LinkLayout::Command LinkLayout::Command::reserve(std::string symbol, u32 size)
+{
+	Command cmd;
+	cmd.type = CommandType::Reserve;
+	cmd.symbol = std::move(symbol);
+	cmd.value = size;
+	return cmd;
+}
+
+LinkLayout::OutputSection& LinkLayout::addSection(std::string name, std::string memory, bool align4)
+{
+	OutputSection& section = sections.emplace_back();
+	section.name = std::move(name);
+	section.memory = std::move(memory);
+	section.align4 = align4;
+	return section;
+}
+
+std::string LinkLayout::toLinkerScript() const
+{
+	std::string o;
+	o.reserve(65536);
+
+	o += "/* NCPatcher: Auto-generated linker script */\n\n";
+
+	if (!symbolsFile.empty())
+	{
+		o += "INCLUDE \"";
+		o += symbolsFile;
+		o += "\"\n\n";
+	}
+
+	if (!importsFile.empty())
+	{
+		o += "INCLUDE \"";
+		o += importsFile;
+		o += "\"\n\n";
+	}
+
+	o += "INPUT (\n";
+	for (const std::string& input : inputs)
+	{
+		o += "\t\"";
+		o += input;
+		o += "\"\n";
+	}
+
+	o += ")\n\nOUTPUT (\"";
+	o += output;
+	o += "\")\n\nMEMORY {\n";
+
+	for (const Memory& memory : memories)
+	{
+		o += '\t';
+		o += memory.name;
+		o += " (rwx): ORIGIN = ";
+		o += Util::intToAddr(int(memory.origin), 8);
+		o += ", LENGTH = ";
+		o += Util::intToAddr(int(memory.length), 8);
+		o += '\n';
+	}
+
+	o += "}\n\nSECTIONS {\n";
+
+	for (const OutputSection& section : sections)
+	{
+		o += '\t';
+		o += section.name;
+		if (section.isPinned)
+		{
+			o += ' ';
+			o += Util::intToAddr(int(section.address), 8);
+		}
+		o += section.align4 ? " : ALIGN(4) {\n" : " : {\n";
+
+		for (const Command& cmd : section.commands)
+		{
+			o += "\t\t";
+			switch (cmd.type)
+			{
+			case CommandType::Align:
+				o += ". = ALIGN(";
+				o += std::to_string(cmd.value);
+				o += ");\n";
+				break;
+			case CommandType::Symbol:
+				o += cmd.symbol;
+				o += " = .;\n";
+				break;
+			case CommandType::Input:
+				if (cmd.keep)
+					o += "KEEP(";
+				if (cmd.file == "*")
+				{
+					o += '*';
+				}
+				else
+				{
+					o += '\"';
+					o += cmd.file;
+					o += '\"';
+				}
+				o += " (";
+				o += cmd.section;
+				o += cmd.keep ? "))\n" : ")\n";
+				break;
+			case CommandType::Reserve:
+				o += cmd.symbol;
+				o += " = .;\n\t\tFILL(0)\n\t\t. = ";
+				o += cmd.symbol;
+				o += " + ";
+				o += std::to_string(cmd.value);
+				o += ";\n";
+				break;
+			}
+		}
+
+		o += "\t} > ";
+		o += section.memory;
+		if (!loadMemory.empty())
+		{
+			o += " AT > ";
+			o += loadMemory;
+		}
+		o += "\n\n";
+	}
+
+	o += "\t/DISCARD/ : {*(.*)}\n"
+		 "}\n";
+
+	if (!externs.empty())
+	{
+		o += "\nEXTERN (\n";
+		for (const std::string& e : externs)
+		{
+			o += '\t';
+			o += e;
+			o += '\n';
+		}
+		o += ")\n";
+	}
+
+	return o;
+}
+
+bool LinkLayout::matchPattern(std::string_view pattern, std::string_view name)
+{
+	// Iterative glob, backtracking to the last * on a mismatch
+	std::size_t p = 0, n = 0;
+	std::size_t starP = std::string_view::npos, starN = 0;
+	while (n < name.length())
+	{
+		if (p < pattern.length() && (pattern[p] == '?' || pattern[p] == name[n]))
+		{
+			p++;
+			n++;
+		}
+		else if (p < pattern.length() && pattern[p] == '*')
+		{
+			starP = p++;
+			starN = n;
+		}
+		else if (starP != std::string_view::npos)
+		{
+			p = starP + 1;
+			n = ++starN;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	while (p < pattern.length() && pattern[p] == '*')
+		p++;
+	return p == pattern.length();
+}
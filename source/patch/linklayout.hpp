@@ -0,0 +1,76 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../types.hpp"
+
+/*
+ * The layout of a link: the memory regions and the output sections,
+ * with the input sections that they collect in placement order.
+ *
+ * It is rendered into the GNU ld linker script and read directly by the
+ * internal linker, so that both of them place every section the same way.
+ * Input sections that no output section collects are discarded.
+ * */
+struct LinkLayout
+{
+	struct Memory
+	{
+		std::string name;
+		u32 origin;
+		u32 length;
+	};
+
+	enum class CommandType
+	{
+		Align,   // . = ALIGN(value);
+		Symbol,  // symbol = .;
+		Input,   // file (section), inside of KEEP() if keep is set
+		Reserve  // symbol = .; FILL(0) . = symbol + value;
+	};
+
+	struct Command
+	{
+		CommandType type;
+		u32 value = 0;
+		std::string symbol;
+		std::string file; // "*" for every file, an object path, "archive:" for every member of an archive or "archive:member"
+		std::string section; // the section name, can have * and ? wildcards
+		bool keep = false;
+
+		static Command align(u32 alignment);
+		static Command symbolHere(std::string symbol);
+		static Command input(std::string file, std::string section, bool keep = false);
+		static Command reserve(std::string symbol, u32 size);
+	};
+
+	struct OutputSection
+	{
+		std::string name;
+		std::string memory;
+		bool align4; // ALIGN(4) on the output section
+		bool isPinned = false; // starts at address instead of the location counter of its memory
+		u32 address = 0;
+		std::vector<Command> commands;
+	};
+
+	std::string symbolsFile; // included before everything else, empty if none
+	std::string importsFile; // the PROVIDE assignments of the symbols of other link units, empty if none
+	std::vector<std::string> inputs;
+	std::string output;
+	std::vector<Memory> memories;
+	std::vector<OutputSection> sections;
+	std::vector<std::string> externs; // kept even if unreferenced
+	std::string loadMemory; // the memory that every section is loaded at (AT >)
+
+	OutputSection& addSection(std::string name, std::string memory, bool align4);
+
+	std::string toLinkerScript() const;
+
+	/**
+	 * @brief Matches a name against a linker script wildcard pattern, supporting * and ?.
+	 */
+	static bool matchPattern(std::string_view pattern, std::string_view name);
+};
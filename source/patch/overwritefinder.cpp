@@ -0,0 +1,115 @@
+#include "overwritefinder.hpp"
+
+#include <algorithm>
+#include <cctype>
+
+#include "../mappedfile.hpp"
+#include "../except.hpp"
+
+namespace fs = std::filesystem;
+
+// Larger gaps between symbols are more likely to hide unnamed code than to be a single function
+static constexpr u32 MaxFunctionSize = 0x4000;
+
+static std::string_view trim(std::string_view str)
+{
+	while (!str.empty() && std::isspace(static_cast<unsigned char>(str.front())))
+		str.remove_prefix(1);
+	while (!str.empty() && std::isspace(static_cast<unsigned char>(str.back())))
+		str.remove_suffix(1);
+	return str;
+}
+
+void OverwriteFinder::loadSymbols(const fs::path& path)
+{
+	MappedFile file;
+	if (!file.open(path))
+		throw ncp::file_error(path, ncp::file_error::read);
+
+	// Without the comments, they can hold anything
+	std::string text;
+	text.reserve(file.size());
+	const char* data = reinterpret_cast<const char*>(file.data());
+	for (std::size_t i = 0; i < file.size(); i++)
+	{
+		if (data[i] == '/' && i + 1 < file.size() && data[i + 1] == '*')
+		{
+			std::size_t end = std::string_view(data, file.size()).find("*/", i + 2);
+			i = end == std::string_view::npos ? file.size() : end + 1;
+			continue;
+		}
+		text += data[i];
+	}
+
+	std::size_t start = 0;
+	while (start < text.length())
+	{
+		std::size_t end = text.find(';', start);
+		if (end == std::string::npos)
+			end = text.length();
+		std::string_view assignment = trim(std::string_view(text).substr(start, end - start));
+		start = end + 1;
+
+		if (assignment.starts_with("PROVIDE"))
+		{
+			std::size_t open = assignment.find('(');
+			std::size_t close = assignment.rfind(')');
+			if (open == std::string_view::npos || close == std::string_view::npos || close < open)
+				continue;
+			assignment = assignment.substr(open + 1, close - open - 1);
+		}
+
+		std::size_t eq = assignment.find('=');
+		if (eq == std::string_view::npos)
+			continue;
+		std::string_view name = trim(assignment.substr(0, eq));
+		std::string value(trim(assignment.substr(eq + 1)));
+		if (name.empty() || value.empty() || !std::isdigit(static_cast<unsigned char>(value[0])))
+			continue;
+
+		u32 address;
+		try {
+			std::size_t parsed = 0;
+			address = u32(std::stoul(value, &parsed, 0));
+			if (parsed != value.length())
+				continue;
+		} catch (std::exception&) {
+			continue;
+		}
+
+		m_symbols.emplace(name, address);
+		m_addresses.push_back(address & ~1);
+	}
+
+	std::sort(m_addresses.begin(), m_addresses.end());
+	m_addresses.erase(std::unique(m_addresses.begin(), m_addresses.end()), m_addresses.end());
+}
+
+bool OverwriteFinder::findFunction(std::string_view name, u32& startAddress, u32& endAddress) const
+{
+	auto it = m_symbols.find(std::string(name));
+	if (it == m_symbols.end())
+		return false;
+	startAddress = it->second & ~1;
+	return findFunctionAt(startAddress, endAddress);
+}
+
+bool OverwriteFinder::findSymbol(std::string_view name, u32& address) const
+{
+	auto it = m_symbols.find(std::string(name));
+	if (it == m_symbols.end())
+		return false;
+	address = it->second & ~1;
+	return true;
+}
+
+bool OverwriteFinder::findFunctionAt(u32 address, u32& endAddress) const
+{
+	if (!std::binary_search(m_addresses.begin(), m_addresses.end(), address))
+		return false;
+	auto it = std::upper_bound(m_addresses.begin(), m_addresses.end(), address);
+	if (it == m_addresses.end() || *it - address > MaxFunctionSize)
+		return false;
+	endAddress = *it;
+	return true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <filesystem>
+#include <unordered_map>
+
+#include "../types.hpp"
+
+/*
+ * Finds the extents of the functions of the symbols file, so that the ones
+ * that are never executed can be reclaimed as overwrite regions.
+ *
+ * The symbols file only holds addresses, a function is assumed to end
+ * where the next symbol starts. Overlays share addresses, so the next symbol
+ * can be one of another overlay, that only makes the function smaller.
+ * */
+class OverwriteFinder
+{
+public:
+	/**
+	 * @brief Reads the numeric assignments of a linker symbols file, expressions are skipped.
+	 */
+	void loadSymbols(const std::filesystem::path& path);
+
+	/**
+	 * @brief Gets the address range of a function, without the THUMB bit.
+	 *
+	 * @return false if the symbol does not exist, has no symbol after it
+	 * or its range is too large to be a single function.
+	 */
+	bool findFunction(std::string_view name, u32& startAddress, u32& endAddress) const;
+
+	/**
+	 * @brief Gets the address of a symbol, without the THUMB bit.
+	 */
+	bool findSymbol(std::string_view name, u32& address) const;
+
+	/**
+	 * @brief Gets the end of the function that a symbol starts at the address, without the THUMB bit.
+	 */
+	bool findFunctionAt(u32 address, u32& endAddress) const;
+
+private:
+	std::unordered_map<std::string, u32> m_symbols;
+	std::vector<u32> m_addresses; // sorted and unique, without the THUMB bit
+};
@@ -0,0 +1,323 @@
+#include "overwritepacker.hpp"
+
+#include <algorithm>
+
+namespace OverwritePacker {
+
+// Instances up to this amount of items are searched exhaustively
+static constexpr std::size_t ExactMaxItems = 24;
+
+// The work that the searches may do, in place of a time budget so that the result is deterministic
+static constexpr u64 ExactNodeBudget = 500000;
+static constexpr u64 SearchLayoutBudget = 200000;
+
+struct Hole
+{
+	u64 start;
+	u64 end;
+};
+
+struct BinLayout
+{
+	bool fits;
+	u64 start;
+	u64 end;
+};
+
+static u64 alignUp(u64 value, u32 alignment)
+{
+	return (value + alignment - 1) & ~u64(alignment - 1);
+}
+
+class Packer
+{
+public:
+	Packer(const std::vector<Item>& items, const std::vector<Bin>& bins) :
+		m_items(items), m_bins(bins), m_members(bins.size()), m_binOf(items.size(), -1)
+	{
+		m_order.resize(items.size());
+		for (std::size_t i = 0; i < items.size(); i++)
+			m_order[i] = i;
+		std::sort(m_order.begin(), m_order.end(), [&](std::size_t a, std::size_t b){
+			if (items[a].size != items[b].size)
+				return items[a].size > items[b].size;
+			if (items[a].alignment != items[b].alignment)
+				return items[a].alignment > items[b].alignment;
+			return a < b;
+		});
+
+		m_remaining.resize(items.size() + 1);
+		for (std::size_t k = items.size(); k-- > 0;)
+			m_remaining[k] = m_remaining[k + 1] + items[m_order[k]].size;
+		m_totalSize = m_remaining[0];
+	}
+
+	Result run()
+	{
+		packBestFit();
+		improveBySearch();
+		saveBest();
+
+		bool isOptimal = m_bestSize == m_totalSize;
+		if (!isOptimal && m_items.size() <= ExactMaxItems)
+		{
+			for (auto& members : m_members)
+				members.clear();
+			std::fill(m_binOf.begin(), m_binOf.end(), -1);
+			m_placedSize = 0;
+
+			searchExact(0);
+			isOptimal = !m_isExhausted;
+		}
+
+		Result result;
+		result.placements.resize(m_items.size());
+		result.binStarts.resize(m_bins.size());
+		result.binEnds.resize(m_bins.size());
+		result.isOptimal = isOptimal;
+
+		std::vector<std::vector<std::size_t>> members(m_bins.size());
+		for (std::size_t i = 0; i < m_items.size(); i++)
+		{
+			if (m_bestBinOf[i] != -1)
+				members[m_bestBinOf[i]].push_back(i);
+		}
+
+		std::vector<u32> addresses(m_items.size());
+		for (std::size_t b = 0; b < m_bins.size(); b++)
+		{
+			BinLayout layout = layoutBin(b, members[b], &addresses);
+			result.binStarts[b] = u32(layout.start);
+			result.binEnds[b] = u32(layout.end);
+			for (std::size_t i : members[b])
+				result.placements[i] = Placement{ int(b), addresses[i] };
+		}
+
+		return result;
+	}
+
+private:
+	const std::vector<Item>& m_items;
+	const std::vector<Bin>& m_bins;
+	std::vector<std::vector<std::size_t>> m_members; // the items of every bin
+	std::vector<int> m_binOf;
+	std::vector<std::size_t> m_order; // the items by decreasing size
+	std::vector<u64> m_remaining; // the size of the items from an index of m_order onwards
+	u64 m_totalSize;
+	u64 m_placedSize = 0;
+	std::vector<int> m_bestBinOf;
+	u64 m_bestSize = 0;
+	u64 m_layoutCount = 0;
+	u64 m_nodeCount = 0;
+	bool m_isExhausted = false;
+
+	/*
+	 * Lays the items out by decreasing alignment, every item goes into the
+	 * smallest padding hole that it fits in, or after the last one.
+	 * The bin starts aligned for its most aligned item, like a linker aligns
+	 * an output section for its input sections.
+	 * */
+	BinLayout layoutBin(std::size_t bin, const std::vector<std::size_t>& members, std::vector<u32>* addresses)
+	{
+		m_layoutCount++;
+
+		std::vector<std::size_t> order = members;
+		std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b){
+			if (m_items[a].alignment != m_items[b].alignment)
+				return m_items[a].alignment > m_items[b].alignment;
+			if (m_items[a].size != m_items[b].size)
+				return m_items[a].size > m_items[b].size;
+			return a < b;
+		});
+
+		u32 maxAlignment = order.empty() ? 1 : m_items[order[0]].alignment;
+		u64 start = alignUp(m_bins[bin].start, maxAlignment);
+		u64 end = start;
+
+		std::vector<Hole> holes;
+		for (std::size_t idx : order)
+		{
+			const Item& item = m_items[idx];
+
+			std::size_t bestHole = holes.size();
+			u64 bestSpare = 0;
+			for (std::size_t h = 0; h < holes.size(); h++)
+			{
+				u64 address = alignUp(holes[h].start, item.alignment);
+				if (address + item.size > holes[h].end)
+					continue;
+				u64 spare = holes[h].end - holes[h].start - item.size;
+				if (bestHole == holes.size() || spare < bestSpare)
+				{
+					bestHole = h;
+					bestSpare = spare;
+				}
+			}
+
+			u64 address;
+			if (bestHole != holes.size())
+			{
+				Hole hole = holes[bestHole];
+				address = alignUp(hole.start, item.alignment);
+				holes.erase(holes.begin() + std::ptrdiff_t(bestHole));
+				if (address > hole.start)
+					holes.push_back(Hole{ hole.start, address });
+				if (address + item.size < hole.end)
+					holes.push_back(Hole{ address + item.size, hole.end });
+			}
+			else
+			{
+				address = alignUp(end, item.alignment);
+				if (address > end)
+					holes.push_back(Hole{ end, address });
+				end = address + item.size;
+			}
+
+			if (addresses != nullptr)
+				(*addresses)[idx] = u32(address);
+		}
+
+		return BinLayout{ end <= m_bins[bin].end, start, end };
+	}
+
+	void place(std::size_t idx, std::size_t bin)
+	{
+		m_members[bin].push_back(idx);
+		m_binOf[idx] = int(bin);
+		m_placedSize += m_items[idx].size;
+	}
+
+	void unplace(std::size_t idx)
+	{
+		auto& members = m_members[m_binOf[idx]];
+		members.erase(std::find(members.begin(), members.end(), idx));
+		m_binOf[idx] = -1;
+		m_placedSize -= m_items[idx].size;
+	}
+
+	// Places the item in the bin that it leaves the least space in, the first one on ties
+	bool placeBestFit(std::size_t idx)
+	{
+		std::size_t bestBin = m_bins.size();
+		u64 bestSlack = 0;
+		for (std::size_t b = 0; b < m_bins.size(); b++)
+		{
+			m_members[b].push_back(idx);
+			BinLayout layout = layoutBin(b, m_members[b], nullptr);
+			m_members[b].pop_back();
+			if (!layout.fits)
+				continue;
+			u64 slack = m_bins[b].end - layout.end;
+			if (bestBin == m_bins.size() || slack < bestSlack)
+			{
+				bestBin = b;
+				bestSlack = slack;
+			}
+		}
+		if (bestBin == m_bins.size())
+			return false;
+		place(idx, bestBin);
+		return true;
+	}
+
+	void packBestFit()
+	{
+		for (std::size_t idx : m_order)
+			placeBestFit(idx);
+	}
+
+	/*
+	 * Tries to place every item that was left out, swapping out a smaller
+	 * item of a bin when that makes room for it and moving the smaller
+	 * one to another bin if possible. Every accepted move places more bytes.
+	 * */
+	void improveBySearch()
+	{
+		for (bool improved = true; improved && m_layoutCount < SearchLayoutBudget;)
+		{
+			improved = false;
+			for (std::size_t u : m_order)
+			{
+				if (m_binOf[u] != -1)
+					continue;
+				if (m_layoutCount >= SearchLayoutBudget)
+					return;
+
+				if (placeBestFit(u))
+				{
+					improved = true;
+					continue;
+				}
+
+				bool swapped = false;
+				for (std::size_t b = 0; b < m_bins.size() && !swapped; b++)
+				{
+					std::vector<std::size_t> members = m_members[b];
+					for (std::size_t a : members)
+					{
+						if (m_items[a].size >= m_items[u].size)
+							continue;
+
+						std::vector<std::size_t> candidate = m_members[b];
+						candidate.erase(std::find(candidate.begin(), candidate.end(), a));
+						candidate.push_back(u);
+						if (!layoutBin(b, candidate, nullptr).fits)
+							continue;
+
+						unplace(a);
+						place(u, b);
+						placeBestFit(a);
+						swapped = true;
+						break;
+					}
+				}
+				improved |= swapped;
+			}
+		}
+	}
+
+	void saveBest()
+	{
+		m_bestBinOf = m_binOf;
+		m_bestSize = m_placedSize;
+	}
+
+	void searchExact(std::size_t k)
+	{
+		if (++m_nodeCount > ExactNodeBudget)
+		{
+			m_isExhausted = true;
+			return;
+		}
+		if (m_placedSize > m_bestSize)
+			saveBest();
+		if (k == m_order.size() || m_bestSize == m_totalSize || m_placedSize + m_remaining[k] <= m_bestSize)
+			return;
+
+		std::size_t idx = m_order[k];
+		for (std::size_t b = 0; b < m_bins.size(); b++)
+		{
+			m_members[b].push_back(idx);
+			bool fits = layoutBin(b, m_members[b], nullptr).fits;
+			m_members[b].pop_back();
+			if (!fits)
+				continue;
+
+			place(idx, b);
+			searchExact(k + 1);
+			unplace(idx);
+			if (m_isExhausted || m_bestSize == m_totalSize)
+				return;
+		}
+
+		// Left out, to the arena
+		searchExact(k + 1);
+	}
+};
+
+Result pack(const std::vector<Item>& items, const std::vector<Bin>& bins)
+{
+	return Packer(items, bins).run();
+}
+
+}
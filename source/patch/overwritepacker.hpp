@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+
+#include "../types.hpp"
+
+/*
+ * Packs sections into the overwrite regions of a destination, placing as
+ * many bytes as possible so that less code falls back into the arena.
+ *
+ * Small instances are solved exactly with a branch and bound search, larger
+ * ones with best fit decreasing improved by a local search. Both are bounded
+ * by an amount of work instead of by time, so the same input always packs the same way.
+ * */
+namespace OverwritePacker {
+
+struct Item
+{
+	u32 size;
+	u32 alignment; // a power of two
+};
+
+struct Bin
+{
+	u32 start;
+	u32 end;
+};
+
+struct Placement
+{
+	int bin = -1; // -1 if the item was not placed
+	u32 address = 0;
+};
+
+struct Result
+{
+	std::vector<Placement> placements; // one for every item
+	std::vector<u32> binStarts; // where the contents of every bin start, after aligning for its items
+	std::vector<u32> binEnds; // where the contents of every bin end
+	bool isOptimal; // if no packing could place more bytes
+};
+
+/**
+ * @brief Assigns the items to the bins and gives them their addresses.
+ *
+ * Inside of a bin the items are laid out in decreasing alignment, the smaller
+ * ones filling the padding left between the larger ones, so that placing
+ * them in address order with every item aligned reproduces the layout.
+ */
+Result pack(const std::vector<Item>& items, const std::vector<Bin>& bins);
+
+}
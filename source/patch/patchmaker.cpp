@@ -1,14 +1,27 @@
 #include "patchmaker.hpp"
 
+#include <chrono>
+#include <cstdint>
+#include <exception>
 #include <fstream>
-#include <functional>
 #include <iomanip>
+#include <map>
+#include <set>
 #include <sstream>
 #include <unordered_map>
 
+#include <BS_thread_pool.hpp>
+
 #include "arenalofinder.hpp"
+#include "intervaltree.hpp"
+#include "internallinker.hpp"
+#include "linklayout.hpp"
+#include "overwritepacker.hpp"
+#include "overwritefinder.hpp"
+#include "sectionorder.hpp"
 
 #include "../elf.hpp"
+#include "../mappedfile.hpp"
 
 #include "../main.hpp"
 #include "../log.hpp"
@@ -17,6 +30,7 @@
 #include "../config/rebuildconfig.hpp"
 #include "../util.hpp"
 #include "../process.hpp"
+#include "../build/timingrecorder.hpp"
 
 /*
  * TODO: Endianness checks
@@ -27,18 +41,59 @@
 namespace fs = std::filesystem;
 
 constexpr std::size_t SizeOfHookBridge = 20;
+constexpr std::size_t SizeOfLeanHookBridge = 20;
+constexpr std::size_t SizeOfSharedHookBridge = 16;
+constexpr std::size_t SizeOfHookStub = 20;
 constexpr std::size_t SizeOfArm2ThumbJumpBridge = 8;
+constexpr std::size_t SizeOfArm2ThumbJumpVeneer = 12; // LDR PC does not change the state on ARMv4
+constexpr std::size_t SizeOfThumb2ArmVeneer = 8;
+constexpr std::size_t SizeOfFarVeneer = 8; // for the branches into a TCM out of their range
+constexpr std::size_t SizeOfThumbHookBridgeHead = 24; // from the entry to the moved instructions
+constexpr std::size_t SizeOfThumbHookBridgeTail = 8; // from the moved instructions to the literals
+
+// The ARM946E-S instruction cache, the ordered call chains are kept within its size and aligned to its lines
+constexpr u32 Arm9ICacheSize = 0x2000;
+constexpr u32 Arm9CacheLineSize = 32;
+
+// The relocations of the branches, their targets are the edges of the call graph
+constexpr u32 relArmPC24 = 1; // R_ARM_PC24
+constexpr u32 relArmThmCall = 10; // R_ARM_THM_CALL
+constexpr u32 relArmCall = 28; // R_ARM_CALL
+constexpr u32 relArmJump24 = 29; // R_ARM_JUMP24
+constexpr u32 relArmThmJump24 = 30; // R_ARM_THM_JUMP24
+
+// From this amount of hooks into the same function, a shared stub saves space over separate bridges
+constexpr std::size_t MinSharedHookSites = 6;
+
+// The largest gap between over patches that still share a linker script memory,
+// ld slows down with the amount of memories and projects can have thousands of over patches
+constexpr u32 MaxOverPatchGap = 0x1000;
 
 constexpr u32 armOpcodeB = 0xEA000000; // B
 constexpr u32 armOpcodeBL = 0xEB000000; // BL
 constexpr u32 armOpCodeBLX = 0xFA000000; // BLX
 constexpr u32 armHookPush = 0xE92D500F; // PUSH {R0-R3,R12,LR}
 constexpr u32 armHookPop = 0xE8BD500F; // POP {R0-R3,R12,LR}
+constexpr u32 armLeanHookPush = 0xE92D5000; // PUSH {R12,LR}
+constexpr u32 armLeanHookPop = 0xE8BD5000; // POP {R12,LR}
+constexpr u32 armHookStubPush = 0xE92D580F; // PUSH {R0-R3,R11,R12,LR}
+constexpr u32 armHookStubPop = 0xE8BD580F; // POP {R0-R3,R11,R12,LR}
+constexpr u32 armPushLR = 0xE52DE004; // PUSH {LR}
+constexpr u32 armReloadArgs = 0xE89D000F; // LDMIA SP, {R0-R3}
+constexpr u32 armSwapLR = 0xE10DE09E; // SWP LR, LR, [SP]
+constexpr u32 armPopPC = 0xE49DF004; // POP {PC}
 constexpr u16 thumbOpCodeBL0 = 0xF000; // BL
 constexpr u16 thumbOpCodeBL1 = 0xF800; // <BL>
 constexpr u16 thumbOpCodeBLX1 = 0xE800; // <BL>X
 constexpr u16 thumbOpCodePushLR = 0xB500; // PUSH {LR}
 constexpr u16 thumbOpCodePopPC = 0xBD00; // POP {PC}
+constexpr u16 thumbOpCodeB = 0xE000; // B
+constexpr u16 thumbOpCodeBXPC = 0x4778; // BX PC
+constexpr u16 thumbOpCodeNop = 0x46C0; // MOV R8, R8
+constexpr u16 thumbOpCodeLdrPC = 0x4800; // LDR R0, [PC,#0]
+constexpr u32 armLdrR12 = 0xE59FC000; // LDR R12, [PC,#0]
+constexpr u32 armBXR12 = 0xE12FFF1C; // BX R12
+constexpr u32 armLdrPCNext = 0xE51FF004; // LDR PC, [PC,#-4]
 
 struct PatchType {
 	enum {
@@ -47,13 +102,14 @@ struct PatchType {
 		RtRepl,
 		TJump, TCall, THook,
 		SetTJump, SetTCall, SetTHook,
+		LHook,
 	};
 };
 
 struct GenericPatchInfo
 {
 	u32 srcAddress; // the address of the symbol (only fetched after linkage)
-	int srcAddressOv; // the overlay the address of the symbol (-1 arm, >= 0 overlay)
+	int srcAddressOv; // the overlay the address of the symbol (-1 arm, -2 itcm, -3 dtcm, >= 0 overlay)
 	u32 destAddress; // the address to be patched
 	int destAddressOv; // the overlay of the address to be patched
 	std::size_t patchType; // the patch type
@@ -62,8 +118,12 @@ struct GenericPatchInfo
 	bool isNcpSet; // if the patch is an ncp_set type patch
 	bool srcThumb; // if the function of the symbol is thumb
 	bool destThumb; // if the function to be patched is thumb
+	bool isLeanHook; // if the hook bridge only saves LR, leaving the other registers to the function
 	std::string symbol; // the symbol of the patch (used to generate linker script)
+	std::string targetKey; // the same for the label patches of the same function, empty if unknown
 	SourceFileJob* job;
+	const Elf32* elf = nullptr; // the linked ELF that sectionIdx refers to
+	std::string label; // the symbol that the linker script defines for a section patch
 };
 
 struct RtReplPatchInfo
@@ -85,30 +145,22 @@ struct NewcodePatch
 struct AutogenDataInfo
 {
 	u32 address;
-	u32 curAddress;
 	std::vector<u8> data;
 };
 
-struct LDSMemoryEntry
+struct LDSOverPatch
 {
-	std::string name;
-	u32 origin;
-	int length;
+	GenericPatchInfo* info;
+	std::string memName;
 };
 
+// What the linker script of a unit places in its region
 struct LDSRegionEntry
 {
-	int dest;
-	LDSMemoryEntry* memory;
-	const BuildTarget::Region* region;
-	std::size_t autogenDataSize;
+	std::string memName;
+	std::size_t autogenDataSize = 0;
 	std::vector<GenericPatchInfo*> sectionPatches;
-};
-
-struct LDSOverPatch
-{
-	GenericPatchInfo* info;
-	LDSMemoryEntry* memory;
+	std::vector<LDSOverPatch> overPatches;
 };
 
 struct SectionInfo
@@ -120,6 +172,23 @@ struct SectionInfo
 	u32 address = 0;
 	const u8* data = nullptr;
 	int destination = -1;
+	bool isBridge = false; // reserved by the linker script for a bridge block, it has no object
+};
+
+// The bridges that a group of patches allocate from, in an overwrite region or in the autogen data
+struct BridgeBlock
+{
+	std::string symbol; // defined by the linker script when in an overwrite region
+	int destination; // the destination of the functions of the patches
+	u32 nearAddress; // the first patched address, the block goes in the overwrite region closest to it
+	std::size_t size = 0;
+	std::size_t siteCount = 0; // the hooks that may share a stub
+	SectionInfo section;
+	OverwriteRegionInfo* overwrite = nullptr;
+	u32 arenaOffset = 0; // from the autogen data, if not in an overwrite region
+	u32 address = 0; // only fetched after linkage
+	std::size_t usedSize = 0;
+	std::vector<u8> data;
 };
 
 struct OverwriteRegionInfo
@@ -133,6 +202,116 @@ struct OverwriteRegionInfo
 	std::string memName;
 	int sectionIdx;
 	int sectionSize;
+	const Elf32* elf = nullptr; // the linked ELF that sectionIdx refers to
+};
+
+// The objects of a region, packed into a static archive for linking
+struct LinkArchive
+{
+	const BuildTarget::Region* region;
+	fs::path path;
+	std::vector<const SourceFileJob*> members;
+};
+
+// A symbol that a link unit uses from another unit
+struct LinkImport
+{
+	std::string name;
+	std::size_t owner; // the index of the unit that defines it
+	bool isThumb;
+	bool isLibrary; // not defined by any object, the owner links it from the libraries
+};
+
+/*
+ * Every destination is linked as its own unit, into its own ELF file,
+ * so that changing the sources of one destination only relinks the units
+ * that use something that moved. The symbols that a unit uses from the
+ * others are given to it as PROVIDE assignments in its imports file.
+ * */
+struct LinkUnit
+{
+	int dest;
+	const BuildTarget::Region* region;
+	LinkLayout layout;
+	fs::path ldscriptPath;
+	fs::path elfPath;
+	fs::path importsPath;
+	u32 placeholderAddress; // given to the imports that were not linked yet, in range of every branch
+	bool linksLibraries; // the default libraries, only the main binary links them when it is a unit
+	u64 ldscriptHash = 0;
+	std::vector<LinkImport> imports;
+	std::unordered_set<std::string> exportedSymbols; // the symbols that the other units import from it
+	std::unordered_map<std::string, u32> exports; // their values in the linked ELF
+	std::string linkerPath;
+	std::string linkArgs;
+	u64 ownFingerprint = 0; // everything that the unit is linked from, except for the imports
+	u64 importsFingerprint = 0; // the values of the imports that the ELF was linked with
+	bool isLinked = false; // if the ELF file matches ownFingerprint
+	std::vector<u8> linkedImage; // the output of the internal linker until it is loaded
+	std::unique_ptr<Elf32> elf;
+	std::ostringstream log; // units link in parallel, their output is printed afterwards
+	std::exception_ptr error;
+};
+
+// A global symbol of an object, used to find the references between the link units
+struct ObjectGlobalSymbol
+{
+	std::string name;
+	bool isDefined;
+	bool isThumb;
+};
+
+// A code section of an object, a node of the call graph of its destination
+struct CodeSectionInfo
+{
+	std::string name;
+	u32 size;
+	u32 alignment;
+	const SourceFileJob* job;
+};
+
+// The call sites from a code section of an object to a function
+struct ObjectCall
+{
+	u32 from; // the code section of the object that calls
+	s32 to; // the code section of the object that is called, -1 if another object defines the function
+	std::string symbol; // the function, if another object defines it
+	u32 count;
+};
+
+// A global function of an object and the code section that holds it
+struct ObjectCodeSymbol
+{
+	std::string name;
+	u32 section;
+};
+
+// The code sections of a destination and the calls between them, ordered for the linker script
+struct CallGraph
+{
+	std::vector<CodeSectionInfo> sections;
+	std::unordered_map<std::string, std::size_t> sectionForSymbol; // the first definition of every global function
+	std::vector<SectionOrder::Edge> calls;
+	std::vector<SectionOrder::Chain> chains; // in placement order, without the sections in overwrite regions
+	std::size_t coldChainsStart = 0; // the chains from here on were never sampled by the profile
+	std::vector<u64> samples; // of every section, from the profile
+};
+
+// Everything found in a single object, objects are scanned in parallel
+struct ObjectScanResult
+{
+	std::vector<std::unique_ptr<GenericPatchInfo>> patches;
+	std::vector<std::unique_ptr<RtReplPatchInfo>> rtreplPatches;
+	std::vector<std::string> externSymbols;
+	std::vector<std::unique_ptr<SectionInfo>> overwriteCandidateSections;
+	std::vector<ObjectGlobalSymbol> globalSymbols;
+	std::vector<CodeSectionInfo> codeSections;
+	std::vector<ObjectCall> calls;
+	std::vector<ObjectCodeSymbol> codeSymbols;
+	bool hasNcpSet = false;
+	u64 objHash = 0; // the hash of the object contents, part of the link fingerprint
+	std::ostringstream warnings; // printed when merging, to keep the output in source order
+	std::exception_ptr error;
 };
 
 static const char* s_patchTypeNames[] = {
@@ -140,52 +319,163 @@ static const char* s_patchTypeNames[] = {
 	"setjump", "setcall", "sethook",
 	"rtrepl",
 	"tjump", "tcall", "thook",
-	"settjump", "settcall", "setthook"
+	"settjump", "settcall", "setthook",
+	"lhook"
+};
+
+/*
+ * Few hooks into a function get a bridge each, more share a stub that saves
+ * the registers and calls the function, their bridges only call the stub.
+ * */
+static std::size_t getHookBridgesSize(std::size_t siteCount)
+{
+	if (siteCount >= MinSharedHookSites)
+		return SizeOfHookStub + siteCount * SizeOfSharedHookBridge;
+	return siteCount * SizeOfHookBridge;
+}
+
+/*
+ * Hooks at the same instruction are chained into a single bridge, that saves
+ * the registers once and calls every function in order. R0-R3 are reloaded
+ * before every call after the first, so that all of them see the hooked state.
+ * */
+static std::size_t getChainedHookBridgeSize(std::size_t handlerCount)
+{
+	return 16 + handlerCount * 4 + (handlerCount - 1) * 4;
+}
+
+// The instructions of a THUMB hook site, that its bridge runs after the call
+struct ThumbHookSite
+{
+	u16 opCodes[4];
+	std::size_t count; // 3, or 4 not to split a BL
+	std::size_t literalCount; // of the PC relative loads, their words are copied into the bridge
 };
 
-static void forEachElfSection(
-	const Elf32_Ehdr& eh, const Elf32_Shdr* sh_tbl, const char* str_tbl,
-	const std::function<bool(std::size_t, const Elf32_Shdr&, std::string_view)>& cb
-)
+static ThumbHookSite readThumbHookSite(const ICodeBin* bin, u32 address)
 {
-	for (std::size_t i = 0; i < eh.e_shnum; i++)
+	ThumbHookSite site;
+	bin->readBytes(address, site.opCodes, sizeof(site.opCodes));
+	site.count = (site.opCodes[2] & 0xF800) == thumbOpCodeBL0 ? 4 : 3;
+	site.literalCount = 0;
+	for (std::size_t i = 0; i < site.count; i++)
 	{
-		const Elf32_Shdr& sh = sh_tbl[i];
-		std::string_view sectionName(&str_tbl[sh.sh_name]);
-		if (cb(i, sh, sectionName))
-			break;
+		if ((site.opCodes[i] & 0xF800) == thumbOpCodeLdrPC)
+			site.literalCount++;
 	}
+	return site;
+}
+
+static std::size_t getThumbHookBridgeSize(const ThumbHookSite& site)
+{
+	std::size_t codeSize = SizeOfThumbHookBridgeHead + site.count * 2 + SizeOfThumbHookBridgeTail;
+	return ((codeSize + 3) & ~3) + (1 + site.literalCount) * 4;
+}
+
+static std::size_t getArm2ThumbJumpBridgeSize(bool isArm9)
+{
+	return isArm9 ? SizeOfArm2ThumbJumpBridge : SizeOfArm2ThumbJumpVeneer;
+}
+
+/*
+ * The bridge blocks are shared by the key of the function of the patch, the
+ * patches of unknown functions get one of their own. The reservation and the
+ * patching look them up by the same key, so that they always agree.
+ * */
+static std::string getBridgeKey(std::string_view kind, const GenericPatchInfo* p)
+{
+	std::string key; key.reserve(64);
+	key += kind;
+	key += ':';
+	key += std::to_string(p->srcAddressOv);
+	key += ':';
+	if (p->targetKey.empty())
+		key += "patch_" + std::to_string(reinterpret_cast<std::uintptr_t>(p));
+	else
+		key += p->targetKey;
+	return key;
 }
 
-static void forEachElfSymbol(
-	const Elf32& elf, const Elf32_Ehdr& eh, const Elf32_Shdr* sh_tbl,
-	const std::function<bool(const Elf32_Sym&, std::string_view)>& cb
-)
+// The key of the bridge block of the hooks at an instruction
+static std::string getHookSiteKey(const GenericPatchInfo* p)
 {
-	for (std::size_t i = 0; i < eh.e_shnum; i++)
+	std::string key; key.reserve(32);
+	key += "site:";
+	key += std::to_string(p->srcAddressOv);
+	key += ':';
+	key += std::to_string(p->destAddressOv);
+	key += ':';
+	key += std::to_string(p->destAddress);
+	return key;
+}
+
+/*
+ * The hooks of every instruction, in the order that their chain calls them:
+ * by the path of their source file, then by their symbol, so that it does not
+ * depend on the order in which the source files were found.
+ * */
+static std::map<std::pair<int, u32>, std::vector<const GenericPatchInfo*>> getHooksForSite(
+	const std::vector<std::unique_ptr<GenericPatchInfo>>& patches)
+{
+	std::map<std::pair<int, u32>, std::vector<const GenericPatchInfo*>> hooksForSite;
+	for (const auto& p : patches)
 	{
-		const Elf32_Shdr& sh = sh_tbl[i];
-		if ((sh.sh_type == SHT_SYMTAB) || (sh.sh_type == SHT_DYNSYM))
-		{
-			auto sym_tbl = elf.getSection<Elf32_Sym>(sh);
-			auto sym_str_tbl = elf.getSection<char>(sh_tbl[sh.sh_link]);
-			for (std::size_t j = 0; j < sh.sh_size / sizeof(Elf32_Sym); j++)
-			{
-				const Elf32_Sym& sym = sym_tbl[j];
-				std::string_view symbolName(&sym_str_tbl[sym.st_name]);
-				if (cb(sym, symbolName))
-					break;
-			}
-		}
+		if (p->patchType == PatchType::Hook)
+			hooksForSite[{ p->destAddressOv, p->destAddress }].push_back(p.get());
+	}
+	for (auto& [site, hooks] : hooksForSite)
+	{
+		std::stable_sort(hooks.begin(), hooks.end(), [](const GenericPatchInfo* a, const GenericPatchInfo* b){
+			if (a->job->srcFilePath != b->job->srcFilePath)
+				return a->job->srcFilePath < b->job->srcFilePath;
+			return a->symbol < b->symbol;
+		});
+	}
+	return hooksForSite;
+}
+
+// The name of a destination in the linker scripts and the sections of the linked ELF
+static std::string getDestName(int dest)
+{
+	switch (dest)
+	{
+	case BuildTarget::DestMain: return "arm";
+	case BuildTarget::DestItcm: return "itcm";
+	case BuildTarget::DestDtcm: return "dtcm";
+	default: return "ov" + std::to_string(dest);
 	}
 }
 
+// Appended to the names of the files of a link unit, the main binary has none
+static std::string getUnitSuffix(int dest)
+{
+	return dest == BuildTarget::DestMain ? "" : "_" + getDestName(dest);
+}
+
+static bool isTcmDest(int dest)
+{
+	return dest == BuildTarget::DestItcm || dest == BuildTarget::DestDtcm;
+}
+
+// The key of the far veneer of a site into a TCM, shared by the sites of a destination branching to the same place
+static std::string getFarVeneerKey(const GenericPatchInfo* p)
+{
+	std::string key; key.reserve(64);
+	key += "far:";
+	key += std::to_string(p->destAddressOv);
+	key += ':';
+	key += p->patchType == PatchType::Hook ? getHookSiteKey(p) : getBridgeKey("fn", p);
+	return key;
+}
+
 static u32 getPatchOverwriteAmount(const GenericPatchInfo* p)
 {
 	std::size_t pt = p->patchType;
 	if (pt == PatchType::Over)
 		return p->sectionSize;
 	if (pt == PatchType::Jump && p->destThumb)
+		return (p->destAddress & 2) ? 10 : 8; // BX PC must be word aligned
+	if (pt == PatchType::Hook && p->destThumb)
 		return 8;
 	return 4;
 }
@@ -207,12 +497,24 @@ void PatchMaker::makeTarget(
 	m_header = &header;
 	m_srcFileJobs = &srcFileJobs;
 
-	m_ldscriptPath = *m_buildDir / (m_target->getArm9() ? "ldscript9.x" : "ldscript7.x");
-	m_elfPath = *m_buildDir / (m_target->getArm9() ? "arm9.elf" : "arm7.elf");
-
 	if (m_srcFileJobs->empty())
 		throw ncp::exception("There are no source files to link.");
 
+	bool isArm9 = m_target->getArm9();
+
+	u64 inputFingerprint = getInputFingerprint();
+	u64 lastInputFingerprint = isArm9 ?
+		RebuildConfig::getArm9InputFingerprint() :
+		RebuildConfig::getArm7InputFingerprint();
+	u64 lastOutputFingerprint = isArm9 ?
+		RebuildConfig::getArm9OutputFingerprint() :
+		RebuildConfig::getArm7OutputFingerprint();
+	if (inputFingerprint == lastInputFingerprint && getOutputFingerprint() == lastOutputFingerprint)
+	{
+		Log::out << OINFO << "Nothing changed since the last build, the ROM files are up to date." << std::endl;
+		return;
+	}
+
 	createBuildDirectory();
 	createBackupDirectory();
 
@@ -229,13 +531,16 @@ void PatchMaker::makeTarget(
 	fetchNewcodeAddr();
 	gatherInfoFromObjects();
 	setupOverwriteRegions();
+	reserveBridges();
 	assignSectionsToOverwrites();
-	createLinkerScript();
-	linkElfFile();
-	loadElfFile();
+	orderCodeSections();
+	packLinkArchives();
+	createLinkerScripts();
+	linkElfFiles();
+	loadElfFiles();
 	gatherInfoFromElf();
 	applyPatchesToRom();
-	unloadElfFile();
+	unloadElfFiles();
 
 	patchedOverlays.clear();
 	for (const auto& [id, ov] : m_loadedOverlays)
@@ -247,6 +552,139 @@ void PatchMaker::makeTarget(
 	saveOverlayBins();
 	saveOverlayTableBin();
 	saveArmBin();
+
+	// Taken after saving, so that the files written by this run are the ones expected next time
+	u64 outputFingerprint = getOutputFingerprint();
+	if (isArm9)
+	{
+		RebuildConfig::setArm9InputFingerprint(inputFingerprint);
+		RebuildConfig::setArm9OutputFingerprint(outputFingerprint);
+	}
+	else
+	{
+		RebuildConfig::setArm7InputFingerprint(inputFingerprint);
+		RebuildConfig::setArm7OutputFingerprint(outputFingerprint);
+	}
+}
+
+/*
+ * The target fingerprints let a run where nothing changed skip the patching
+ * entirely, without loading, relinking or rewriting anything.
+ * They only hash the size and write time of the files, never their contents.
+ * */
+
+static constexpr u32 TargetFingerprintVersion = 1;
+
+static u64 hashFileStamp(const fs::path& path, u64 hash)
+{
+	std::string pathStr = path.string();
+	hash = Util::fnv1a64(pathStr.data(), pathStr.length(), hash);
+
+	std::error_code ec;
+	s64 size = -1;
+	s64 writeTime = 0;
+	if (fs::is_regular_file(path, ec))
+	{
+		size = s64(fs::file_size(path, ec));
+		writeTime = s64(fs::last_write_time(path, ec).time_since_epoch().count());
+	}
+	hash = Util::fnv1a64(&size, sizeof(s64), hash);
+	hash = Util::fnv1a64(&writeTime, sizeof(s64), hash);
+	return hash;
+}
+
+u64 PatchMaker::getInputFingerprint() const
+{
+	bool isArm9 = m_target->getArm9();
+	const fs::path& romPath = Main::getRomPath();
+	fs::path bakDir = Main::getWorkPath() / BuildConfig::getBackupDir();
+
+	u64 hash = Util::fnv1a64(&TargetFingerprintVersion, sizeof(u32));
+
+	s64 configWriteTime = s64(BuildConfig::getLastWriteTime());
+	s64 targetWriteTime = s64(m_target->getLastWriteTime());
+	hash = Util::fnv1a64(&configWriteTime, sizeof(s64), hash);
+	hash = Util::fnv1a64(&targetWriteTime, sizeof(s64), hash);
+	for (const std::string& define : Main::getDefines())
+		hash = Util::fnv1a64(define.data(), define.length() + 1, hash);
+
+	for (const auto& srcFileJob : *m_srcFileJobs)
+		hash = hashFileStamp(srcFileJob->objFilePath, hash);
+
+	if (!m_target->symbols.empty())
+		hash = hashFileStamp(*m_targetWorkDir / m_target->symbols, hash);
+	if (!m_target->profile.empty())
+		hash = hashFileStamp(*m_targetWorkDir / m_target->profile, hash);
+
+	// The unpatched files that the patching starts from
+	hash = hashFileStamp(romPath / "header.bin", hash);
+	hash = hashFileStamp(bakDir / (isArm9 ? "arm9.bin" : "arm7.bin"), hash);
+	hash = hashFileStamp(bakDir / (isArm9 ? "arm9ovt.bin" : "arm7ovt.bin"), hash);
+
+	return hash;
+}
+
+u64 PatchMaker::getOutputFingerprint() const
+{
+	bool isArm9 = m_target->getArm9();
+	const fs::path& romPath = Main::getRomPath();
+
+	u64 hash = Util::fnv1a64(&TargetFingerprintVersion, sizeof(u32));
+	hash = hashFileStamp(romPath / (isArm9 ? "arm9.bin" : "arm7.bin"), hash);
+	hash = hashFileStamp(romPath / (isArm9 ? "arm9ovt.bin" : "arm7ovt.bin"), hash);
+
+	const std::vector<u32>& patchedOverlays = isArm9 ?
+		RebuildConfig::getArm7PatchedOvs() :
+		RebuildConfig::getArm9PatchedOvs();
+
+	std::string prefix = isArm9 ? "overlay9" : "overlay7";
+	for (u32 ovID : patchedOverlays)
+		hash = hashFileStamp(romPath / prefix / (prefix + "_" + std::to_string(ovID) + ".bin"), hash);
+
+	return hash;
+}
+
+static constexpr u32 ItcmSize = 0x8000;
+static constexpr u32 DtcmSize = 0x4000;
+
+/*
+ * The code of a TCM region extends the autoload entry of the TCM, after its BSS
+ * that becomes data. The ITCM is the entry below the main memory, the DTCM the
+ * one past the main binary.
+ * */
+void PatchMaker::fetchTcmNewcodeAddr(int dest)
+{
+	ArmBin* arm = getArm();
+	bool isItcm = dest == BuildTarget::DestItcm;
+
+	const ArmBin::AutoLoadEntry* tcmEntry = nullptr;
+	for (const ArmBin::AutoLoadEntry& entry : arm->getAutoloadList())
+	{
+		bool isEntryItcm = entry.address < arm->getRamAddress();
+		bool isEntryDtcm = !isEntryItcm && !arm->sanityCheckAddress(entry.address);
+		if (isItcm ? isEntryItcm : isEntryDtcm)
+		{
+			tcmEntry = &entry;
+			break;
+		}
+	}
+	if (tcmEntry == nullptr)
+	{
+		std::ostringstream oss;
+		oss << "The ARM9 has no autoload entry for the " << (isItcm ? "ITCM" : "DTCM") << " to extend.";
+		throw ncp::exception(oss.str());
+	}
+
+	u32 tcmSize = isItcm ? ItcmSize : DtcmSize;
+	u32 startAddress = tcmEntry->address & ~(tcmSize - 1);
+	m_tcmForDest[dest] = TcmSegment{ startAddress, startAddress + tcmSize, tcmEntry->address };
+	m_newcodeAddrForDest[dest] = (tcmEntry->address + tcmEntry->size + tcmEntry->bssSize + 3) & ~3;
+
+	if (Main::getVerbose())
+	{
+		Log::out << OINFO << "Found the " << (isItcm ? "ITCM" : "DTCM") << " autoload at 0x" << std::uppercase << std::hex
+			<< tcmEntry->address << ", the new code goes at 0x" << m_newcodeAddrForDest[dest] << std::dec << std::endl;
+	}
 }
 
 void PatchMaker::fetchNewcodeAddr()
@@ -296,7 +734,11 @@ void PatchMaker::fetchNewcodeAddr()
 	for (auto& region : m_target->regions)
 	{
 		int dest = region.destination;
-		if (dest != -1)
+		if (isTcmDest(dest))
+		{
+			fetchTcmNewcodeAddr(dest);
+		}
+		else if (dest != -1)
 		{
 			u32 addr;
 			switch (region.mode)
@@ -323,314 +765,398 @@ void PatchMaker::fetchNewcodeAddr()
 	}
 }
 
-void PatchMaker::gatherInfoFromObjects()
-{
-	fs::current_path(*m_targetWorkDir);
+/*
+ * Object metadata sidecar (.ncpmeta)
+ *
+ * Caches what scanObject extracts from an object, so that unchanged objects
+ * do not have to be parsed again. The sidecar is used when the object size
+ * and write time match, if only the write time differs the object hash decides.
+ * */
 
-	Log::info("Getting patches from objects...");
+static constexpr u32 ObjectMetaMagic = 0x4D50434E; // "NCPM"
+static constexpr u32 ObjectMetaVersion = 6;
 
-	for (auto& srcFileJob : *m_srcFileJobs)
+struct ObjectMetaWriter
+{
+	std::vector<u8> data;
+
+	template<typename T>
+	void write(T value)
 	{
-		const fs::path& objPath = srcFileJob->objFilePath;
+		std::size_t offset = data.size();
+		data.resize(offset + sizeof(T));
+		Util::write<T>(&data[offset], value);
+	}
 
-		if (Main::getVerbose())
-			Log::out << ANSI_bYELLOW << objPath.string() << ANSI_RESET << std::endl;
+	void writeString(std::string_view str)
+	{
+		write<u32>(u32(str.length()));
+		data.insert(data.end(), str.begin(), str.end());
+	}
+};
 
-		const BuildTarget::Region* region = srcFileJob->region;
+struct ObjectMetaReader
+{
+	const u8* cur;
+	const u8* end;
+	bool failed = false;
 
-		std::vector<GenericPatchInfo*> patchInfoForThisObj;
+	template<typename T>
+	T read()
+	{
+		if (failed || std::size_t(end - cur) < sizeof(T))
+		{
+			failed = true;
+			return T();
+		}
+		T value = Util::read<T>(cur);
+		cur += sizeof(T);
+		return value;
+	}
 
-		if (!std::filesystem::exists(objPath))
-			throw ncp::file_error(objPath, ncp::file_error::find);
-		Elf32 elf;
-		if (!elf.load(objPath))
-			throw ncp::file_error(objPath, ncp::file_error::read);
+	std::string readString()
+	{
+		u32 length = read<u32>();
+		if (failed || std::size_t(end - cur) < length)
+		{
+			failed = true;
+			return {};
+		}
+		std::string str(reinterpret_cast<const char*>(cur), length);
+		cur += length;
+		return str;
+	}
+};
 
-		const Elf32_Ehdr& eh = elf.getHeader();
-		auto sh_tbl = elf.getSectionHeaderTable();
-		auto str_tbl = elf.getSection<char>(sh_tbl[eh.e_shstrndx]);
-		const Elf32_Shdr* ncpSetSection = nullptr;
-		const Elf32_Rel* ncpSetRel = nullptr;
-		const Elf32_Sym* ncpSetRelSymTbl = nullptr;
-		std::size_t ncpSetRelCount = 0;
-		std::size_t ncpSetRelSymTblSize = 0;
+static s64 getObjectWriteTime(const fs::path& objPath)
+{
+	return s64(fs::last_write_time(objPath).time_since_epoch().count());
+}
 
-		auto parseSymbol = [&](std::string_view symbolName, u32 symbolAddr, int sectionIdx, int sectionSize){
-			std::string_view labelName = symbolName.substr(sectionIdx != -1 ? 5 : 4);
+static bool loadObjectMeta(SourceFileJob* srcFileJob, ObjectScanResult& result)
+{
+	const fs::path& objPath = srcFileJob->objFilePath;
+	const fs::path& metaPath = srcFileJob->metaFilePath;
 
-			std::size_t patchTypeNameEnd = labelName.find('_');
-			if (patchTypeNameEnd == std::string::npos)
-				return;
+	std::error_code ec;
+	if (!fs::exists(metaPath, ec) || !fs::exists(objPath, ec))
+		return false;
 
-			std::string_view patchTypeName = labelName.substr(0, patchTypeNameEnd);
-			std::size_t patchType = Util::indexOf(patchTypeName, s_patchTypeNames, sizeof(s_patchTypeNames) / sizeof(char*));
-			if (patchType == -1)
-			{
-				Log::out << OWARN << "Found invalid patch type: " << patchTypeName << std::endl;
-				return;
-			}
+	MappedFile metaFile;
+	if (!metaFile.open(metaPath))
+		return false;
 
-			if (patchType == PatchType::Over && sectionIdx == -1)
-			{
-				Log::out << OWARN << "\"over\" patch must be a section type patch: " << patchTypeName << std::endl;
-				return;
-			}
+	ObjectMetaReader r{ metaFile.data(), metaFile.data() + metaFile.size() };
+	if (r.read<u32>() != ObjectMetaMagic || r.read<u32>() != ObjectMetaVersion)
+		return false;
 
-			if (patchType == PatchType::RtRepl)
-			{
-				if (sectionIdx != -1) // we do not want the labels, those are placeholders
-				{
-					m_rtreplPatches.emplace_back(new RtReplPatchInfo{
-						/*.symbol = */std::string(symbolName),
-						/*.job = */srcFileJob.get()
-					});
-				}
-				return;
-			}
+	u64 objSize = r.read<u64>();
+	s64 objWriteTime = r.read<s64>();
+	u64 objHash = r.read<u64>();
+	if (r.failed || objSize != fs::file_size(objPath))
+		return false;
 
-			bool forceThumb = false;
-			if (patchType >= PatchType::TJump && patchType <= PatchType::THook)
-			{
-				patchType -= PatchType::TJump - PatchType::Jump;
-				forceThumb = true;
-			}
-			else if (patchType >= PatchType::SetTJump && patchType <= PatchType::SetTHook)
-			{
-				patchType -= PatchType::SetTJump - PatchType::SetJump;
-				forceThumb = true;
-			}
+	if (objWriteTime != getObjectWriteTime(objPath))
+	{
+		// Touched but possibly not changed, compare the contents
+		MappedFile objFile;
+		if (!objFile.open(objPath) || Util::fnv1a64(objFile.data(), objFile.size()) != objHash)
+			return false;
+	}
 
-			bool isNcpSet = false;
-			if (patchType >= PatchType::SetJump && patchType <= PatchType::SetHook)
-			{
-				patchType -= PatchType::SetJump - PatchType::Jump;
-				isNcpSet = true;
-			}
+	const BuildTarget::Region* region = srcFileJob->region;
 
-			bool expectingOverlay = true;
-			std::size_t addressNameStart = patchTypeNameEnd + 1;
-			std::size_t addressNameEnd = labelName.find('_', addressNameStart);
-			if (addressNameEnd == std::string::npos)
-			{
-				addressNameEnd = labelName.length();
-				expectingOverlay = false;
-			}
-			std::string_view addressName = labelName.substr(addressNameStart, addressNameEnd - addressNameStart);
-			u32 destAddress;
-			try {
-				destAddress = Util::addrToInt(std::string(addressName));
-			} catch (std::exception& e) {
-				Log::out << OWARN << "Found invalid address for patch: " << labelName << std::endl;
-				return;
-			}
-			if (forceThumb)
-				destAddress |= 1;
+	ObjectScanResult meta;
+	meta.hasNcpSet = r.read<u8>() != 0;
+	meta.warnings << r.readString();
 
-			int destAddressOv = -1;
-			if (expectingOverlay)
-			{
-				std::size_t overlayNameStart = addressNameEnd + 1;
-				std::size_t overlayNameEnd = labelName.length();
-				std::string_view overlayName = labelName.substr(overlayNameStart, overlayNameEnd - overlayNameStart);
-				if (!overlayName.starts_with("ov"))
-				{
-					Log::out << OWARN << "Expected overlay definition in patch for: " << labelName << std::endl;
-					return;
-				}
-				try {
-					destAddressOv = Util::addrToInt(std::string(overlayName.substr(2)));
-				} catch (std::exception& e) {
-					Log::out << OWARN << "Found invalid overlay for patch: " << labelName << std::endl;
-					return;
-				}
-			}
+	u32 patchCount = r.read<u32>();
+	for (u32 i = 0; i < patchCount && !r.failed; i++)
+	{
+		auto* p = new GenericPatchInfo();
+		meta.patches.emplace_back(p);
+		p->srcAddress = 0;
+		p->destAddress = r.read<u32>();
+		p->destAddressOv = r.read<s32>();
+		p->patchType = r.read<u32>();
+		p->sectionIdx = r.read<s32>();
+		p->sectionSize = r.read<s32>();
+		u8 flags = r.read<u8>();
+		p->isNcpSet = flags & 1;
+		p->srcThumb = flags & 2;
+		p->destThumb = flags & 4;
+		p->isLeanHook = flags & 8;
+		p->symbol = r.readString();
+		p->targetKey = r.readString();
+		p->job = srcFileJob;
+		// Depends on the build target, not on the object
+		p->srcAddressOv = p->patchType == PatchType::Over ? p->destAddressOv : region->destination;
+		if (p->patchType > PatchType::Over)
+			r.failed = true;
+	}
 
-			for (auto& region : m_target->regions)
-			{
-				if (region.destination == destAddressOv && region.mode != BuildTarget::Mode::Append)
-				{
-					std::ostringstream oss;
-					oss << OSTRa(symbolName) << " (" << OSTR(srcFileJob->srcFilePath.string())
-						<< ") cannot be applied to an overlay that is not in " << OSTRa("append") << " mode.";
-					throw ncp::exception(oss.str());
-				}
-			}
+	u32 rtreplCount = r.read<u32>();
+	for (u32 i = 0; i < rtreplCount && !r.failed; i++)
+		meta.rtreplPatches.emplace_back(new RtReplPatchInfo{ r.readString(), srcFileJob });
 
-			int srcAddressOv = patchType == PatchType::Over ? destAddressOv : region->destination;
-
-			auto* patchInfoEntry = new GenericPatchInfo({
-				.srcAddress = 0, // we do not yet know it, only after linkage
-				.srcAddressOv = srcAddressOv,
-				.destAddress = (destAddress & ~1),
-				.destAddressOv = destAddressOv,
-				.patchType = patchType,
-				.sectionIdx = sectionIdx,
-				.sectionSize = sectionSize,
-				.isNcpSet = isNcpSet,
-				.srcThumb = bool(symbolAddr & 1),
-				.destThumb = bool(destAddress & 1),
-				.symbol = std::string(symbolName),
-				.job = srcFileJob.get()
-			});
+	u32 externCount = r.read<u32>();
+	for (u32 i = 0; i < externCount && !r.failed; i++)
+		meta.externSymbols.emplace_back(r.readString());
 
-			patchInfoForThisObj.emplace_back(patchInfoEntry);
-			m_patchInfo.emplace_back(patchInfoEntry);
-		};
+	u32 sectionCount = r.read<u32>();
+	for (u32 i = 0; i < sectionCount && !r.failed; i++)
+	{
+		auto* section = new SectionInfo();
+		meta.overwriteCandidateSections.emplace_back(section);
+		section->name = r.readString();
+		section->size = r.read<u32>();
+		section->alignment = r.read<u32>();
+		section->job = srcFileJob;
+	}
 
-		// Find patches in sections
-		forEachElfSection(eh, sh_tbl, str_tbl,
-		[&](std::size_t sectionIdx, const Elf32_Shdr& section, std::string_view sectionName){
-			if (sectionName.starts_with(".ncp_"))
+	u32 globalCount = r.read<u32>();
+	for (u32 i = 0; i < globalCount && !r.failed; i++)
+	{
+		std::string name = r.readString();
+		u8 flags = r.read<u8>();
+		meta.globalSymbols.push_back(ObjectGlobalSymbol{ std::move(name), bool(flags & 1), bool(flags & 2) });
+	}
+
+	u32 codeSectionCount = r.read<u32>();
+	for (u32 i = 0; i < codeSectionCount && !r.failed; i++)
+	{
+		std::string name = r.readString();
+		u32 size = r.read<u32>();
+		u32 alignment = r.read<u32>();
+		meta.codeSections.push_back(CodeSectionInfo{ std::move(name), size, alignment, srcFileJob });
+	}
+
+	u32 callCount = r.read<u32>();
+	for (u32 i = 0; i < callCount && !r.failed; i++)
+	{
+		u32 from = r.read<u32>();
+		s32 to = r.read<s32>();
+		std::string symbol = r.readString();
+		u32 count = r.read<u32>();
+		if (from >= codeSectionCount || to >= s32(codeSectionCount))
+			r.failed = true;
+		meta.calls.push_back(ObjectCall{ from, to, std::move(symbol), count });
+	}
+
+	u32 codeSymbolCount = r.read<u32>();
+	for (u32 i = 0; i < codeSymbolCount && !r.failed; i++)
+	{
+		std::string name = r.readString();
+		u32 section = r.read<u32>();
+		if (section >= codeSectionCount)
+			r.failed = true;
+		meta.codeSymbols.push_back(ObjectCodeSymbol{ std::move(name), section });
+	}
+
+	if (r.failed || r.cur != r.end)
+		return false;
+
+	result.patches = std::move(meta.patches);
+	result.rtreplPatches = std::move(meta.rtreplPatches);
+	result.externSymbols = std::move(meta.externSymbols);
+	result.overwriteCandidateSections = std::move(meta.overwriteCandidateSections);
+	result.globalSymbols = std::move(meta.globalSymbols);
+	result.codeSections = std::move(meta.codeSections);
+	result.calls = std::move(meta.calls);
+	result.codeSymbols = std::move(meta.codeSymbols);
+	result.hasNcpSet = meta.hasNcpSet;
+	result.objHash = objHash;
+	result.warnings << meta.warnings.str();
+	return true;
+}
+
+static void saveObjectMeta(const SourceFileJob* srcFileJob, ObjectScanResult& result)
+{
+	const fs::path& objPath = srcFileJob->objFilePath;
+	const fs::path& metaPath = srcFileJob->metaFilePath;
+
+	MappedFile objFile;
+	if (!objFile.open(objPath))
+		return;
+
+	ObjectMetaWriter w;
+	w.write<u32>(ObjectMetaMagic);
+	w.write<u32>(ObjectMetaVersion);
+	w.write<u64>(objFile.size());
+	w.write<s64>(getObjectWriteTime(objPath));
+	result.objHash = Util::fnv1a64(objFile.data(), objFile.size());
+	w.write<u64>(result.objHash);
+	objFile.close();
+
+	w.write<u8>(result.hasNcpSet);
+	w.writeString(result.warnings.str());
+
+	w.write<u32>(u32(result.patches.size()));
+	for (const auto& p : result.patches)
+	{
+		w.write<u32>(p->destAddress);
+		w.write<s32>(p->destAddressOv);
+		w.write<u32>(u32(p->patchType));
+		w.write<s32>(p->sectionIdx);
+		w.write<s32>(p->sectionSize);
+		w.write<u8>(u8((p->isNcpSet ? 1 : 0) | (p->srcThumb ? 2 : 0) | (p->destThumb ? 4 : 0) | (p->isLeanHook ? 8 : 0)));
+		w.writeString(p->symbol);
+		w.writeString(p->targetKey);
+	}
+
+	w.write<u32>(u32(result.rtreplPatches.size()));
+	for (const auto& p : result.rtreplPatches)
+		w.writeString(p->symbol);
+
+	w.write<u32>(u32(result.externSymbols.size()));
+	for (const auto& sym : result.externSymbols)
+		w.writeString(sym);
+
+	w.write<u32>(u32(result.overwriteCandidateSections.size()));
+	for (const auto& section : result.overwriteCandidateSections)
+	{
+		w.writeString(section->name);
+		w.write<u32>(u32(section->size));
+		w.write<u32>(section->alignment);
+	}
+
+	w.write<u32>(u32(result.globalSymbols.size()));
+	for (const auto& sym : result.globalSymbols)
+	{
+		w.writeString(sym.name);
+		w.write<u8>(u8((sym.isDefined ? 1 : 0) | (sym.isThumb ? 2 : 0)));
+	}
+
+	w.write<u32>(u32(result.codeSections.size()));
+	for (const auto& section : result.codeSections)
+	{
+		w.writeString(section.name);
+		w.write<u32>(section.size);
+		w.write<u32>(section.alignment);
+	}
+
+	w.write<u32>(u32(result.calls.size()));
+	for (const auto& call : result.calls)
+	{
+		w.write<u32>(call.from);
+		w.write<s32>(call.to);
+		w.writeString(call.symbol);
+		w.write<u32>(call.count);
+	}
+
+	w.write<u32>(u32(result.codeSymbols.size()));
+	for (const auto& sym : result.codeSymbols)
+	{
+		w.writeString(sym.name);
+		w.write<u32>(sym.section);
+	}
+
+	// The sidecar is only a cache, if it can not be written the object is parsed again next time
+	std::ofstream metaFile(metaPath, std::ios::binary);
+	if (!metaFile.is_open())
+		return;
+	metaFile.write(reinterpret_cast<const char*>(w.data.data()), std::streamsize(w.data.size()));
+}
+
+void PatchMaker::gatherInfoFromObjects()
+{
+	fs::current_path(*m_targetWorkDir);
+
+	Log::info("Getting patches from objects...");
+
+	// Objects are scanned in parallel, then merged in source order so that
+	// the patches and the linker script come out the same as in a serial run.
+	std::size_t objCount = m_srcFileJobs->size();
+	std::vector<ObjectScanResult> results(objCount);
+
+	// A call into another object, resolved once every object defined its functions
+	struct PendingCall
+	{
+		int dest;
+		std::size_t from;
+		std::string symbol;
+		u32 count;
+	};
+	std::vector<PendingCall> pendingCalls;
+
+	BS::thread_pool pool(BuildConfig::getThreadCount());
+	for (std::size_t i = 0; i < objCount; i++)
+	{
+		pool.push_task([this, &results, i](){
+			ObjectScanResult& result = results[i];
+			try
 			{
-				if (ncpSetSection == nullptr && sectionName.substr(5).starts_with("set"))
+				SourceFileJob* srcFileJob = (*m_srcFileJobs)[i].get();
+				if (!loadObjectMeta(srcFileJob, result))
 				{
-					ncpSetSection = &section;
-					int dest = region->destination;
-					if (std::find(m_destWithNcpSet.begin(), m_destWithNcpSet.end(), dest) == m_destWithNcpSet.end())
-						m_destWithNcpSet.emplace_back(dest);
-					m_jobsWithNcpSet.emplace_back(srcFileJob.get());
-					return false;
+					scanObject(srcFileJob, result);
+					saveObjectMeta(srcFileJob, result);
 				}
-				parseSymbol(sectionName, 0, int(sectionIdx), int(section.sh_size));
 			}
-			else if (ncpSetRel == nullptr && sectionName == ".rel.ncp_set")
+			catch (...)
 			{
-				ncpSetRel = elf.getSection<Elf32_Rel>(section);
-				ncpSetRelCount = section.sh_size / sizeof(Elf32_Rel);
-				ncpSetRelSymTbl = elf.getSection<Elf32_Sym>(sh_tbl[section.sh_link]);
-				ncpSetRelSymTblSize = sh_tbl[section.sh_link].sh_size / sizeof(Elf32_Sym);
+				result.error = std::current_exception();
 			}
-			return false;
 		});
+	}
+	pool.wait_for_tasks();
 
-		// Find the functions corresponding to the patch to check if they are thumb
-		forEachElfSymbol(elf, eh, sh_tbl,
-		[&](const Elf32_Sym& symbol, std::string_view symbolName){
-			if (ELF32_ST_TYPE(symbol.st_info) == STT_FUNC)
-			{
-				for (GenericPatchInfo* p : patchInfoForThisObj)
-				{
-					// no need to check this condition because at this point all fetched patches are only section marked ones
-					/*if (p->sectionIdx != -1) // is patch instructed by section
-					{*/
-					
-					// if function has the same section as the patch instruction section
-					if (p->sectionIdx == symbol.st_shndx)
-					{
-						p->srcThumb = symbol.st_value & 1;
-						break;
-					}
-					
-					//}
-				}
-			}
-			return false;
-		});
+	for (std::size_t i = 0; i < objCount; i++)
+	{
+		ObjectScanResult& result = results[i];
+		SourceFileJob* srcFileJob = (*m_srcFileJobs)[i].get();
+
+		if (Main::getVerbose())
+			Log::out << ANSI_bYELLOW << srcFileJob->objFilePath.string() << ANSI_RESET << std::endl;
+
+		std::string warnings = result.warnings.str();
+		if (!warnings.empty())
+			Log::out << warnings << std::flush;
+		if (result.error)
+			std::rethrow_exception(result.error);
 
-		// Find patches in symbols
-		forEachElfSymbol(elf, eh, sh_tbl,
-		[&](const Elf32_Sym& symbol, std::string_view symbolName){
-			if (symbolName.starts_with("ncp_"))
+		for (auto& p : result.patches)
+		{
+			for (auto& region : m_target->regions)
 			{
-				std::string_view stemless = symbolName.substr(4);
-				if (stemless != "dest")
+				if (region.destination == p->destAddressOv && region.mode != BuildTarget::Mode::Append)
 				{
-					u32 addr = symbol.st_value;
-					if (stemless.starts_with("set")) // requires special care because of thumb function detection
-					{
-						if (ncpSetSection == nullptr)
-							throw ncp::exception("Found an ncp_set hook, but an \".ncp_set\" section does not exist!");
-
-						// Here we are just getting the address, so that we can know beforehand
-						// if the function is thumb or not. The final address is obtained after linkage.
-						auto& section = sh_tbl[symbol.st_shndx];
-						auto sectionData = elf.getSection<char>(section);
-						if (ncpSetRel == nullptr)
-						{
-							addr = Util::read<u32>(&sectionData[addr - section.sh_addr]);
-						}
-						else
-						{
-							for (int relIdx = 0; relIdx < ncpSetRelCount; relIdx++)
-							{
-								const Elf32_Rel& rel = ncpSetRel[relIdx];
-								if (rel.r_offset == addr) // found the corresponding relocation
-								{
-									// layer after layer, we finally reach the symbol :p
-									std::size_t symIdx = ELF32_R_SYM(rel.r_info);
-									if (symIdx >= ncpSetRelSymTblSize)
-									{
-										std::ostringstream oss;
-										oss << "Relocation entry with index " << relIdx
-											<< " in " << OSTR(".rel.ncp_set") << " section has an index of " << symIdx
-											<< " as linked symbol table entry but the symbol table only contains "
-											<< ncpSetRelSymTblSize << " entries.";
-										throw ncp::exception(oss.str());
-									}
-									addr = ncpSetRelSymTbl[symIdx].st_value;
-									break;
-								}
-							}
-						}
-					}
-					parseSymbol(symbolName, addr, -1, 0);
+					std::ostringstream oss;
+					oss << OSTRa(p->symbol) << " (" << OSTR(srcFileJob->srcFilePath.string())
+						<< ") cannot be applied to an overlay that is not in " << OSTRa("append") << " mode.";
+					throw ncp::exception(oss.str());
 				}
 			}
-			return false;
-		});
-
-		// Find functions that should be external (label marked)
-		for (GenericPatchInfo* p : patchInfoForThisObj)
-		{
-			if (p->sectionIdx == -1) // is patch instructed by label
-				m_externSymbols.emplace_back(p->symbol);
-		}
 
-		// Find sections suitable to place in overwrites
-		forEachElfSection(eh, sh_tbl, str_tbl,
-		[&](std::size_t sectionIdx, const Elf32_Shdr& section, std::string_view sectionName){
-			bool ncpSectionSupportsOverrideRegion =
-				sectionName.starts_with(".ncp_jump") || 
-				sectionName.starts_with(".ncp_call") || 
-				sectionName.starts_with(".ncp_hook");
-			
-			if ((sectionName.starts_with(".ncp_") && !ncpSectionSupportsOverrideRegion) ||
-				sectionName.starts_with(".rel") || 
-				sectionName.starts_with(".debug") ||
-				sectionName == ".shstrtab" || 
-				sectionName == ".strtab" || 
-				sectionName == ".symtab" ||
-				section.sh_size == 0)
+			// A lean hook leaves R0-R3 to the function, compiled code can clobber them anywhere
+			if (p->isLeanHook && (p->sectionIdx != -1 || srcFileJob->srcFilePath.extension() != ".s"))
 			{
-				return false;
+				std::ostringstream oss;
+				oss << OSTRa(p->symbol) << " (" << OSTR(srcFileJob->srcFilePath.string())
+					<< ") is a lean hook, which does not preserve R0-R3, it can only be used as a label from assembly.";
+				throw ncp::exception(oss.str());
 			}
 
-			if (sectionName.starts_with(".text") || 
-				sectionName.starts_with(".rodata") ||
-				sectionName.starts_with(".data") ||
-				ncpSectionSupportsOverrideRegion)
+			// The THUMB hook bridge always saves R0-R3
+			if (p->isLeanHook && p->destThumb)
 			{
-				auto* sectionInfo = new SectionInfo{
-					.name = std::string(sectionName),
-					.size = section.sh_size,
-					.job = srcFileJob.get(),
-					.alignment = section.sh_addralign > 0 ? section.sh_addralign : 4
-				};
-				m_overwriteCandidateSections.emplace_back(sectionInfo);
+				std::ostringstream oss;
+				oss << OSTRa(p->symbol) << " (" << OSTR(srcFileJob->srcFilePath.string())
+					<< ") is a lean hook of THUMB code, lean hooks can only be placed in ARM code.";
+				throw ncp::exception(oss.str());
 			}
-			return false;
-		});
+		}
 
 		if (Main::getVerbose())
 		{
-			if (patchInfoForThisObj.empty())
+			if (result.patches.empty())
 			{
 				Log::out << "NO PATCHES" << std::endl;
 			}
 			else
 			{
 				Log::out << "SRC_ADDR_OV, DST_ADDR, DST_ADDR_OV, PATCH_TYPE, SEC_IDX, SEC_SIZE, NCP_SET, SRC_THUMB, DST_THUMB, SYMBOL" << std::endl;
-				for (auto& p : patchInfoForThisObj)
+				for (auto& p : result.patches)
 				{
 					Log::out <<
 						std::setw(11) << std::dec << p->srcAddressOv << "  " <<
@@ -646,1006 +1172,3083 @@ void PatchMaker::gatherInfoFromObjects()
 				}
 			}
 		}
+
+		int dest = srcFileJob->region->destination;
+
+		auto hashIt = m_objectsHashForDest.try_emplace(dest, Util::fnv1a64(nullptr, 0)).first;
+		hashIt->second = Util::fnv1a64(&result.objHash, sizeof(u64), hashIt->second);
+
+		for (auto& p : result.patches)
+			m_patchInfo.emplace_back(std::move(p));
+		for (auto& p : result.rtreplPatches)
+			m_rtreplPatches.emplace_back(std::move(p));
+		std::vector<std::string>& externSymbols = m_externSymbolsForDest[dest];
+		for (auto& sym : result.externSymbols)
+			externSymbols.emplace_back(std::move(sym));
+		for (auto& section : result.overwriteCandidateSections)
+			m_overwriteCandidateSections.emplace_back(std::move(section));
+
+		auto& definedSymbols = m_definedSymbolsForDest[dest];
+		auto& undefinedSymbols = m_undefinedSymbolsForDest[dest];
+		for (auto& sym : result.globalSymbols)
+		{
+			if (sym.isDefined)
+				definedSymbols.try_emplace(std::move(sym.name), sym.isThumb);
+			else
+				undefinedSymbols.emplace(std::move(sym.name));
+		}
+
+		if (result.hasNcpSet)
+		{
+			if (std::find(m_destWithNcpSet.begin(), m_destWithNcpSet.end(), dest) == m_destWithNcpSet.end())
+				m_destWithNcpSet.emplace_back(dest);
+			m_jobsWithNcpSet.emplace_back(srcFileJob);
+		}
+
+		if (m_target->orderSections || !m_target->profile.empty())
+		{
+			std::unique_ptr<CallGraph>& graph = m_callGraphForDest[dest];
+			if (graph == nullptr)
+				graph = std::make_unique<CallGraph>();
+
+			std::size_t firstSection = graph->sections.size();
+			for (auto& section : result.codeSections)
+				graph->sections.emplace_back(std::move(section));
+			for (auto& sym : result.codeSymbols)
+				graph->sectionForSymbol.try_emplace(std::move(sym.name), firstSection + sym.section);
+			for (auto& call : result.calls)
+			{
+				if (call.to != -1)
+					graph->calls.push_back(SectionOrder::Edge{ firstSection + call.from, firstSection + std::size_t(call.to), call.count });
+				else
+					pendingCalls.push_back(PendingCall{ dest, firstSection + call.from, std::move(call.symbol), call.count });
+			}
+		}
 	}
+
+	// The calls into the functions of other destinations are far away anyway
+	for (PendingCall& call : pendingCalls)
+	{
+		CallGraph& graph = *m_callGraphForDest[call.dest];
+		auto it = graph.sectionForSymbol.find(call.symbol);
+		if (it != graph.sectionForSymbol.end())
+			graph.calls.push_back(SectionOrder::Edge{ call.from, it->second, call.count });
+	}
+
 	if (Main::getVerbose())
 	{
-		if (m_externSymbols.empty())
-		{
-			Log::out << "\nExternal symbols: NONE" << std::endl;
-		}
-		else
+		bool hasExternSymbols = false;
+		for (const auto& [dest, externSymbols] : m_externSymbolsForDest)
 		{
-			Log::out << "\nExternal symbols:\n";
-			for (const std::string& sym : m_externSymbols)
+			if (externSymbols.empty())
+				continue;
+			if (!hasExternSymbols)
+				Log::out << "\nExternal symbols:\n";
+			hasExternSymbols = true;
+			for (const std::string& sym : externSymbols)
 				Log::out << sym << '\n';
-			Log::out << std::flush;
 		}
+		if (hasExternSymbols)
+			Log::out << std::flush;
+		else
+			Log::out << "\nExternal symbols: NONE" << std::endl;
 	}
 }
 
-void PatchMaker::setupOverwriteRegions()
+void PatchMaker::scanObject(SourceFileJob* srcFileJob, ObjectScanResult& result) const
 {
-	Log::info("Setting up overwrite regions...");
+	std::ostringstream& log = result.warnings;
 
-	for (const auto& region : m_target->regions)
+	const fs::path& objPath = srcFileJob->objFilePath;
+
+	const BuildTarget::Region* region = srcFileJob->region;
+
+	std::vector<GenericPatchInfo*> patchInfoForThisObj;
+
+	if (!std::filesystem::exists(objPath))
+		throw ncp::file_error(objPath, ncp::file_error::find);
+	Elf32 elf;
+	if (!elf.load(objPath))
+		throw ncp::file_error(objPath, ncp::file_error::read);
+
+	// The ARM9 cannot fetch instructions from the DTCM, only the over patches hold code for elsewhere
+	if (region->destination == BuildTarget::DestDtcm)
 	{
-		for (const auto& overwrite : region.overwrites)
-		{
-			std::string memName = "overwrite_";
-			memName += Util::intToAddr(int(overwrite.startAddress), 8, false);
-			if (region.destination != -1)
+		elf.forEachSection([&](std::size_t, const Elf32_Shdr& section, std::string_view sectionName){
+			if ((section.sh_flags & SHF_EXECINSTR) && section.sh_size != 0 && !sectionName.starts_with(".ncp_over"))
 			{
-				memName += "_ov";
-				memName += std::to_string(region.destination);
+				std::ostringstream oss;
+				oss << "The section " << OSTR(sectionName) << " of " << OSTR(srcFileJob->srcFilePath.string())
+					<< " holds code, but the DTCM can only hold data.";
+				throw ncp::exception(oss.str());
 			}
+			return false;
+		});
+	}
 
-			auto* overwriteRegion = new OverwriteRegionInfo{
-				.startAddress = overwrite.startAddress,
-				.endAddress = overwrite.endAddress,
-				.destination = region.destination,
-				.assignedSections = {},
-				.usedSize = 0,
-				.memName = memName
-			};
-			m_overwriteRegions.emplace_back(overwriteRegion);
+	const Elf32_Ehdr& eh = elf.getHeader();
+	auto sh_tbl = elf.getSectionHeaderTable();
+	const Elf32_Shdr* ncpSetSection = nullptr;
+	const Elf32_Shdr* ncpSetRelSection = nullptr;
+	ElfRelocationIndex ncpSetRelIndex;
+	ElfRange<Elf32_Sym> ncpSetRelSymTbl;
 
-			if (Main::getVerbose())
+	auto parseSymbol = [&](std::string_view symbolName, u32 symbolAddr, int sectionIdx, int sectionSize, std::string targetKey){
+		std::string_view labelName = symbolName.substr(sectionIdx != -1 ? 5 : 4);
+
+		std::size_t patchTypeNameEnd = labelName.find('_');
+		if (patchTypeNameEnd == std::string::npos)
+			return;
+
+		std::string_view patchTypeName = labelName.substr(0, patchTypeNameEnd);
+		std::size_t patchType = Util::indexOf(patchTypeName, s_patchTypeNames, sizeof(s_patchTypeNames) / sizeof(char*));
+		if (patchType == -1)
+		{
+			log << OWARN << "Found invalid patch type: " << patchTypeName << std::endl;
+			return;
+		}
+
+		if (patchType == PatchType::Over && sectionIdx == -1)
+		{
+			log << OWARN << "\"over\" patch must be a section type patch: " << patchTypeName << std::endl;
+			return;
+		}
+
+		if (patchType == PatchType::RtRepl)
+		{
+			if (sectionIdx != -1) // we do not want the labels, those are placeholders
 			{
-				Log::out << OINFO << "Found overwrite region: 0x" << std::hex << std::uppercase 
-					<< overwrite.startAddress << "-0x" << overwrite.endAddress 
-					<< " (size: " << std::dec << (overwrite.endAddress - overwrite.startAddress) 
-					<< " bytes)" << std::endl;
+				result.rtreplPatches.emplace_back(new RtReplPatchInfo{
+					/*.symbol = */std::string(symbolName),
+					/*.job = */srcFileJob
+				});
 			}
+			return;
 		}
-	}
-}
 
-void PatchMaker::assignSectionsToOverwrites()
-{
-	if (m_overwriteRegions.empty())
-		return;
+		bool forceThumb = false;
+		if (patchType >= PatchType::TJump && patchType <= PatchType::THook)
+		{
+			patchType -= PatchType::TJump - PatchType::Jump;
+			forceThumb = true;
+		}
+		else if (patchType >= PatchType::SetTJump && patchType <= PatchType::SetTHook)
+		{
+			patchType -= PatchType::SetTJump - PatchType::SetJump;
+			forceThumb = true;
+		}
 
-	// Group sections by destination
-	std::unordered_map<int, std::vector<SectionInfo*>> sectionsByDest;
-	for (auto& section : m_overwriteCandidateSections)
-	{
-		int dest = section->job->region->destination;
-		sectionsByDest[dest].emplace_back(section.get());
-	}
+		bool isLeanHook = false;
+		if (patchType == PatchType::LHook)
+		{
+			patchType = PatchType::Hook;
+			isLeanHook = true;
+		}
 
-	// Structure to store assignment information for table printing
-	struct SectionAssignment {
-		std::string sectionName;
-		std::size_t sectionSize;
-		u32 startAddress;
-		u32 endAddress;
-		bool assigned;
-	};
-	std::vector<SectionAssignment> assignments;
+		bool isNcpSet = false;
+		if (patchType >= PatchType::SetJump && patchType <= PatchType::SetHook)
+		{
+			patchType -= PatchType::SetJump - PatchType::Jump;
+			isNcpSet = true;
+		}
 
-	// Process each destination
-	for (auto& [dest, sections] : sectionsByDest)
-	{
-		// Get overwrite regions for this destination
-		std::vector<OverwriteRegionInfo*> destOverwrites;
-		for (auto& overwrite : m_overwriteRegions)
+		bool expectingOverlay = true;
+		std::size_t addressNameStart = patchTypeNameEnd + 1;
+		std::size_t addressNameEnd = labelName.find('_', addressNameStart);
+		if (addressNameEnd == std::string::npos)
 		{
-			if (overwrite->destination == dest)
-				destOverwrites.emplace_back(overwrite.get());
+			addressNameEnd = labelName.length();
+			expectingOverlay = false;
+		}
+		std::string_view addressName = labelName.substr(addressNameStart, addressNameEnd - addressNameStart);
+		u32 destAddress;
+		try {
+			destAddress = Util::addrToInt(std::string(addressName));
+		} catch (std::exception& e) {
+			log << OWARN << "Found invalid address for patch: " << labelName << std::endl;
+			return;
 		}
+		if (forceThumb)
+			destAddress |= 1;
 
-		if (destOverwrites.empty())
-			continue;
+		int destAddressOv = -1;
+		if (expectingOverlay)
+		{
+			std::size_t overlayNameStart = addressNameEnd + 1;
+			std::size_t overlayNameEnd = labelName.length();
+			std::string_view overlayName = labelName.substr(overlayNameStart, overlayNameEnd - overlayNameStart);
+			if (!overlayName.starts_with("ov"))
+			{
+				log << OWARN << "Expected overlay definition in patch for: " << labelName << std::endl;
+				return;
+			}
+			try {
+				destAddressOv = Util::addrToInt(std::string(overlayName.substr(2)));
+			} catch (std::exception& e) {
+				log << OWARN << "Found invalid overlay for patch: " << labelName << std::endl;
+				return;
+			}
+		}
 
-		// Sort sections by size (largest first for best fit)
-		std::sort(sections.begin(), sections.end(), [](const SectionInfo* a, const SectionInfo* b){
-			return a->size > b->size;
+		int srcAddressOv = patchType == PatchType::Over ? destAddressOv : region->destination;
+
+		auto* patchInfoEntry = new GenericPatchInfo({
+			.srcAddress = 0, // we do not yet know it, only after linkage
+			.srcAddressOv = srcAddressOv,
+			.destAddress = (destAddress & ~1),
+			.destAddressOv = destAddressOv,
+			.patchType = patchType,
+			.sectionIdx = sectionIdx,
+			.sectionSize = sectionSize,
+			.isNcpSet = isNcpSet,
+			.srcThumb = bool(symbolAddr & 1),
+			.destThumb = bool(destAddress & 1),
+			.isLeanHook = isLeanHook,
+			.symbol = std::string(symbolName),
+			.targetKey = std::move(targetKey),
+			.job = srcFileJob,
+			.elf = nullptr,
+			.label = {}
 		});
 
-		// Sort overwrite regions by available space (largest first)
-		std::sort(destOverwrites.begin(), destOverwrites.end(), [](const OverwriteRegionInfo* a, const OverwriteRegionInfo* b){
-			u32 sizeA = a->endAddress - a->startAddress - a->usedSize;
-			u32 sizeB = b->endAddress - b->startAddress - b->usedSize;
-			return sizeA > sizeB;
-		});
+		patchInfoForThisObj.emplace_back(patchInfoEntry);
+		result.patches.emplace_back(patchInfoEntry);
+	};
 
-		// Assign sections to overwrite regions using best fit algorithm
-		for (auto* section : sections)
+	// Find patches in sections
+	elf.forEachSection([&](std::size_t sectionIdx, const Elf32_Shdr& section, std::string_view sectionName){
+		if (sectionName.starts_with(".ncp_"))
 		{
-			bool assigned = false;
-			
-			for (auto* overwrite : destOverwrites)
+			if (ncpSetSection == nullptr && sectionName.substr(5).starts_with("set"))
 			{
-				u32 currentPos = overwrite->startAddress + overwrite->usedSize;
-				u32 alignedPos = (currentPos + section->alignment - 1) & ~(section->alignment - 1);
-				u32 endPos = alignedPos + section->size;
-				
-				if (endPos <= overwrite->endAddress)
+				ncpSetSection = &section;
+				result.hasNcpSet = true;
+				return false;
+			}
+			parseSymbol(sectionName, 0, int(sectionIdx), int(section.sh_size), {});
+		}
+		return false;
+	});
+
+	int ncpSetRelIdx = elf.findSection(".rel.ncp_set");
+	if (ncpSetRelIdx == -1)
+		ncpSetRelIdx = elf.findSection(".rela.ncp_set");
+	if (ncpSetRelIdx != -1)
+	{
+		ncpSetRelSection = &sh_tbl[ncpSetRelIdx];
+		ncpSetRelIndex.build(elf, *ncpSetRelSection);
+		ncpSetRelSymTbl = elf.getSectionEntries<Elf32_Sym>(sh_tbl[ncpSetRelSection->sh_link]);
+	}
+
+	// Find the functions corresponding to the patch to check if they are thumb,
+	// at this point all fetched patches are only section marked ones
+	std::vector<GenericPatchInfo*> patchForSection(eh.e_shnum, nullptr);
+	for (GenericPatchInfo* p : patchInfoForThisObj)
+		patchForSection[p->sectionIdx] = p;
+
+	elf.forEachSymbol([&](const Elf32_Sym& symbol, std::string_view symbolName){
+		// if function has the same section as the patch instruction section
+		if (ELF32_ST_TYPE(symbol.st_info) == STT_FUNC && symbol.st_shndx < patchForSection.size())
+		{
+			GenericPatchInfo* p = patchForSection[symbol.st_shndx];
+			if (p != nullptr)
+				p->srcThumb = symbol.st_value & 1;
+		}
+		return false;
+	});
+
+	// Find patches in symbols
+	elf.forEachSymbol([&](const Elf32_Sym& symbol, std::string_view symbolName){
+		if (symbolName.starts_with("ncp_"))
+		{
+			std::string_view stemless = symbolName.substr(4);
+			if (stemless != "dest")
+			{
+				u32 addr = symbol.st_value;
+
+				// Identifies the function, the name of a referenced symbol or the location of a defined one
+				auto makeTargetKey = [&](const Elf32_Sym& target, s32 addend){
+					std::string_view targetName = elf.getSymbolName(target);
+					std::string key;
+					if (target.st_shndx == SHN_UNDEF && !targetName.empty())
+						key = std::string(targetName) + '+' + std::to_string(addend);
+					else if (target.st_shndx == SHN_ABS)
+						key = "abs:" + std::to_string(target.st_value + addend);
+					else
+						key = objPath.string() + ':' + std::to_string(target.st_shndx) + ':' + std::to_string(target.st_value + addend);
+					return key;
+				};
+				std::string targetKey = makeTargetKey(symbol, 0);
+
+				if (stemless.starts_with("set")) // requires special care because of thumb function detection
 				{
-					// Assign this section to the overwrite region
-					overwrite->assignedSections.emplace_back(section);
-					overwrite->usedSize = endPos - overwrite->startAddress;
-					assigned = true;
+					if (ncpSetSection == nullptr)
+						throw ncp::exception("Found an ncp_set hook, but an \".ncp_set\" section does not exist!");
+
+					// Here we are just getting the address, so that we can know beforehand
+					// if the function is thumb or not. The final address is obtained after linkage.
+					auto& section = sh_tbl[symbol.st_shndx];
+					auto sectionData = elf.getSection<char>(section);
+					u32 dataOffset = addr - section.sh_addr;
+					if (dataOffset + 4 > section.sh_size)
+					{
+						std::ostringstream oss;
+						oss << OSTRa(symbolName) << " points out of its section.";
+						throw ncp::exception(oss.str());
+					}
 
-					// Store assignment info for table printing
-					if (Main::getVerbose())
+					const ElfRelocationIndex::Entry* rel = ncpSetRelSection != nullptr ? ncpSetRelIndex.find(addr) : nullptr;
+					if (rel == nullptr)
 					{
-						assignments.push_back({
-							.sectionName = section->name,
-							.sectionSize = section->size,
-							.startAddress = overwrite->startAddress,
-							.endAddress = overwrite->endAddress,
-							.assigned = true
-						});
+						addr = Util::read<u32>(&sectionData[dataOffset]);
+						targetKey = "abs:" + std::to_string(addr);
+					}
+					else
+					{
+						// layer after layer, we finally reach the symbol :p
+						std::size_t symIdx = ELF32_R_SYM(rel->info);
+						if (symIdx >= ncpSetRelSymTbl.size())
+						{
+							std::ostringstream oss;
+							oss << "Relocation entry with index " << rel->index
+								<< " in " << OSTR(elf.getSectionName(*ncpSetRelSection)) << " section has an index of " << symIdx
+								<< " as linked symbol table entry but the symbol table only contains "
+								<< ncpSetRelSymTbl.size() << " entries.";
+							throw ncp::exception(oss.str());
+						}
+						// REL keeps the addend in the relocated word, it is there when referenced through a section symbol
+						s32 addend = rel->hasAddend ? rel->addend : Util::read<s32>(&sectionData[dataOffset]);
+						addr = ncpSetRelSymTbl[symIdx].st_value + addend;
+						targetKey = makeTargetKey(ncpSetRelSymTbl[symIdx], addend);
 					}
-					break;
 				}
-			}
-
-			if (!assigned && Main::getVerbose())
-			{
-				assignments.push_back({
-					.sectionName = section->name,
-					.sectionSize = section->size,
-					.startAddress = 0,
-					.endAddress = 0,
-					.assigned = false
-				});
+				parseSymbol(symbolName, addr, -1, 0, std::move(targetKey));
 			}
 		}
-	}
+		return false;
+	});
 
-	// Print assignment table if verbose mode is enabled
-	if (Main::getVerbose() && !assignments.empty())
+	// Find functions that should be external (label marked)
+	for (GenericPatchInfo* p : patchInfoForThisObj)
 	{
-		Log::out << ANSI_bCYAN "Assigned sections:" ANSI_RESET "\n" 
-			<< ANSI_bWHITE "SECTION_NAME" ANSI_RESET "                     " 
-			<< ANSI_bWHITE "SIZE" ANSI_RESET "     " 
-			<< ANSI_bWHITE "OVERWRITE_REGION" ANSI_RESET "        " 
-			<< ANSI_bWHITE "STATUS" ANSI_RESET << std::endl;
+		if (p->sectionIdx == -1) // is patch instructed by label
+			result.externSymbols.emplace_back(p->symbol);
+	}
+
+	// Find sections suitable to place in overwrites
+	elf.forEachSection([&](std::size_t sectionIdx, const Elf32_Shdr& section, std::string_view sectionName){
+		bool ncpSectionSupportsOverrideRegion =
+			sectionName.starts_with(".ncp_jump") || 
+			sectionName.starts_with(".ncp_call") || 
+			sectionName.starts_with(".ncp_hook");
 		
-		for (const auto& assignment : assignments)
+		if ((sectionName.starts_with(".ncp_") && !ncpSectionSupportsOverrideRegion) ||
+			sectionName.starts_with(".rel") || 
+			sectionName.starts_with(".debug") ||
+			sectionName == ".shstrtab" || 
+			sectionName == ".strtab" || 
+			sectionName == ".symtab" ||
+			section.sh_size == 0)
 		{
-			// Section name - yellow for readability
-			Log::out << ANSI_YELLOW << std::setw(64) << std::left << assignment.sectionName << ANSI_RESET << std::right << " ";
-			
-			// Size - white/cyan
-			Log::out << ANSI_CYAN << std::setw(8) << std::dec << assignment.sectionSize << ANSI_RESET << "  ";
-			
-			if (assignment.assigned)
+			return false;
+		}
+
+		if (sectionName.starts_with(".text") || 
+			sectionName.starts_with(".rodata") ||
+			sectionName.starts_with(".data") ||
+			ncpSectionSupportsOverrideRegion)
+		{
+			auto* sectionInfo = new SectionInfo{
+				.name = std::string(sectionName),
+				.size = section.sh_size,
+				.job = srcFileJob,
+				.alignment = section.sh_addralign > 0 ? section.sh_addralign : 4
+			};
+			result.overwriteCandidateSections.emplace_back(sectionInfo);
+		}
+		return false;
+	});
+
+	// The code sections and the branches between them, the call graph that orders them
+	std::vector<s32> codeSectionIdx(eh.e_shnum, -1);
+	elf.forEachSection([&](std::size_t sectionIdx, const Elf32_Shdr& section, std::string_view sectionName){
+		if ((section.sh_flags & SHF_EXECINSTR) && section.sh_size != 0 &&
+			(sectionName == ".text" || sectionName.starts_with(".text.")))
+		{
+			codeSectionIdx[sectionIdx] = s32(result.codeSections.size());
+			result.codeSections.push_back(CodeSectionInfo{
+				.name = std::string(sectionName),
+				.size = section.sh_size,
+				.alignment = section.sh_addralign > 0 ? section.sh_addralign : 4,
+				.job = srcFileJob
+			});
+		}
+		return false;
+	});
+
+	elf.forEachSection([&](std::size_t, const Elf32_Shdr& section, std::string_view){
+		if ((section.sh_type != SHT_REL && section.sh_type != SHT_RELA) ||
+			section.sh_info >= codeSectionIdx.size() || codeSectionIdx[section.sh_info] == -1 ||
+			section.sh_link >= eh.e_shnum)
+		{
+			return false;
+		}
+
+		ElfRelocationIndex relIndex;
+		relIndex.build(elf, section);
+		ElfRange<Elf32_Sym> relSymTbl = elf.getSectionEntries<Elf32_Sym>(sh_tbl[section.sh_link]);
+
+		// Counted by target, so that every function called is a single edge
+		std::map<std::pair<s32, std::string_view>, u32> callCounts;
+		for (const ElfRelocationIndex::Entry& rel : relIndex.getEntries())
+		{
+			u32 type = ELF32_R_TYPE(rel.info);
+			if (type != relArmPC24 && type != relArmThmCall && type != relArmCall &&
+				type != relArmJump24 && type != relArmThmJump24)
 			{
-				// Address range - blue
-				Log::out << ANSI_BLUE "0x" << std::setw(7) << std::hex << std::uppercase << assignment.startAddress 
-					<< ANSI_BLUE "-0x" << std::setw(7) << assignment.endAddress << ANSI_RESET "  ";
-				// Success status - green
-				Log::out << ANSI_bGREEN << std::setw(8) << "ASSIGNED" << ANSI_RESET << std::endl;
+				continue;
 			}
-			else
+
+			std::size_t symIdx = ELF32_R_SYM(rel.info);
+			if (symIdx >= relSymTbl.size())
+				continue;
+			const Elf32_Sym& target = relSymTbl[symIdx];
+			if (target.st_shndx == SHN_UNDEF)
 			{
-				// N/A - gray/white
-				Log::out << ANSI_WHITE << std::setw(19) << "N/A" << ANSI_RESET << "  ";
-				// Failed status - red
-				Log::out << ANSI_bRED << std::setw(8) << "FAILED" << ANSI_RESET << std::endl;
+				std::string_view targetName = elf.getSymbolName(target);
+				if (!targetName.empty())
+					callCounts[{ -1, targetName }]++;
+			}
+			else if (target.st_shndx < codeSectionIdx.size() && codeSectionIdx[target.st_shndx] != -1)
+			{
+				callCounts[{ codeSectionIdx[target.st_shndx], {} }]++;
+			}
+		}
+
+		u32 from = u32(codeSectionIdx[section.sh_info]);
+		for (const auto& [target, count] : callCounts)
+			result.calls.push_back(ObjectCall{ from, target.first, std::string(target.second), count });
+		return false;
+	});
+
+	// The global symbols tell which link unit defines what the others use
+	elf.forEachSymbol([&](const Elf32_Sym& symbol, std::string_view symbolName){
+		u32 bind = ELF32_ST_BIND(symbol.st_info);
+		if ((bind != STB_GLOBAL && bind != STB_WEAK) || symbolName.empty())
+			return false;
+		bool isDefined = symbol.st_shndx != SHN_UNDEF;
+		bool isThumb = isDefined && ELF32_ST_TYPE(symbol.st_info) == STT_FUNC && (symbol.st_value & 1) != 0;
+		result.globalSymbols.push_back(ObjectGlobalSymbol{ std::string(symbolName), isDefined, isThumb });
+		if (isDefined && symbol.st_shndx < codeSectionIdx.size() && codeSectionIdx[symbol.st_shndx] != -1)
+			result.codeSymbols.push_back(ObjectCodeSymbol{ std::string(symbolName), u32(codeSectionIdx[symbol.st_shndx]) });
+		return false;
+	});
+}
+
+// Bodies of functions that are too small only fit the smallest sections
+static constexpr u32 MinReclaimedSize = 16;
+
+/*
+ * Reclaims the functions of the symbols file that are never executed:
+ * the ones listed as dead by the regions, and the ones replaced by an ncp_jump
+ * at their start, past the jump itself. Ranges that overlap the listed
+ * overwrites or another patch are left alone.
+ * */
+std::vector<PatchMaker::ReclaimedOverwrite> PatchMaker::findReclaimableOverwrites() const
+{
+	std::vector<ReclaimedOverwrite> candidates;
+	if (m_target->symbols.empty())
+		return candidates;
+
+	OverwriteFinder finder;
+	finder.loadSymbols(*m_targetWorkDir / m_target->symbols);
+
+	std::unordered_set<int> destsReclaimingJumped;
+	for (const auto& region : m_target->regions)
+	{
+		if (region.reclaimJumped)
+			destsReclaimingJumped.insert(region.destination);
+
+		for (const BuildTarget::DeadFunction& function : region.deadFunctions)
+		{
+			// With a size the function is never taken past it, the next symbol
+			// can be missing from the symbols file and unnamed code could follow
+			u32 startAddress, endAddress;
+			bool isSized = function.size != 0;
+			if (isSized)
+			{
+				if (!finder.findSymbol(function.name, startAddress))
+				{
+					Log::out << OWARN << "The dead function " << OSTR(function.name) << " was not found in the symbols file." << std::endl;
+					continue;
+				}
+				endAddress = startAddress + function.size;
+				u32 nextAddress;
+				if (finder.findFunctionAt(startAddress, nextAddress))
+					endAddress = std::min(endAddress, nextAddress);
 			}
+			else if (!finder.findFunction(function.name, startAddress, endAddress))
+			{
+				Log::out << OWARN << "The dead function " << OSTR(function.name) << " was not found in the symbols file or could not be sized." << std::endl;
+				continue;
+			}
+			candidates.push_back(ReclaimedOverwrite{ region.destination, startAddress, endAddress, isSized || region.reclaimUnsized, true });
+		}
+	}
+
+	// Only the destinations with a region can hold code
+	std::unordered_set<int> dests;
+	for (const auto& region : m_target->regions)
+		dests.insert(region.destination);
+
+	for (const auto& p : m_patchInfo)
+	{
+		if (p->patchType != PatchType::Jump || !dests.contains(p->destAddressOv))
+			continue;
+		u32 endAddress;
+		if (!finder.findFunctionAt(p->destAddress, endAddress))
+			continue;
+		u32 startAddress = p->destAddress + getPatchOverwriteAmount(p.get());
+		if (startAddress < endAddress)
+			candidates.push_back(ReclaimedOverwrite{ p->destAddressOv, startAddress, endAddress, destsReclaimingJumped.contains(p->destAddressOv), false });
+	}
+
+	IntervalTree<int> usedTree;
+	for (const auto& region : m_target->regions)
+	{
+		for (const auto& overwrite : region.overwrites)
+			usedTree.insert(region.destination, overwrite.startAddress, overwrite.endAddress, 0);
+	}
+	for (const auto& p : m_patchInfo)
+		usedTree.insert(p->destAddressOv, p->destAddress, p->destAddress + getPatchOverwriteAmount(p.get()), 0);
+	usedTree.build();
+
+	std::sort(candidates.begin(), candidates.end(), [](const ReclaimedOverwrite& a, const ReclaimedOverwrite& b){
+		if (a.destination != b.destination)
+			return a.destination < b.destination;
+		return a.startAddress < b.startAddress;
+	});
+
+	std::vector<ReclaimedOverwrite> reclaimed;
+	std::size_t proposedCount = 0;
+	u32 proposedSize = 0;
+	std::size_t proposedDeadCount = 0;
+	u32 proposedDeadSize = 0;
+	for (const ReclaimedOverwrite& candidate : candidates)
+	{
+		if (candidate.endAddress - candidate.startAddress < MinReclaimedSize)
+			continue;
+
+		bool isUsed = false;
+		usedTree.forEachOverlapping(candidate.destination, candidate.startAddress, candidate.endAddress, [&](const auto&){
+			isUsed = true;
+		});
+		// Sorted, a dead function can also be replaced by a jump
+		if (!reclaimed.empty() && reclaimed.back().destination == candidate.destination && reclaimed.back().endAddress > candidate.startAddress)
+			isUsed = true;
+		if (isUsed)
+			continue;
+
+		if (!candidate.isReclaimed && candidate.isDead)
+		{
+			proposedDeadCount++;
+			proposedDeadSize += candidate.endAddress - candidate.startAddress;
+			if (Main::getVerbose())
+			{
+				Log::out << OINFO << "The dead function at 0x" << std::hex << std::uppercase << candidate.startAddress
+					<< "-0x" << candidate.endAddress << std::dec << " has no size and could be reclaimed up to the next symbol." << std::endl;
+			}
+			continue;
+		}
+
+		if (!candidate.isReclaimed)
+		{
+			proposedCount++;
+			proposedSize += candidate.endAddress - candidate.startAddress;
+			if (Main::getVerbose())
+			{
+				Log::out << OINFO << "The function body at 0x" << std::hex << std::uppercase << candidate.startAddress
+					<< "-0x" << candidate.endAddress << std::dec << " is replaced by a jump and could be reclaimed." << std::endl;
+			}
+			continue;
 		}
+
+		reclaimed.push_back(candidate);
+	}
+
+	if (proposedCount != 0)
+	{
+		Log::out << OINFO << proposedCount << " functions replaced by jumps could free " << proposedSize
+			<< " bytes, set " << OSTR("reclaim_jumped") << " on their regions to use them as overwrites." << std::endl;
+	}
+	if (proposedDeadCount != 0)
+	{
+		Log::out << OINFO << proposedDeadCount << " dead functions without a size could free " << proposedDeadSize
+			<< " bytes, give them their size or set " << OSTR("reclaim_unsized") << " on their regions to use them as overwrites." << std::endl;
 	}
+
+	return reclaimed;
 }
 
-void PatchMaker::createBuildDirectory()
+void PatchMaker::setupOverwriteRegions()
 {
-	fs::current_path(Main::getWorkPath());
-	const fs::path& buildDir = *m_buildDir;
-	if (!fs::exists(buildDir))
+	Log::info("Setting up overwrite regions...");
+
+	auto addOverwrite = [&](int dest, u32 startAddress, u32 endAddress){
+		std::string memName = "overwrite_";
+		memName += Util::intToAddr(int(startAddress), 8, false);
+		if (dest != -1)
+		{
+			memName += '_';
+			memName += getDestName(dest);
+		}
+
+		auto* overwriteRegion = new OverwriteRegionInfo{
+			.startAddress = startAddress,
+			.endAddress = endAddress,
+			.destination = dest,
+			.assignedSections = {},
+			.usedSize = 0,
+			.memName = memName
+		};
+		m_overwriteRegions.emplace_back(overwriteRegion);
+
+		if (Main::getVerbose())
+		{
+			Log::out << OINFO << "Found overwrite region: 0x" << std::hex << std::uppercase 
+				<< startAddress << "-0x" << endAddress 
+				<< " (size: " << std::dec << (endAddress - startAddress) 
+				<< " bytes)" << std::endl;
+		}
+	};
+
+	for (const auto& region : m_target->regions)
 	{
-		if (!fs::create_directories(buildDir))
+		for (const auto& overwrite : region.overwrites)
+			addOverwrite(region.destination, overwrite.startAddress, overwrite.endAddress);
+	}
+
+	for (const auto& overwrite : findReclaimableOverwrites())
+		addOverwrite(overwrite.destination, overwrite.startAddress, overwrite.endAddress);
+
+	// Overwrite regions sharing bytes would be linked on top of each other
+	IntervalTree<const OverwriteRegionInfo*> overwriteTree;
+	for (const auto& overwrite : m_overwriteRegions)
+		overwriteTree.insert(overwrite->destination, overwrite->startAddress, overwrite->endAddress, overwrite.get());
+	overwriteTree.build();
+
+	bool foundOverlapping = false;
+	overwriteTree.forEachOverlap([&](const auto& ia, const auto& ib){
+		Log::out << OERROR << "Overwrite region 0x" << std::hex << std::uppercase
+			<< ia.start << "-0x" << ia.end << " overlaps with overwrite region 0x"
+			<< ib.start << "-0x" << ib.end << std::dec << std::endl;
+		foundOverlapping = true;
+	});
+	if (foundOverlapping)
+		throw ncp::exception("Overlapping overwrite regions were detected.");
+}
+
+/*
+ * Sizes the bridges that the patches need before linking, grouped into blocks
+ * that are placed like sections: into the overwrite regions when there is space
+ * left, otherwise into the autogen data after the code of the destination.
+ * */
+void PatchMaker::reserveBridges()
+{
+	bool isArm9 = m_target->getArm9();
+
+	auto getBlockIn = [&](const std::string& key, int dest, const GenericPatchInfo* p) -> BridgeBlock& {
+		BridgeBlock*& block = m_bridgeBlockForKey[key];
+		if (block == nullptr)
+		{
+			auto newBlock = std::make_unique<BridgeBlock>();
+			newBlock->symbol = "ncp_bridge_" + std::to_string(m_bridgeBlocks.size());
+			newBlock->destination = dest;
+			newBlock->nearAddress = p->destAddress;
+			block = newBlock.get();
+			m_bridgeBlocks.emplace_back(std::move(newBlock));
+		}
+		return *block;
+	};
+	auto getBlock = [&](const std::string& key, const GenericPatchInfo* p) -> BridgeBlock& {
+		return getBlockIn(key, p->srcAddressOv, p);
+	};
+
+	std::unordered_set<int> regionDests;
+	for (const auto& region : m_target->regions)
+		regionDests.insert(region.destination);
+
+	/*
+	 * A THUMB BL reaches 4MB and an ARM branch 32MB, the sites that may not reach
+	 * some of a TCM go through a far veneer in their own destination, or in the
+	 * main binary if it has no region.
+	 * */
+	auto reserveFarVeneer = [&](const GenericPatchInfo* p){
+		auto tcmIt = m_tcmForDest.find(p->srcAddressOv);
+		if (tcmIt == m_tcmForDest.end())
+			return false;
+
+		bool isThumbBL = p->destThumb && p->patchType != PatchType::Jump;
+		s64 range = isThumbBL ? 0x400000 : 0x2000000;
+		s64 farthest = std::max(
+			std::abs(s64(tcmIt->second.startAddress) - s64(p->destAddress)),
+			std::abs(s64(tcmIt->second.endAddress) - s64(p->destAddress))
+		);
+		if (farthest + 8 < range)
+			return false;
+
+		int dest = regionDests.contains(p->destAddressOv) ? p->destAddressOv : -1;
+		if (!regionDests.contains(dest))
 		{
 			std::ostringstream oss;
-			oss << "Could not create build directory: " << OSTR(buildDir);
+			oss << OSTRa(p->symbol) << " (" << OSTR(p->job->srcFilePath.string()) << ") is out of range of the TCM"
+				<< " and needs a veneer, but there is no region in its destination or in the main binary to place it.";
 			throw ncp::exception(oss.str());
 		}
+		getBlockIn(getFarVeneerKey(p), dest, p).size = SizeOfFarVeneer;
+		return true;
+	};
+
+	// Bridges into the same function are shared, the ones of unknown functions are reserved apart
+	for (const auto& p : m_patchInfo)
+	{
+		// The far veneer also changes the state
+		bool isBranch = p->patchType == PatchType::Jump || p->patchType == PatchType::Call || p->patchType == PatchType::Hook;
+		if (isBranch && reserveFarVeneer(p.get()) && p->patchType != PatchType::Hook)
+			continue;
+
+		if (p->patchType == PatchType::Hook)
+		{
+			if (p->destThumb && !p->srcThumb && !isArm9) // THUMB -> ARM
+				getBlock(getBridgeKey("thumb2arm", p.get()), p.get()).size = SizeOfThumb2ArmVeneer;
+			else if (!p->destThumb && p->srcThumb && !isArm9) // ARM -> THUMB, the bridges call through a veneer
+				getBlock(getBridgeKey("arm2thumb", p.get()), p.get()).size = getArm2ThumbJumpBridgeSize(isArm9);
+		}
+		else if (p->patchType == PatchType::Jump)
+		{
+			// Reserved for THUMB -> THUMB as well, if it is too far for a THUMB branch
+			if (p->srcThumb)
+				getBlock(getBridgeKey("arm2thumb", p.get()), p.get()).size = getArm2ThumbJumpBridgeSize(isArm9);
+		}
+		else if (p->patchType == PatchType::Call && p->destThumb != p->srcThumb && !isArm9)
+		{
+			if (p->srcThumb) // ARM -> THUMB
+				getBlock(getBridgeKey("arm2thumb", p.get()), p.get()).size = getArm2ThumbJumpBridgeSize(isArm9);
+			else // THUMB -> ARM
+				getBlock(getBridgeKey("thumb2arm", p.get()), p.get()).size = SizeOfThumb2ArmVeneer;
+		}
+	}
+
+	for (const auto& [site, hooks] : getHooksForSite(m_patchInfo))
+	{
+		// The labels and the ncp_set variables are global symbols, they would be defined twice
+		for (const GenericPatchInfo* hook : hooks)
+		{
+			if (hooks.size() > 1 && hook->sectionIdx == -1)
+			{
+				std::ostringstream oss;
+				oss << OSTRa(hook->symbol) << " (" << OSTR(hook->job->srcFilePath.string()) << ") hooks "
+					<< Util::intToAddr(hook->destAddress, 8) << " along with other hooks, but only the hooks of "
+					<< OSTRa("ncp_hook") << " function tags can be chained.";
+				throw ncp::exception(oss.str());
+			}
+
+			// Each would move the instructions of the site into its own bridge, nesting them
+			if (hooks.size() > 1 && hook->destThumb)
+			{
+				std::ostringstream oss;
+				oss << OSTRa(hook->symbol) << " (" << OSTR(hook->job->srcFilePath.string()) << ") hooks the THUMB code at "
+					<< Util::intToAddr(hook->destAddress, 8) << " along with other hooks, but THUMB hooks cannot be chained.";
+				throw ncp::exception(oss.str());
+			}
+		}
+
+		const GenericPatchInfo* hook = hooks.front();
+		if (hook->destThumb)
+		{
+			ICodeBin* bin = (hook->destAddressOv == -1) ?
+							static_cast<ICodeBin*>(getArm()) :
+							static_cast<ICodeBin*>(getOverlay(hook->destAddressOv));
+			getBlock(getHookSiteKey(hook), hook).size += getThumbHookBridgeSize(readThumbHookSite(bin, hook->destAddress));
+		}
+		else if (hooks.size() > 1)
+			getBlock(getHookSiteKey(hook), hook).size += getChainedHookBridgeSize(hooks.size());
+		else if (hook->isLeanHook)
+			getBlock(getHookSiteKey(hook), hook).size += SizeOfLeanHookBridge;
+		else if (hook->targetKey.empty())
+			getBlock(getHookSiteKey(hook), hook).size += SizeOfHookBridge;
+		else
+			getBlock(getBridgeKey("hook", hook), hook).siteCount++;
+	}
+
+	for (auto& block : m_bridgeBlocks)
+	{
+		if (block->siteCount != 0)
+			block->size = getHookBridgesSize(block->siteCount);
+
+		SectionInfo& section = block->section;
+		section.name = block->symbol;
+		section.size = block->size;
+		section.job = nullptr;
+		section.alignment = 4;
+		section.destination = block->destination;
+		section.isBridge = true;
+	}
+}
+
+// Section patches are aligned to 4 by the linker script, for the label that they are turned into
+static u32 getOverwritePlacementAlignment(const SectionInfo* section)
+{
+	bool isPatch = section->name.starts_with(".ncp_jump") ||
+		section->name.starts_with(".ncp_call") ||
+		section->name.starts_with(".ncp_hook");
+	return isPatch ? std::max<u32>(section->alignment, 4) : section->alignment;
+}
+
+void PatchMaker::assignSectionsToOverwrites()
+{
+	if (m_overwriteRegions.empty())
+		return;
+
+	// Group sections by destination, in destination order so that the report is stable
+	std::map<int, std::vector<SectionInfo*>> sectionsByDest;
+	for (auto& section : m_overwriteCandidateSections)
+	{
+		int dest = section->job->region->destination;
+		sectionsByDest[dest].emplace_back(section.get());
+	}
+	for (const auto& block : m_bridgeBlocks)
+		sectionsByDest.try_emplace(block->destination);
+
+	// Structure to store assignment information for table printing
+	struct SectionAssignment {
+		std::string sectionName;
+		std::size_t sectionSize;
+		u32 startAddress;
+		u32 endAddress;
+		bool assigned;
+	};
+	std::vector<SectionAssignment> assignments;
+
+	// Process each destination
+	for (auto& [dest, sections] : sectionsByDest)
+	{
+		// Get overwrite regions for this destination
+		std::vector<OverwriteRegionInfo*> destOverwrites;
+		for (auto& overwrite : m_overwriteRegions)
+		{
+			if (overwrite->destination == dest)
+				destOverwrites.emplace_back(overwrite.get());
+		}
+
+		if (destOverwrites.empty())
+			continue;
+
+		// Regions in address order, shrunk to the alignment of the output sections
+		std::sort(destOverwrites.begin(), destOverwrites.end(), [](const OverwriteRegionInfo* a, const OverwriteRegionInfo* b){
+			return a->startAddress < b->startAddress;
+		});
+
+		std::vector<OverwritePacker::Bin> bins;
+		bins.reserve(destOverwrites.size());
+		for (const auto* overwrite : destOverwrites)
+		{
+			u32 start = (overwrite->startAddress + 3) & ~3;
+			u32 end = std::max(start, overwrite->endAddress & ~3);
+			bins.push_back(OverwritePacker::Bin{ start, end });
+		}
+
+		std::vector<OverwritePacker::Item> items;
+		items.reserve(sections.size());
+		for (const auto* section : sections)
+			items.push_back(OverwritePacker::Item{ u32(section->size), getOverwritePlacementAlignment(section) });
+
+		OverwritePacker::Result packing = OverwritePacker::pack(items, bins);
+
+		for (std::size_t i = 0; i < sections.size(); i++)
+		{
+			SectionInfo* section = sections[i];
+			const OverwritePacker::Placement& placement = packing.placements[i];
+			if (placement.bin != -1)
+			{
+				section->address = placement.address;
+				destOverwrites[placement.bin]->assignedSections.emplace_back(section);
+			}
+
+			if (Main::getVerbose())
+			{
+				const OverwriteRegionInfo* overwrite = placement.bin != -1 ? destOverwrites[placement.bin] : nullptr;
+				assignments.push_back({
+					.sectionName = section->name,
+					.sectionSize = section->size,
+					.startAddress = overwrite != nullptr ? overwrite->startAddress : 0,
+					.endAddress = overwrite != nullptr ? overwrite->endAddress : 0,
+					.assigned = overwrite != nullptr
+				});
+			}
+		}
+
+		// The bridges fill the space that the sections leave, in the region closest to their patch
+		std::vector<u32> binEnds(bins.size());
+		for (std::size_t b = 0; b < bins.size(); b++)
+			binEnds[b] = (packing.binEnds[b] + 3) & ~3;
+		for (auto& block : m_bridgeBlocks)
+		{
+			if (block->destination != dest)
+				continue;
+
+			std::size_t bestBin = bins.size();
+			u32 bestDistance = 0;
+			for (std::size_t b = 0; b < bins.size(); b++)
+			{
+				if (binEnds[b] + block->size > bins[b].end)
+					continue;
+				u32 distance = 0;
+				if (block->nearAddress < bins[b].start)
+					distance = bins[b].start - block->nearAddress;
+				else if (block->nearAddress >= bins[b].end)
+					distance = block->nearAddress - bins[b].end;
+				if (bestBin == bins.size() || distance < bestDistance)
+				{
+					bestBin = b;
+					bestDistance = distance;
+				}
+			}
+
+			if (bestBin != bins.size())
+			{
+				block->section.address = binEnds[bestBin];
+				block->overwrite = destOverwrites[bestBin];
+				block->overwrite->assignedSections.emplace_back(&block->section);
+				binEnds[bestBin] += u32(block->size);
+			}
+
+			if (Main::getVerbose())
+			{
+				assignments.push_back({
+					.sectionName = block->symbol,
+					.sectionSize = block->size,
+					.startAddress = block->overwrite != nullptr ? block->overwrite->startAddress : 0,
+					.endAddress = block->overwrite != nullptr ? block->overwrite->endAddress : 0,
+					.assigned = block->overwrite != nullptr
+				});
+			}
+		}
+
+		// The linker script places the sections in address order, which reproduces the packed layout
+		for (std::size_t b = 0; b < destOverwrites.size(); b++)
+		{
+			OverwriteRegionInfo* overwrite = destOverwrites[b];
+			std::sort(overwrite->assignedSections.begin(), overwrite->assignedSections.end(), [](const SectionInfo* x, const SectionInfo* y){
+				return x->address < y->address;
+			});
+
+			u32 usedBytes = 0;
+			for (const auto* section : overwrite->assignedSections)
+				usedBytes += u32(section->size);
+			if (!overwrite->assignedSections.empty())
+				overwrite->usedSize = binEnds[b] - packing.binStarts[b];
+
+			if (Main::getVerbose())
+			{
+				u32 capacity = overwrite->endAddress - overwrite->startAddress;
+				Log::out << OINFO << "Overwrite region " << OSTR(overwrite->memName)
+					<< " holds " << overwrite->assignedSections.size() << " sections, "
+					<< usedBytes << " of " << capacity << " bytes used ("
+					<< std::fixed << std::setprecision(1) << (capacity != 0 ? 100.0 * usedBytes / capacity : 0.0)
+					<< std::defaultfloat << "%)" << std::endl;
+			}
+		}
+
+		if (Main::getVerbose() && !packing.isOptimal)
+			Log::out << OINFO << "The overwrite packing of " << getDestName(dest) << " may not be optimal." << std::endl;
+	}
+
+	// Print assignment table if verbose mode is enabled
+	if (Main::getVerbose() && !assignments.empty())
+	{
+		Log::out << ANSI_bCYAN "Assigned sections:" ANSI_RESET "\n" 
+			<< ANSI_bWHITE "SECTION_NAME" ANSI_RESET "                     " 
+			<< ANSI_bWHITE "SIZE" ANSI_RESET "     " 
+			<< ANSI_bWHITE "OVERWRITE_REGION" ANSI_RESET "        " 
+			<< ANSI_bWHITE "STATUS" ANSI_RESET << std::endl;
+		
+		for (const auto& assignment : assignments)
+		{
+			// Section name - yellow for readability
+			Log::out << ANSI_YELLOW << std::setw(64) << std::left << assignment.sectionName << ANSI_RESET << std::right << " ";
+			
+			// Size - white/cyan
+			Log::out << ANSI_CYAN << std::setw(8) << std::dec << assignment.sectionSize << ANSI_RESET << "  ";
+			
+			if (assignment.assigned)
+			{
+				// Address range - blue
+				Log::out << ANSI_BLUE "0x" << std::setw(7) << std::hex << std::uppercase << assignment.startAddress 
+					<< ANSI_BLUE "-0x" << std::setw(7) << assignment.endAddress << ANSI_RESET "  ";
+				// Success status - green
+				Log::out << ANSI_bGREEN << std::setw(8) << "ASSIGNED" << ANSI_RESET << std::endl;
+			}
+			else
+			{
+				// N/A - gray/white
+				Log::out << ANSI_WHITE << std::setw(19) << "N/A" << ANSI_RESET << "  ";
+				// Failed status - red
+				Log::out << ANSI_bRED << std::setw(8) << "FAILED" << ANSI_RESET << std::endl;
+			}
+		}
+	}
+}
+
+static constexpr u32 ProfileMapVersion = 1;
+
+/*
+ * Maps the PC samples of the profile to the functions of the new code.
+ * The samples come from the ROM of a previous build, so they are mapped
+ * through the ELF files of that build. The mapping is kept in the build
+ * directory, the next builds move the functions but keep using it until the profile changes.
+ * */
+void PatchMaker::loadProfile()
+{
+	const std::string armName = m_target->getArm9() ? "arm9" : "arm7";
+	fs::path profilePath = *m_targetWorkDir / m_target->profile;
+	fs::path mapPath = *m_buildDir / (armName + ".profile");
+	u64 stamp = hashFileStamp(profilePath, Util::fnv1a64(&ProfileMapVersion, sizeof(u32)));
+
+	if (!fs::is_regular_file(profilePath))
+		throw ncp::file_error(profilePath, ncp::file_error::find);
+
+	std::unordered_map<int, std::unordered_map<std::string, u64>> samplesForFunction;
+	u64 totalSamples = 0;
+	u64 mappedSamples = 0;
+
+	bool isMapped = false;
+	std::ifstream mapFile(mapPath);
+	u64 mapStamp;
+	if (mapFile.is_open() && (mapFile >> std::hex >> mapStamp >> std::dec >> totalSamples >> mappedSamples) && mapStamp == stamp)
+	{
+		int dest;
+		u64 count;
+		std::string name;
+		while (mapFile >> dest >> count >> name)
+			samplesForFunction[dest][name] += count;
+		isMapped = true;
+	}
+	mapFile.close();
+
+	if (!isMapped)
+	{
+		std::ifstream profileFile(profilePath);
+		if (!profileFile.is_open())
+			throw ncp::file_error(profilePath, ncp::file_error::read);
+
+		// Every line holds a hexadecimal address and its sample count, # starts a comment
+		std::vector<std::pair<u32, u64>> samples;
+		totalSamples = 0;
+		mappedSamples = 0;
+		std::string line;
+		for (std::size_t lineNo = 1; std::getline(profileFile, line); lineNo++)
+		{
+			std::size_t comment = line.find('#');
+			if (comment != std::string::npos)
+				line.resize(comment);
+
+			std::istringstream iss(line);
+			std::string addressStr, countStr;
+			if (!(iss >> addressStr))
+				continue;
+
+			u32 address;
+			u64 count;
+			try {
+				std::size_t parsed = 0;
+				address = u32(std::stoul(addressStr, &parsed, 16));
+				if (parsed != addressStr.length() || !(iss >> countStr))
+					throw std::invalid_argument(addressStr);
+				count = std::stoull(countStr, &parsed, 10);
+				if (parsed != countStr.length())
+					throw std::invalid_argument(countStr);
+			} catch (std::exception&) {
+				std::ostringstream oss;
+				oss << "Invalid sample at line " << lineNo << " of " << OSTR(profilePath.string())
+					<< ", expected an address and a count.";
+				throw ncp::exception(oss.str());
+			}
+
+			samples.emplace_back(address & ~1, count);
+			totalSamples += count;
+		}
+
+		std::vector<bool> isSampleMapped(samples.size(), false);
+		bool hasElf = false;
+		for (const auto& [dest, graph] : m_callGraphForDest)
+		{
+			fs::path elfPath = *m_buildDir / (armName + getUnitSuffix(dest) + ".elf");
+			std::error_code ec;
+			Elf32 elf;
+			if (!fs::exists(elfPath, ec) || !elf.load(elfPath))
+				continue;
+			hasElf = true;
+
+			struct FunctionRange
+			{
+				u32 start;
+				u32 end;
+				std::string_view name;
+			};
+			std::vector<FunctionRange> functions;
+			elf.forEachSymbol([&](const Elf32_Sym& symbol, std::string_view symbolName){
+				if (ELF32_ST_TYPE(symbol.st_info) == STT_FUNC && symbol.st_size != 0 && !symbolName.empty() &&
+					symbol.st_shndx != SHN_UNDEF && symbol.st_shndx != SHN_ABS)
+				{
+					u32 start = symbol.st_value & ~1;
+					functions.push_back(FunctionRange{ start, start + symbol.st_size, symbolName });
+				}
+				return false;
+			});
+			std::sort(functions.begin(), functions.end(), [](const FunctionRange& a, const FunctionRange& b){
+				return a.start < b.start;
+			});
+
+			// The overlays share addresses, a sample goes to the functions of every one holding it
+			auto& functionSamples = samplesForFunction[dest];
+			for (std::size_t i = 0; i < samples.size(); i++)
+			{
+				u32 address = samples[i].first;
+				auto it = std::upper_bound(functions.begin(), functions.end(), address, [](u32 addr, const FunctionRange& f){
+					return addr < f.start;
+				});
+				if (it == functions.begin() || std::prev(it)->end <= address)
+					continue;
+				functionSamples[std::string(std::prev(it)->name)] += samples[i].second;
+				isSampleMapped[i] = true;
+			}
+		}
+
+		if (!hasElf)
+		{
+			Log::out << OWARN << "The profile is mapped through the ELF files of the build it was taken from, "
+				"none exist yet, it is used from the next build." << std::endl;
+			return;
+		}
+
+		for (std::size_t i = 0; i < samples.size(); i++)
+		{
+			if (isSampleMapped[i])
+				mappedSamples += samples[i].second;
+		}
+
+		// Only a cache, if it can not be written the profile is mapped again next time
+		std::ofstream outMapFile(mapPath);
+		if (outMapFile.is_open())
+		{
+			outMapFile << std::hex << stamp << std::dec << ' ' << totalSamples << ' ' << mappedSamples << '\n';
+			for (const auto& [dest, functionSamples] : samplesForFunction)
+			{
+				for (const auto& [name, count] : functionSamples)
+					outMapFile << dest << ' ' << count << ' ' << name << '\n';
+			}
+		}
+	}
+
+	Log::out << OINFO << std::dec << mappedSamples << " of the " << totalSamples
+		<< " samples of the profile are in the new code." << std::endl;
+
+	for (auto& [dest, graph] : m_callGraphForDest)
+	{
+		graph->samples.assign(graph->sections.size(), 0);
+		auto samplesIt = samplesForFunction.find(dest);
+		if (samplesIt == samplesForFunction.end())
+			continue;
+
+		// The static functions are found by the name of their section, if no other section has it
+		std::unordered_map<std::string_view, std::size_t> sectionForName;
+		for (std::size_t i = 0; i < graph->sections.size(); i++)
+		{
+			auto [it, isNew] = sectionForName.try_emplace(graph->sections[i].name, i);
+			if (!isNew)
+				it->second = std::size_t(-1);
+		}
+
+		for (const auto& [name, count] : samplesIt->second)
+		{
+			std::size_t idx;
+			auto symbolIt = graph->sectionForSymbol.find(name);
+			if (symbolIt != graph->sectionForSymbol.end())
+			{
+				idx = symbolIt->second;
+			}
+			else
+			{
+				std::string sectionName = ".text." + name;
+				auto nameIt = sectionForName.find(sectionName);
+				if (nameIt == sectionForName.end() || nameIt->second == std::size_t(-1))
+					continue;
+				idx = nameIt->second;
+			}
+			graph->samples[idx] += count;
+		}
+	}
+}
+
+/*
+ * Orders the code sections of every destination by their call graph, the
+ * sections packed into overwrite regions are left out, they are placed by the packing.
+ * With a profile, the sections that were sampled are only chained with each
+ * other and come first, the ones never sampled go to the end of the new code.
+ * */
+void PatchMaker::orderCodeSections()
+{
+	if (!m_target->orderSections && m_target->profile.empty())
+		return;
+
+	if (!m_target->profile.empty())
+		loadProfile();
+
+	std::set<std::pair<const SourceFileJob*, std::string_view>> overwriteSections;
+	for (const auto& overwrite : m_overwriteRegions)
+	{
+		for (const SectionInfo* section : overwrite->assignedSections)
+		{
+			if (!section->isBridge)
+				overwriteSections.emplace(section->job, section->name);
+		}
+	}
+
+	std::vector<int> dests;
+	for (const auto& [dest, graph] : m_callGraphForDest)
+		dests.push_back(dest);
+	std::sort(dests.begin(), dests.end());
+
+	// The ARM7 and the TCMs have no cache to keep the chains in
+	bool isArm9 = m_target->getArm9();
+
+	for (int dest : dests)
+	{
+		CallGraph& graph = *m_callGraphForDest[dest];
+
+		bool hasSamples = std::any_of(graph.samples.begin(), graph.samples.end(), [](u64 count){ return count != 0; });
+		auto isHot = [&](std::size_t idx){ return hasSamples && graph.samples[idx] != 0; };
+
+		std::vector<SectionOrder::Node> nodes;
+		std::vector<bool> isInOverwrite;
+		nodes.reserve(graph.sections.size());
+		isInOverwrite.reserve(graph.sections.size());
+		for (const CodeSectionInfo& section : graph.sections)
+		{
+			nodes.push_back(SectionOrder::Node{ section.size, section.alignment });
+			isInOverwrite.push_back(overwriteSections.contains({ section.job, section.name }));
+		}
+
+		// The calls between hot sections weigh by how often the least sampled one runs
+		std::vector<SectionOrder::Edge> calls;
+		for (const SectionOrder::Edge& call : graph.calls)
+		{
+			if (isInOverwrite[call.from] || isInOverwrite[call.to] || isHot(call.from) != isHot(call.to))
+				continue;
+			u64 weight = call.weight;
+			if (isHot(call.from))
+				weight *= 1 + std::min(graph.samples[call.from], graph.samples[call.to]);
+			calls.push_back(SectionOrder::Edge{ call.from, call.to, weight });
+		}
+
+		u32 maxChainSize = isArm9 && !isTcmDest(dest) ? Arm9ICacheSize : 0;
+		std::size_t hotChainCount = 0;
+		std::size_t orderedCount = 0;
+		graph.chains.clear();
+		for (SectionOrder::Chain& chain : SectionOrder::order(nodes, calls, maxChainSize))
+		{
+			if (chain.nodes.size() == 1 && isInOverwrite[chain.nodes[0]])
+				continue;
+			if (chain.nodes.size() > 1)
+				hotChainCount++;
+			orderedCount += chain.nodes.size();
+			graph.chains.emplace_back(std::move(chain));
+		}
+
+		// A chain only joins sections of the same temperature
+		auto coldIt = std::stable_partition(graph.chains.begin(), graph.chains.end(), [&](const SectionOrder::Chain& chain){
+			return !hasSamples || isHot(chain.nodes[0]);
+		});
+		graph.coldChainsStart = std::size_t(coldIt - graph.chains.begin());
+
+		if (orderedCount != 0)
+		{
+			Log::out << OINFO << "Ordered " << std::dec << orderedCount << " code sections of " << getDestName(dest)
+				<< " into " << hotChainCount << " call chains." << std::endl;
+		}
+
+		if (hasSamples)
+			reportProfile(dest, graph);
+	}
+}
+
+// The amount of hottest sections listed by the profile report
+static constexpr std::size_t ProfileReportSections = 8;
+
+/*
+ * Shows how much of the instruction cache or of the ITCM the
+ * sampled code of a destination is expected to take.
+ * */
+void PatchMaker::reportProfile(int dest, const CallGraph& graph) const
+{
+	u64 totalSamples = 0;
+	std::size_t hotCount = 0;
+	u64 hotSize = 0;
+	u64 coldSize = 0;
+	std::vector<std::size_t> hotSections;
+	for (std::size_t i = 0; i < graph.sections.size(); i++)
+	{
+		totalSamples += graph.samples[i];
+		if (graph.samples[i] != 0)
+		{
+			hotCount++;
+			hotSize += graph.sections[i].size;
+			hotSections.push_back(i);
+		}
+		else
+		{
+			coldSize += graph.sections[i].size;
+		}
+	}
+	std::stable_sort(hotSections.begin(), hotSections.end(), [&](std::size_t a, std::size_t b){
+		return graph.samples[a] > graph.samples[b];
+	});
+
+	// The working set, the hottest sections holding 90% of the samples
+	u64 workingSetSize = 0;
+	u64 workingSetSamples = 0;
+	for (std::size_t idx : hotSections)
+	{
+		if (workingSetSamples * 10 >= totalSamples * 9)
+			break;
+		workingSetSamples += graph.samples[idx];
+		workingSetSize += graph.sections[idx].size;
+	}
+
+	auto percent = [](u64 value, u64 total){
+		return total == 0 ? 0 : unsigned(value * 100 / total);
+	};
+
+	std::string destName = getDestName(dest);
+	Log::out << ANSI_bCYAN "Profile of " << destName << ":" ANSI_RESET "\n" << std::dec
+		<< "  Hot code: " << hotCount << " sections, " << hotSize << " bytes\n"
+		<< "  Cold code: " << (graph.sections.size() - hotCount) << " sections, " << coldSize << " bytes\n"
+		<< "  90% of the samples run in " << workingSetSize << " bytes";
+
+	if (dest == BuildTarget::DestItcm)
+	{
+		const TcmSegment& tcm = m_tcmForDest.at(dest);
+		u32 freeSize = tcm.endAddress - m_newcodeAddrForDest.at(dest);
+		Log::out << "\n  ITCM: the code sections take " << (hotSize + coldSize) << " of the " << freeSize
+			<< " free bytes (" << percent(hotSize + coldSize, freeSize) << "%)";
+	}
+	else if (m_target->getArm9() && !isTcmDest(dest))
+	{
+		Log::out << ", " << percent(workingSetSize, Arm9ICacheSize) << "% of the instruction cache";
+		if (workingSetSize > Arm9ICacheSize)
+			Log::out << ", it does not fit";
+		auto tcmIt = m_tcmForDest.find(BuildTarget::DestItcm);
+		u32 itcmFree = tcmIt != m_tcmForDest.end() ? tcmIt->second.endAddress - m_newcodeAddrForDest.at(BuildTarget::DestItcm) : ItcmSize;
+		if (workingSetSize <= itcmFree)
+			Log::out << "\n  It would fit in the " << itcmFree << " free bytes of the ITCM, as an \"itcm\" region";
+	}
+	Log::out << '\n';
+
+	Log::out << "  SAMPLES     SHARE  SIZE      SECTION\n";
+	for (std::size_t i = 0; i < hotSections.size() && i < ProfileReportSections; i++)
+	{
+		const CodeSectionInfo& section = graph.sections[hotSections[i]];
+		u64 count = graph.samples[hotSections[i]];
+		Log::out << "  " << std::setw(10) << std::left << count
+			<< "  " << std::setw(4) << std::right << percent(count, totalSamples) << "%"
+			<< "  " << std::setw(8) << std::left << section.size
+			<< "  " << section.name << " (" << Util::relativeIfSubpath(section.job->objFilePath).string() << ")"
+			<< std::right << '\n';
+	}
+	Log::out << std::flush;
+}
+
+void PatchMaker::createBuildDirectory()
+{
+	fs::current_path(Main::getWorkPath());
+	const fs::path& buildDir = *m_buildDir;
+	if (!fs::exists(buildDir))
+	{
+		if (!fs::create_directories(buildDir))
+		{
+			std::ostringstream oss;
+			oss << "Could not create build directory: " << OSTR(buildDir);
+			throw ncp::exception(oss.str());
+		}
+	}
+}
+
+void PatchMaker::createBackupDirectory()
+{
+	fs::current_path(Main::getWorkPath());
+	const fs::path& bakDir = BuildConfig::getBackupDir();
+	if (!fs::exists(bakDir))
+	{
+		if (!fs::create_directories(bakDir))
+		{
+			std::ostringstream oss;
+			oss << "Could not create backup directory: " << OSTR(bakDir);
+			throw ncp::exception(oss.str());
+		}
+	}
+
+	const char* prefix = m_target->getArm9() ? "overlay9" : "overlay7";
+	fs::path bakOvDir = bakDir / prefix;
+	if (!fs::exists(bakOvDir))
+	{
+		if (!fs::create_directories(bakOvDir))
+		{
+			std::ostringstream oss;
+			oss << "Could not create overlay backup directory: " << OSTR(bakOvDir);
+			throw ncp::exception(oss.str());
+		}
+	}
+}
+
+void PatchMaker::loadArmBin()
+{
+	bool isArm9 = m_target->getArm9();
+
+	const char* binName; u32 entryAddress, ramAddress, autoLoadListHookOff;
+	if (isArm9)
+	{
+		binName = "arm9.bin";
+		entryAddress = m_header->arm9.entryAddress;
+		ramAddress = m_header->arm9.ramAddress;
+		autoLoadListHookOff = m_header->arm9AutoLoadListHookOffset;
+	}
+	else
+	{
+		binName = "arm7.bin";
+		entryAddress = m_header->arm7.entryAddress;
+		ramAddress = m_header->arm7.ramAddress;
+		autoLoadListHookOff = m_header->arm7AutoLoadListHookOffset;
+	}
+
+	fs::current_path(Main::getWorkPath());
+
+	fs::path bakBinName = BuildConfig::getBackupDir() / binName;
+
+	m_arm = std::make_unique<ArmBin>();
+	if (fs::exists(bakBinName)) //has backup
+	{
+		m_arm->load(bakBinName, entryAddress, ramAddress, autoLoadListHookOff, isArm9);
+	}
+	else //has no backup
+	{
+		fs::current_path(Main::getRomPath());
+		m_arm->load(binName, entryAddress, ramAddress, autoLoadListHookOff, isArm9);
+		const std::vector<u8>& bytes = m_arm->data();
+
+		fs::current_path(Main::getWorkPath());
+		std::ofstream outputFile(bakBinName, std::ios::binary);
+		if (!outputFile.is_open())
+			throw ncp::file_error(bakBinName, ncp::file_error::write);
+		outputFile.write(reinterpret_cast<const char*>(bytes.data()), std::streamsize(bytes.size()));
+		outputFile.close();
+	}
+}
+
+void PatchMaker::saveArmBin()
+{
+	const char* binName = m_target->getArm9() ? "arm9.bin" : "arm7.bin";
+
+	const std::vector<u8>& bytes = m_arm->data();
+
+	fs::current_path(Main::getRomPath());
+	std::ofstream outputFile(binName, std::ios::binary);
+	if (!outputFile.is_open())
+		throw ncp::file_error(binName, ncp::file_error::write);
+	outputFile.write(reinterpret_cast<const char*>(bytes.data()), std::streamsize(bytes.size()));
+	outputFile.close();
+}
+
+void PatchMaker::loadOverlayTableBin()
+{
+	Log::info("Loading overlay table...");
+
+	const char* binName = m_target->getArm9() ? "arm9ovt.bin" : "arm7ovt.bin";
+
+	fs::current_path(Main::getWorkPath());
+
+	fs::path bakBinName = BuildConfig::getBackupDir() / binName;
+
+	fs::path workBinName;
+	if (fs::exists(bakBinName)) //has backup
+	{
+		workBinName = bakBinName;
+	}
+	else //has no backup
+	{
+		fs::current_path(Main::getRomPath());
+		if (!fs::exists(binName))
+			throw ncp::file_error(binName, ncp::file_error::find);
+		workBinName = binName;
+	}
+
+	MappedFile inputFile;
+	if (!inputFile.open(workBinName))
+		throw ncp::file_error(workBinName, ncp::file_error::read);
+
+	u32 overlayCount = inputFile.size() / sizeof(OvtEntry);
+
+	m_ovtEntries.resize(overlayCount);
+	if (overlayCount != 0)
+		std::memcpy(m_ovtEntries.data(), inputFile.data(), overlayCount * sizeof(OvtEntry));
+	inputFile.close();
+
+	m_bakOvtEntries.resize(m_ovtEntries.size());
+	std::memcpy(m_bakOvtEntries.data(), m_ovtEntries.data(), m_ovtEntries.size() * sizeof(OvtEntry));
+}
+
+void PatchMaker::saveOverlayTableBin()
+{
+	auto saveOvtEntries = [](const std::vector<OvtEntry>& ovtEntries, const fs::path& filePath){
+		std::ofstream outputFile(filePath, std::ios::binary);
+		if (!outputFile.is_open())
+			throw ncp::file_error(filePath, ncp::file_error::write);
+		outputFile.write(reinterpret_cast<const char*>(ovtEntries.data()), ovtEntries.size() * sizeof(OvtEntry));
+		outputFile.close();
+	};
+
+	const char* binName = m_target->getArm9() ? "arm9ovt.bin" : "arm7ovt.bin";
+
+	if (m_bakOvtChanged)
+	{
+		fs::current_path(Main::getWorkPath());
+		saveOvtEntries(m_bakOvtEntries, BuildConfig::getBackupDir() / binName);
+	}
+
+	fs::current_path(Main::getRomPath());
+	saveOvtEntries(m_ovtEntries, binName);
+}
+
+OverlayBin* PatchMaker::loadOverlayBin(std::size_t ovID)
+{
+	std::string prefix = m_target->getArm9() ? "overlay9" : "overlay7";
+
+	fs::current_path(Main::getWorkPath());
+
+	fs::path binName = fs::path(prefix) / (prefix + "_" + std::to_string(ovID) + ".bin");
+	fs::path bakBinName = BuildConfig::getBackupDir() / binName;
+
+	OvtEntry& ovte = m_ovtEntries[ovID];
+
+	auto* overlay = new OverlayBin();
+	if (fs::exists(bakBinName)) //has backup
+	{
+		overlay->load(bakBinName, ovte.ramAddress, ovte.flag & OVERLAY_FLAG_COMP, ovID);
+		ovte.flag = 0;
+	}
+	else //has no backup
+	{
+		fs::current_path(Main::getRomPath());
+		overlay->load(binName, ovte.ramAddress, ovte.flag & OVERLAY_FLAG_COMP, ovID);
+		ovte.flag = 0;
+		const std::vector<u8>& bytes = overlay->data();
+
+		std::vector<u8>& backupBytes = overlay->backupData();
+		backupBytes.resize(bytes.size());
+		std::memcpy(backupBytes.data(), bytes.data(), bytes.size());
+
+		m_bakOvtEntries[ovID].flag = 0;
+		m_bakOvtChanged = true;
+	}
+
+	m_loadedOverlays.emplace(ovID, std::unique_ptr<OverlayBin>(overlay));
+	return overlay;
+}
+
+OverlayBin* PatchMaker::getOverlay(std::size_t ovID)
+{
+	for (auto& [id, ov] : m_loadedOverlays)
+	{
+		if (id == ovID)
+			return ov.get();
+	}
+	return loadOverlayBin(ovID);
+}
+
+// The TCM regions are autoloaded by the main binary
+ICodeBin* PatchMaker::getBinForDest(int dest)
+{
+	if (dest < 0)
+		return getArm();
+	return getOverlay(std::size_t(dest));
+}
+
+void PatchMaker::saveOverlayBins()
+{
+	std::string prefix = m_target->getArm9() ? "overlay9" : "overlay7";
+
+	for (auto& [ovID, ov] : m_loadedOverlays)
+	{
+		fs::path binName = fs::path(prefix) / (prefix + "_" + std::to_string(ovID) + ".bin");
+
+		auto saveOvData = [](const std::vector<u8>& ovData, const fs::path& ovFilePath){
+			std::ofstream outputFile(ovFilePath, std::ios::binary);
+			if (!outputFile.is_open())
+				throw ncp::file_error(ovFilePath, ncp::file_error::write);
+			outputFile.write(reinterpret_cast<const char*>(ovData.data()), std::streamsize(ovData.size()));
+			outputFile.close();
+		};
+
+		fs::current_path(Main::getRomPath());
+		saveOvData(ov->data(), binName);
+
+		if (!ov->backupData().empty())
+		{
+			fs::current_path(Main::getWorkPath());
+			saveOvData(ov->backupData(), BuildConfig::getBackupDir() / binName);
+		}
+	}
+}
+
+/*
+ * With "link-archives" enabled, the objects of every region are packed into
+ * a static archive that is linked whole, so that the linker script can select
+ * their sections with a single pattern per archive instead of one per object.
+ * The archives are only repacked when their objects change.
+ * */
+
+void PatchMaker::packLinkArchives()
+{
+	if (!BuildConfig::getLinkArchives())
+		return;
+
+	fs::current_path(Main::getWorkPath());
+
+	// Objects that the linker script selects by their own name must stay loose
+	std::unordered_set<const SourceFileJob*> looseJobs;
+	for (const auto& overwrite : m_overwriteRegions)
+	{
+		for (const auto* section : overwrite->assignedSections)
+		{
+			if (!section->isBridge)
+				looseJobs.insert(section->job);
+		}
+	}
+	for (const SourceFileJob* job : m_jobsWithNcpSet)
+	{
+		if (job->region->destination != -1)
+			looseJobs.insert(job);
+	}
+
+	for (std::size_t i = 0; i < m_target->regions.size(); i++)
+	{
+		const BuildTarget::Region* region = &m_target->regions[i];
+		int dest = region->destination;
+
+		std::string archiveName; archiveName.reserve(32);
+		archiveName += "region";
+		archiveName += std::to_string(i);
+		archiveName += '_';
+		archiveName += getDestName(dest);
+		archiveName += ".a";
+
+		auto archive = std::make_unique<LinkArchive>();
+		archive->region = region;
+		archive->path = *m_buildDir / archiveName;
+
+		// ar identifies the members by their file name, objects sharing one must stay loose
+		std::unordered_set<std::string> memberNames;
+		for (const auto& srcFileJob : *m_srcFileJobs)
+		{
+			if (srcFileJob->region != region || looseJobs.contains(srcFileJob.get()))
+				continue;
+			if (!memberNames.insert(srcFileJob->objFilePath.filename().string()).second)
+				continue;
+			archive->members.push_back(srcFileJob.get());
+		}
+
+		if (archive->members.empty())
+			continue;
+
+		updateLinkArchive(*archive);
+
+		for (const SourceFileJob* member : archive->members)
+			m_archivedJobs.insert(member);
+		m_linkArchives.emplace_back(std::move(archive));
+	}
+}
+
+void PatchMaker::updateLinkArchive(const LinkArchive& archive) const
+{
+	// Response files keep the command short, forward slashes are not taken as escapes
+	auto addMember = [](std::string& list, const SourceFileJob* member){
+		list += '"';
+		list += Util::relativeIfSubpath(member->objFilePath).generic_string();
+		list += "\"\n";
+	};
+
+	auto writeList = [](const fs::path& listPath, const std::string& list){
+		std::ofstream outputFile(listPath, std::ios::binary);
+		if (!outputFile.is_open())
+			throw ncp::file_error(listPath, ncp::file_error::write);
+		outputFile.write(list.data(), std::streamsize(list.length()));
+		outputFile.close();
+	};
+
+	// The member list doubles as the record of what the archive holds
+	fs::path listPath = archive.path;
+	listPath += ".rsp";
+
+	std::string list;
+	for (const SourceFileJob* member : archive.members)
+		addMember(list, member);
+
+	std::error_code ec;
+	bool hasSameMembers = false;
+	if (fs::exists(archive.path, ec))
+	{
+		MappedFile listFile;
+		hasSameMembers = listFile.open(listPath) &&
+			std::string_view(reinterpret_cast<const char*>(listFile.data()), listFile.size()) == list;
+	}
+
+	std::string archivePath = Util::relativeIfSubpath(archive.path).string();
+
+	std::string ccmd;
+	ccmd.reserve(64);
+	ccmd += BuildConfig::getToolchain();
+
+	if (hasSameMembers)
+	{
+		fs::file_time_type archiveWriteTime = fs::last_write_time(archive.path);
+
+		std::string staleList;
+		for (const SourceFileJob* member : archive.members)
+		{
+			if (fs::last_write_time(member->objFilePath) > archiveWriteTime)
+				addMember(staleList, member);
+		}
+		if (staleList.empty())
+			return;
+
+		fs::path staleListPath = archive.path;
+		staleListPath += ".upd.rsp";
+		writeList(staleListPath, staleList);
+
+		ccmd += "ar rsD \"";
+		ccmd += archivePath;
+		ccmd += "\" @\"";
+		ccmd += Util::relativeIfSubpath(staleListPath).string();
+		ccmd += '\"';
+	}
+	else
+	{
+		// Rebuilt from scratch, replacing would keep the removed members
+		fs::remove(archive.path, ec);
+		writeList(listPath, list);
+
+		ccmd += "ar rcsD \"";
+		ccmd += archivePath;
+		ccmd += "\" @\"";
+		ccmd += Util::relativeIfSubpath(listPath).string();
+		ccmd += '\"';
+	}
+
+	Log::out << OLINK << "Packing " << OSTR(archivePath) << std::endl;
+
+	auto packStart = std::chrono::steady_clock::now();
+
+	std::ostringstream oss;
+	int retcode = Process::start(ccmd.c_str(), &oss);
+	if (retcode != 0)
+	{
+		// Never leave an archive that looks complete
+		fs::remove(archive.path, ec);
+		fs::remove(listPath, ec);
+		Log::out << oss.str() << std::endl;
+		throw ncp::exception("Could not create the link archive: " + archivePath);
+	}
+
+	// Kept, the internal linker reads the members of the archive
+	if (TimingRecorder::isEnabled())
+	{
+		auto packTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - packStart);
+		TimingRecorder::recordStep(
+			TimingRecorder::StepKind::Archive, archivePath,
+			packTime.count(), archive.path, fs::path(), true
+		);
+	}
+}
+
+const LinkArchive* PatchMaker::getLinkArchive(const BuildTarget::Region* region) const
+{
+	for (const auto& archive : m_linkArchives)
+	{
+		if (archive->region == region)
+			return archive.get();
+	}
+	return nullptr;
+}
+
+void PatchMaker::createLinkerScripts()
+{
+	using Command = LinkLayout::Command;
+
+	// Section patches of the same name in a unit, like hooks chained at the same
+	// instruction, are selected by their object and get a label each
+	std::map<std::pair<int, std::string_view>, std::size_t> sectionPatchCount;
+	for (auto& p : m_patchInfo)
+	{
+		if (p->sectionIdx == -1 || p->patchType == PatchType::Over)
+			continue;
+		std::size_t idx = sectionPatchCount[{ p->job->region->destination, p->symbol }]++;
+		p->label = p->symbol.substr(1);
+		if (idx != 0)
+			p->label += "_" + std::to_string(idx);
+	}
+
+	auto getObjectPattern = [&](const SourceFileJob* job){
+		if (!m_archivedJobs.contains(job))
+			return Util::relativeIfSubpath(job->objFilePath).string();
+		const LinkArchive* archive = getLinkArchive(job->region);
+		return Util::relativeIfSubpath(archive->path).string() + ':' + job->objFilePath.filename().string();
+	};
+
+	auto addSectionPatchInclude = [&](LinkLayout::OutputSection& o, GenericPatchInfo* p) {
+		// Convert the section patches into label patches,
+		// except for over and set types
+		bool isAmbiguous = sectionPatchCount[{ p->job->region->destination, p->symbol }] > 1;
+		o.commands.push_back(Command::align(4));
+		o.commands.push_back(Command::symbolHere(p->label));
+		o.commands.push_back(Command::input(isAmbiguous ? getObjectPattern(p->job) : "*", p->symbol, true));
+	};
+
+	Log::out << OLINK << "Generating the linker scripts..." << std::endl;
+
+	fs::current_path(*m_targetWorkDir);
+	fs::path symbolsFile;
+	if (!m_target->symbols.empty())
+		symbolsFile = fs::absolute(m_target->symbols);
+
+	fs::current_path(Main::getWorkPath());
+
+	// One unit for every destination, the main binary comes first
+	std::vector<const BuildTarget::Region*> orderedRegions(m_target->regions.size());
+	for (std::size_t i = 0; i < m_target->regions.size(); i++)
+		orderedRegions[i] = &m_target->regions[i];
+	std::sort(orderedRegions.begin(), orderedRegions.end(), [](const BuildTarget::Region* a, const BuildTarget::Region* b){
+		if ((a->destination == -1) != (b->destination == -1))
+			return a->destination == -1;
+		return a->destination < b->destination;
+	});
+
+	const std::string armName = m_target->getArm9() ? "arm9" : "arm7";
+	const std::string ldscriptName = m_target->getArm9() ? "ldscript9" : "ldscript7";
+
+	std::unordered_map<int, std::size_t> unitIdxForDest;
+	for (const BuildTarget::Region* region : orderedRegions)
+	{
+		int dest = region->destination;
+		if (!unitIdxForDest.try_emplace(dest, m_linkUnits.size()).second)
+			continue;
+
+		std::string suffix = getUnitSuffix(dest);
+
+		auto unit = std::make_unique<LinkUnit>();
+		unit->dest = dest;
+		unit->region = region;
+		unit->ldscriptPath = *m_buildDir / (ldscriptName + suffix + ".x");
+		unit->elfPath = *m_buildDir / (armName + suffix + ".elf");
+		unit->importsPath = *m_buildDir / (armName + suffix + ".imports.x");
+		unit->placeholderAddress = m_newcodeAddrForDest[dest];
+		m_linkUnits.emplace_back(std::move(unit));
+	}
+
+	const std::size_t unitCount = m_linkUnits.size();
+	LinkUnit* libraryUnit = m_linkUnits[0]->dest == -1 ? m_linkUnits[0].get() : nullptr;
+	for (auto& unit : m_linkUnits)
+		unit->linksLibraries = libraryUnit == nullptr || unit.get() == libraryUnit;
+
+	// Find what every unit uses from the others, the first unit defining a symbol owns it
+	for (std::size_t i = 0; i < unitCount; i++)
+	{
+		LinkUnit& unit = *m_linkUnits[i];
+		const auto& definedSymbols = m_definedSymbolsForDest[unit.dest];
+		const auto& undefinedSymbols = m_undefinedSymbolsForDest[unit.dest];
+
+		std::vector<std::string_view> names(undefinedSymbols.begin(), undefinedSymbols.end());
+		std::sort(names.begin(), names.end());
+
+		for (std::string_view name : names)
+		{
+			std::string nameStr(name);
+			if (definedSymbols.contains(nameStr))
+				continue;
+
+			bool isFound = false;
+			for (std::size_t j = 0; j < unitCount && !isFound; j++)
+			{
+				if (j == i)
+					continue;
+				const auto& ownerSymbols = m_definedSymbolsForDest[m_linkUnits[j]->dest];
+				auto it = ownerSymbols.find(nameStr);
+				if (it == ownerSymbols.end())
+					continue;
+				unit.imports.push_back(LinkImport{ nameStr, j, it->second, false });
+				m_linkUnits[j]->exportedSymbols.insert(nameStr);
+				isFound = true;
+			}
+
+			// Defined by the libraries or the symbols file, the main binary gets it
+			if (!isFound && !unit.linksLibraries)
+			{
+				unit.imports.push_back(LinkImport{ nameStr, 0, false, true });
+				libraryUnit->exportedSymbols.insert(nameStr);
+			}
+		}
+	}
+
+	std::vector<LDSRegionEntry> regionEntries(unitCount);
+
+	// The overwrite regions holding each assigned section name, in region order
+	std::unordered_map<std::string_view, std::vector<OverwriteRegionInfo*>> overwritesForSection;
+	for (const auto& overwrite : m_overwriteRegions)
+	{
+		for (const auto* section : overwrite->assignedSections)
+			overwritesForSection[section->name].emplace_back(overwrite.get());
+	}
+
+	for (std::size_t i = 0; i < unitCount; i++)
+	{
+		LinkUnit& unit = *m_linkUnits[i];
+		LinkLayout& layout = unit.layout;
+
+		if (!symbolsFile.empty())
+			layout.symbolsFile = Util::relativeIfSubpath(symbolsFile).string();
+		layout.importsFile = Util::relativeIfSubpath(unit.importsPath).string();
+		layout.output = Util::relativeIfSubpath(unit.elfPath).string();
+		layout.loadMemory = "bin";
+
+		layout.memories.push_back(LinkLayout::Memory{ "bin", 0, 0x100000 });
+
+		// Add memory entries for overwrite regions
+		for (const auto& overwrite : m_overwriteRegions)
+		{
+			if (overwrite->destination != unit.dest || overwrite->assignedSections.empty())
+				continue;
+			u32 regionSize = overwrite->endAddress - overwrite->startAddress;
+			layout.memories.push_back(LinkLayout::Memory{ overwrite->memName, overwrite->startAddress, regionSize });
+		}
+
+		std::string& memName = regionEntries[i].memName;
+		memName = getDestName(unit.dest);
+
+		// The new code of a TCM cannot grow past its end
+		u32 newcodeAddr = m_newcodeAddrForDest[unit.dest];
+		u32 length = u32(unit.region->length);
+		auto tcmIt = m_tcmForDest.find(unit.dest);
+		if (tcmIt != m_tcmForDest.end())
+			length = std::min(length, tcmIt->second.endAddress - newcodeAddr);
+		layout.memories.push_back(LinkLayout::Memory{ memName, newcodeAddr, length });
+	}
+
+	// Iterate all patches to setup the linker scripts, every patch goes to the unit of its object
+	for (auto& info : m_patchInfo)
+	{
+		std::size_t unitIdx = unitIdxForDest.at(info->job->region->destination);
+		LinkUnit& unit = *m_linkUnits[unitIdx];
+		LDSRegionEntry& ldsRegion = regionEntries[unitIdx];
+
+		if (info->patchType == PatchType::Over)
+		{
+			ldsRegion.overPatches.push_back(LDSOverPatch{ info.get(), {} });
+		}
+		else
+		{
+			if (info->sectionIdx != -1)
+			{
+				// Check if this patch's section is assigned to an overwrite region
+				OverwriteRegionInfo* patchOverwrite = nullptr;
+				auto overwritesIt = overwritesForSection.find(info->symbol);
+				if (overwritesIt != overwritesForSection.end())
+				{
+					for (OverwriteRegionInfo* overwrite : overwritesIt->second)
+					{
+						if (overwrite->destination == unit.dest)
+						{
+							patchOverwrite = overwrite;
+							break;
+						}
+					}
+				}
+
+				// Only add to sectionPatches if not in overwrite region
+				if (patchOverwrite != nullptr)
+					patchOverwrite->sectionPatches.emplace_back(info.get());
+				else
+					ldsRegion.sectionPatches.emplace_back(info.get());
+			}
+		}
 	}
-}
 
-void PatchMaker::createBackupDirectory()
-{
-	fs::current_path(Main::getWorkPath());
-	const fs::path& bakDir = BuildConfig::getBackupDir();
-	if (!fs::exists(bakDir))
+	// The bridge blocks left out of the overwrite regions follow each other in the autogen data
+	for (auto& block : m_bridgeBlocks)
 	{
-		if (!fs::create_directories(bakDir))
-		{
-			std::ostringstream oss;
-			oss << "Could not create backup directory: " << OSTR(bakDir);
-			throw ncp::exception(oss.str());
-		}
+		if (block->overwrite != nullptr)
+			continue;
+		LDSRegionEntry& ldsRegion = regionEntries[unitIdxForDest.at(block->destination)];
+		block->arenaOffset = u32(ldsRegion.autogenDataSize);
+		ldsRegion.autogenDataSize += block->size;
 	}
 
-	const char* prefix = m_target->getArm9() ? "overlay9" : "overlay7";
-	fs::path bakOvDir = bakDir / prefix;
-	if (!fs::exists(bakOvDir))
+	// Nearby over patches share a memory, their sections are pinned to the patched addresses
+	for (std::size_t i = 0; i < unitCount; i++)
 	{
-		if (!fs::create_directories(bakOvDir))
+		std::vector<LDSOverPatch>& overPatches = regionEntries[i].overPatches;
+		std::sort(overPatches.begin(), overPatches.end(), [](const LDSOverPatch& a, const LDSOverPatch& b){
+			if (a.info->destAddressOv != b.info->destAddressOv)
+				return a.info->destAddressOv < b.info->destAddressOv;
+			return a.info->destAddress < b.info->destAddress;
+		});
+
+		for (std::size_t first = 0; first < overPatches.size();)
 		{
-			std::ostringstream oss;
-			oss << "Could not create overlay backup directory: " << OSTR(bakOvDir);
-			throw ncp::exception(oss.str());
+			const GenericPatchInfo* firstInfo = overPatches[first].info;
+			u32 regionEnd = firstInfo->destAddress + u32(firstInfo->sectionSize);
+
+			std::size_t last = first + 1;
+			for (; last < overPatches.size(); last++)
+			{
+				const GenericPatchInfo* info = overPatches[last].info;
+				if (info->destAddressOv != firstInfo->destAddressOv || info->destAddress > regionEnd + MaxOverPatchGap)
+					break;
+				regionEnd = std::max(regionEnd, info->destAddress + u32(info->sectionSize));
+			}
+
+			std::string memName; memName.reserve(32);
+			memName += "over_";
+			memName += Util::intToAddr(int(firstInfo->destAddress), 8, false);
+			if (firstInfo->destAddressOv != -1)
+			{
+				memName += '_';
+				memName += std::to_string(firstInfo->destAddressOv);
+			}
+			m_linkUnits[i]->layout.memories.push_back(LinkLayout::Memory{ memName, firstInfo->destAddress, regionEnd - firstInfo->destAddress });
+
+			for (std::size_t j = first; j < last; j++)
+				overPatches[j].memName = memName;
+			first = last;
 		}
 	}
-}
 
-void PatchMaker::loadArmBin()
-{
-	bool isArm9 = m_target->getArm9();
+	static const char* textSecIncs[] = {
+		".text",
+		".rodata",
+		".init_array",
+		".data",
+		".text.*",
+		".rodata.*",
+		".init_array.*",
+		".data.*"
+	};
+	// With a call graph, its code sections go around the data, the hot ones before and the cold ones after
+	static const char* textDataSecIncs[] = {
+		".rodata",
+		".init_array",
+		".data",
+		".rodata.*",
+		".init_array.*",
+		".data.*"
+	};
+	static const char* textCodeSecIncs[] = {
+		".text",
+		".text.*"
+	};
+	static const char* bssSecIncs[] = {
+		".bss",
+		".bss.*"
+	};
 
-	const char* binName; u32 entryAddress, ramAddress, autoLoadListHookOff;
-	if (isArm9)
-	{
-		binName = "arm9.bin";
-		entryAddress = m_header->arm9.entryAddress;
-		ramAddress = m_header->arm9.ramAddress;
-		autoLoadListHookOff = m_header->arm9AutoLoadListHookOffset;
-	}
-	else
+	for (std::size_t i = 0; i < unitCount; i++)
 	{
-		binName = "arm7.bin";
-		entryAddress = m_header->arm7.entryAddress;
-		ramAddress = m_header->arm7.ramAddress;
-		autoLoadListHookOff = m_header->arm7AutoLoadListHookOffset;
-	}
+		LinkUnit& unit = *m_linkUnits[i];
+		LinkLayout& layout = unit.layout;
+		const LDSRegionEntry& s = regionEntries[i];
 
-	fs::current_path(Main::getWorkPath());
+		bool hasNcpSet = std::find(m_destWithNcpSet.begin(), m_destWithNcpSet.end(), unit.dest) != m_destWithNcpSet.end();
+		if (hasNcpSet)
+			layout.memories.push_back(LinkLayout::Memory{ "ncp_set", 0, 0x100000 });
 
-	fs::path bakBinName = BuildConfig::getBackupDir() / binName;
+		for (auto& srcFileJob : *m_srcFileJobs)
+		{
+			if (srcFileJob->region->destination != unit.dest || m_archivedJobs.contains(srcFileJob.get()))
+				continue; // given to the linker in its archive
+			layout.inputs.emplace_back(Util::relativeIfSubpath(srcFileJob->objFilePath).string());
+		}
 
-	m_arm = std::make_unique<ArmBin>();
-	if (fs::exists(bakBinName)) //has backup
-	{
-		m_arm->load(bakBinName, entryAddress, ramAddress, autoLoadListHookOff, isArm9);
-	}
-	else //has no backup
-	{
-		fs::current_path(Main::getRomPath());
-		m_arm->load(binName, entryAddress, ramAddress, autoLoadListHookOff, isArm9);
-		const std::vector<u8>& bytes = m_arm->data();
+		// Add overwrite sections
+		for (const auto& overwrite : m_overwriteRegions)
+		{
+			if (overwrite->destination != unit.dest || overwrite->assignedSections.empty())
+				continue;
 
-		fs::current_path(Main::getWorkPath());
-		std::ofstream outputFile(bakBinName, std::ios::binary);
-		if (!outputFile.is_open())
-			throw ncp::file_error(bakBinName, ncp::file_error::write);
-		outputFile.write(reinterpret_cast<const char*>(bytes.data()), std::streamsize(bytes.size()));
-		outputFile.close();
-	}
-}
+			LinkLayout::OutputSection& o = layout.addSection("." + overwrite->memName, overwrite->memName, true);
 
-void PatchMaker::saveArmBin()
-{
-	const char* binName = m_target->getArm9() ? "arm9.bin" : "arm7.bin";
+			// In the address order of the packing, the section patches at the place of their section
+			std::vector<GenericPatchInfo*> sectionPatches = overwrite->sectionPatches;
+			for (const auto* section : overwrite->assignedSections)
+			{
+				if (section->isBridge)
+				{
+					o.commands.push_back(Command::align(section->alignment));
+					o.commands.push_back(Command::reserve(section->name, u32(section->size)));
+					continue;
+				}
 
-	const std::vector<u8>& bytes = m_arm->data();
+				if (section->name.starts_with(".ncp_jump") ||
+					section->name.starts_with(".ncp_call") ||
+					section->name.starts_with(".ncp_hook"))
+				{
+					auto patchIt = std::find_if(sectionPatches.begin(), sectionPatches.end(), [&](const GenericPatchInfo* p){
+						return p->symbol == section->name && p->job == section->job;
+					});
+					if (patchIt != sectionPatches.end())
+					{
+						o.commands.push_back(Command::align(section->alignment));
+						addSectionPatchInclude(o, *patchIt);
+						sectionPatches.erase(patchIt);
+					}
+					continue;
+				}
 
-	fs::current_path(Main::getRomPath());
-	std::ofstream outputFile(binName, std::ios::binary);
-	if (!outputFile.is_open())
-		throw ncp::file_error(binName, ncp::file_error::write);
-	outputFile.write(reinterpret_cast<const char*>(bytes.data()), std::streamsize(bytes.size()));
-	outputFile.close();
-}
+				o.commands.push_back(Command::align(section->alignment));
+				o.commands.push_back(Command::input(Util::relativeIfSubpath(section->job->objFilePath).string(), section->name));
+			}
+			for (auto& p : sectionPatches)
+				addSectionPatchInclude(o, p);
 
-void PatchMaker::loadOverlayTableBin()
-{
-	Log::info("Loading overlay table...");
+			o.commands.push_back(Command::align(4));
+		}
 
-	const char* binName = m_target->getArm9() ? "arm9ovt.bin" : "arm7ovt.bin";
+		// Only the objects of the unit are linked, so every pattern can match any file
+		auto addRegionIncludes = [&](LinkLayout::OutputSection& o, auto& secIncs){
+			for (const char* secInc : secIncs)
+				o.commands.push_back(Command::input("*", secInc));
+		};
 
-	fs::current_path(Main::getWorkPath());
+		// TEXT
+		LinkLayout::OutputSection& text = layout.addSection("." + s.memName + ".text", s.memName, true);
+		for (auto& p : s.sectionPatches)
+		{
+			addSectionPatchInclude(text, p);
+		}
+		for (auto& p : m_rtreplPatches)
+		{
+			if (p->job->region == unit.region)
+			{
+				std::string stem = p->symbol.substr(1);
+				text.commands.push_back(Command::symbolHere(stem + "_start"));
+				text.commands.push_back(Command::input("*", p->symbol));
+				text.commands.push_back(Command::symbolHere(stem + "_end"));
+			}
+		}
+		// The code sections ordered by their call graph are listed by name, the wildcards skip them
+		auto graphIt = m_callGraphForDest.find(unit.dest);
+		if (graphIt != m_callGraphForDest.end())
+		{
+			const CallGraph& graph = *graphIt->second;
+			auto addChains = [&](std::size_t first, std::size_t last, bool alignChains){
+				for (std::size_t c = first; c < last; c++)
+				{
+					const SectionOrder::Chain& chain = graph.chains[c];
+					if (alignChains && chain.nodes.size() > 1)
+						text.commands.push_back(Command::align(Arm9CacheLineSize));
+					for (std::size_t idx : chain.nodes)
+					{
+						const CodeSectionInfo& section = graph.sections[idx];
+						text.commands.push_back(Command::input(getObjectPattern(section.job), section.name));
+					}
+				}
+			};
+			bool alignChains = m_target->alignHotChains && m_target->getArm9() && !isTcmDest(unit.dest);
+			addChains(0, graph.coldChainsStart, alignChains);
+			addRegionIncludes(text, textDataSecIncs);
+			addChains(graph.coldChainsStart, graph.chains.size(), false);
+			addRegionIncludes(text, textCodeSecIncs);
+		}
+		else
+		{
+			addRegionIncludes(text, textSecIncs);
+		}
+		if (s.autogenDataSize != 0)
+		{
+			text.commands.push_back(Command::align(4));
+			text.commands.push_back(Command::reserve(
+				unit.dest == -1 ? "ncp_autogendata" : "ncp_autogendata_" + s.memName,
+				u32(s.autogenDataSize)
+			));
+		}
+		text.commands.push_back(Command::align(4));
 
-	fs::path bakBinName = BuildConfig::getBackupDir() / binName;
+		// BSS
+		LinkLayout::OutputSection& bss = layout.addSection("." + s.memName + ".bss", s.memName, true);
+		addRegionIncludes(bss, bssSecIncs);
+		bss.commands.push_back(Command::align(4));
 
-	fs::path workBinName;
-	if (fs::exists(bakBinName)) //has backup
-	{
-		workBinName = bakBinName;
-	}
-	else //has no backup
-	{
-		fs::current_path(Main::getRomPath());
-		if (!fs::exists(binName))
-			throw ncp::file_error(binName, ncp::file_error::find);
-		workBinName = binName;
-	}
+		for (const LDSOverPatch& p : s.overPatches)
+		{
+			LinkLayout::OutputSection& o = layout.addSection(p.info->symbol, p.memName, false);
+			o.isPinned = true;
+			o.address = p.info->destAddress;
+			o.commands.push_back(Command::input("*", p.info->symbol, true));
+		}
 
-	uintmax_t fileSize = fs::file_size(workBinName);
-	u32 overlayCount = fileSize / sizeof(OvtEntry);
+		if (hasNcpSet)
+		{
+			std::string name = unit.dest == -1 ? ".ncp_set" : ".ncp_set_" + getDestName(unit.dest);
+			LinkLayout::OutputSection& o = layout.addSection(name, "ncp_set", false);
+			o.commands.push_back(Command::input("*", ".ncp_set", true));
+		}
 
-	m_ovtEntries.resize(overlayCount);
+		// The symbols of the patches and the ones used by the other units are kept
+		layout.externs = m_externSymbolsForDest[unit.dest];
+		std::vector<std::string> exported(unit.exportedSymbols.begin(), unit.exportedSymbols.end());
+		std::sort(exported.begin(), exported.end());
+		for (std::string& sym : exported)
+			layout.externs.emplace_back(std::move(sym));
 
-	std::ifstream inputFile(workBinName, std::ios::binary);
-	if (!inputFile.is_open())
-		throw ncp::file_error(workBinName, ncp::file_error::read);
-	for (u32 i = 0; i < overlayCount; i++)
-		inputFile.read(reinterpret_cast<char*>(&m_ovtEntries[i]), sizeof(OvtEntry));
-	inputFile.close();
+		std::string o = layout.toLinkerScript();
 
-	m_bakOvtEntries.resize(m_ovtEntries.size());
-	std::memcpy(m_bakOvtEntries.data(), m_ovtEntries.data(), m_ovtEntries.size() * sizeof(OvtEntry));
-}
+		unit.ldscriptHash = Util::fnv1a64(o.data(), o.length());
 
-void PatchMaker::saveOverlayTableBin()
-{
-	auto saveOvtEntries = [](const std::vector<OvtEntry>& ovtEntries, const fs::path& filePath){
-		std::ofstream outputFile(filePath, std::ios::binary);
+		// Output the file
+		std::ofstream outputFile(unit.ldscriptPath);
 		if (!outputFile.is_open())
-			throw ncp::file_error(filePath, ncp::file_error::write);
-		outputFile.write(reinterpret_cast<const char*>(ovtEntries.data()), ovtEntries.size() * sizeof(OvtEntry));
+			throw ncp::file_error(unit.ldscriptPath, ncp::file_error::write);
+		outputFile.write(o.data(), std::streamsize(o.length()));
 		outputFile.close();
-	};
-
-	const char* binName = m_target->getArm9() ? "arm9ovt.bin" : "arm7ovt.bin";
+	}
+}
 
-	if (m_bakOvtChanged)
+std::string PatchMaker::ldFlagsToGccFlags(std::string flags)
+{
+	std::size_t cpos = 0;
+	while ((cpos = flags.find(' ', cpos)) != std::string::npos)
 	{
-		fs::current_path(Main::getWorkPath());
-		saveOvtEntries(m_bakOvtEntries, BuildConfig::getBackupDir() / binName);
+		std::size_t dpos = flags.find('-', cpos);
+		if (dpos == std::string::npos)
+			break;
+		flags.replace(cpos, dpos - cpos, ",");
+		cpos += 2;
 	}
-
-	fs::current_path(Main::getRomPath());
-	saveOvtEntries(m_ovtEntries, binName);
+	return flags;
 }
 
-OverlayBin* PatchMaker::loadOverlayBin(std::size_t ovID)
-{
-	std::string prefix = m_target->getArm9() ? "overlay9" : "overlay7";
+// Below the command line limit of cmd.exe
+static constexpr std::size_t MaxLinkCommandLength = 8000;
 
-	fs::current_path(Main::getWorkPath());
+// The flags that select the multilib of the gcc driver, taken from the C flags of the target
+static std::string getMachineFlags(const std::string& cFlags)
+{
+	std::string flags;
+	std::istringstream iss(cFlags);
+	std::string flag;
+	while (iss >> flag)
+	{
+		if (!flag.starts_with("-m"))
+			continue;
+		if (!flags.empty())
+			flags += ' ';
+		flags += flag;
+	}
+	return flags;
+}
 
-	fs::path binName = fs::path(prefix) / (prefix + "_" + std::to_string(ovID) + ".bin");
-	fs::path bakBinName = BuildConfig::getBackupDir() / binName;
+/*
+ * The library directories that the gcc driver would give to ld for the
+ * machine flags, with its multilib directory first, so that -lgcc and -lc
+ * resolve to the ARMv4T or ARMv5TE builds instead of the default ones.
+ * Cached by the flags, the ARM9 and ARM7 targets select different ones.
+ * */
+static const std::vector<std::string>& getLinkerSearchDirs(const std::string& machineFlags)
+{
+	static std::map<std::string, std::vector<std::string>> searchDirsForFlags;
+	auto cached = searchDirsForFlags.find(machineFlags);
+	if (cached != searchDirsForFlags.end())
+		return cached->second;
+	std::vector<std::string>& searchDirs = searchDirsForFlags[machineFlags];
 
-	OvtEntry& ovte = m_ovtEntries[ovID];
+	std::string gccCmd = BuildConfig::getToolchain() + "gcc";
+	if (!machineFlags.empty())
+		gccCmd += ' ' + machineFlags;
 
-	auto* overlay = new OverlayBin();
-	if (fs::exists(bakBinName)) //has backup
+	std::string multiDir;
 	{
-		overlay->load(bakBinName, ovte.ramAddress, ovte.flag & OVERLAY_FLAG_COMP, ovID);
-		ovte.flag = 0;
+		std::string ccmd = gccCmd + " -print-multi-directory";
+		std::ostringstream oss;
+		if (Process::start(ccmd.c_str(), &oss) != 0)
+			throw ncp::exception("Could not query the multilib directory of the toolchain.");
+		std::istringstream iss(oss.str());
+		std::getline(iss, multiDir);
+		if (!multiDir.empty() && multiDir.back() == '\r')
+			multiDir.pop_back();
+		if (multiDir == ".")
+			multiDir.clear();
 	}
-	else //has no backup
-	{
-		fs::current_path(Main::getRomPath());
-		overlay->load(binName, ovte.ramAddress, ovte.flag & OVERLAY_FLAG_COMP, ovID);
-		ovte.flag = 0;
-		const std::vector<u8>& bytes = overlay->data();
 
-		std::vector<u8>& backupBytes = overlay->backupData();
-		backupBytes.resize(bytes.size());
-		std::memcpy(backupBytes.data(), bytes.data(), bytes.size());
+	std::string ccmd = gccCmd + " -print-search-dirs";
+	std::ostringstream oss;
+	if (Process::start(ccmd.c_str(), &oss) != 0)
+		throw ncp::exception("Could not query the library directories of the toolchain.");
+
+#ifdef _WIN32
+	constexpr char pathSeparator = ';';
+#else
+	constexpr char pathSeparator = ':';
+#endif
+
+	auto addDir = [&](const fs::path& dir){
+		std::string dirStr = dir.lexically_normal().string();
+		if (std::find(searchDirs.begin(), searchDirs.end(), dirStr) == searchDirs.end())
+			searchDirs.emplace_back(std::move(dirStr));
+	};
 
-		m_bakOvtEntries[ovID].flag = 0;
-		m_bakOvtChanged = true;
-	}
+	std::istringstream iss(oss.str());
+	std::string line;
+	while (std::getline(iss, line))
+	{
+		constexpr std::string_view prefix = "libraries: =";
+		if (!line.starts_with(prefix))
+			continue;
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
 
-	m_loadedOverlays.emplace(ovID, std::unique_ptr<OverlayBin>(overlay));
-	return overlay;
+		std::istringstream dirs(line.substr(prefix.length()));
+		std::string dir;
+		std::error_code ec;
+		while (std::getline(dirs, dir, pathSeparator))
+		{
+			if (dir.empty())
+				continue;
+			if (!multiDir.empty() && fs::is_directory(fs::path(dir) / multiDir, ec))
+				addDir(fs::path(dir) / multiDir);
+			if (fs::is_directory(dir, ec))
+				addDir(dir);
+		}
+	}
+	return searchDirs;
 }
 
-OverlayBin* PatchMaker::getOverlay(std::size_t ovID)
+std::string PatchMaker::makeLinkCommand(const LinkUnit& unit, BuildConfig::Linker linker, std::string& linkArgs) const
 {
-	for (auto& [id, ov] : m_loadedOverlays)
+	const std::string& toolchain = BuildConfig::getToolchain();
+
+	std::string ldscriptPath = Util::relativeIfSubpath(unit.ldscriptPath).string();
+	const LinkArchive* archive = getLinkArchive(unit.region);
+
+	if (linker == BuildConfig::Linker::Gcc)
 	{
-		if (id == ovID)
-			return ov.get();
+		linkArgs.reserve(64);
+		linkArgs += unit.linksLibraries ? "-nostartfiles" : "-nostartfiles -nodefaultlibs";
+		linkArgs += " -Wl,--gc-sections,-T\"";
+		linkArgs += ldscriptPath;
+		linkArgs += '\"';
+		if (archive != nullptr)
+		{
+			// Linked whole, like loose objects, --gc-sections still drops what is unused
+			linkArgs += ",--whole-archive,\"";
+			linkArgs += Util::relativeIfSubpath(archive->path).string();
+			linkArgs += "\",--no-whole-archive";
+		}
+		std::string targetFlags = ldFlagsToGccFlags(m_target->ldFlags);
+		if (!targetFlags.empty())
+			linkArgs += ',';
+		linkArgs += targetFlags;
+		return toolchain + "gcc";
 	}
-	return loadOverlayBin(ovID);
-}
 
-void PatchMaker::saveOverlayBins()
-{
-	std::string prefix = m_target->getArm9() ? "overlay9" : "overlay7";
-
-	for (auto& [ovID, ov] : m_loadedOverlays)
+	std::string linkerPath;
+	switch (linker)
 	{
-		fs::path binName = fs::path(prefix) / (prefix + "_" + std::to_string(ovID) + ".bin");
+	case BuildConfig::Linker::Bfd:
+		linkerPath = toolchain + "ld.bfd";
+		break;
+	case BuildConfig::Linker::Gold:
+		linkerPath = toolchain + "ld.gold";
+		break;
+	default:
+		linkerPath = "ld.lld";
+		break;
+	}
 
-		auto saveOvData = [](const std::vector<u8>& ovData, const fs::path& ovFilePath){
-			std::ofstream outputFile(ovFilePath, std::ios::binary);
-			if (!outputFile.is_open())
-				throw ncp::file_error(ovFilePath, ncp::file_error::write);
-			outputFile.write(reinterpret_cast<const char*>(ovData.data()), std::streamsize(ovData.size()));
-			outputFile.close();
-		};
+	if (!Process::exists(linkerPath.c_str()))
+	{
+		std::ostringstream oss;
+		oss << "The linker " << OSTR(linkerPath) << " was not found." << OREASONNL;
+		oss << "Make sure that it is present on your system or choose another " << OSTR("linker") << " in the " << OSTR("ncpatcher.json") << " file.";
+		throw ncp::exception(oss.str());
+	}
 
-		fs::current_path(Main::getRomPath());
-		saveOvData(ov->data(), binName);
+	linkArgs.reserve(256);
+	linkArgs += "--gc-sections -T \"";
+	linkArgs += ldscriptPath;
+	linkArgs += '\"';
+	if (archive != nullptr)
+	{
+		linkArgs += " --whole-archive \"";
+		linkArgs += Util::relativeIfSubpath(archive->path).string();
+		linkArgs += "\" --no-whole-archive";
+	}
 
-		if (!ov->backupData().empty())
+	int threads = BuildConfig::getLinkerThreads();
+	if (linker == BuildConfig::Linker::Gold)
+	{
+		linkArgs += " --threads";
+		if (threads > 0)
 		{
-			fs::current_path(Main::getWorkPath());
-			saveOvData(ov->backupData(), BuildConfig::getBackupDir() / binName);
+			linkArgs += " --thread-count ";
+			linkArgs += std::to_string(threads);
 		}
 	}
-}
+	else if (linker == BuildConfig::Linker::Lld && threads > 0)
+	{
+		linkArgs += " --threads=";
+		linkArgs += std::to_string(threads);
+	}
 
-void PatchMaker::createLinkerScript()
-{
-	auto addSectionInclude = [](std::string& o, std::string& objPath, const char* secInc){
-		o += "\t\t\"";
-		o += objPath;
-		o += "\" (.";
-		o += secInc;
-		o += ")\n";
-	};
+	for (const std::string& dir : getLinkerSearchDirs(getMachineFlags(m_target->cFlags)))
+	{
+		linkArgs += " -L\"";
+		linkArgs += dir;
+		linkArgs += '\"';
+	}
 
-	auto addSectionPatchInclude = [](std::string& o, GenericPatchInfo*& p) {
-		// Convert the section patches into label patches,
-		// except for over and set types
-		o += "\t\t. = ALIGN(4);\n\t\t";
-		o += std::string_view(p->symbol).substr(1);
-		o += " = .;\n\t\tKEEP(* (";
-		o += p->symbol;
-		o += "))\n";
-	};
+	if (!m_target->ldFlags.empty())
+	{
+		linkArgs += ' ';
+		linkArgs += m_target->ldFlags;
+	}
 
-	Log::out << OLINK << "Generating the linker script..." << std::endl;
+	// The default libraries of the gcc driver
+	if (unit.linksLibraries)
+		linkArgs += " --start-group -lgcc -lc --end-group";
 
-	fs::current_path(*m_targetWorkDir);
-	fs::path symbolsFile;
-	if (!m_target->symbols.empty())
-		symbolsFile = fs::absolute(m_target->symbols);
+	return linkerPath;
+}
+
+// Units normally settle in two rounds, the first one finds where the symbols of the changed units went
+static constexpr int MaxLinkRounds = 4;
+
+void PatchMaker::linkElfFiles()
+{
+	Log::out << OLINK << "Linking the ARM binaries..." << std::endl;
 
 	fs::current_path(Main::getWorkPath());
 
-	std::vector<std::unique_ptr<LDSMemoryEntry>> memoryEntries;
-	memoryEntries.emplace_back(new LDSMemoryEntry{ "bin", 0, 0x100000 });
+	BuildConfig::Linker linker = BuildConfig::getLinker();
+	bool isInternal = linker == BuildConfig::Linker::Internal;
 
-	// Add memory entries for overwrite regions
-	for (const auto& overwrite : m_overwriteRegions)
+	u64 symbolsHash = Util::fnv1a64(nullptr, 0);
+	if (!m_target->symbols.empty())
 	{
-		if (overwrite->assignedSections.empty())
-			continue;
-			
-		u32 regionSize = overwrite->endAddress - overwrite->startAddress;
-		auto* memEntry = new LDSMemoryEntry{ overwrite->memName, overwrite->startAddress, static_cast<int>(regionSize) };
-		memoryEntries.emplace_back(memEntry);
+		fs::current_path(*m_targetWorkDir);
+		MappedFile symbolsFile;
+		if (!symbolsFile.open(m_target->symbols))
+			throw ncp::file_error(m_target->symbols, ncp::file_error::read);
+		symbolsHash = Util::fnv1a64(symbolsFile.data(), symbolsFile.size());
+		fs::current_path(Main::getWorkPath());
 	}
 
-	std::vector<std::unique_ptr<LDSRegionEntry>> regionEntries;
-
-	// Overlays must come before arm section
-	std::vector<const BuildTarget::Region*> orderedRegions(m_target->regions.size());
-	for (std::size_t i = 0; i < m_target->regions.size(); i++)
-		orderedRegions[i] = &m_target->regions[i];
-	std::sort(orderedRegions.begin(), orderedRegions.end(), [](const BuildTarget::Region* a, const BuildTarget::Region* b){
-		return a->destination > b->destination;
-	});
-
-	std::vector<int> orderedDestWithNcpSet = m_destWithNcpSet;
-	std::sort(orderedDestWithNcpSet.begin(), orderedDestWithNcpSet.end(), [](int a, int b){
-		return a > b;
-	});
+	// Fetched before the units link in parallel
+	if (isInternal)
+		getLinkerSearchDirs(getMachineFlags(m_target->cFlags));
 
-	for (const BuildTarget::Region* region : orderedRegions)
+	for (auto& unit : m_linkUnits)
 	{
-		LDSMemoryEntry* memEntry;
-
-		int dest = region->destination;
-		u32 newcodeAddr = m_newcodeAddrForDest[dest];
-		if (dest == -1)
+		std::string ccmd;
+		if (isInternal)
 		{
-			memEntry = new LDSMemoryEntry{ "arm", newcodeAddr, region->length };
+			// Nothing is run, but the flags and the toolchain libraries still change the output
+			ccmd = "internal ";
+			ccmd += BuildConfig::getToolchain();
+			ccmd += ' ';
+			ccmd += m_target->ldFlags;
+			if (!unit->linksLibraries)
+				ccmd += " nodefaultlibs";
+			if (BuildConfig::getLinkerVerify())
+				ccmd += " verify";
 		}
 		else
 		{
-			std::string memName; memName.reserve(8);
-			memName += "ov";
-			memName += std::to_string(dest);
-			memEntry = new LDSMemoryEntry{ std::move(memName), newcodeAddr, region->length };
+			unit->linkerPath = makeLinkCommand(*unit, linker, unit->linkArgs);
+			ccmd.reserve(unit->linkerPath.length() + 1 + unit->linkArgs.length());
+			ccmd += unit->linkerPath;
+			ccmd += ' ';
+			ccmd += unit->linkArgs;
 		}
 
-		memoryEntries.emplace_back(memEntry);
-		regionEntries.emplace_back(new LDSRegionEntry{ dest, memEntry, region, 0 });
+		// Everything that can change the linker output, the command includes the toolchain and flags
+		u64 objectsHash = m_objectsHashForDest[unit->dest];
+		u64 fingerprint = Util::fnv1a64(ccmd.data(), ccmd.length());
+		fingerprint = Util::fnv1a64(&unit->ldscriptHash, sizeof(u64), fingerprint);
+		fingerprint = Util::fnv1a64(&objectsHash, sizeof(u64), fingerprint);
+		fingerprint = Util::fnv1a64(&symbolsHash, sizeof(u64), fingerprint);
+		unit->ownFingerprint = fingerprint;
+
+		unit->isLinked = loadLinkRecord(*unit);
+		if (unit->isLinked)
+			loadUnitExports(*unit);
 	}
 
-	std::vector<std::unique_ptr<LDSOverPatch>> overPatches;
-
-	// Iterate all patches to setup the linker script
-	for (auto& info : m_patchInfo)
+	// A unit relinks when its own inputs changed or when something that it imports moved,
+	// the layout of a unit does not depend on its imports so the exports are final once linked.
+	std::size_t linkedCount = 0;
+	for (int round = 0; ; round++)
 	{
-		if (info->patchType == PatchType::Over)
+		std::vector<LinkUnit*> pending;
+		for (auto& unit : m_linkUnits)
 		{
-			std::string memName; memName.reserve(32);
-			memName += "over_";
-			memName += Util::intToAddr(int(info->destAddress), 8, false);
-			if (info->destAddressOv != -1)
-			{
-				memName += '_';
-				memName += std::to_string(info->destAddressOv);
-			}
-			auto* memEntry = new LDSMemoryEntry({ std::move(memName), info->destAddress, static_cast<int>(info->sectionSize) });
-			memoryEntries.emplace_back(memEntry);
-			overPatches.emplace_back(new LDSOverPatch{ info.get(), memEntry });
+			if (!unit->isLinked || unit->importsFingerprint != getImportsFingerprint(*unit))
+				pending.push_back(unit.get());
 		}
-		else
+		if (pending.empty())
+			break;
+		if (round == MaxLinkRounds)
+			throw ncp::exception("The symbols shared between the link units did not settle.");
+
+		// Library symbols have no placeholder, the units using them wait for the main binary
+		LinkUnit* libraryUnit = m_linkUnits[0]->linksLibraries ? m_linkUnits[0].get() : nullptr;
+		bool waitsForLibraries = false;
+		if (libraryUnit != nullptr && std::find(pending.begin(), pending.end(), libraryUnit) != pending.end())
 		{
-			for (auto& ldsRegion : regionEntries)
+			for (LinkUnit* unit : pending)
 			{
-				if (ldsRegion->dest == info->job->region->destination)
-				{
-					if (info->sectionIdx != -1)
-					{
-						// Check if this patch's section is assigned to an overwrite region
-						bool patchInOverwrite = false;
-						for (const auto& overwrite : m_overwriteRegions)
-						{
-							if (overwrite->destination == ldsRegion->dest)
-							{
-								for (const auto* section : overwrite->assignedSections)
-								{
-									if (section->name == info->symbol)
-									{
-										// Add to sectionPatches of the overwrite region
-										overwrite->sectionPatches.emplace_back(info.get());
-
-										patchInOverwrite = true;
-										break;
-									}
-								}
-							}
-							if (patchInOverwrite) break;
-						}
-						
-						// Only add to sectionPatches if not in overwrite region
-						if (!patchInOverwrite)
-							ldsRegion->sectionPatches.emplace_back(info.get());
-					}
-
-					if (info->patchType == PatchType::Hook)
-					{
-						ldsRegion->autogenDataSize += SizeOfHookBridge;
-					}
-					else if (info->patchType == PatchType::Jump)
-					{
-						if (!info->destThumb && info->srcThumb) // ARM -> THUMB
-							ldsRegion->autogenDataSize += SizeOfArm2ThumbJumpBridge;
-					}
-				}
+				for (const LinkImport& import : unit->imports)
+					waitsForLibraries |= import.isLibrary;
 			}
 		}
-	}
-
-	if (!orderedDestWithNcpSet.empty())
-		memoryEntries.emplace_back(new LDSMemoryEntry{ "ncp_set", 0, 0x100000 });
+		if (waitsForLibraries)
+		{
+			linkUnits({ libraryUnit });
+			pending.erase(std::find(pending.begin(), pending.end(), libraryUnit));
+			linkedCount++;
+		}
 
-	std::string o;
-	o.reserve(65536);
+		linkUnits(pending);
+		linkedCount += pending.size();
+	}
 
-	o += "/* NCPatcher: Auto-generated linker script */\n\n";
+	if (linkedCount == 0)
+		Log::out << OINFO << "The linker inputs did not change, reusing the previous ELF files." << std::endl;
 
-	if (!symbolsFile.empty())
+	// Placeholders can only remain if a unit did not define what it was expected to
+	bool foundUndefined = false;
+	for (auto& unit : m_linkUnits)
 	{
-		o += "INCLUDE \"";
-		o += Util::relativeIfSubpath(symbolsFile).string();
-		o += "\"\n\n";
+		for (const LinkImport& import : unit->imports)
+		{
+			const LinkUnit& owner = *m_linkUnits[import.owner];
+			if (import.isLibrary || owner.exports.contains(import.name))
+				continue;
+			Log::out << OERROR << OSTR(import.name) << " used by " << OSTR(Util::relativeIfSubpath(unit->elfPath).string())
+				<< " is not defined in " << OSTR(Util::relativeIfSubpath(owner.elfPath).string()) << std::endl;
+			foundUndefined = true;
+		}
 	}
-	
-	o += "INPUT (\n";
-	for (auto& srcFileJob : *m_srcFileJobs)
+	if (foundUndefined)
+		throw ncp::exception("Symbols shared between the link units were not found.");
+}
+
+bool PatchMaker::getImportValue(const LinkUnit& unit, const LinkImport& import, u32& value) const
+{
+	const LinkUnit& owner = *m_linkUnits[import.owner];
+	auto it = owner.exports.find(import.name);
+	if (it != owner.exports.end())
 	{
-		o += "\t\"";
-		o += Util::relativeIfSubpath(srcFileJob->objFilePath).string();
-		o += "\"\n";
+		value = it->second;
+		return true;
 	}
+	if (import.isLibrary)
+		return false; // left to the symbols file, or reported by the linker
+	value = unit.placeholderAddress | (import.isThumb ? 1 : 0);
+	return true;
+}
 
-	o += ")\n\nOUTPUT (\"";
-	o += Util::relativeIfSubpath(m_elfPath).string();
-	o += "\")\n\nMEMORY {\n";
-
-	for (auto& memoryEntry : memoryEntries)
+u64 PatchMaker::getImportsFingerprint(const LinkUnit& unit) const
+{
+	u64 hash = Util::fnv1a64(nullptr, 0);
+	for (const LinkImport& import : unit.imports)
 	{
-		o += '\t';
-		o += memoryEntry->name;
-		o += " (rwx): ORIGIN = ";
-		o += Util::intToAddr(int(memoryEntry->origin), 8);
-		o += ", LENGTH = ";
-		o += Util::intToAddr(int(memoryEntry->length), 8);
-		o += '\n';
+		u32 value;
+		s64 entry = getImportValue(unit, import, value) ? s64(value) : -1;
+		hash = Util::fnv1a64(import.name.data(), import.name.length(), hash);
+		hash = Util::fnv1a64(&entry, sizeof(s64), hash);
 	}
+	return hash;
+}
 
-	o += "}\n\nSECTIONS {\n";
-
-	// Add overwrite sections
-	for (const auto& overwrite : m_overwriteRegions)
+void PatchMaker::linkUnits(const std::vector<LinkUnit*>& units)
+{
+	// The imports are written before any of the units runs, with the values known so far
+	for (LinkUnit* unit : units)
 	{
-		if (overwrite->assignedSections.empty())
-			continue;
-		
-		o += "\t.";
-		o += overwrite->memName;
-		o += " : ALIGN(4) {\n";
-
-		for (auto& p : overwrite->sectionPatches)
-			addSectionPatchInclude(o, p);
-		
-		for (const auto* section : overwrite->assignedSections)
+		std::string o = "/* NCPatcher: Auto-generated imports */\n\n";
+		for (const LinkImport& import : unit->imports)
 		{
-			// Skip ncp_jump, ncp_call, ncp_hook sections as they are already handled above
-			if (section->name.starts_with(".ncp_jump") || 
-				section->name.starts_with(".ncp_call") || 
-				section->name.starts_with(".ncp_hook"))
+			u32 value;
+			if (!getImportValue(*unit, import, value))
 				continue;
-
-			std::string objPath = Util::relativeIfSubpath(section->job->objFilePath).string();
-			o += "\t\t. = ALIGN(";
-			o += std::to_string(section->alignment);
-			o += ");\n\t\t\"";
-			o += objPath;
-			o += "\" (";
-			o += section->name;
-			o += ")\n";
+			o += "PROVIDE(";
+			o += import.name;
+			o += " = ";
+			o += Util::intToAddr(int(value), 8);
+			o += ");\n";
 		}
-		
-		o += "\t\t. = ALIGN(4);\n"
-				"\t} > ";
-		o += overwrite->memName;
-		o += " AT > bin\n\n";
+
+		std::ofstream outputFile(unit->importsPath);
+		if (!outputFile.is_open())
+			throw ncp::file_error(unit->importsPath, ncp::file_error::write);
+		outputFile.write(o.data(), std::streamsize(o.length()));
+		outputFile.close();
+
+		unit->importsFingerprint = getImportsFingerprint(*unit);
+		unit->isLinked = false;
+
+		// A failed link must not leave a fingerprint that matches a stale ELF
+		fs::path recordPath = unit->elfPath;
+		recordPath += ".linkfp";
+		std::error_code ec;
+		fs::remove(recordPath, ec);
+
+		Log::out << OLINK << "Linking " << OSTR(Util::relativeIfSubpath(unit->elfPath).string()) << std::endl;
 	}
 
-	for (auto& s : regionEntries)
+	BS::thread_pool pool(BuildConfig::getThreadCount());
+	for (LinkUnit* unit : units)
 	{
-		// TEXT
-		o += "\t.";
-		o += s->memory->name;
-		o += ".text : ALIGN(4) {\n";
-		for (auto& p : s->sectionPatches)
-		{
-			addSectionPatchInclude(o, p);
-		}
-		for (auto& p : m_rtreplPatches)
-		{
-			if (p->job->region == s->region)
-			{
-				std::string_view stem = std::string_view(p->symbol).substr(1);
-				o += "\t\t";
-				o += stem;
-				o += "_start = .;\n\t\t* (";
-				o += p->symbol;
-				o += ")\n\t\t";
-				o += stem;
-				o += "_end = .;\n";
-			}
-		}
-		if (s->dest == -1)
-		{
-			o += "\t\t* (.text)\n"
-				 "\t\t* (.rodata)\n"
-				 "\t\t* (.init_array)\n"
-				 "\t\t* (.data)\n"
-				 "\t\t* (.text.*)\n"
-				 "\t\t* (.rodata.*)\n"
-				 "\t\t* (.init_array.*)\n"
-				 "\t\t* (.data.*)\n";
-			if (s->autogenDataSize != 0)
-			{
-				o += "\t\t. = ALIGN(4);\n"
-					 "\t\tncp_autogendata = .;\n"
-					 "\t\tFILL(0)\n"
-					 "\t\t. = ncp_autogendata + ";
-				o += std::to_string(s->autogenDataSize);
-				o += ";\n";
-			}
-		}
-		else
-		{
-			for (auto& f : *m_srcFileJobs)
+		pool.push_task([this, unit](){
+			try
 			{
-				if (f->region == s->region)
-				{
-					std::string objPath = Util::relativeIfSubpath(f->objFilePath).string();
-					static const char* secIncs[] = {
-						"text",
-						"rodata",
-						"init_array",
-						"data",
-						"text.*",
-						"rodata.*",
-						"init_array.*",
-						"data.*"
-					};
-					for (auto& secInc : secIncs)
-						addSectionInclude(o, objPath, secInc);
-				}
+				linkUnit(*unit);
 			}
-			if (s->autogenDataSize)
+			catch (...)
 			{
-				o += "\t\t. = ALIGN(4);\n\t\tncp_autogendata_";
-				o += s->memory->name;
-				o += " = .;\n\t\tFILL(0)\n\t\t. = ncp_autogendata_";
-				o += s->memory->name;
-				o += " + ";
-				o += std::to_string(s->autogenDataSize);
-				o += ";\n";
+				unit->error = std::current_exception();
 			}
-		}
-		o += "\t\t. = ALIGN(4);\n"
-			 "\t} > ";
-		o += s->memory->name;
-		o += " AT > bin\n"
+		});
+	}
+	pool.wait_for_tasks();
 
-		// BSS
-		     "\n\t.";
-		o += s->memory->name;
-		o += ".bss : ALIGN(4) {\n";
-		if (s->dest == -1)
-		{
-			o += "\t\t* (.bss)\n"
-				 "\t\t* (.bss.*)\n";
-		}
-		else
-		{
-			for (auto& f : *m_srcFileJobs)
-			{
-				if (f->region == s->region)
-				{
-					std::string objPath = Util::relativeIfSubpath(f->objFilePath).string();
-					addSectionInclude(o, objPath, "bss");
-					addSectionInclude(o, objPath, "bss.*");
-				}
-			}
-		}
-		o += "\t\t. = ALIGN(4);\n"
-			 "\t} > ";
-		o += s->memory->name;
-		o += " AT > bin\n\n";
+	for (LinkUnit* unit : units)
+	{
+		std::string log = unit->log.str();
+		unit->log.str({});
+		if (!log.empty())
+			Log::out << log << std::flush;
+	}
+	for (LinkUnit* unit : units)
+	{
+		if (unit->error)
+			std::rethrow_exception(unit->error);
 	}
 
-	for (auto& p : overPatches)
+	for (LinkUnit* unit : units)
 	{
-		o += '\t';
-		o += p->info->symbol;
-		o += " : { KEEP(* (";
-		o += p->info->symbol;
-		o += ")) } > ";
-		o += p->memory->name;
-		o += " AT > bin\n";
+		saveLinkRecord(*unit);
+		unit->isLinked = true;
+		loadUnitExports(*unit);
 	}
-	if (!overPatches.empty())
-		o += '\n';
+}
+
+void PatchMaker::linkUnit(LinkUnit& unit) const
+{
+	auto linkStart = std::chrono::steady_clock::now();
+
+	if (BuildConfig::getLinker() == BuildConfig::Linker::Internal)
+		linkInternal(unit);
+	else
+		runLinker(unit.linkerPath, unit.linkArgs, unit.elfPath, unit.log);
+
+	if (TimingRecorder::isEnabled())
+	{
+		auto linkTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - linkStart);
+		TimingRecorder::recordStep(
+			TimingRecorder::StepKind::Link, Util::relativeIfSubpath(unit.elfPath).string(),
+			linkTime.count(), unit.elfPath, fs::path(), true
+		);
+	}
+}
 
-	for (auto& p : orderedDestWithNcpSet)
+void PatchMaker::runLinker(const std::string& linkerPath, const std::string& linkArgs, const fs::path& elfPath, std::ostream& log) const
+{
+	std::string ccmd;
+	ccmd.reserve(linkerPath.length() + 1 + linkArgs.length());
+	ccmd += linkerPath;
+	ccmd += ' ';
+	ccmd += linkArgs;
+
+	// Long commands do not fit the command line limits, all the linkers accept response files
+	fs::path responsePath = elfPath;
+	responsePath += ".rsp";
+	if (ccmd.length() > MaxLinkCommandLength)
 	{
-		o += "\t.ncp_set";
-		if (p == -1)
+		// Backslashes are escapes in response files
+		std::string response; response.reserve(linkArgs.length() + 16);
+		for (char c : linkArgs)
 		{
-			o += " : { KEEP(* (.ncp_set)) } > ncp_set AT > bin\n\n";
+			if (c == '\\')
+				response += '\\';
+			response += c;
 		}
+
+		std::ofstream outputFile(responsePath, std::ios::binary);
+		if (!outputFile.is_open())
+			throw ncp::file_error(responsePath, ncp::file_error::write);
+		outputFile.write(response.data(), std::streamsize(response.length()));
+		outputFile.close();
+
+		ccmd = linkerPath;
+		ccmd += " @\"";
+		ccmd += Util::relativeIfSubpath(responsePath).string();
+		ccmd += '\"';
+	}
+
+	std::ostringstream oss;
+	int retcode = Process::start(ccmd.c_str(), &oss);
+	if (retcode != 0)
+	{
+		log << oss.str() << std::endl;
+		throw ncp::exception("Could not link the ELF file " + Util::relativeIfSubpath(elfPath).string() + ".");
+	}
+}
+
+/*
+ * Links with the internal linker, the image is kept in memory for the patching
+ * and also written to the ELF path, where the link fingerprint expects it.
+ * */
+void PatchMaker::linkInternal(LinkUnit& unit) const
+{
+	InternalLinker::Options options;
+	options.log = &unit.log;
+	// BLX exists since ARMv5T, the ARM7 needs it to be enabled explicitly
+	options.allowBlx = m_target->getArm9();
+
+	std::istringstream flags(m_target->ldFlags);
+	std::string flag;
+	while (flags >> flag)
+	{
+		if (flag.length() >= 2 && flag.front() == '"' && flag.back() == '"')
+			flag = flag.substr(1, flag.length() - 2);
+
+		if (flag == "--use-blx")
+			options.allowBlx = true;
+		else if (flag.starts_with("-l") && flag.length() > 2)
+			options.libraries.emplace_back(flag.substr(2));
+		else if (flag.starts_with("-L") && flag.length() > 2)
+			options.searchDirs.emplace_back(flag.substr(2));
 		else
-		{
-			o += "_ov";
-			o += std::to_string(p);
-			o += " : {\n";
-			for (auto& j : m_jobsWithNcpSet)
-			{
-				if (j->region->destination == p)
-				{
-					o += "\t\t KEEP(\"";
-					o += Util::relativeIfSubpath(j->objFilePath).string();
-					o += "\" (.ncp_set))\n\t"
-						 "} > ncp_set AT > bin\n\n";
-				}
-			}
-		}
+			unit.log << OWARN << "The internal linker ignores the linker flag " << OSTR(flag) << std::endl;
 	}
+	for (const std::string& dir : getLinkerSearchDirs(getMachineFlags(m_target->cFlags)))
+		options.searchDirs.emplace_back(dir);
+	if (const LinkArchive* archive = getLinkArchive(unit.region))
+		options.wholeArchives.emplace_back(Util::relativeIfSubpath(archive->path).string());
+
+	// The default libraries of the gcc driver
+	if (unit.linksLibraries)
+		options.groupLibraries = { "gcc", "c" };
+
+	InternalLinker linker;
+	unit.linkedImage = linker.link(unit.layout, options);
 
-	o += "\t/DISCARD/ : {*(.*)}\n"
-		 "}\n";
+	std::string elfName = Util::relativeIfSubpath(unit.elfPath).string();
 
-	if (!m_externSymbols.empty())
+	if (BuildConfig::getLinkerVerify())
 	{
-		o += "\nEXTERN (\n";
-		for (auto& e : m_externSymbols)
+		// The reference is linked to the ELF path, the internal output replaces it after the comparison
+		std::string linkArgs;
+		std::string linkerPath = makeLinkCommand(unit, BuildConfig::Linker::Gcc, linkArgs);
+		runLinker(linkerPath, linkArgs, unit.elfPath, unit.log);
+
+		Elf32 reference;
+		if (!reference.load(unit.elfPath))
+			throw ncp::file_error(unit.elfPath, ncp::file_error::read);
+		Elf32 internal;
+		internal.loadFromMemory(unit.linkedImage, "internal link of " + elfName);
+
+		std::size_t differences = InternalLinker::compare(internal, reference, 20, unit.log);
+		if (differences != 0)
 		{
-			o += '\t';
-			o += e;
-			o += '\n';
+			unit.log << OERROR << "Found " << differences << " differences between the internal linker and GNU ld for " << OSTR(elfName) << std::endl;
+			throw ncp::exception("The internal linker output differs from GNU ld.");
 		}
-		o += ")\n";
+		unit.log << OINFO << "The internal linker output matches GNU ld for " << OSTR(elfName) << std::endl;
 	}
 
-	// Output the file
-	std::ofstream outputFile(m_ldscriptPath);
+	std::ofstream outputFile(unit.elfPath, std::ios::binary);
 	if (!outputFile.is_open())
-		throw ncp::file_error(m_ldscriptPath, ncp::file_error::write);
-	outputFile.write(o.data(), std::streamsize(o.length()));
+		throw ncp::file_error(unit.elfPath, ncp::file_error::write);
+	outputFile.write(reinterpret_cast<const char*>(unit.linkedImage.data()), std::streamsize(unit.linkedImage.size()));
 	outputFile.close();
 }
 
-std::string PatchMaker::ldFlagsToGccFlags(std::string flags)
+// The values of the symbols that the other units import, taken from the linked ELF
+void PatchMaker::loadUnitExports(LinkUnit& unit) const
 {
-	std::size_t cpos = 0;
-	while ((cpos = flags.find(' ', cpos)) != std::string::npos)
-	{
-		std::size_t dpos = flags.find('-', cpos);
-		if (dpos == std::string::npos)
-			break;
-		flags.replace(cpos, dpos - cpos, ",");
-		cpos += 2;
-	}
-	return flags;
+	unit.exports.clear();
+	if (unit.exportedSymbols.empty())
+		return;
+
+	Elf32 elf;
+	if (!elf.load(unit.elfPath))
+		throw ncp::file_error(unit.elfPath, ncp::file_error::read);
+
+	elf.forEachSymbol([&](const Elf32_Sym& symbol, std::string_view symbolName){
+		u32 bind = ELF32_ST_BIND(symbol.st_info);
+		if ((bind != STB_GLOBAL && bind != STB_WEAK) || symbol.st_shndx == SHN_UNDEF || symbol.st_shndx >= SHN_LORESERVE)
+			return false;
+		std::string name(symbolName);
+		if (unit.exportedSymbols.contains(name))
+			unit.exports.try_emplace(std::move(name), symbol.st_value);
+		return false;
+	});
 }
 
-void PatchMaker::linkElfFile()
+/*
+ * The link record of a unit holds the fingerprints of its own inputs and of
+ * the imports it was linked with, and the size and write time of the ELF file
+ * that they produced, so that an ELF file changed or removed by something else
+ * is not reused.
+ * */
+
+static constexpr u32 LinkFingerprintMagic = 0x4C50434E; // "NCPL"
+static constexpr u32 LinkFingerprintVersion = 2;
+
+bool PatchMaker::loadLinkRecord(LinkUnit& unit) const
 {
-	Log::out << OLINK << "Linking the ARM binary..." << std::endl;
+	fs::path recordPath = unit.elfPath;
+	recordPath += ".linkfp";
 
-	fs::current_path(Main::getWorkPath());
+	std::error_code ec;
+	if (!fs::exists(recordPath, ec) || !fs::exists(unit.elfPath, ec))
+		return false;
 
-	std::string ccmd;
-	ccmd.reserve(64);
-	ccmd += BuildConfig::getToolchain();
-	ccmd += "gcc -nostartfiles -Wl,--gc-sections,-T\"";
-	ccmd += Util::relativeIfSubpath(m_ldscriptPath).string();
-	ccmd += '\"';
-	std::string targetFlags = ldFlagsToGccFlags(m_target->ldFlags);
-	if (!targetFlags.empty())
-		ccmd += ',';
-	ccmd += targetFlags;
+	MappedFile file;
+	if (!file.open(recordPath) || file.size() != 40)
+		return false;
 
-	std::ostringstream oss;
-	int retcode = Process::start(ccmd.c_str(), &oss);
-	if (retcode != 0)
-	{
-		Log::out << oss.str() << std::endl;
-		throw ncp::exception("Could not link the ELF file.");
-	}
+	const u8* data = file.data();
+	if (Util::read<u32>(&data[0]) != LinkFingerprintMagic ||
+		Util::read<u32>(&data[4]) != LinkFingerprintVersion ||
+		Util::read<u64>(&data[8]) != unit.ownFingerprint ||
+		Util::read<u64>(&data[24]) != fs::file_size(unit.elfPath) ||
+		Util::read<s64>(&data[32]) != s64(fs::last_write_time(unit.elfPath).time_since_epoch().count()))
+		return false;
+
+	unit.importsFingerprint = Util::read<u64>(&data[16]);
+	return true;
+}
+
+void PatchMaker::saveLinkRecord(const LinkUnit& unit) const
+{
+	u8 data[40];
+	Util::write<u32>(&data[0], LinkFingerprintMagic);
+	Util::write<u32>(&data[4], LinkFingerprintVersion);
+	Util::write<u64>(&data[8], unit.ownFingerprint);
+	Util::write<u64>(&data[16], unit.importsFingerprint);
+	Util::write<u64>(&data[24], fs::file_size(unit.elfPath));
+	Util::write<s64>(&data[32], s64(fs::last_write_time(unit.elfPath).time_since_epoch().count()));
+
+	// Not being able to write it only costs a relink on the next build
+	fs::path recordPath = unit.elfPath;
+	recordPath += ".linkfp";
+	std::ofstream file(recordPath, std::ios::binary);
+	if (file.is_open())
+		file.write(reinterpret_cast<const char*>(data), sizeof(data));
 }
 
 void PatchMaker::gatherInfoFromElf()
 {
 	Log::info("Getting patches from elf...");
 
-	const Elf32_Ehdr& eh = m_elf->getHeader();
-	auto sh_tbl = m_elf->getSectionHeaderTable();
-	auto str_tbl = m_elf->getSection<char>(sh_tbl[eh.e_shstrndx]);
+	// Index the patches by the name of the symbol they resolve to,
+	// section patches are converted into labels by the linker script
+	std::unordered_multimap<std::string, GenericPatchInfo*> patchForSymbol;
+	patchForSymbol.reserve(m_patchInfo.size());
+	for (auto& p : m_patchInfo)
+	{
+		if (p->sectionIdx != -1) // patch is section
+			patchForSymbol.emplace(p->label, p.get());
+		else
+			patchForSymbol.emplace(p->symbol, p.get());
+	}
 
-	// Update the patch info with new values
-	forEachElfSymbol(*m_elf, eh, sh_tbl,
-	[&](const Elf32_Sym& symbol, std::string_view symbolName){
-		for (auto& p : m_patchInfo)
-		{
-			if (p->sectionIdx != -1) // patch is section
+	std::unordered_multimap<std::string_view, GenericPatchInfo*> overPatchForSection;
+	for (auto& p : m_patchInfo)
+	{
+		if (p->patchType == PatchType::Over)
+			overPatchForSection.emplace(p->symbol, p.get());
+	}
+
+	for (auto& unit : m_linkUnits)
+	{
+		const Elf32* elf = unit->elf.get();
+
+		// Update the patch info with new values, the imports of the unit are absolute and skipped,
+		// a patch is resolved by the unit of its own object
+		elf->forEachSymbol([&](const Elf32_Sym& symbol, std::string_view symbolName){
+			if (symbol.st_shndx == SHN_UNDEF || symbol.st_shndx >= SHN_LORESERVE)
+				return false;
+			auto range = patchForSymbol.equal_range(std::string(symbolName));
+			for (auto it = range.first; it != range.second; ++it)
 			{
-				std::string_view nameAsLabel = std::string_view(p->symbol).substr(1);
-				if (nameAsLabel == symbolName)
+				GenericPatchInfo* p = it->second;
+				if (p->job->region->destination != unit->dest)
+					continue;
+				if (p->sectionIdx != -1) // patch is section
 				{
-					p->srcAddress = symbol.st_value;
-					p->sectionIdx = symbol.st_shndx;
-					p->symbol = nameAsLabel;
+					// Only the first symbol resolves it, after that the patch is already a label
+					if (p->symbol.starts_with('.'))
+					{
+						p->srcAddress = symbol.st_value;
+						p->sectionIdx = symbol.st_shndx;
+						p->symbol = it->first;
+						p->elf = elf;
+					}
 				}
-			}
-			else
-			{
-				// This must run before fetching ncp_set section, otherwise ncp_set srcAddr will be overwritten
-				if (p->symbol == symbolName)
+				else
 				{
+					// This must run before fetching ncp_set section, otherwise ncp_set srcAddr will be overwritten
 					p->srcAddress = symbol.st_value;
 					p->sectionIdx = symbol.st_shndx;
+					p->elf = elf;
 				}
 			}
-		}
-		if (symbolName.starts_with("ncp_autogendata"))
-		{
-			int srcAddrOv = -1;
-			if (symbolName.length() != 15 && symbolName.substr(15).starts_with("_ov"))
+			// Only the unit of a destination defines its autogen data
+			if (symbolName.starts_with("ncp_autogendata"))
 			{
-				try {
-					srcAddrOv = std::stoi(std::string(symbolName.substr(18)));
-				} catch (std::exception& e) {
-					Log::out << OWARN << "Found invalid overlay parsing ncp_autogendata symbol: " << symbolName << std::endl;
-					return false;
-				}
+				auto* info = new AutogenDataInfo();
+				info->address = symbol.st_value;
+				m_autogenDataInfoForDest.emplace(unit->dest, info);
 			}
-			auto* info = new AutogenDataInfo();
-			info->address = symbol.st_value;
-			info->curAddress = symbol.st_value;
-			m_autogenDataInfoForDest.emplace(srcAddrOv, info);
-		}
-		return false;
-	});
+			return false;
+		});
 
-	forEachElfSection(eh, sh_tbl, str_tbl,
-	[&](std::size_t sectionIdx, const Elf32_Shdr& section, std::string_view sectionName){
-		for (auto& p : m_patchInfo)
-		{
-			if (p->patchType == PatchType::Over)
+		elf->forEachSection([&](std::size_t sectionIdx, const Elf32_Shdr& section, std::string_view sectionName){
+			auto range = overPatchForSection.equal_range(sectionName);
+			for (auto it = range.first; it != range.second; ++it)
 			{
-				if (p->symbol == sectionName)
+				GenericPatchInfo* p = it->second;
+				if (p->job->region->destination != unit->dest)
+					continue;
+				// The section is pinned to the destination in a memory shared with other over patches
+				if (section.sh_addr != p->destAddress || section.sh_size != u32(p->sectionSize))
 				{
-					p->srcAddress = section.sh_addr; // should be the same as the destination
-					p->sectionIdx = int(sectionIdx);
+					std::ostringstream oss;
+					oss << "The over patch " << OSTR(p->symbol) << " was not linked at its destination.";
+					throw ncp::exception(oss.str());
 				}
+				p->srcAddress = section.sh_addr;
+				p->sectionIdx = int(sectionIdx);
+				p->elf = elf;
 			}
-		}
-		if (sectionName.starts_with(".ncp_set"))
-		{
-			// found the ncp_set section, get all hook definitions stored there
-
-			int srcAddrOv = -1;
-			if (sectionName.length() != 8 && sectionName.substr(8).starts_with("_ov"))
+			if (sectionName.starts_with(".ncp_set"))
 			{
-				try {
-					srcAddrOv = std::stoi(std::string(sectionName.substr(11)));
-				} catch (std::exception& e) {
-					Log::out << OWARN << "Found invalid overlay reading ncp_set section: " << sectionName << std::endl;
-					return false;
-				}
-			}
+				// found the ncp_set section of the unit, get all hook definitions stored there
+				int srcAddrOv = unit->dest;
 
-			const char* sectionData = m_elf->getSection<char>(section);
+				const char* sectionData = elf->getSection<char>(section);
 
-			for (auto& p : m_patchInfo)
-			{
-				if (p->isNcpSet && p->srcAddressOv == srcAddrOv)
+				for (auto& p : m_patchInfo)
 				{
-					u32 dataOffset = p->srcAddress - section.sh_addr;
-					if (dataOffset + 4 > section.sh_size)
+					if (p->isNcpSet && p->srcAddressOv == srcAddrOv)
 					{
-						std::ostringstream oss;
-						oss << "Tried to read " << OSTR(sectionName) << " data out of bounds.";
-						throw ncp::exception(oss.str());
+						u32 dataOffset = p->srcAddress - section.sh_addr;
+						if (dataOffset + 4 > section.sh_size)
+						{
+							std::ostringstream oss;
+							oss << "Tried to read " << OSTR(sectionName) << " data out of bounds.";
+							throw ncp::exception(oss.str());
+						}
+						// ncp_set comes with the THUMB bit, we must clear it!
+						p->srcAddress = Util::read<u32>(&sectionData[dataOffset]) & ~1;
 					}
-					// ncp_set comes with the THUMB bit, we must clear it!
-					p->srcAddress = Util::read<u32>(&sectionData[dataOffset]) & ~1;
 				}
 			}
+			return false;
+		});
+	}
+
+	// The bridge blocks are in their overwrite region or after each other in the autogen data
+	for (auto& block : m_bridgeBlocks)
+	{
+		if (block->overwrite == nullptr)
+		{
+			auto infoIt = m_autogenDataInfoForDest.find(block->destination);
+			if (infoIt == m_autogenDataInfoForDest.end())
+				throw ncp::exception("The autogen data of a bridge block was not found.");
+			block->address = infoIt->second->address + block->arenaOffset;
+			continue;
+		}
+
+		const Elf32* elf = nullptr;
+		for (auto& unit : m_linkUnits)
+		{
+			if (unit->dest == block->destination)
+				elf = unit->elf.get();
 		}
-		return false;
-	});
+
+		const Elf32_Sym* symbol = elf != nullptr ? elf->findSymbol(block->symbol) : nullptr;
+		if (symbol == nullptr)
+		{
+			std::ostringstream oss;
+			oss << "Failed to get symbol " << OSTR(block->symbol) << " from ELF file.";
+			throw ncp::exception(oss.str());
+		}
+		block->address = symbol->st_value;
+	}
 
 	// Check if any overlapping patches exist
+	IntervalTree<const GenericPatchInfo*> patchTree;
+	for (const auto& p : m_patchInfo)
+		patchTree.insert(p->destAddressOv, p->destAddress, p->destAddress + getPatchOverwriteAmount(p.get()), p.get());
+	patchTree.build();
+
 	bool foundOverlapping = false;
-	for (std::size_t i = 0; i < m_patchInfo.size(); i++)
-	{
-		auto& a = m_patchInfo[i];
-        for (std::size_t j = i + 1; j < m_patchInfo.size(); j++)
-		{
-			auto& b = m_patchInfo[j];
-			if (a->destAddressOv != b->destAddressOv)
-				continue;
-			u32 aSz = getPatchOverwriteAmount(a.get());
-			u32 bSz = getPatchOverwriteAmount(b.get());
-			if (Util::overlaps(a->destAddress, a->destAddress + aSz, b->destAddress, b->destAddress + bSz))
-			{
-				Log::out << OERROR
-					<< OSTRa(a->symbol) << "[sz=" << aSz << "] (" << OSTR(a->job->srcFilePath.string()) << ") overlaps with "
-					<< OSTRa(b->symbol) << "[sz=" << bSz << "] (" << OSTR(b->job->srcFilePath.string()) << ")\n";
-				foundOverlapping = true;
-			}
-        }
-    }
+	patchTree.forEachOverlap([&](const auto& ia, const auto& ib){
+		const GenericPatchInfo* a = ia.value;
+		const GenericPatchInfo* b = ib.value;
+		// Hooks at the same instruction are chained, if their bridge can be in the same place
+		if (a->patchType == PatchType::Hook && b->patchType == PatchType::Hook && !a->destThumb &&
+			a->destAddress == b->destAddress && a->srcAddressOv == b->srcAddressOv)
+			return;
+		Log::out << OERROR
+			<< OSTRa(a->symbol) << "[sz=" << (ia.end - ia.start) << "] (" << OSTR(a->job->srcFilePath.string()) << ") overlaps with "
+			<< OSTRa(b->symbol) << "[sz=" << (ib.end - ib.start) << "] (" << OSTR(b->job->srcFilePath.string()) << ")\n";
+		foundOverlapping = true;
+	});
 	if (foundOverlapping)
 		throw ncp::exception("Overlapping patches were detected.");
-	
+
 	// Check that no patch is being written to an overwrite region
+	// The patches address the TCM through the main binary
+	IntervalTree<const OverwriteRegionInfo*> overwriteTree;
+	for (const auto& overwrite : m_overwriteRegions)
+		overwriteTree.insert(std::max(overwrite->destination, -1), overwrite->startAddress, overwrite->endAddress, overwrite.get());
+	overwriteTree.build();
+
 	bool foundPatchInOverwrite = false;
 	for (const auto& patch : m_patchInfo)
 	{
-		for (const auto& overwrite : m_overwriteRegions)
-		{
-			// Check if patch targets the same destination as the overwrite region
-			if (patch->destAddressOv == overwrite->destination)
-			{
-				u32 patchEnd = patch->destAddress + getPatchOverwriteAmount(patch.get());
-				
-				// Check if patch overlaps with overwrite region
-				if (Util::overlaps(patch->destAddress, patchEnd, overwrite->startAddress, overwrite->endAddress))
-				{
-					Log::out << OERROR
-						<< "Patch " << OSTRa(patch->symbol) << " (" << OSTR(patch->job->srcFilePath.string()) 
-						<< ") conflicts with overwrite region 0x" << std::hex << std::uppercase 
-						<< overwrite->startAddress << "-0x" << overwrite->endAddress << std::endl;
-					foundPatchInOverwrite = true;
-				}
-			}
-		}
+		u32 patchEnd = patch->destAddress + getPatchOverwriteAmount(patch.get());
+		overwriteTree.forEachOverlapping(patch->destAddressOv, patch->destAddress, patchEnd, [&](const auto& io){
+			const OverwriteRegionInfo* overwrite = io.value;
+			Log::out << OERROR
+				<< "Patch " << OSTRa(patch->symbol) << " (" << OSTR(patch->job->srcFilePath.string())
+				<< ") conflicts with overwrite region 0x" << std::hex << std::uppercase
+				<< overwrite->startAddress << "-0x" << overwrite->endAddress << std::endl;
+			foundPatchInOverwrite = true;
+		});
 	}
 	if (foundPatchInOverwrite)
 		throw ncp::exception("Patches targeting overwrite regions were detected.");
@@ -1670,33 +4273,29 @@ void PatchMaker::gatherInfoFromElf()
 		}
 	}
 
-	forEachElfSection(eh, sh_tbl, str_tbl,
-	[&](std::size_t sectionIdx, const Elf32_Shdr& section, std::string_view sectionName){
-		auto insertSection = [&](int dest, bool isBss){
-			auto& newcodeInfo = m_newcodeDataForDest[dest];
-			if (newcodeInfo == nullptr)
-			    newcodeInfo = std::make_unique<NewcodePatch>();
-
-			(isBss ? newcodeInfo->bssData : newcodeInfo->binData) = m_elf->getSection<u8>(section);
-			(isBss ? newcodeInfo->bssSize : newcodeInfo->binSize) = section.sh_size;
-			(isBss ? newcodeInfo->bssAlign : newcodeInfo->binAlign) = section.sh_addralign;
-		};
+	for (auto& unit : m_linkUnits)
+	{
+		const Elf32* elf = unit->elf.get();
+		std::string textName = "." + getDestName(unit->dest) + ".text";
+		std::string bssName = "." + getDestName(unit->dest) + ".bss";
+		elf->forEachSection([&](std::size_t sectionIdx, const Elf32_Shdr& section, std::string_view sectionName){
+			auto insertSection = [&](int dest, bool isBss){
+				auto& newcodeInfo = m_newcodeDataForDest[dest];
+				if (newcodeInfo == nullptr)
+				    newcodeInfo = std::make_unique<NewcodePatch>();
+
+				(isBss ? newcodeInfo->bssData : newcodeInfo->binData) = elf->getSection<u8>(section);
+				(isBss ? newcodeInfo->bssSize : newcodeInfo->binSize) = section.sh_size;
+				(isBss ? newcodeInfo->bssAlign : newcodeInfo->binAlign) = section.sh_addralign;
+			};
 
-		if (sectionName.starts_with(".arm"))
-		{
-			insertSection(-1, sectionName.substr(5) == "bss");
-		}
-		else if (sectionName.starts_with(".ov") && !sectionName.starts_with(".overwrite"))
-		{
-			std::size_t pos = sectionName.find('.', 3);
-			if (pos != std::string::npos)
-			{
-				int dest = std::stoi(std::string(sectionName.substr(3, pos - 3)));
-				insertSection(dest, sectionName.substr(pos + 1) == "bss");
-			}
-		}
-		return false;
-	});
+			if (sectionName == textName)
+				insertSection(unit->dest, false);
+			else if (sectionName == bssName)
+				insertSection(unit->dest, true);
+			return false;
+		});
+	}
 
 	if (Main::getVerbose())
 	{
@@ -1704,7 +4303,7 @@ void PatchMaker::gatherInfoFromElf()
 		for (const auto& [dest, newcodeInfo] : m_newcodeDataForDest)
 		{
 			Log::out <<
-				std::setw(8) << std::left << (dest == -1 ? "ARM" : ("OV" + std::to_string(dest))) << std::right <<
+				std::setw(8) << std::left << getDestName(dest) << std::right <<
 				std::setw(9) << std::dec << newcodeInfo->binSize << "    " <<
 				std::setw(8) << std::dec << newcodeInfo->bssSize << std::endl;
 		}
@@ -1713,67 +4312,82 @@ void PatchMaker::gatherInfoFromElf()
 	// Gather overwrite section data
 	for (const auto& overwrite : m_overwriteRegions)
 	{
-		overwrite->sectionIdx = -1;
+		// Overwrites without sections have no memory in the linker script
+		if (overwrite->assignedSections.empty())
+			continue;
 
-		forEachElfSection(eh, sh_tbl, str_tbl,
-		[&](std::size_t sectionIdx, const Elf32_Shdr& section, std::string_view sectionName) -> bool {
-			if (sectionName == "." + overwrite->memName)
-			{
-				overwrite->sectionIdx = sectionIdx;
-				overwrite->sectionSize = section.sh_size;
+		const Elf32* elf = nullptr;
+		for (auto& unit : m_linkUnits)
+		{
+			if (unit->dest == overwrite->destination)
+				elf = unit->elf.get();
+		}
 
-				if (overwrite->sectionSize != overwrite->usedSize)
-				{
-					Log::out << OWARN << "Overwrite region " << OSTR(overwrite->memName)
-						<< " at 0x" << std::hex << std::uppercase << overwrite->startAddress
-						<< " has section size " << std::dec << section.sh_size
-						<< " bytes, but expected " << overwrite->usedSize << " bytes." << std::endl;
-				}
+		int sectionIdx = elf != nullptr ? elf->findSection("." + overwrite->memName) : -1;
+		if (sectionIdx == -1)
+		{
+			std::ostringstream oss;
+			oss << "Failed to get section " << OSTR(overwrite->memName) << " from ELF file.";
+			throw ncp::exception(oss.str());
+		}
 
-				u32 maxSize = overwrite->endAddress - overwrite->startAddress;
+		const Elf32_Shdr& section = elf->getSectionHeaderTable()[sectionIdx];
 
-				if (overwrite->sectionSize > maxSize)
-				{
-					std::ostringstream oss;
-					oss << OERROR << "Overwrite region is smaller than the generated section "
-						<< " (size: " << std::dec << overwrite->sectionSize << " bytes, max size: "  << maxSize << ")" << std::endl;
-					throw ncp::exception(oss.str());
-				}
-				
-				if (Main::getVerbose())
-				{
-					Log::out << OINFO << "Found overwrite region " << OSTR(overwrite->memName) 
-						<< " at 0x" << std::hex << std::uppercase << overwrite->startAddress
-						<< " (size: " << std::dec << section.sh_size << " bytes)" << std::endl;
-				}
-				
-				return true;
-			}
-			return false;
-		});
+		overwrite->sectionIdx = sectionIdx;
+		overwrite->elf = elf;
+		overwrite->sectionSize = section.sh_size;
+
+		if (overwrite->sectionSize != overwrite->usedSize)
+		{
+			Log::out << OWARN << "Overwrite region " << OSTR(overwrite->memName)
+				<< " at 0x" << std::hex << std::uppercase << overwrite->startAddress
+				<< " has section size " << std::dec << section.sh_size
+				<< " bytes, but expected " << overwrite->usedSize << " bytes." << std::endl;
+		}
+
+		u32 maxSize = overwrite->endAddress - overwrite->startAddress;
 
-		if (overwrite->sectionIdx == -1)
+		if (overwrite->sectionSize > maxSize)
 		{
 			std::ostringstream oss;
-			oss << "Failed to get section " << OSTR(overwrite->memName) << " from ELF file.";
+			oss << OERROR << "Overwrite region is smaller than the generated section "
+				<< " (size: " << std::dec << overwrite->sectionSize << " bytes, max size: "  << maxSize << ")" << std::endl;
 			throw ncp::exception(oss.str());
 		}
+
+		if (Main::getVerbose())
+		{
+			Log::out << OINFO << "Found overwrite region " << OSTR(overwrite->memName)
+				<< " at 0x" << std::hex << std::uppercase << overwrite->startAddress
+				<< " (size: " << std::dec << section.sh_size << " bytes)" << std::endl;
+		}
 	}
 }
 
-void PatchMaker::loadElfFile()
+void PatchMaker::loadElfFiles()
 {
-	if (!std::filesystem::exists(m_elfPath))
-		throw ncp::file_error(m_elfPath, ncp::file_error::find);
+	for (auto& unit : m_linkUnits)
+	{
+		if (!std::filesystem::exists(unit->elfPath))
+			throw ncp::file_error(unit->elfPath, ncp::file_error::find);
 
-	m_elf = std::make_unique<Elf32>();
-	if (!m_elf->load(m_elfPath))
-		throw ncp::file_error(m_elfPath, ncp::file_error::read);
+		unit->elf = std::make_unique<Elf32>();
+		if (!unit->linkedImage.empty())
+		{
+			// Just linked in memory, no need to read it back
+			unit->elf->loadFromMemory(std::move(unit->linkedImage), unit->elfPath.string());
+			unit->linkedImage.clear();
+			continue;
+		}
+		if (!unit->elf->load(unit->elfPath))
+			throw ncp::file_error(unit->elfPath, ncp::file_error::read);
+	}
 }
 
-void PatchMaker::unloadElfFile()
+void PatchMaker::unloadElfFiles()
 {
-	m_elf = nullptr;
+	for (auto& unit : m_linkUnits)
+		unit->elf = nullptr;
 }
 
 u32 PatchMaker::makeJumpOpCode(u32 opCode, u32 fromAddr, u32 toAddr)
@@ -1880,15 +4494,164 @@ void PatchMaker::applyPatchesToRom()
 
 	Log::info("Patching the binaries...");
 
-	auto failInject = [](std::unique_ptr<GenericPatchInfo>& p, bool srcThumb, bool destThumb, const char* injectType){
-		std::ostringstream oss;
-		oss << "Injecting " << injectType << " from " << (destThumb ? "THUMB" : "ARM") << " to "
-			<< (srcThumb ? "THUMB" : "ARM") << " is not supported, at "
-			<< OSTRa(p->symbol) << " (" << OSTR(p->job->srcFilePath.string()) << ")";
-		throw ncp::exception(oss.str());
+	auto getBridgeBlock = [&](const std::string& key){
+		auto blockIt = m_bridgeBlockForKey.find(key);
+		if (blockIt == m_bridgeBlockForKey.end())
+			throw ncp::exception("Unexpected bridge " + key + " encountered, it was not reserved.");
+		return blockIt->second;
+	};
+
+	// Takes from the bridge block of the key, the data is sized to the block so the pointers stay valid
+	auto allocBridgeData = [&](const std::string& key, std::size_t size, u32& address){
+		BridgeBlock* block = getBridgeBlock(key);
+		if (block->usedSize + size > block->size)
+			throw ncp::exception("The bridge " + key + " is larger than reserved.");
+		if (block->data.empty())
+			block->data.resize(block->size);
+
+		u8* dataPtr = block->data.data() + block->usedSize;
+		address = block->address + u32(block->usedSize);
+		block->usedSize += size;
+		return dataPtr;
+	};
+
+	bool isArm9 = m_target->getArm9();
+
+	// Bridges into the same function are shared, by the key of their bridge block
+	std::unordered_map<std::string, u32> hookStubForKey;
+	std::unordered_map<std::string, u32> thumbJumpBridgeForKey;
+	std::unordered_map<std::string, u32> armVeneerForKey;
+	std::unordered_map<std::string, u32> farVeneerForKey;
+
+	/*
+	 * Jumps from ARM into the THUMB function of a patch, changing no register
+	 * other than R12 that veneers are free to use:
+	 *
+	 * arm2thumb_jump_bridge:
+	 *     LDR   PC, [PC,#-4]
+	 *     .int: srcAddr+1
+	 *
+	 * arm2thumb_jump_veneer: @ ARMv4, LDR PC does not change the state
+	 *     LDR   R12, [PC,#0]
+	 *     BX    R12
+	 *     .int: srcAddr+1
+	 * */
+	auto getThumbJumpBridge = [&](const GenericPatchInfo* p){
+		std::string key = getBridgeKey("arm2thumb", p);
+		auto [bridgeIt, isNewBridge] = thumbJumpBridgeForKey.try_emplace(key, 0);
+		if (!isNewBridge)
+			return bridgeIt->second;
+
+		std::size_t bridgeSize = getArm2ThumbJumpBridgeSize(isArm9);
+		u32 bridgeAddr;
+		u8* bridgeDataPtr = allocBridgeData(key, bridgeSize, bridgeAddr);
+		bridgeIt->second = bridgeAddr;
+
+		if (Main::getVerbose())
+			Log::out << "ARM->THUMB BRIDGE: " << Util::intToAddr(bridgeAddr, 8) << std::endl;
+
+		if (isArm9)
+		{
+			Util::write<u32>(bridgeDataPtr, armLdrPCNext);
+			Util::write<u32>(bridgeDataPtr + 4, p->srcAddress | 1); // int value to jump to
+		}
+		else
+		{
+			Util::write<u32>(bridgeDataPtr, armLdrR12);
+			Util::write<u32>(bridgeDataPtr + 4, armBXR12);
+			Util::write<u32>(bridgeDataPtr + 8, p->srcAddress | 1);
+		}
+
+		if (Main::getVerbose())
+			Util::printDataAsHex(bridgeDataPtr, bridgeSize, 32);
+		return bridgeAddr;
+	};
+
+	// Switches from THUMB to ARM at a word aligned BX PC and branches, in 8 bytes or 10 if not aligned
+	auto writeThumbToArmJump = [](ICodeBin* bin, const GenericPatchInfo* p, u32 toAddr){
+		u32 address = p->destAddress;
+		if (address & 2)
+		{
+			// The instruction past the usual 8 bytes is overwritten as well
+			Log::out << OWARN << "The THUMB jump " << OSTRa(p->symbol) << " (" << OSTR(p->job->srcFilePath.string())
+				<< ") is not word aligned at " << Util::intToAddr(address, 8) << ", it overwrites 10 bytes instead of 8." << std::endl;
+			bin->write<u16>(address, thumbOpCodeNop);
+			address += 2;
+		}
+		bin->write<u16>(address, thumbOpCodeBXPC);
+		bin->write<u16>(address + 2, thumbOpCodeNop);
+		bin->write<u32>(address + 4, makeJumpOpCode(armOpcodeB, address + 4, toAddr));
+	};
+
+	/*
+	 * Calls from THUMB into the ARM function of a patch on ARMv4, that has no BLX:
+	 *
+	 * thumb2arm_veneer:
+	 *     BX    PC
+	 *     NOP
+	 *     B     srcAddr    @ ARM, the function returns to THUMB with BX LR
+	 * */
+	auto getArmVeneer = [&](const GenericPatchInfo* p){
+		std::string key = getBridgeKey("thumb2arm", p);
+		auto [veneerIt, isNewVeneer] = armVeneerForKey.try_emplace(key, 0);
+		if (!isNewVeneer)
+			return veneerIt->second;
+
+		u32 veneerAddr;
+		u8* veneerDataPtr = allocBridgeData(key, SizeOfThumb2ArmVeneer, veneerAddr);
+		veneerIt->second = veneerAddr;
+
+		if (Main::getVerbose())
+			Log::out << "THUMB->ARM VENEER: " << Util::intToAddr(veneerAddr, 8) << std::endl;
+
+		Util::write<u16>(veneerDataPtr, thumbOpCodeBXPC);
+		Util::write<u16>(veneerDataPtr + 2, thumbOpCodeNop);
+		Util::write<u32>(veneerDataPtr + 4, makeJumpOpCode(armOpcodeB, veneerAddr + 4, p->srcAddress));
+
+		if (Main::getVerbose())
+			Util::printDataAsHex(veneerDataPtr, SizeOfThumb2ArmVeneer, 32);
+		return veneerAddr;
 	};
 
-	auto sh_tbl = m_elf->getSectionHeaderTable();
+	/*
+	 * Branches from a site into a TCM out of its range go through a veneer near the site,
+	 * 0 if the site reaches:
+	 *
+	 * far_veneer:
+	 *     LDR   PC, [PC,#-4]
+	 *     .int: toAddr       @ with the THUMB bit, LDR PC changes the state on ARMv5
+	 * */
+	auto getFarVeneer = [&](const GenericPatchInfo* p, u32 toAddr){
+		std::string key = getFarVeneerKey(p);
+		if (!m_bridgeBlockForKey.contains(key))
+			return u32(0);
+
+		auto [veneerIt, isNewVeneer] = farVeneerForKey.try_emplace(key, 0);
+		if (!isNewVeneer)
+			return veneerIt->second;
+
+		u32 veneerAddr;
+		u8* veneerDataPtr = allocBridgeData(key, SizeOfFarVeneer, veneerAddr);
+		veneerIt->second = veneerAddr;
+
+		if (Main::getVerbose())
+			Log::out << "FAR VENEER: " << Util::intToAddr(veneerAddr, 8) << std::endl;
+
+		Util::write<u32>(veneerDataPtr, armLdrPCNext);
+		Util::write<u32>(veneerDataPtr + 4, toAddr);
+
+		if (Main::getVerbose())
+			Util::printDataAsHex(veneerDataPtr, SizeOfFarVeneer, 32);
+		return veneerAddr;
+	};
+
+	// The site of an ARM hook branches to its bridge
+	auto writeHookJump = [&](ICodeBin* bin, const GenericPatchInfo* p, u32 hookBridgeAddr){
+		u32 farAddr = getFarVeneer(p, hookBridgeAddr);
+		bin->write<u32>(p->destAddress, makeJumpOpCode(armOpcodeB, p->destAddress, farAddr != 0 ? farAddr : hookBridgeAddr));
+	};
+
+	auto hooksForSite = getHooksForSite(m_patchInfo);
 
 	for (auto& p : m_patchInfo)
 	{
@@ -1900,7 +4663,14 @@ void PatchMaker::applyPatchesToRom()
 		{
 		case PatchType::Jump:
 		{
-			if (!p->destThumb && !p->srcThumb) // ARM -> ARM
+			if (u32 farAddr = getFarVeneer(p.get(), p->srcAddress | (p->srcThumb ? 1 : 0)); farAddr != 0) // Into a TCM out of range
+			{
+				if (p->destThumb)
+					writeThumbToArmJump(bin, p.get(), farAddr);
+				else
+					bin->write<u32>(p->destAddress, makeJumpOpCode(armOpcodeB, p->destAddress, farAddr));
+			}
+			else if (!p->destThumb && !p->srcThumb) // ARM -> ARM
 			{
 				bin->write<u32>(p->destAddress, makeJumpOpCode(armOpcodeB, p->destAddress, p->srcAddress));
 			}
@@ -1909,77 +4679,52 @@ void PatchMaker::applyPatchesToRom()
 				/*
 				 * If the patch type is a ARM to THUMB jump, the instruction at
 				 * destAddr must become a jump to a ARM to THUMB jump bridge generated
-				 * by NCPatcher and it should look as such:
-				 *
-				 * arm2thumb_jump_bridge:
-				 *     LDR   PC, [PC,#-4]
-				 *     .int: srcAddr+1
+				 * by NCPatcher, the jumps to the same function share the bridge.
 				 * */
-				
-				auto& info = m_autogenDataInfoForDest[p->srcAddressOv];
-				if (info == nullptr)
-					throw ncp::exception("Unexpected p->srcAddressOv for m_autogenDataInfoForDest encountered.");
-
-				std::vector<u8>& bridgeData = info->data;
-				std::size_t offset = bridgeData.size();
-				bridgeData.resize(offset + SizeOfArm2ThumbJumpBridge);
-
-				u32 bridgeAddr = info->curAddress;
-
-				if (Main::getVerbose())
-					Log::out << "ARM->THUMB BRIDGE: " << Util::intToAddr(bridgeAddr, 8) << std::endl;
-
-				bin->write<u32>(p->destAddress, makeJumpOpCode(armOpcodeB, p->destAddress, bridgeAddr));
-
-				u8* bridgeDataPtr = bridgeData.data() + offset;
-
-				Util::write<u32>(bridgeDataPtr, 0xE51FF004);            // LDR PC, [PC,#-4]
-				Util::write<u32>(bridgeDataPtr + 4, p->srcAddress | 1); // int value to jump to
-
-				if (Main::getVerbose())
-					Util::printDataAsHex(bridgeData.data() + offset, SizeOfArm2ThumbJumpBridge, 32);
-
-				info->curAddress += SizeOfArm2ThumbJumpBridge;
+				bin->write<u32>(p->destAddress, makeJumpOpCode(armOpcodeB, p->destAddress, getThumbJumpBridge(p.get())));
 			}
 			else if (p->destThumb && !p->srcThumb) // THUMB -> ARM
 			{
-				u16 patchData[4];
-				patchData[0] = thumbOpCodePushLR;
-				Util::write<u32>(&patchData[1], makeThumbCallOpCode(true, p->destAddress + 2, p->srcAddress));
-				patchData[3] = thumbOpCodePopPC;
-				bin->writeBytes(p->destAddress, patchData, 8);
+				writeThumbToArmJump(bin, p.get(), p->srcAddress);
 			}
 			else // THUMB -> THUMB
 			{
-				u16 patchData[4];
-				patchData[0] = thumbOpCodePushLR;
-				Util::write<u32>(&patchData[1], makeThumbCallOpCode(false, p->destAddress + 2, p->srcAddress));
-				patchData[3] = thumbOpCodePopPC;
-				bin->writeBytes(p->destAddress, patchData, 8);
+				// A THUMB branch if in range, otherwise through ARM and its bridge
+				s32 offset = s32(p->srcAddress) - s32(p->destAddress + 4);
+				if (offset >= -0x800 && offset < 0x800)
+					bin->write<u16>(p->destAddress, u16(thumbOpCodeB | ((offset >> 1) & 0x7FF)));
+				else
+					writeThumbToArmJump(bin, p.get(), getThumbJumpBridge(p.get()));
 			}
 			break;
 		}
 		case PatchType::Call:
 		{
-			if (p->destThumb != p->srcThumb && !m_target->getArm9())
+			// ARMv4 has no BLX, the calls that change the state go through a veneer
+			if (u32 farAddr = getFarVeneer(p.get(), p->srcAddress | (p->srcThumb ? 1 : 0)); farAddr != 0) // Into a TCM out of range
 			{
-				std::ostringstream oss;
-				oss << "Cannot create thumb-interworking veneer: BLX not supported on armv4. At "
-					<< OSTRa(p->symbol) << " (" << OSTR(p->job->srcFilePath.string()) << ")";
-				throw ncp::exception(oss.str());
+				if (p->destThumb)
+					bin->write<u32>(p->destAddress, makeThumbCallOpCode(true, p->destAddress, farAddr));
+				else
+					bin->write<u32>(p->destAddress, makeJumpOpCode(armOpcodeBL, p->destAddress, farAddr));
 			}
-
-			if (!p->destThumb && !p->srcThumb) // ARM -> ARM
+			else if (!p->destThumb && !p->srcThumb) // ARM -> ARM
 			{
 				bin->write<u32>(p->destAddress, makeJumpOpCode(armOpcodeBL, p->destAddress, p->srcAddress));
 			}
 			else if (!p->destThumb && p->srcThumb) // ARM -> THUMB
 			{
-				bin->write<u32>(p->destAddress, makeBLXOpCode(p->destAddress, p->srcAddress));
+				if (isArm9)
+					bin->write<u32>(p->destAddress, makeBLXOpCode(p->destAddress, p->srcAddress));
+				else
+					bin->write<u32>(p->destAddress, makeJumpOpCode(armOpcodeBL, p->destAddress, getThumbJumpBridge(p.get())));
 			}
 			else if (p->destThumb && !p->srcThumb) // THUMB -> ARM
 			{
-				bin->write<u32>(p->destAddress, makeThumbCallOpCode(true, p->destAddress, p->srcAddress));
+				if (isArm9)
+					bin->write<u32>(p->destAddress, makeThumbCallOpCode(true, p->destAddress, p->srcAddress));
+				else
+					bin->write<u32>(p->destAddress, makeThumbCallOpCode(false, p->destAddress, getArmVeneer(p.get())));
 			}
 			else // THUMB -> THUMB
 			{
@@ -1995,54 +4740,305 @@ void PatchMaker::applyPatchesToRom()
 			 * by NCPatcher and it should look as such:
 			 *
 			 * hook_bridge:
-			 *     PUSH {R0-R3,R12}
-			 *     BL   srcAddr        @ BLX if srcAddr is THUMB
-			 *     POP  {R0-R3,R12}
+			 *     PUSH {R0-R3,R12,LR}
+			 *     BL   srcAddr        @ BLX if srcAddr is THUMB, a veneer on ARMv4
+			 *     POP  {R0-R3,R12,LR}
+			 *     <unpatched destAddr's instruction>
+			 *     B    (destAddr + 4)
+			 *
+			 * When many hooks call the same function, they share a stub
+			 * and only keep the call to it in their own bridge:
+			 *
+			 * hook_stub:
+			 *     PUSH {R0-R3,R11,R12,LR} @ R11 keeps the stack 8 byte aligned
+			 *     BL   srcAddr            @ BLX if srcAddr is THUMB, a veneer on ARMv4
+			 *     POP  {R0-R3,R11,R12,LR}
+			 *     SWP  LR, LR, [SP]       @ restores LR, leaves the bridge return address
+			 *     POP  {PC}
+			 *
+			 * hook_bridge:
+			 *     PUSH {LR}
+			 *     BL   hook_stub
 			 *     <unpatched destAddr's instruction>
 			 *     B    (destAddr + 4)
+			 *
+			 * A lean hook bridge is the first one, saving only R12 and LR,
+			 * R12 for the stack to stay 8 byte aligned.
+			 *
+			 * Hooks at the same instruction are chained into one bridge:
+			 *
+			 * hook_chain_bridge:
+			 *     PUSH  {R0-R3,R12,LR}
+			 *     BL    srcAddr0
+			 *     LDMIA SP, {R0-R3}
+			 *     BL    srcAddr1
+			 *     ...
+			 *     POP   {R0-R3,R12,LR}
+			 *     <unpatched destAddr's instruction>
+			 *     B     (destAddr + 4)
 			 * */
 
 			if (p->destThumb)
-				failInject(p, p->srcThumb, p->destThumb, "hook");
+			{
+				/*
+				 * A THUMB hook saves LR before calling its bridge, which
+				 * runs the moved instructions after the call and returns
+				 * with a jump that does not change any register:
+				 *
+				 * destAddr:
+				 *     PUSH  {LR}
+				 *     BL    thumb_hook_bridge
+				 *     NOP                   @ if a BL was moved along
+				 *
+				 * thumb_hook_bridge:
+				 *     PUSH  {R0-R3,LR}
+				 *     MOV   R0, R12
+				 *     PUSH  {R0,R1}         @ R1 keeps the stack 8 byte aligned
+				 *     LDR   R0, [SP,#8]     @ the R0 of the hooked function, for the arguments
+				 *     BL    srcAddr         @ BLX if srcAddr is ARM, a veneer on ARMv4
+				 *     LDR   R0, [SP,#28]
+				 *     MOV   LR, R0          @ the LR of the hooked function
+				 *     POP   {R0,R1}
+				 *     MOV   R12, R0
+				 *     POP   {R0-R3}
+				 *     ADD   SP, #8
+				 *     <unpatched destAddr's instructions>
+				 *     PUSH  {R0,R1}
+				 *     LDR   R0, =(destAddr + 6 + 1) @ + 8 if a BL was moved along
+				 *     STR   R0, [SP,#4]
+				 *     POP   {R0,PC}
+				 * */
+
+				// THUMB -> ARM && THUMB -> THUMB
+
+				u32 veneerAddr = (!p->srcThumb && !isArm9) ? getArmVeneer(p.get()) : 0;
+
+				ThumbHookSite site = readThumbHookSite(bin, p->destAddress);
+				std::size_t bridgeSize = getThumbHookBridgeSize(site);
+				u32 hookBridgeAddr;
+				u8* hookDataPtr = allocBridgeData(getHookSiteKey(p.get()), bridgeSize, hookBridgeAddr);
+
+				if (Main::getVerbose())
+					Log::out << "THUMB HOOK BRIDGE: " << Util::intToAddr(hookBridgeAddr, 8) << std::endl;
+
+				u32 callOpCode;
+				if (p->srcThumb)
+					callOpCode = makeThumbCallOpCode(false, hookBridgeAddr + 8, p->srcAddress);
+				else if (isArm9)
+					callOpCode = makeThumbCallOpCode(true, hookBridgeAddr + 8, p->srcAddress);
+				else
+					callOpCode = makeThumbCallOpCode(false, hookBridgeAddr + 8, veneerAddr);
+
+				const u16 headOpCodes[] = {
+					0xB50F, // PUSH {R0-R3,LR}
+					0x4660, // MOV R0, R12
+					0xB403, // PUSH {R0,R1}
+					0x9802, // LDR R0, [SP,#8]
+					u16(callOpCode), u16(callOpCode >> 16),
+					0x9807, // LDR R0, [SP,#28]
+					0x4686, // MOV LR, R0
+					0xBC03, // POP {R0,R1}
+					0x4684, // MOV R12, R0
+					0xBC0F, // POP {R0-R3}
+					0xB002  // ADD SP, #8
+				};
+				std::memcpy(hookDataPtr, headOpCodes, sizeof(headOpCodes));
+
+				u32 codeEnd = u32(SizeOfThumbHookBridgeHead + site.count * 2 + SizeOfThumbHookBridgeTail);
+				u32 literalAddr = hookBridgeAddr + ((codeEnd + 3) & ~3);
+				u32 returnAddr = p->destAddress + u32(site.count * 2);
+
+				auto failRelocate = [&](u32 address){
+					std::ostringstream oss;
+					oss << "The THUMB instruction at " << Util::intToAddr(address, 8) << " cannot be moved into a hook bridge, at "
+						<< OSTRa(p->symbol) << " (" << OSTR(p->job->srcFilePath.string()) << ")";
+					throw ncp::exception(oss.str());
+				};
+
+				// Moves the instructions, fixing the ones relative to PC
+				auto putLiteral = [&](u32 value){
+					Util::write<u32>(hookDataPtr + (literalAddr - hookBridgeAddr), value);
+					literalAddr += 4;
+					return literalAddr - 4;
+				};
+				u32 returnLiteralAddr = putLiteral(returnAddr | 1);
+				for (std::size_t i = 0; i < site.count; i++)
+				{
+					u16 opCode = site.opCodes[i];
+					u32 ogAddr = p->destAddress + u32(i * 2);
+					u32 newAddr = hookBridgeAddr + u32(SizeOfThumbHookBridgeHead + i * 2);
+					u8* opCodePtr = hookDataPtr + SizeOfThumbHookBridgeHead + i * 2;
+
+					if ((opCode & 0xF800) == thumbOpCodeBL0 && i + 1 < site.count) // BL, BLX
+					{
+						u16 opCode1 = site.opCodes[i + 1];
+						bool exchange = (opCode1 & 0xF800) == thumbOpCodeBLX1;
+						s32 offset = s32(u32(((opCode & 0x7FF) << 11) | (opCode1 & 0x7FF)) << 10) >> 10;
+						u32 toAddr = u32(s32(ogAddr) + 4 + offset * 2);
+						if (exchange)
+							toAddr &= ~3;
+						Util::write<u32>(opCodePtr, makeThumbCallOpCode(exchange, newAddr, toAddr));
+						i++;
+					}
+					else if ((opCode & 0xF800) == thumbOpCodeLdrPC) // LDR Rd, [PC,#imm]
+					{
+						u32 ogLiteralAddr = ((ogAddr + 4) & ~3) + (opCode & 0xFF) * 4;
+						u32 newLiteralAddr = putLiteral(bin->read<u32>(ogLiteralAddr));
+						u32 imm = (newLiteralAddr - ((newAddr + 4) & ~3)) / 4;
+						Util::write<u16>(opCodePtr, u16((opCode & 0xFF00) | imm));
+					}
+					else
+					{
+						bool isHiRegPC = (opCode & 0xFC00) == 0x4400 &&
+							(((opCode >> 3) & 0xF) == 15 || (((opCode >> 4) & 8) | (opCode & 7)) == 15);
+						if ((opCode & 0xF000) == 0xD000 || // B<cond>, SWI
+							(opCode & 0xF800) == 0xE000 || // B
+							(opCode & 0xF800) == 0xA000 || // ADD Rd, PC, #imm
+							(opCode & 0xF800) == thumbOpCodeBL1 || (opCode & 0xF800) == thumbOpCodeBLX1 || // a split BL
+							isHiRegPC)
+						{
+							if ((opCode & 0xFF00) != 0xDF00) // SWI does not depend on PC
+								failRelocate(ogAddr);
+						}
+						Util::write<u16>(opCodePtr, opCode);
+					}
+				}
+
+				u8* tailPtr = hookDataPtr + SizeOfThumbHookBridgeHead + site.count * 2;
+				u32 ldrAddr = hookBridgeAddr + u32(SizeOfThumbHookBridgeHead + site.count * 2 + 2);
+				Util::write<u16>(tailPtr, 0xB403); // PUSH {R0,R1}
+				Util::write<u16>(tailPtr + 2, u16(thumbOpCodeLdrPC | ((returnLiteralAddr - ((ldrAddr + 4) & ~3)) / 4)));
+				Util::write<u16>(tailPtr + 4, 0x9001); // STR R0, [SP,#4]
+				Util::write<u16>(tailPtr + 6, 0xBD01); // POP {R0,PC}
+
+				u16 siteOpCodes[4] = { thumbOpCodePushLR, 0, 0, thumbOpCodeNop };
+				u32 farAddr = getFarVeneer(p.get(), hookBridgeAddr | 1);
+				Util::write<u32>(&siteOpCodes[1], farAddr != 0 ?
+					makeThumbCallOpCode(true, p->destAddress + 2, farAddr) :
+					makeThumbCallOpCode(false, p->destAddress + 2, hookBridgeAddr));
+				bin->writeBytes(p->destAddress, siteOpCodes, u32(site.count * 2));
+
+				if (Main::getVerbose())
+					Util::printDataAsHex(hookDataPtr, bridgeSize, 32);
+				break;
+			}
 
 			// ARM -> ARM && ARM -> THUMB
 
 			u32 ogOpCode = bin->read<u32>(p->destAddress);
 
-			auto& info = m_autogenDataInfoForDest[p->srcAddressOv];
-			if (info == nullptr)
-				throw ncp::exception("Unexpected p->srcAddressOv for m_autogenDataInfoForDest encountered.");
+			// ARMv4 has no BLX, a THUMB function is called through a veneer that only changes R12, which the bridges save
+			auto makeCallOpCode = [&](const GenericPatchInfo* hook, u32 fromAddr){
+				if (!hook->srcThumb)
+					return makeJumpOpCode(armOpcodeBL, fromAddr, hook->srcAddress);
+				if (isArm9)
+					return makeBLXOpCode(fromAddr, hook->srcAddress);
+				return makeJumpOpCode(armOpcodeBL, fromAddr, getThumbJumpBridge(hook));
+			};
+
+			const auto& siteHooks = hooksForSite[{ p->destAddressOv, p->destAddress }];
+			if (siteHooks.size() > 1)
+			{
+				// Written once, by the first hook of the chain
+				if (siteHooks.front() != p.get())
+					break;
 
-			std::vector<u8>& hookData = info->data;
-			std::size_t offset = hookData.size();
-			hookData.resize(offset + SizeOfHookBridge);
+				std::size_t bridgeSize = getChainedHookBridgeSize(siteHooks.size());
+				u32 hookBridgeAddr;
+				u8* hookDataPtr = allocBridgeData(getHookSiteKey(p.get()), bridgeSize, hookBridgeAddr);
 
-			u32 hookBridgeAddr = info->curAddress;
+				if (Main::getVerbose())
+					Log::out << "HOOK CHAIN BRIDGE: " << Util::intToAddr(hookBridgeAddr, 8) << std::endl;
 
-			if (Main::getVerbose())
-				Log::out << "HOOK BRIDGE: " << Util::intToAddr(hookBridgeAddr, 8) << std::endl;
+				writeHookJump(bin, p.get(), hookBridgeAddr);
+
+				u32 offset = 0;
+				auto writeOpCode = [&](u32 opCode){
+					Util::write<u32>(hookDataPtr + offset, opCode);
+					offset += 4;
+				};
+				writeOpCode(armHookPush);
+				for (const GenericPatchInfo* hook : siteHooks)
+				{
+					if (hook != siteHooks.front())
+						writeOpCode(armReloadArgs);
+					writeOpCode(makeCallOpCode(hook, hookBridgeAddr + offset));
+				}
+				writeOpCode(armHookPop);
+				writeOpCode(fixupOpCode(ogOpCode, p->destAddress, hookBridgeAddr + offset));
+				writeOpCode(makeJumpOpCode(armOpcodeB, hookBridgeAddr + offset, p->destAddress + 4));
+
+				if (Main::getVerbose())
+					Util::printDataAsHex(hookDataPtr, bridgeSize, 32);
+				break;
+			}
+
+			// The bridges of lean hooks and of unknown functions are reserved at their site
+			bool isSiteBridge = p->isLeanHook || p->targetKey.empty();
+			std::string key = isSiteBridge ? getHookSiteKey(p.get()) : getBridgeKey("hook", p.get());
+			if (isSiteBridge || getBridgeBlock(key)->siteCount < MinSharedHookSites)
+			{
+				std::size_t bridgeSize = p->isLeanHook ? SizeOfLeanHookBridge : SizeOfHookBridge;
+				u32 hookBridgeAddr;
+				u8* hookDataPtr = allocBridgeData(key, bridgeSize, hookBridgeAddr);
+
+				if (Main::getVerbose())
+					Log::out << "HOOK BRIDGE: " << Util::intToAddr(hookBridgeAddr, 8) << std::endl;
+
+				writeHookJump(bin, p.get(), hookBridgeAddr);
+
+				Util::write<u32>(hookDataPtr, p->isLeanHook ? armLeanHookPush : armHookPush);
+				Util::write<u32>(hookDataPtr + 4, makeCallOpCode(p.get(), hookBridgeAddr + 4));
+				Util::write<u32>(hookDataPtr + 8, p->isLeanHook ? armLeanHookPop : armHookPop);
+				Util::write<u32>(hookDataPtr + 12, fixupOpCode(ogOpCode, p->destAddress, hookBridgeAddr + 12));
+				Util::write<u32>(hookDataPtr + 16, makeJumpOpCode(armOpcodeB, hookBridgeAddr + 16, p->destAddress + 4));
+
+				if (Main::getVerbose())
+					Util::printDataAsHex(hookDataPtr, bridgeSize, 32);
+				break;
+			}
+
+			auto [stubIt, isNewStub] = hookStubForKey.try_emplace(key, 0);
+			if (isNewStub)
+			{
+				u32 stubAddr;
+				u8* stubDataPtr = allocBridgeData(key, SizeOfHookStub, stubAddr);
+				stubIt->second = stubAddr;
 
-			bin->write<u32>(p->destAddress, makeJumpOpCode(armOpcodeB, p->destAddress, hookBridgeAddr));
+				if (Main::getVerbose())
+					Log::out << "HOOK STUB: " << Util::intToAddr(stubAddr, 8) << std::endl;
 
-			u8* hookDataPtr = hookData.data() + offset;
+				Util::write<u32>(stubDataPtr, armHookStubPush);
+				Util::write<u32>(stubDataPtr + 4, makeCallOpCode(p.get(), stubAddr + 4));
+				Util::write<u32>(stubDataPtr + 8, armHookStubPop);
+				Util::write<u32>(stubDataPtr + 12, armSwapLR);
+				Util::write<u32>(stubDataPtr + 16, armPopPC);
 
-			u32 jmpOpCode = p->srcThumb ? makeBLXOpCode(hookBridgeAddr + 4, p->srcAddress) : makeJumpOpCode(armOpcodeBL, hookBridgeAddr + 4, p->srcAddress);
+				if (Main::getVerbose())
+					Util::printDataAsHex(stubDataPtr, SizeOfHookStub, 32);
+			}
+			u32 stubAddr = stubIt->second;
 
-			Util::write<u32>(hookDataPtr, armHookPush);
-			Util::write<u32>(hookDataPtr + 4, jmpOpCode);
-			Util::write<u32>(hookDataPtr + 8, armHookPop);
-			Util::write<u32>(hookDataPtr + 12, fixupOpCode(ogOpCode, p->destAddress, hookBridgeAddr + 12));
-			Util::write<u32>(hookDataPtr + 16, makeJumpOpCode(armOpcodeB, hookBridgeAddr + 16, p->destAddress + 4));
+			u32 hookBridgeAddr;
+			u8* hookDataPtr = allocBridgeData(key, SizeOfSharedHookBridge, hookBridgeAddr);
 
 			if (Main::getVerbose())
-				Util::printDataAsHex(hookData.data() + offset, SizeOfHookBridge, 32);
+				Log::out << "HOOK BRIDGE: " << Util::intToAddr(hookBridgeAddr, 8) << std::endl;
+
+			writeHookJump(bin, p.get(), hookBridgeAddr);
 
-			info->curAddress += SizeOfHookBridge;
+			Util::write<u32>(hookDataPtr, armPushLR);
+			Util::write<u32>(hookDataPtr + 4, makeJumpOpCode(armOpcodeBL, hookBridgeAddr + 4, stubAddr));
+			Util::write<u32>(hookDataPtr + 8, fixupOpCode(ogOpCode, p->destAddress, hookBridgeAddr + 8));
+			Util::write<u32>(hookDataPtr + 12, makeJumpOpCode(armOpcodeB, hookBridgeAddr + 12, p->destAddress + 4));
+
+			if (Main::getVerbose())
+				Util::printDataAsHex(hookDataPtr, SizeOfSharedHookBridge, 32);
 			break;
 		}
 		case PatchType::Over:
 		{
-			const char* sectionData = m_elf->getSection<char>(sh_tbl[p->sectionIdx]);
+			const char* sectionData = p->elf->getSection<char>(p->elf->getSectionHeaderTable()[p->sectionIdx]);
 			bin->writeBytes(p->destAddress, sectionData, p->sectionSize);
 			break;
 		}
@@ -2055,13 +5051,13 @@ void PatchMaker::applyPatchesToRom()
 		if (overwrite->assignedSections.empty())
 			continue;
 
-		ICodeBin* bin = (overwrite->destination == -1) ?
-						static_cast<ICodeBin*>(getArm()) :
-						static_cast<ICodeBin*>(getOverlay(overwrite->destination));
+		ICodeBin* bin = getBinForDest(overwrite->destination);
 
-		const char* sectionData = m_elf->getSection<char>(sh_tbl[overwrite->sectionIdx]);
+		const Elf32_Shdr& section = overwrite->elf->getSectionHeaderTable()[overwrite->sectionIdx];
+		const char* sectionData = overwrite->elf->getSection<char>(section);
 
-		bin->writeBytes(overwrite->startAddress, sectionData, overwrite->sectionSize);
+		// The section starts aligned for its contents, not always at the start of the region
+		bin->writeBytes(section.sh_addr, sectionData, overwrite->sectionSize);
 		
 		if (Main::getVerbose())
 		{
@@ -2071,11 +5067,30 @@ void PatchMaker::applyPatchesToRom()
 		}
 		
 		// Mark overlay as dirty if it's an overlay
-		if (overwrite->destination != -1)
+		if (overwrite->destination >= 0)
 		{
 			static_cast<OverlayBin*>(bin)->setDirty(true);
 		}
 	}
+
+	// The bridges go over the space reserved for them in the overwrite regions, or into the autogen data
+	for (const auto& block : m_bridgeBlocks)
+	{
+		if (block->data.empty())
+			continue;
+
+		if (block->overwrite != nullptr)
+		{
+			ICodeBin* bin = getBinForDest(block->destination);
+			bin->writeBytes(block->address, block->data.data(), u32(block->data.size()));
+			continue;
+		}
+
+		std::vector<u8>& data = m_autogenDataInfoForDest[block->destination]->data;
+		if (data.size() < block->arenaOffset + block->data.size())
+			data.resize(block->arenaOffset + block->data.size());
+		std::memcpy(data.data() + block->arenaOffset, block->data.data(), block->data.size());
+	}
 	
 	for (const auto& [dest, newcodeInfo] : m_newcodeDataForDest)
 	{
@@ -2086,15 +5101,14 @@ void PatchMaker::applyPatchesToRom()
 		const auto& clang_newcodeInfo = newcodeInfo;
 
 		auto writeNewcode = [&](u8* addr){
-			std::size_t autogenDataSize = 0;
-			auto& autogenDataInfo = m_autogenDataInfoForDest[clang_dest];
-			if (autogenDataInfo != nullptr)
-				autogenDataSize = autogenDataInfo->data.size();
-
-			// Write the patch data
-			std::memcpy(addr, clang_newcodeInfo->binData, clang_newcodeInfo->binSize - autogenDataSize);
-			if (autogenDataSize != 0)
-				std::memcpy(&addr[clang_newcodeInfo->binSize - autogenDataSize], autogenDataInfo->data.data(), autogenDataSize);
+			// Write the patch data, the autogen data goes over the space reserved for it
+			std::memcpy(addr, clang_newcodeInfo->binData, clang_newcodeInfo->binSize);
+			auto autogenIt = m_autogenDataInfoForDest.find(clang_dest);
+			if (autogenIt != m_autogenDataInfoForDest.end() && !autogenIt->second->data.empty())
+			{
+				const std::vector<u8>& autogenData = autogenIt->second->data;
+				std::memcpy(&addr[autogenIt->second->address - newcodeAddr], autogenData.data(), autogenData.size());
+			}
 		};
 
 		if (dest == -1)
@@ -2153,7 +5167,69 @@ void PatchMaker::applyPatchesToRom()
 					std::memcpy(writeAutoloadPtr, entryData, 12);
 					writeAutoloadPtr += 12;
 				}
+
+				// The data of the other entries moved after the new code
+				bin->refreshAutoloadData();
+			}
+		}
+		else if (isTcmDest(dest))
+		{
+			const char* tcmName = dest == BuildTarget::DestItcm ? "ITCM" : "DTCM";
+			const TcmSegment& tcm = m_tcmForDest.at(dest);
+
+			std::size_t totalSize = newcodeInfo->binSize + newcodeInfo->bssSize;
+			for (const BuildTarget::Region& region : m_target->regions)
+			{
+				if (region.destination == dest && totalSize > std::size_t(region.length))
+				{
+					throw ncp::exception(std::string("The ") + tcmName + " region exceeds max length of "
+						+ std::to_string(region.length) + " bytes, got " + std::to_string(totalSize) + " bytes.");
+				}
+			}
+
+			u32 bssAlign = std::max<u32>(u32(newcodeInfo->bssAlign), 1);
+			u32 bssStart = (newcodeAddr + u32(newcodeInfo->binSize) + bssAlign - 1) & ~(bssAlign - 1);
+			u32 newcodeEnd = bssStart + u32(newcodeInfo->bssSize);
+			if (newcodeEnd > tcm.endAddress)
+			{
+				std::ostringstream oss;
+				oss << "The " << tcmName << " exceeds its size of " << (tcm.endAddress - tcm.startAddress)
+					<< " bytes by " << (newcodeEnd - tcm.endAddress) << " bytes.";
+				throw ncp::exception(oss.str());
+			}
+
+			ArmBin* bin = getArm();
+			std::vector<ArmBin::AutoLoadEntry>& autoloadList = bin->getAutoloadList();
+			auto entryIt = std::find_if(autoloadList.begin(), autoloadList.end(), [&](const ArmBin::AutoLoadEntry& entry){
+				return entry.address == tcm.autoloadAddress;
+			});
+			if (entryIt == autoloadList.end())
+				throw ncp::exception(std::string("The autoload entry of the ") + tcmName + " could not be found.");
+			ArmBin::AutoLoadEntry& entry = *entryIt;
+
+			// The BSS of the entry and the alignment before the new code become data
+			u32 dataEnd = entry.address + entry.size;
+			u32 growSize = newcodeInfo->binSize != 0 ? (newcodeAddr - dataEnd) + u32(newcodeInfo->binSize) : 0;
+			if (growSize != 0)
+			{
+				std::vector<u8>& data = bin->data();
+				u32 binDataEnd = entry.dataOff + entry.size;
+				data.insert(data.begin() + binDataEnd, growSize, 0);
+				writeNewcode(&data[binDataEnd + (newcodeAddr - dataEnd)]);
+
+				ArmBin::ModuleParams* moduleParams = bin->getModuleParams();
+				moduleParams->autoloadListStart += growSize;
+				moduleParams->autoloadListEnd += growSize;
 			}
+			entry.size += growSize;
+			entry.bssSize = newcodeEnd - (entry.address + entry.size);
+
+			// Write the entry into the moved autoload list
+			std::size_t entryIdx = std::size_t(entryIt - autoloadList.begin());
+			u32 entryData[3] = { entry.address, entry.size, entry.bssSize };
+			u32 binEntryOff = bin->getModuleParams()->autoloadListStart - bin->getRamAddress() + u32(entryIdx * 12);
+			std::memcpy(&bin->data()[binEntryOff], entryData, 12);
+			bin->refreshAutoloadData();
 		}
 		else
 		{
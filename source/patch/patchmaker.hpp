@@ -4,6 +4,7 @@
 #include <vector>
 #include <filesystem>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "../types.hpp"
 #include "../build/sourcefilejob.hpp"
@@ -11,6 +12,7 @@
 #include "../ndsbin/headerbin.hpp"
 #include "../ndsbin/armbin.hpp"
 #include "../ndsbin/overlaybin.hpp"
+#include "../config/buildconfig.hpp"
 
 class Elf32;
 struct GenericPatchInfo;
@@ -19,6 +21,12 @@ struct NewcodePatch;
 struct AutogenDataInfo;
 struct SectionInfo;
 struct OverwriteRegionInfo;
+struct BridgeBlock;
+struct CallGraph;
+struct ObjectScanResult;
+struct LinkArchive;
+struct LinkUnit;
+struct LinkImport;
 
 class PatchMaker
 {
@@ -35,6 +43,22 @@ public:
 	);
 
 private:
+	struct ReclaimedOverwrite
+	{
+		int destination;
+		u32 startAddress;
+		u32 endAddress;
+		bool isReclaimed; // false if only proposed
+		bool isDead; // a dead function, else the body of a function replaced by a jump
+	};
+
+	struct TcmSegment
+	{
+		u32 startAddress; // of the whole TCM
+		u32 endAddress;
+		u32 autoloadAddress; // of the autoload entry that the new code extends
+	};
+
 	const BuildTarget* m_target;
 	const std::filesystem::path* m_targetWorkDir;
 	const std::filesystem::path* m_buildDir;
@@ -49,23 +73,44 @@ private:
 	std::vector<std::unique_ptr<RtReplPatchInfo>> m_rtreplPatches;
 	std::vector<int> m_destWithNcpSet;
 	std::vector<const SourceFileJob*> m_jobsWithNcpSet;
-	std::vector<std::string> m_externSymbols;
+	std::unordered_map<int, std::vector<std::string>> m_externSymbolsForDest;
+	std::unordered_map<int, std::unordered_map<std::string, bool>> m_definedSymbolsForDest; // the global symbols defined by the objects, and if they are thumb
+	std::unordered_map<int, std::unordered_set<std::string>> m_undefinedSymbolsForDest;
+	std::unordered_map<int, u64> m_objectsHashForDest;
 	std::vector<std::unique_ptr<struct SectionInfo>> m_overwriteCandidateSections;
 	std::vector<std::unique_ptr<struct OverwriteRegionInfo>> m_overwriteRegions;
-	std::filesystem::path m_ldscriptPath;
-	std::filesystem::path m_elfPath;
-	std::unique_ptr<Elf32> m_elf;
+	std::vector<std::unique_ptr<BridgeBlock>> m_bridgeBlocks;
+	std::unordered_map<std::string, BridgeBlock*> m_bridgeBlockForKey;
+	std::unordered_map<int, std::unique_ptr<CallGraph>> m_callGraphForDest;
+	std::vector<std::unique_ptr<LinkArchive>> m_linkArchives;
+	std::unordered_set<const SourceFileJob*> m_archivedJobs;
+	std::vector<std::unique_ptr<LinkUnit>> m_linkUnits;
 	std::unordered_map<int, u32> m_newcodeAddrForDest;
+	std::unordered_map<int, TcmSegment> m_tcmForDest;
 	std::unordered_map<int, std::unique_ptr<NewcodePatch>> m_newcodeDataForDest;
 	std::unordered_map<int, std::unique_ptr<AutogenDataInfo>> m_autogenDataInfoForDest;
 	int m_arenalo;
 
 	[[nodiscard]] inline ArmBin* getArm() const { return m_arm.get(); }
 
+	u64 getInputFingerprint() const;
+	u64 getOutputFingerprint() const;
 	void fetchNewcodeAddr();
+	void fetchTcmNewcodeAddr(int dest);
 	void gatherInfoFromObjects();
+	void scanObject(SourceFileJob* srcFileJob, ObjectScanResult& result) const;
 	static std::string ldFlagsToGccFlags(std::string flags);
-	void linkElfFile();
+	std::string makeLinkCommand(const LinkUnit& unit, BuildConfig::Linker linker, std::string& linkArgs) const;
+	void linkElfFiles();
+	bool getImportValue(const LinkUnit& unit, const LinkImport& import, u32& value) const;
+	u64 getImportsFingerprint(const LinkUnit& unit) const;
+	void linkUnits(const std::vector<LinkUnit*>& units);
+	void linkUnit(LinkUnit& unit) const;
+	void runLinker(const std::string& linkerPath, const std::string& linkArgs, const std::filesystem::path& elfPath, std::ostream& log) const;
+	void linkInternal(LinkUnit& unit) const;
+	void loadUnitExports(LinkUnit& unit) const;
+	bool loadLinkRecord(LinkUnit& unit) const;
+	void saveLinkRecord(const LinkUnit& unit) const;
 	static u32 makeJumpOpCode(u32 opCode, u32 fromAddr, u32 toAddr);
 	static u32 makeBLXOpCode(u32 fromAddr, u32 toAddr);
 	static u32 makeThumbCallOpCode(bool exchange, u32 fromAddr, u32 toAddr);
@@ -73,8 +118,8 @@ private:
 	void applyPatchesToRom();
 	void gatherInfoFromElf();
 
-	void loadElfFile();
-	void unloadElfFile();
+	void loadElfFiles();
+	void unloadElfFiles();
 
 	void createBuildDirectory();
 	void createBackupDirectory();
@@ -84,9 +129,18 @@ private:
 	void saveOverlayTableBin();
 	OverlayBin* loadOverlayBin(std::size_t ovID);
 	OverlayBin* getOverlay(std::size_t ovID);
+	ICodeBin* getBinForDest(int dest);
 	void saveOverlayBins();
 
-    void createLinkerScript();
+	void packLinkArchives();
+	void updateLinkArchive(const LinkArchive& archive) const;
+	const LinkArchive* getLinkArchive(const BuildTarget::Region* region) const;
+    void createLinkerScripts();
+	std::vector<ReclaimedOverwrite> findReclaimableOverwrites() const;
     void setupOverwriteRegions();
+	void reserveBridges();
 	void assignSectionsToOverwrites();
+	void loadProfile();
+	void orderCodeSections();
+	void reportProfile(int dest, const CallGraph& graph) const;
 };
@@ -0,0 +1,139 @@
+#include "sectionorder.hpp"
+
+#include <algorithm>
+#include <map>
+
+namespace SectionOrder {
+
+static u64 alignUp(u64 value, u32 alignment)
+{
+	return (value + alignment - 1) & ~u64(alignment - 1);
+}
+
+struct Layout
+{
+	std::vector<u64> offsets; // of every node of the sequence
+	u64 end;
+	u64 padding;
+};
+
+// Lays the nodes out in sequence, from an address aligned for all of them
+static Layout layoutSequence(const std::vector<Node>& nodes, const std::vector<std::size_t>& sequence)
+{
+	Layout layout{ {}, 0, 0 };
+	layout.offsets.reserve(sequence.size());
+	for (std::size_t idx : sequence)
+	{
+		u64 offset = alignUp(layout.end, nodes[idx].alignment);
+		layout.padding += offset - layout.end;
+		layout.offsets.push_back(offset);
+		layout.end = offset + nodes[idx].size;
+	}
+	return layout;
+}
+
+std::vector<Chain> order(const std::vector<Node>& nodes, const std::vector<Edge>& edges, u32 maxChainSize)
+{
+	// The calls in both directions between two nodes weigh as one edge
+	std::map<std::pair<std::size_t, std::size_t>, u64> weights;
+	for (const Edge& edge : edges)
+	{
+		if (edge.from == edge.to || edge.weight == 0)
+			continue;
+		weights[{ std::min(edge.from, edge.to), std::max(edge.from, edge.to) }] += edge.weight;
+	}
+
+	std::vector<std::pair<std::pair<std::size_t, std::size_t>, u64>> sortedEdges(weights.begin(), weights.end());
+	std::stable_sort(sortedEdges.begin(), sortedEdges.end(), [](const auto& a, const auto& b){
+		return a.second > b.second;
+	});
+
+	std::vector<Chain> chains(nodes.size());
+	std::vector<std::size_t> chainOf(nodes.size());
+	for (std::size_t i = 0; i < nodes.size(); i++)
+	{
+		chains[i] = Chain{ { i }, 0, nodes[i].size };
+		chainOf[i] = i;
+	}
+
+	for (const auto& [pair, weight] : sortedEdges)
+	{
+		auto [a, b] = pair;
+		std::size_t ca = chainOf[a];
+		std::size_t cb = chainOf[b];
+		if (ca == cb)
+		{
+			chains[ca].weight += weight;
+			continue;
+		}
+
+		// Of the four ways to join the chains, the one bringing the nodes of the call closest
+		std::vector<std::size_t> bestSequence;
+		u64 bestDistance = 0;
+		Layout bestLayout{ {}, 0, 0 };
+		for (int flip = 0; flip < 4; flip++)
+		{
+			std::vector<std::size_t> sequence;
+			sequence.reserve(chains[ca].nodes.size() + chains[cb].nodes.size());
+			if (flip & 1)
+				sequence.insert(sequence.end(), chains[ca].nodes.rbegin(), chains[ca].nodes.rend());
+			else
+				sequence.insert(sequence.end(), chains[ca].nodes.begin(), chains[ca].nodes.end());
+			if (flip & 2)
+				sequence.insert(sequence.end(), chains[cb].nodes.rbegin(), chains[cb].nodes.rend());
+			else
+				sequence.insert(sequence.end(), chains[cb].nodes.begin(), chains[cb].nodes.end());
+
+			Layout layout = layoutSequence(nodes, sequence);
+			if (maxChainSize != 0 && layout.end > maxChainSize)
+				continue;
+
+			std::size_t posA = std::size_t(std::find(sequence.begin(), sequence.end(), a) - sequence.begin());
+			std::size_t posB = std::size_t(std::find(sequence.begin(), sequence.end(), b) - sequence.begin());
+			u64 distance = posA < posB ?
+				layout.offsets[posB] - (layout.offsets[posA] + nodes[a].size) :
+				layout.offsets[posA] - (layout.offsets[posB] + nodes[b].size);
+
+			if (bestSequence.empty() || distance < bestDistance ||
+				(distance == bestDistance && layout.padding < bestLayout.padding))
+			{
+				bestSequence = std::move(sequence);
+				bestDistance = distance;
+				bestLayout = std::move(layout);
+			}
+		}
+		if (bestSequence.empty())
+			continue;
+
+		for (std::size_t idx : chains[cb].nodes)
+			chainOf[idx] = ca;
+		chains[ca].nodes = std::move(bestSequence);
+		chains[ca].weight += chains[cb].weight + weight;
+		chains[ca].size = u32(bestLayout.end);
+		chains[cb].nodes.clear();
+	}
+
+	std::vector<Chain> hotChains;
+	std::vector<std::size_t> lone;
+	for (Chain& chain : chains)
+	{
+		if (chain.nodes.size() > 1)
+			hotChains.emplace_back(std::move(chain));
+		else if (chain.nodes.size() == 1)
+			lone.push_back(chain.nodes[0]);
+	}
+
+	std::stable_sort(hotChains.begin(), hotChains.end(), [](const Chain& a, const Chain& b){
+		return double(a.weight) / double(std::max(a.size, 1u)) > double(b.weight) / double(std::max(b.size, 1u));
+	});
+	std::stable_sort(lone.begin(), lone.end(), [&](std::size_t a, std::size_t b){
+		return nodes[a].alignment > nodes[b].alignment;
+	});
+
+	std::vector<Chain> result = std::move(hotChains);
+	for (std::size_t idx : lone)
+		result.push_back(Chain{ { idx }, 0, nodes[idx].size });
+	return result;
+}
+
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+
+#include "../types.hpp"
+
+/*
+ * Orders the code sections of a link by their call graph, in the manner of
+ * Pettis and Hansen, so that the functions calling each other the most end
+ * up next to each other and share the lines of the instruction cache.
+ *
+ * The heaviest calls merge their chains first. A merged chain keeps the
+ * caller and the callee as close as the ends of both chains allow, and
+ * of the arrangements that are as close, the one with the least padding.
+ * */
+namespace SectionOrder {
+
+struct Node
+{
+	u32 size;
+	u32 alignment; // a power of two
+};
+
+struct Edge
+{
+	std::size_t from;
+	std::size_t to;
+	u64 weight; // how often the call is made, or how many call sites it has without a profile
+};
+
+struct Chain
+{
+	std::vector<std::size_t> nodes; // in placement order
+	u64 weight; // of the calls inside of the chain
+	u32 size; // with the padding between the nodes
+};
+
+/**
+ * @brief Groups the nodes into chains and orders them.
+ *
+ * The chains of more than one node come first, by decreasing call weight
+ * per byte. The nodes left alone follow by decreasing alignment, so that
+ * no padding is needed between them.
+ *
+ * @param maxChainSize Chains are not merged past this size, 0 for no limit.
+ */
+std::vector<Chain> order(const std::vector<Node>& nodes, const std::vector<Edge>& edges, u32 maxChainSize);
+
+}
@@ -41,6 +41,18 @@ void printDataAsHex(const void* data, std::size_t size, std::size_t rowlen)
 	Log::out << std::flush;
 }
 
+std::uint64_t fnv1a64(const void* data, std::size_t size, std::uint64_t seed)
+{
+	const auto* cdata = static_cast<const unsigned char*>(data);
+	std::uint64_t hash = seed;
+	for (std::size_t i = 0; i < size; i++)
+	{
+		hash ^= cdata[i];
+		hash *= 0x100000001B3;
+	}
+	return hash;
+}
+
 std::filesystem::path relativeIfSubpath(const std::filesystem::path& path)
 {
     try
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstring>
+#include <cstdint>
 #include <ctime>
 #include <string>
 #include <string_view>
@@ -95,6 +96,9 @@ std::string intToAddr(int in, int align, bool prefix = true);
 
 void printDataAsHex(const void* data, std::size_t size, std::size_t rowlen);
 
+// 64-bit FNV-1a hash, pass the previous result as seed to hash data in chunks.
+std::uint64_t fnv1a64(const void* data, std::size_t size, std::uint64_t seed = 0xCBF29CE484222325);
+
 std::filesystem::path relativeIfSubpath(const std::filesystem::path& path);
 
 }
@@ -0,0 +1,324 @@
+#include "test.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "../source/patch/internallinker.hpp"
+#include "../source/patch/linklayout.hpp"
+#include "../source/elf.hpp"
+#include "../source/except.hpp"
+#include "../source/util.hpp"
+
+namespace fs = std::filesystem;
+
+#define R_ARM_ABS32       2
+#define R_ARM_REL32       3
+#define R_ARM_THM_CALL    10
+#define R_ARM_CALL        28
+#define R_ARM_JUMP24      29
+#define R_ARM_THM_JUMP11  102
+
+/*
+ * Writes a relocatable ARM object with REL relocations, the sections
+ * are laid out after the header in the order that they are added.
+ * */
+class ObjectWriter
+{
+public:
+	ObjectWriter()
+	{
+		addSection("", SHT_NULL, 0, {}, 0);
+		m_strTab.push_back(0);
+		m_shStrTab.push_back(0);
+		m_symbols.push_back(Elf32_Sym{});
+	}
+
+	u32 addSection(const std::string& name, u32 type, u32 flags, std::vector<u8> data, u32 alignment)
+	{
+		Elf32_Shdr sh{};
+		sh.sh_name = addString(m_shStrTab, name);
+		sh.sh_type = type;
+		sh.sh_flags = flags;
+		sh.sh_addralign = alignment;
+		m_headers.push_back(sh);
+		m_data.push_back(std::move(data));
+		return u32(m_headers.size() - 1);
+	}
+
+	u32 addCode(const std::string& name, const std::vector<u16>& halfwords)
+	{
+		std::vector<u8> data(halfwords.size() * 2);
+		std::memcpy(data.data(), halfwords.data(), data.size());
+		return addSection(name, SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, std::move(data), 4);
+	}
+
+	u32 addCode(const std::string& name, const std::vector<u32>& words)
+	{
+		std::vector<u8> data(words.size() * 4);
+		std::memcpy(data.data(), words.data(), data.size());
+		return addSection(name, SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, std::move(data), 4);
+	}
+
+	// Only global symbols, so that the relocations can refer to them by their index
+	u32 addFunction(const std::string& name, u32 section, u32 value)
+	{
+		Elf32_Sym sym{};
+		sym.st_name = addString(m_strTab, name);
+		sym.st_value = value;
+		sym.st_info = ELF32_ST_INFO(STB_GLOBAL, STT_FUNC);
+		sym.st_shndx = Elf32_Half(section);
+		m_symbols.push_back(sym);
+		return u32(m_symbols.size() - 1);
+	}
+
+	void addRelocation(u32 section, u32 offset, u32 symbol, u32 type)
+	{
+		m_relocations.push_back({ section, Elf32_Rel{ offset, ELF32_R_INFO(symbol, type) } });
+	}
+
+	void write(const fs::path& path)
+	{
+		u32 symTabIdx = u32(m_headers.size());
+		for (u32 target = 1; target < symTabIdx; target++)
+		{
+			std::vector<u8> rels;
+			for (const auto& [section, rel] : m_relocations)
+			{
+				if (section != target)
+					continue;
+				std::size_t pos = rels.size();
+				rels.resize(pos + sizeof(Elf32_Rel));
+				std::memcpy(rels.data() + pos, &rel, sizeof(Elf32_Rel));
+			}
+			if (rels.empty())
+				continue;
+			std::string name(reinterpret_cast<const char*>(&m_shStrTab[m_headers[target].sh_name]));
+			u32 relIdx = addSection(".rel" + name, SHT_REL, 0, std::move(rels), 4);
+			m_headers[relIdx].sh_info = target;
+			m_headers[relIdx].sh_entsize = sizeof(Elf32_Rel);
+			m_relocatedSections.push_back(relIdx);
+		}
+
+		std::vector<u8> symData(m_symbols.size() * sizeof(Elf32_Sym));
+		std::memcpy(symData.data(), m_symbols.data(), symData.size());
+		symTabIdx = addSection(".symtab", SHT_SYMTAB, 0, std::move(symData), 4);
+		u32 strTabIdx = addSection(".strtab", SHT_STRTAB, 0, m_strTab, 1);
+		u32 shStrTabIdx = addSection(".shstrtab", SHT_STRTAB, 0, {}, 1);
+		m_data[shStrTabIdx] = m_shStrTab;
+
+		m_headers[symTabIdx].sh_link = strTabIdx;
+		m_headers[symTabIdx].sh_info = 1;
+		m_headers[symTabIdx].sh_entsize = sizeof(Elf32_Sym);
+		for (u32 relIdx : m_relocatedSections)
+			m_headers[relIdx].sh_link = symTabIdx;
+
+		std::vector<u8> image(sizeof(Elf32_Ehdr));
+		for (std::size_t i = 1; i < m_headers.size(); i++)
+		{
+			image.resize((image.size() + 3) & ~std::size_t(3));
+			m_headers[i].sh_offset = u32(image.size());
+			m_headers[i].sh_size = u32(m_data[i].size());
+			image.insert(image.end(), m_data[i].begin(), m_data[i].end());
+		}
+		image.resize((image.size() + 3) & ~std::size_t(3));
+		u32 shOffset = u32(image.size());
+		image.resize(image.size() + m_headers.size() * sizeof(Elf32_Shdr));
+		std::memcpy(image.data() + shOffset, m_headers.data(), m_headers.size() * sizeof(Elf32_Shdr));
+
+		Elf32_Ehdr eh{};
+		eh.e_ident[EI_MAG0] = ELFMAG0;
+		eh.e_ident[EI_MAG1] = ELFMAG1;
+		eh.e_ident[EI_MAG2] = ELFMAG2;
+		eh.e_ident[EI_MAG3] = ELFMAG3;
+		eh.e_ident[EI_CLASS] = ELFCLASS32;
+		eh.e_ident[EI_DATA] = ELFDATA2LSB;
+		eh.e_ident[EI_VERSION] = EV_CURRENT;
+		eh.e_type = ET_REL;
+		eh.e_machine = EM_ARM;
+		eh.e_version = EV_CURRENT;
+		eh.e_shoff = shOffset;
+		eh.e_flags = EF_ARM_EABI_VER5;
+		eh.e_ehsize = sizeof(Elf32_Ehdr);
+		eh.e_shentsize = sizeof(Elf32_Shdr);
+		eh.e_shnum = Elf32_Half(m_headers.size());
+		eh.e_shstrndx = Elf32_Half(shStrTabIdx);
+		std::memcpy(image.data(), &eh, sizeof(Elf32_Ehdr));
+
+		std::ofstream file(path, std::ios::binary);
+		file.write(reinterpret_cast<const char*>(image.data()), std::streamsize(image.size()));
+	}
+
+private:
+	std::vector<Elf32_Shdr> m_headers;
+	std::vector<std::vector<u8>> m_data;
+	std::vector<Elf32_Sym> m_symbols;
+	std::vector<std::pair<u32, Elf32_Rel>> m_relocations;
+	std::vector<u32> m_relocatedSections;
+	std::vector<u8> m_strTab;
+	std::vector<u8> m_shStrTab;
+
+	static u32 addString(std::vector<u8>& table, const std::string& str)
+	{
+		if (str.empty())
+			return 0;
+		u32 offset = u32(table.size());
+		table.insert(table.end(), str.begin(), str.end());
+		table.push_back(0);
+		return offset;
+	}
+};
+
+constexpr u32 Origin = 0x02000000;
+
+/*
+ * .text, ARM at Origin:
+ *     0x00 BL    arm_callee      @ R_ARM_CALL
+ *     0x04 B     arm_callee      @ R_ARM_JUMP24
+ *     0x08 BL    thumb_fn        @ R_ARM_CALL, becomes BLX
+ *     0x0C BL    thumb_callee    @ R_ARM_CALL, becomes BLX with H set
+ *     0x10 .word thumb_fn        @ R_ARM_ABS32
+ *     0x14 .word arm_callee      @ R_ARM_REL32
+ *   arm_callee:
+ *     0x18 BX    LR
+ *     0x1C .word arm_callee + 8  @ R_ARM_ABS32, the addend is in place
+ *
+ * .text.thumb, THUMB at Origin + 0x20:
+ *   thumb_fn:
+ *     0x00 BL    arm_callee      @ R_ARM_THM_CALL, becomes BLX
+ *     0x04 B     thumb_callee    @ R_ARM_THM_JUMP11
+ *   thumb_callee:
+ *     0x06 BX    LR
+ * */
+static fs::path writeFixture(const fs::path& dir, bool withArmToThumbJump)
+{
+	ObjectWriter obj;
+	u32 text = obj.addCode(".text", std::vector<u32>{
+		0xEBFFFFFE, 0xEAFFFFFE, 0xEBFFFFFE, 0xEBFFFFFE,
+		0x00000000, 0x00000000, 0xE12FFF1E, 0x00000008
+	});
+	u32 thumb = obj.addCode(".text.thumb", std::vector<u16>{ 0xF7FF, 0xFFFE, 0xE7FE, 0x4770 });
+
+	obj.addFunction("arm_caller", text, 0x00);
+	u32 armCallee = obj.addFunction("arm_callee", text, 0x18);
+	u32 thumbFn = obj.addFunction("thumb_fn", thumb, 0x00 | 1);
+	u32 thumbCallee = obj.addFunction("thumb_callee", thumb, 0x06 | 1);
+
+	obj.addRelocation(text, 0x00, armCallee, R_ARM_CALL);
+	obj.addRelocation(text, 0x04, withArmToThumbJump ? thumbFn : armCallee, R_ARM_JUMP24);
+	obj.addRelocation(text, 0x08, thumbFn, R_ARM_CALL);
+	obj.addRelocation(text, 0x0C, thumbCallee, R_ARM_CALL);
+	obj.addRelocation(text, 0x10, thumbFn, R_ARM_ABS32);
+	obj.addRelocation(text, 0x14, armCallee, R_ARM_REL32);
+	obj.addRelocation(text, 0x1C, armCallee, R_ARM_ABS32);
+	obj.addRelocation(thumb, 0x00, armCallee, R_ARM_THM_CALL);
+	obj.addRelocation(thumb, 0x04, thumbCallee, R_ARM_THM_JUMP11);
+
+	fs::path path = dir / (withArmToThumbJump ? "jump.o" : "fixture.o");
+	obj.write(path);
+	return path;
+}
+
+static LinkLayout makeLayout(const fs::path& object)
+{
+	LinkLayout layout;
+	layout.inputs.push_back(object.string());
+	layout.memories.push_back(LinkLayout::Memory{ "bin", Origin, 0x1000 });
+	LinkLayout::OutputSection& text = layout.addSection(".text", "bin", true);
+	text.commands.push_back(LinkLayout::Command::input("*", ".text", true));
+	text.commands.push_back(LinkLayout::Command::input("*", ".text.thumb", true));
+	return layout;
+}
+
+static void testRelocations(const fs::path& dir)
+{
+	LinkLayout layout = makeLayout(writeFixture(dir, false));
+	InternalLinker::Options options;
+	options.allowBlx = true;
+
+	InternalLinker linker;
+	Elf32 elf;
+	elf.loadFromMemory(linker.link(layout, options), "fixture link");
+
+	int textIdx = elf.findSection(".text");
+	CHECK(textIdx != -1);
+	if (textIdx == -1)
+		return;
+	const Elf32_Shdr& text = elf.getSections()[textIdx];
+	CHECK_EQ(text.sh_addr, Origin);
+	CHECK_EQ(text.sh_size, 0x28u);
+	if (text.sh_size < 0x28)
+		return;
+
+	const u8* data = elf.getSection<u8>(text);
+	auto word = [&](u32 offset){ return Util::read<u32>(data + offset); };
+	auto half = [&](u32 offset){ return Util::read<u16>(data + offset); };
+
+	CHECK_EQ(word(0x00), 0xEB000004u); // BL   +0x10 from PC
+	CHECK_EQ(word(0x04), 0xEA000003u); // B    +0x0C from PC
+	CHECK_EQ(word(0x08), 0xFA000004u); // BLX  +0x10 from PC
+	CHECK_EQ(word(0x0C), 0xFB000004u); // BLX  +0x12 from PC, the halfword in H
+	CHECK_EQ(word(0x10), Origin + 0x21); // the THUMB bit is kept
+	CHECK_EQ(word(0x14), 0x4u);
+	CHECK_EQ(word(0x1C), Origin + 0x20);
+	CHECK_EQ(half(0x20), 0xF7FFu); // BLX  -0x0C from the word aligned PC
+	CHECK_EQ(half(0x22), 0xEFFAu);
+	CHECK_EQ(half(0x24), 0xE7FFu); // B    -0x02 from PC
+}
+
+// Without BLX, or from a B, switching the instruction set would need a veneer that is not made
+static void testRejectsInterworkingWithoutVeneer(const fs::path& dir)
+{
+	LinkLayout layout = makeLayout(writeFixture(dir, false));
+	InternalLinker::Options options;
+	options.allowBlx = false;
+
+	bool threw = false;
+	try
+	{
+		InternalLinker linker;
+		linker.link(layout, options);
+	}
+	catch (const ncp::exception&)
+	{
+		threw = true;
+	}
+	CHECK(threw);
+
+	LinkLayout jumpLayout = makeLayout(writeFixture(dir, true));
+	options.allowBlx = true;
+	threw = false;
+	try
+	{
+		InternalLinker linker;
+		linker.link(jumpLayout, options);
+	}
+	catch (const ncp::exception&)
+	{
+		threw = true;
+	}
+	CHECK(threw);
+}
+
+int main()
+{
+	fs::path dir = fs::temp_directory_path() / "ncpatcher_internallinker_test";
+	fs::create_directories(dir);
+
+	try
+	{
+		testRelocations(dir);
+		testRejectsInterworkingWithoutVeneer(dir);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "unexpected exception: " << e.what() << std::endl;
+		Test::failures++;
+	}
+
+	std::error_code ec;
+	fs::remove_all(dir, ec);
+	return Test::result("internallinker");
+}
@@ -0,0 +1,123 @@
+#include "test.hpp"
+
+#include "../source/patch/overwritepacker.hpp"
+
+using namespace OverwritePacker;
+
+// Every placed item lies inside of its bin, aligned, and apart from the others of the bin
+static void checkPlacements(const std::vector<Item>& items, const std::vector<Bin>& bins, const Result& result)
+{
+	CHECK_EQ(result.placements.size(), items.size());
+	CHECK_EQ(result.binStarts.size(), bins.size());
+	CHECK_EQ(result.binEnds.size(), bins.size());
+
+	for (std::size_t i = 0; i < result.placements.size(); i++)
+	{
+		const Placement& a = result.placements[i];
+		if (a.bin == -1)
+			continue;
+		const Bin& bin = bins[a.bin];
+		CHECK(a.address >= bin.start);
+		CHECK(a.address + items[i].size <= bin.end);
+		CHECK_EQ(a.address % items[i].alignment, 0u);
+		CHECK(a.address >= result.binStarts[a.bin]);
+		CHECK(a.address + items[i].size <= result.binEnds[a.bin]);
+
+		for (std::size_t j = i + 1; j < result.placements.size(); j++)
+		{
+			const Placement& b = result.placements[j];
+			if (b.bin != a.bin)
+				continue;
+			CHECK(a.address + items[i].size <= b.address || b.address + items[j].size <= a.address);
+		}
+	}
+}
+
+static u32 getPlacedSize(const std::vector<Item>& items, const Result& result)
+{
+	u32 size = 0;
+	for (std::size_t i = 0; i < items.size(); i++)
+	{
+		if (result.placements[i].bin != -1)
+			size += items[i].size;
+	}
+	return size;
+}
+
+// Best fit decreasing leaves the last item out, {5,3,2} and {4,4,2} fill both regions
+static void testFillsWhereBestFitDoesNot()
+{
+	std::vector<Item> items = { { 5, 1 }, { 4, 1 }, { 4, 1 }, { 3, 1 }, { 2, 1 }, { 2, 1 } };
+	std::vector<Bin> bins = { { 0x100, 0x10A }, { 0x200, 0x20A } };
+
+	Result result = pack(items, bins);
+	checkPlacements(items, bins, result);
+	CHECK_EQ(getPlacedSize(items, result), 20u);
+	CHECK(result.isOptimal);
+}
+
+// The less aligned item fills the padding left between the more aligned ones
+static void testFillsAlignmentPadding()
+{
+	std::vector<Item> items = { { 4, 8 }, { 4, 8 }, { 4, 4 }, { 4, 4 } };
+	std::vector<Bin> bins = { { 0x100, 0x110 } };
+
+	Result result = pack(items, bins);
+	checkPlacements(items, bins, result);
+	CHECK_EQ(getPlacedSize(items, result), 16u);
+	CHECK(result.isOptimal);
+}
+
+// The bin starts aligned for its most aligned item, like the output section of a linker
+static void testAlignsBinStart()
+{
+	std::vector<Item> items = { { 8, 8 }, { 4, 4 } };
+	std::vector<Bin> bins = { { 0x104, 0x110 } };
+
+	Result result = pack(items, bins);
+	checkPlacements(items, bins, result);
+	CHECK_EQ(getPlacedSize(items, result), 8u);
+	CHECK_EQ(result.binStarts[0] % 8, 0u);
+}
+
+// What does not fit anywhere is left for the arena
+static void testLeavesOversizedItems()
+{
+	std::vector<Item> items = { { 0x20, 4 }, { 8, 4 } };
+	std::vector<Bin> bins = { { 0x100, 0x110 } };
+
+	Result result = pack(items, bins);
+	checkPlacements(items, bins, result);
+	CHECK_EQ(result.placements[0].bin, -1);
+	CHECK_EQ(result.placements[1].bin, 0);
+	CHECK_EQ(getPlacedSize(items, result), 8u);
+}
+
+// Past the exact search, the same input still packs the same way
+static void testIsDeterministic()
+{
+	std::vector<Item> items;
+	for (u32 i = 0; i < 40; i++)
+		items.push_back(Item{ 4 + (i * 37) % 60 * 4, (i % 3 == 0) ? 8u : 4u });
+	std::vector<Bin> bins = { { 0x1000, 0x1200 }, { 0x2004, 0x2100 }, { 0x3000, 0x3080 } };
+
+	Result a = pack(items, bins);
+	Result b = pack(items, bins);
+	checkPlacements(items, bins, a);
+	for (std::size_t i = 0; i < items.size(); i++)
+	{
+		CHECK_EQ(a.placements[i].bin, b.placements[i].bin);
+		CHECK_EQ(a.placements[i].address, b.placements[i].address);
+	}
+	CHECK_EQ(a.isOptimal, b.isOptimal);
+}
+
+int main()
+{
+	testFillsWhereBestFitDoesNot();
+	testFillsAlignmentPadding();
+	testAlignsBinStart();
+	testLeavesOversizedItems();
+	testIsDeterministic();
+	return Test::result("overwritepacker");
+}
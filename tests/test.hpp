@@ -0,0 +1,41 @@
+#pragma once
+
+#include <iostream>
+#include <iomanip>
+
+/*
+ * A minimal harness for the behavior tests. Every test is an executable
+ * that reports the checks that failed and returns nonzero if there were any.
+ * */
+namespace Test {
+
+inline int failures = 0;
+
+template<typename A, typename B>
+inline void checkEqual(const A& actual, const B& expected, const char* expr, const char* file, int line)
+{
+	if (actual == expected)
+		return;
+	std::cerr << file << ':' << line << ": " << expr << " is 0x" << std::hex << std::uppercase
+		<< actual << ", expected 0x" << expected << std::dec << std::endl;
+	failures++;
+}
+
+inline int result(const char* name)
+{
+	if (failures != 0)
+		std::cerr << name << ": " << failures << " checks failed." << std::endl;
+	return failures != 0 ? 1 : 0;
+}
+
+}
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			std::cerr << __FILE__ << ':' << __LINE__ << ": check failed: " #cond << std::endl; \
+			Test::failures++; \
+		} \
+	} while (0)
+
+#define CHECK_EQ(actual, expected) Test::checkEqual((actual), (expected), #actual, __FILE__, __LINE__)
@@ -0,0 +1,221 @@
+/*
+ * NCPatcher fake toolchain
+ *
+ * Stands in for the GCC toolchain by replaying a timing manifest
+ * recorded by running NCPatcher with --record-timings DIR.
+ * Every invocation looks up its output file in the manifest, waits for
+ * the recorded duration and then writes the recorded output and
+ * dependency files, so that the scheduling of a real build can be
+ * benchmarked on any machine.
+ *
+ * Usage: set the "toolchain" in ncpatcher.json to the prefix of the
+ * copies made by the build (eg. "/path/to/build/fakechain/fake-") and
+ * point NCP_FAKECHAIN_MANIFEST to the recorded manifest.txt file.
+ * The copies stand in for gcc, g++, ar, ld.bfd and ld.gold. ld.lld is
+ * not prefixed by the toolchain, so the fakechain directory must come
+ * first in PATH to replay it.
+ * */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <filesystem>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+struct StepEntry
+{
+	std::string kind;
+	std::uint64_t durationUs;
+	std::uintmax_t outputSize;
+	std::string outputBlob;
+	std::string depBlob;
+};
+
+static int fail(const std::string& msg)
+{
+	std::cerr << "fakechain: " << msg << std::endl;
+	return 1;
+}
+
+static bool loadManifest(const fs::path& path, std::unordered_map<std::string, StepEntry>& out)
+{
+	std::ifstream file(path);
+	if (!file.is_open())
+		return false;
+
+	std::string line;
+	while (std::getline(file, line))
+	{
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		std::istringstream iss(line);
+		StepEntry entry;
+		if (!(iss >> entry.kind >> entry.durationUs >> entry.outputSize >> entry.outputBlob >> entry.depBlob))
+			continue;
+
+		std::string key;
+		std::getline(iss >> std::ws, key);
+		out[fs::path(key).lexically_normal().string()] = std::move(entry);
+	}
+	return true;
+}
+
+// Reads the output file out of the OUTPUT ("...") command of a linker script.
+static std::string getScriptOutput(const fs::path& scriptPath)
+{
+	std::ifstream file(scriptPath);
+	if (!file.is_open())
+		return {};
+	std::stringstream ss;
+	ss << file.rdbuf();
+	std::string script = ss.str();
+
+	std::size_t pos = script.find("OUTPUT");
+	while (pos != std::string::npos && script.compare(pos, 7, "OUTPUT_") == 0)
+		pos = script.find("OUTPUT", pos + 1);
+	if (pos == std::string::npos)
+		return {};
+	std::size_t start = script.find('(', pos);
+	std::size_t end = script.find(')', start);
+	if (start == std::string::npos || end == std::string::npos)
+		return {};
+
+	std::string_view value(&script[start + 1], end - start - 1);
+	while (!value.empty() && (value.front() == ' ' || value.front() == '"'))
+		value.remove_prefix(1);
+	while (!value.empty() && (value.back() == ' ' || value.back() == '"'))
+		value.remove_suffix(1);
+	return std::string(value);
+}
+
+// The archiver takes its operation first and the archive after it, eg. "ar rcsD lib.a @list"
+static bool isArchiver(const char* argv0)
+{
+	std::string name = fs::path(argv0).filename().string();
+	if (name.ends_with(".exe"))
+		name.resize(name.length() - 4);
+	return name.ends_with("ar");
+}
+
+static bool writeOutput(const fs::path& blobDir, const std::string& blob, std::uintmax_t size, const fs::path& dest)
+{
+	if (dest.has_parent_path())
+	{
+		std::error_code ec;
+		fs::create_directories(dest.parent_path(), ec);
+	}
+
+	if (blob != "-")
+	{
+		std::error_code ec;
+		fs::copy_file(blobDir / blob, dest, fs::copy_options::overwrite_existing, ec);
+		return !ec;
+	}
+
+	std::ofstream file(dest, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+		return false;
+	std::vector<char> zeros(4096, 0);
+	while (size != 0)
+	{
+		std::size_t chunk = std::min<std::uintmax_t>(size, zeros.size());
+		file.write(zeros.data(), std::streamsize(chunk));
+		size -= chunk;
+	}
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	// The queries of the library directories, done before invoking a linker directly
+	for (int i = 1; i < argc; i++)
+	{
+		std::string_view arg = argv[i];
+		if (arg == "-print-multi-directory")
+		{
+			std::cout << "." << std::endl;
+			return 0;
+		}
+		if (arg == "-print-search-dirs")
+		{
+			std::cout << "libraries: =" << std::endl;
+			return 0;
+		}
+	}
+
+	const char* manifestEnv = std::getenv("NCP_FAKECHAIN_MANIFEST");
+	if (manifestEnv == nullptr)
+		return fail("NCP_FAKECHAIN_MANIFEST is not set.");
+
+	fs::path manifestPath = manifestEnv;
+	std::unordered_map<std::string, StepEntry> entries;
+	if (!loadManifest(manifestPath, entries))
+		return fail("could not read manifest: " + manifestPath.string());
+
+	std::string outputPath;
+	std::string depPath;
+	std::string scriptPath;
+
+	if (isArchiver(argv[0]) && argc > 2)
+		outputPath = argv[2];
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string_view arg = argv[i];
+		if (arg == "-o" && i + 1 < argc)
+		{
+			outputPath = argv[++i];
+		}
+		else if (arg == "-MF" && i + 1 < argc)
+		{
+			depPath = argv[++i];
+		}
+		else if (arg == "-T" && i + 1 < argc)
+		{
+			scriptPath = argv[++i];
+		}
+		else if (arg.starts_with("-Wl,"))
+		{
+			std::string linkerArgs(arg.substr(4));
+			std::istringstream iss(linkerArgs);
+			std::string linkerArg;
+			while (std::getline(iss, linkerArg, ','))
+			{
+				if (linkerArg.starts_with("-T"))
+					scriptPath = linkerArg.substr(2);
+			}
+		}
+	}
+
+	if (outputPath.empty() && !scriptPath.empty())
+		outputPath = getScriptOutput(scriptPath);
+	if (outputPath.empty())
+		return fail("could not determine the output of the invocation.");
+
+	auto it = entries.find(fs::path(outputPath).lexically_normal().string());
+	if (it == entries.end())
+		return fail("no recorded step for output: " + outputPath);
+	const StepEntry& entry = it->second;
+
+	std::this_thread::sleep_for(std::chrono::microseconds(entry.durationUs));
+
+	fs::path blobDir = manifestPath.parent_path() / "blobs";
+	if (!writeOutput(blobDir, entry.outputBlob, entry.outputSize, outputPath))
+		return fail("could not write output: " + outputPath);
+	if (!depPath.empty() && entry.depBlob != "-" && !writeOutput(blobDir, entry.depBlob, 0, depPath))
+		return fail("could not write dependency file: " + depPath);
+
+	return 0;
+}